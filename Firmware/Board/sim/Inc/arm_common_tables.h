@@ -0,0 +1,17 @@
+#ifndef __SIM_ARM_COMMON_TABLES_H
+#define __SIM_ARM_COMMON_TABLES_H
+
+#include "arm_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Filled in by the simulated board at startup
+extern float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SIM_ARM_COMMON_TABLES_H
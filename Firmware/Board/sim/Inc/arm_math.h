@@ -0,0 +1,15 @@
+/*
+* @brief Host replacement for the subset of CMSIS-DSP used by the firmware.
+*/
+
+#ifndef __SIM_ARM_MATH_H
+#define __SIM_ARM_MATH_H
+
+#include <stdint.h>
+#include <math.h>
+
+typedef float float32_t;
+
+#define FAST_MATH_TABLE_SIZE 512
+
+#endif // __SIM_ARM_MATH_H
@@ -0,0 +1,95 @@
+/*
+* @brief Single-threaded stand-in for the CMSIS-RTOS API.
+*
+* The simulation runs without an RTOS. Threads are never started and all
+* blocking calls advance the simulated time instead of waiting. This allows
+* blocking routines such as motor calibration to be called directly from the
+* simulation's main function while the control loop keeps running.
+*/
+
+#ifndef __SIM_CMSIS_OS_H
+#define __SIM_CMSIS_OS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    osPriorityIdle = -3,
+    osPriorityLow = -2,
+    osPriorityBelowNormal = -1,
+    osPriorityNormal = 0,
+    osPriorityAboveNormal = +1,
+    osPriorityHigh = +2,
+    osPriorityRealtime = +3,
+    osPriorityError = 0x84
+} osPriority;
+
+#define osWaitForever 0xFFFFFFFF
+
+typedef enum {
+    osOK = 0,
+    osEventSignal = 0x08,
+    osEventMessage = 0x10,
+    osEventMail = 0x20,
+    osEventTimeout = 0x40,
+    osErrorParameter = 0x80,
+    osErrorResource = 0x81,
+    osErrorTimeoutResource = 0xC1,
+    osErrorISR = 0x82,
+    osErrorISRRecursive = 0x83,
+    osErrorPriority = 0x84,
+    osErrorNoMemory = 0x85,
+    osErrorValue = 0x86,
+    osErrorOS = 0xFF,
+    os_status_reserved = 0x7FFFFFFF
+} osStatus;
+
+typedef uint32_t StackType_t;
+typedef void (*os_pthread)(void* argument);
+typedef void* osThreadId;
+typedef void* osSemaphoreId;
+typedef void* osMessageQId;
+
+typedef struct os_thread_def {
+    const char* name;
+    os_pthread pthread;
+    osPriority tpriority;
+    uint32_t instances;
+    uint32_t stacksize;
+} osThreadDef_t;
+
+typedef struct {
+    osStatus status;
+    union {
+        uint32_t v;
+        void* p;
+        int32_t signals;
+    } value;
+} osEvent;
+
+#define osThreadDef(name, thread, priority, instances, stacksz) \
+const osThreadDef_t os_thread_def_##name = \
+{ #name, (thread), (priority), (instances), (uint32_t)(stacksz) }
+
+#define osThread(name) &os_thread_def_##name
+
+#define osKernelSysTickFrequency 1000
+
+osThreadId osThreadCreate(const osThreadDef_t* thread_def, void* argument);
+osPriority osThreadGetPriority(osThreadId thread_id);
+uint32_t osKernelSysTick(void);
+osStatus osDelay(uint32_t millisec);
+int32_t osSignalSet(osThreadId thread_id, int32_t signals);
+osEvent osSignalWait(int32_t signals, uint32_t millisec);
+int32_t osSemaphoreWait(osSemaphoreId semaphore_id, uint32_t millisec);
+osStatus osSemaphoreRelease(osSemaphoreId semaphore_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SIM_CMSIS_OS_H
@@ -0,0 +1,6 @@
+#ifndef __gpio_H
+#define __gpio_H
+
+#include "main.h"
+
+#endif // __gpio_H
@@ -0,0 +1,6 @@
+#ifndef __i2c_H
+#define __i2c_H
+
+#include "main.h"
+
+#endif // __i2c_H
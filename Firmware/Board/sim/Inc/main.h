@@ -0,0 +1,21 @@
+/*
+* @brief Clock and timer constants of the simulated board.
+*
+* These mirror the values that CubeMX generates for ODrive v3 so that all
+* timestamp arithmetic in the control code behaves the same as on hardware.
+*/
+
+#ifndef __MAIN_H__
+#define __MAIN_H__
+
+#include "sim_hal.h"
+
+#define TIM_1_8_CLOCK_HZ 168000000
+#define TIM_1_8_PERIOD_CLOCKS 3500
+#define TIM_1_8_DEADTIME_CLOCKS 20
+#define TIM_APB1_CLOCK_HZ 84000000
+#define TIM_APB1_PERIOD_CLOCKS 4096
+#define TIM_APB1_DEADTIME_CLOCKS 40
+#define TIM_1_8_RCR 2
+
+#endif // __MAIN_H__
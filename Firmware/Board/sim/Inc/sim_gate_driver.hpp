@@ -0,0 +1,52 @@
+#ifndef __SIM_GATE_DRIVER_HPP
+#define __SIM_GATE_DRIVER_HPP
+
+#include <stdint.h>
+#include <Drivers/gate_driver.hpp>
+
+/**
+ * @brief Ideal gate driver and current sense amplifier.
+ *
+ * The amplifier gain is applied exactly as requested. A fault can be injected
+ * by setting `fault_` to a non-zero value, which takes the driver out of ready
+ * state just like a real driver chip would do.
+ */
+class SimGateDriver : public GateDriverBase, public OpAmpBase {
+public:
+    bool config(float requested_gain, float* actual_gain) {
+        gain_ = requested_gain;
+        *actual_gain = requested_gain;
+        return true;
+    }
+
+    bool init() {
+        initialized_ = gain_ > 0.0f;
+        return initialized_;
+    }
+
+    void do_checks() {}
+
+    bool is_ready() final {
+        return initialized_ && !fault_;
+    }
+
+    bool set_enabled(bool enabled) final { return true; }
+
+    uint32_t get_error() {
+        return fault_;
+    }
+
+    float get_midpoint() final {
+        return 0.5f; // [V]
+    }
+
+    float get_max_output_swing() final {
+        return 1.35f / 1.65f; // same as DRV8301
+    }
+
+    float gain_ = 0.0f; // [V/V]
+    bool initialized_ = false;
+    uint32_t fault_ = 0;
+};
+
+#endif // __SIM_GATE_DRIVER_HPP
@@ -0,0 +1,408 @@
+/*
+* @brief Minimal emulation of the STM32 peripheral registers and HAL API that
+* the ODrive control code touches directly.
+*
+* The register blocks are plain memory. Writes that the real hardware would
+* turn into an action (e.g. enabling the PWM outputs) are picked up by the
+* simulated board in board.cpp.
+*/
+
+#ifndef __SIM_HAL_H
+#define __SIM_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Core --------------------------------------------------------------------- */
+
+extern uint32_t sim_primask;
+
+static inline uint32_t __get_PRIMASK(void) { return sim_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { sim_primask = primask; }
+static inline void __disable_irq(void) { sim_primask = 1; }
+static inline void __enable_irq(void) { sim_primask = 0; }
+
+void NVIC_SystemReset(void);
+
+extern uint8_t sim_otp[16];
+#define FLASH_OTP_BASE ((uintptr_t)&sim_otp[0])
+#define FLASH_OTP_END (FLASH_OTP_BASE + sizeof(sim_otp) - 1)
+
+typedef enum {
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum {
+    DISABLE = 0U,
+    ENABLE = !DISABLE
+} FunctionalState;
+
+uint32_t HAL_GetTick(void);
+
+/* GPIO --------------------------------------------------------------------- */
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t OTYPER;
+    volatile uint32_t OSPEEDR;
+    volatile uint32_t PUPDR;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    volatile uint32_t BSRR;
+    volatile uint32_t LCKR;
+    volatile uint32_t AFR[2];
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef sim_gpio_ports[3];
+#define GPIOA (&sim_gpio_ports[0])
+#define GPIOB (&sim_gpio_ports[1])
+#define GPIOC (&sim_gpio_ports[2])
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT 0x00000000U
+#define GPIO_MODE_OUTPUT_PP 0x00000001U
+#define GPIO_MODE_OUTPUT_OD 0x00000011U
+#define GPIO_MODE_AF_PP 0x00000002U
+#define GPIO_MODE_AF_OD 0x00000012U
+#define GPIO_MODE_ANALOG 0x00000003U
+
+#define GPIO_NOPULL 0x00000000U
+#define GPIO_PULLUP 0x00000001U
+#define GPIO_PULLDOWN 0x00000002U
+
+#define GPIO_SPEED_FREQ_LOW 0x00000000U
+#define GPIO_SPEED_FREQ_MEDIUM 0x00000001U
+#define GPIO_SPEED_FREQ_HIGH 0x00000002U
+#define GPIO_SPEED_FREQ_VERY_HIGH 0x00000003U
+
+typedef enum {
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+// Outputs are looped back to the input data register so that a pin reads
+// back what was last written to it.
+static inline void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state) {
+    if (state == GPIO_PIN_SET) {
+        port->ODR |= pin;
+        port->IDR |= pin;
+    } else {
+        port->ODR &= ~(uint32_t)pin;
+        port->IDR &= ~(uint32_t)pin;
+    }
+}
+
+/* Timers ------------------------------------------------------------------- */
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t SMCR;
+    volatile uint32_t DIER;
+    volatile uint32_t SR;
+    volatile uint32_t EGR;
+    volatile uint32_t CCMR1;
+    volatile uint32_t CCMR2;
+    volatile uint32_t CCER;
+    volatile uint32_t CNT;
+    volatile uint32_t PSC;
+    volatile uint32_t ARR;
+    volatile uint32_t RCR;
+    volatile uint32_t CCR1;
+    volatile uint32_t CCR2;
+    volatile uint32_t CCR3;
+    volatile uint32_t CCR4;
+    volatile uint32_t BDTR;
+} TIM_TypeDef;
+
+extern TIM_TypeDef sim_tim1;
+extern TIM_TypeDef sim_tim2;
+extern TIM_TypeDef sim_tim3;
+extern TIM_TypeDef sim_tim4;
+extern TIM_TypeDef sim_tim5;
+extern TIM_TypeDef sim_tim8;
+extern TIM_TypeDef sim_tim13;
+extern TIM_TypeDef sim_tim14;
+#define TIM1 (&sim_tim1)
+#define TIM2 (&sim_tim2)
+#define TIM3 (&sim_tim3)
+#define TIM4 (&sim_tim4)
+#define TIM5 (&sim_tim5)
+#define TIM8 (&sim_tim8)
+#define TIM14 (&sim_tim14)
+
+// TIM13 is the free running counter used by the task timers. On the real
+// board it is reloaded at the start of every control loop iteration. Here it
+// is emulated with the host's monotonic clock (see sim_tim13_sample()).
+TIM_TypeDef* sim_tim13_sample(void);
+#define TIM13 (sim_tim13_sample())
+
+#define TIM_CR1_DIR (1U << 4)
+#define TIM_BDTR_AOE (1U << 14)
+#define TIM_BDTR_MOE (1U << 15)
+#define TIM_BDTR_MOE_Msk TIM_BDTR_MOE
+
+#define TIM_CHANNEL_1 0x00000000U
+#define TIM_CHANNEL_2 0x00000004U
+#define TIM_CHANNEL_3 0x00000008U
+#define TIM_CHANNEL_4 0x0000000CU
+#define TIM_CHANNEL_ALL 0x0000003CU
+#define TIM_CCx_ENABLE 0x00000001U
+#define TIM_CCxN_ENABLE 0x00000004U
+#define TIM_FLAG_UPDATE (1U << 0)
+#define TIM_IT_UPDATE (1U << 0)
+
+typedef struct {
+    uint32_t Prescaler;
+    uint32_t CounterMode;
+    uint32_t Period;
+    uint32_t ClockDivision;
+    uint32_t RepetitionCounter;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+    TIM_TypeDef* Instance;
+    TIM_Base_InitTypeDef Init;
+} TIM_HandleTypeDef;
+
+#define __HAL_TIM_GET_FLAG(htim, flag) (((htim)->Instance->SR & (flag)) == (flag))
+#define __HAL_TIM_CLEAR_IT(htim, it) ((htim)->Instance->SR = ~(it))
+#define __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(htim) ((htim)->Instance->BDTR &= ~(TIM_BDTR_MOE))
+
+static inline HAL_StatusTypeDef HAL_TIM_Encoder_Start(TIM_HandleTypeDef* htim, uint32_t channel) {
+    (void)htim; (void)channel;
+    return HAL_OK;
+}
+
+static inline HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t channel) {
+    (void)htim; (void)channel;
+    return HAL_OK;
+}
+
+/* ADC ---------------------------------------------------------------------- */
+
+// The ADC conversions are not emulated at register level. The simulated board
+// writes the sampled values directly into adc_measurements_ and calls the
+// conversion callbacks itself.
+
+typedef struct {
+    uint32_t CR2;
+} ADC_TypeDef;
+
+extern ADC_TypeDef sim_adc1;
+#define ADC1 (&sim_adc1)
+
+#define ADC_CLOCK_SYNC_PCLK_DIV4 0x00010000U
+#define ADC_RESOLUTION_12B 0x00000000U
+#define ADC_EXTERNALTRIGCONVEDGE_NONE 0x00000000U
+#define ADC_SOFTWARE_START 0x0F000001U
+#define ADC_DATAALIGN_RIGHT 0x00000000U
+#define ADC_EOC_SINGLE_CONV 0x00000001U
+#define ADC_SAMPLETIME_15CYCLES 0x00000001U
+#define ADC_CR1_AWDCH_Pos 0U
+
+typedef struct {
+    uint32_t ClockPrescaler;
+    uint32_t Resolution;
+    uint32_t DataAlign;
+    uint32_t ScanConvMode;
+    uint32_t EOCSelection;
+    uint32_t ContinuousConvMode;
+    uint32_t NbrOfConversion;
+    uint32_t DiscontinuousConvMode;
+    uint32_t ExternalTrigConv;
+    uint32_t ExternalTrigConvEdge;
+    uint32_t DMAContinuousRequests;
+} ADC_InitTypeDef;
+
+typedef struct {
+    uint32_t Channel;
+    uint32_t Rank;
+    uint32_t SamplingTime;
+} ADC_ChannelConfTypeDef;
+
+typedef struct {
+    ADC_TypeDef* Instance;
+    ADC_InitTypeDef Init;
+} ADC_HandleTypeDef;
+
+#define __HAL_ADC_ENABLE(hadc) ((void)(hadc))
+
+static inline HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc) {
+    (void)hadc;
+    return HAL_OK;
+}
+
+static inline HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* config) {
+    (void)hadc; (void)config;
+    return HAL_OK;
+}
+
+static inline HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* data, uint32_t length) {
+    (void)hadc; (void)data; (void)length;
+    return HAL_OK;
+}
+
+/* SPI ---------------------------------------------------------------------- */
+
+#define SPI_MODE_MASTER 0x00000104U
+#define SPI_DIRECTION_2LINES 0x00000000U
+#define SPI_DATASIZE_8BIT 0x00000000U
+#define SPI_DATASIZE_16BIT 0x00000800U
+#define SPI_POLARITY_LOW 0x00000000U
+#define SPI_POLARITY_HIGH 0x00000002U
+#define SPI_PHASE_1EDGE 0x00000000U
+#define SPI_PHASE_2EDGE 0x00000001U
+#define SPI_NSS_SOFT 0x00000200U
+#define SPI_BAUDRATEPRESCALER_16 0x00000018U
+#define SPI_BAUDRATEPRESCALER_32 0x00000020U
+#define SPI_FIRSTBIT_MSB 0x00000000U
+#define SPI_TIMODE_DISABLE 0x00000000U
+#define SPI_CRCCALCULATION_DISABLE 0x00000000U
+
+typedef struct {
+    uint32_t Mode;
+    uint32_t Direction;
+    uint32_t DataSize;
+    uint32_t CLKPolarity;
+    uint32_t CLKPhase;
+    uint32_t NSS;
+    uint32_t BaudRatePrescaler;
+    uint32_t FirstBit;
+    uint32_t TIMode;
+    uint32_t CRCCalculation;
+    uint32_t CRCPolynomial;
+} SPI_InitTypeDef;
+
+typedef struct {
+    void* Instance;
+    SPI_InitTypeDef Init;
+} SPI_HandleTypeDef;
+
+/* UART --------------------------------------------------------------------- */
+
+typedef struct {
+    uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct {
+    void* Instance;
+    UART_InitTypeDef Init;
+} UART_HandleTypeDef;
+
+/* I2C ---------------------------------------------------------------------- */
+
+typedef struct {
+    void* Instance;
+} I2C_HandleTypeDef;
+
+/* USB ---------------------------------------------------------------------- */
+
+typedef struct {
+    uint32_t dev_state;
+} USBD_HandleTypeDef;
+
+/* CAN ---------------------------------------------------------------------- */
+
+#define HAL_CAN_ERROR_NONE 0x00000000U
+#define HAL_CAN_ERROR_TIMEOUT 0x00020000U
+
+#define CAN_ID_STD 0x00000000U
+#define CAN_ID_EXT 0x00000004U
+#define CAN_RTR_DATA 0x00000000U
+#define CAN_RTR_REMOTE 0x00000002U
+
+#define CAN_RX_FIFO0 0x00000000U
+#define CAN_RX_FIFO1 0x00000001U
+
+#define CAN_FILTERMODE_IDMASK 0x00000000U
+#define CAN_FILTERSCALE_32BIT 0x00000001U
+
+#define CAN_IT_TX_MAILBOX_EMPTY (1U << 0)
+#define CAN_IT_RX_FIFO0_MSG_PENDING (1U << 1)
+#define CAN_IT_RX_FIFO1_MSG_PENDING (1U << 4)
+
+typedef struct {
+    uint32_t Prescaler;
+} CAN_InitTypeDef;
+
+typedef struct {
+    void* Instance;
+    CAN_InitTypeDef Init;
+    volatile uint32_t ErrorCode;
+} CAN_HandleTypeDef;
+
+typedef struct {
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    FunctionalState TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct {
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t Timestamp;
+    uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+typedef struct {
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank;
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef* hcan);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef* hcan);
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef* hcan);
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef* hcan, CAN_FilterTypeDef* filter);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef* hcan, uint32_t active_its);
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef* hcan, uint32_t inactive_its);
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef* hcan);
+uint32_t HAL_CAN_GetError(CAN_HandleTypeDef* hcan);
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef* hcan, uint32_t fifo);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef* hcan, uint32_t fifo, CAN_RxHeaderTypeDef* header, uint8_t data[]);
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef* hcan);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef* hcan, CAN_TxHeaderTypeDef* header, uint8_t data[], uint32_t* mailbox);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SIM_HAL_H
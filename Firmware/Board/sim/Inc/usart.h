@@ -0,0 +1,6 @@
+#ifndef __usart_H
+#define __usart_H
+
+#include "main.h"
+
+#endif // __usart_H
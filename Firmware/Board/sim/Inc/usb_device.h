@@ -0,0 +1,6 @@
+#ifndef __usb_device_H
+#define __usb_device_H
+
+#include "main.h"
+
+#endif // __usb_device_H
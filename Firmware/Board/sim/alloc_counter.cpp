@@ -0,0 +1,82 @@
+
+#include "alloc_counter.hpp"
+
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+
+AllocCounter alloc_counter; // zero-initialized
+
+// Each allocation is prefixed with its size so that operator delete can
+// account for it. These functions live in their own translation unit so that
+// the compiler doesn't see malloc() and free() paired with new and delete at
+// the call site.
+static void* counted_alloc(size_t size) {
+    size_t* base = (size_t*)malloc(size + sizeof(max_align_t));
+    if (!base) {
+        throw std::bad_alloc();
+    }
+    *base = size;
+    alloc_counter.n_allocs++;
+    alloc_counter.live_bytes += size;
+    if (alloc_counter.live_bytes > alloc_counter.peak_bytes) {
+        alloc_counter.peak_bytes = alloc_counter.live_bytes;
+    }
+    return (uint8_t*)base + sizeof(max_align_t);
+}
+
+static void counted_free(void* ptr) {
+    if (ptr) {
+        size_t* base = (size_t*)((uint8_t*)ptr - sizeof(max_align_t));
+        alloc_counter.live_bytes -= *base;
+        free(base);
+    }
+}
+
+void* operator new(size_t size) {
+    return counted_alloc(size);
+}
+
+void* operator new[](size_t size) {
+    return counted_alloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return counted_alloc(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return counted_alloc(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* ptr) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    counted_free(ptr);
+}
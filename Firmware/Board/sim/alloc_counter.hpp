@@ -0,0 +1,22 @@
+#ifndef __ALLOC_COUNTER_HPP
+#define __ALLOC_COUNTER_HPP
+
+#include <stddef.h>
+
+/**
+ * @brief Heap usage of the host benchmarks.
+ *
+ * Linking alloc_counter.cpp into a program replaces the global operator new
+ * and operator delete with versions that count the allocations and the number
+ * of live bytes. The counters start at zero before any static constructor
+ * runs.
+ */
+struct AllocCounter {
+    size_t n_allocs; // number of allocations so far
+    size_t live_bytes; // bytes that are currently allocated
+    size_t peak_bytes; // maximum of live_bytes, can be reset by the caller
+};
+
+extern AllocCounter alloc_counter;
+
+#endif // __ALLOC_COUNTER_HPP
@@ -0,0 +1,344 @@
+/*
+* @brief Host benchmark for batched property access in libfibre.
+*
+* Connects a Fibre client to a Fibre server in the same process. The server
+* runs the same protocol code as the firmware and exposes an object with 30
+* properties. The two are connected by packet queues with the MTU of USB. The
+* benchmark reads these properties one at a time (as pyfibre does when it reads
+* them in sequence) and with libfibre_start_batch(), with and without batch
+* support on the server, and reports the number of requests and round trips.
+* A round trip is one pass of all queued packets from the client to the server
+* and back. It also checks that written values are read back and reports the
+* batches per second and the heap allocations per batch, which are counted
+* through the global operator new (see alloc_counter.hpp).
+*
+* Usage: fibre_batch_bench [number of batches]
+*/
+
+#include <fibre/libfibre.h>
+#include <fibre/../../legacy_protocol.hpp>
+#include <fibre/../../legacy_object_client.hpp>
+#include <fibre/../../protocol.hpp>
+#include <fibre/../../crc.hpp>
+#include <fibre/simple_serdes.hpp>
+#include "alloc_counter.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace fibre;
+
+/* Simulated device ----------------------------------------------------------*/
+
+// Properties 1...24 are floats, followed by two uint32, two bool, a read-only
+// float and an endpoint reference.
+#define PROPERTY(id, type, access) "{\"name\":\"prop" #id "\",\"id\":" #id ",\"type\":\"" type "\",\"access\":\"" access "\"}"
+
+static constexpr size_t kNumProperties = 30;
+static constexpr int kReadOnlyProperty = 29;
+
+const unsigned char fibre::embedded_json[] = "["
+    "{\"name\":\"\",\"id\":0,\"type\":\"json\",\"access\":\"r\"},"
+    "{\"name\":\"axis0\",\"type\":\"object\",\"members\":["
+    PROPERTY(1, "float", "rw") "," PROPERTY(2, "float", "rw") "," PROPERTY(3, "float", "rw") ","
+    PROPERTY(4, "float", "rw") "," PROPERTY(5, "float", "rw") "," PROPERTY(6, "float", "rw") ","
+    PROPERTY(7, "float", "rw") "," PROPERTY(8, "float", "rw") "," PROPERTY(9, "float", "rw") ","
+    PROPERTY(10, "float", "rw") "," PROPERTY(11, "float", "rw") "," PROPERTY(12, "float", "rw") ","
+    PROPERTY(13, "float", "rw") "," PROPERTY(14, "float", "rw") "," PROPERTY(15, "float", "rw") ","
+    PROPERTY(16, "float", "rw") "," PROPERTY(17, "float", "rw") "," PROPERTY(18, "float", "rw") ","
+    PROPERTY(19, "float", "rw") "," PROPERTY(20, "float", "rw") "," PROPERTY(21, "float", "rw") ","
+    PROPERTY(22, "float", "rw") "," PROPERTY(23, "float", "rw") "," PROPERTY(24, "float", "rw") ","
+    PROPERTY(25, "uint32", "rw") "," PROPERTY(26, "uint32", "rw") ","
+    PROPERTY(27, "bool", "rw") "," PROPERTY(28, "bool", "rw") ","
+    PROPERTY(29, "float", "r") "," PROPERTY(30, "endpoint_ref", "rw")
+    "]}]";
+const size_t fibre::embedded_json_length = sizeof(fibre::embedded_json) - 1;
+const uint16_t fibre::json_crc_ = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION, embedded_json, embedded_json_length);
+const uint32_t fibre::json_version_id_ = (json_crc_ << 16) | calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(json_crc_, embedded_json, embedded_json_length);
+
+static uint8_t property_values[kNumProperties + 1][4];
+
+static size_t property_size(int idx) {
+    return (idx == 27 || idx == 28) ? 1 : 4;
+}
+
+// Behaves like the generated exchange() handlers of the firmware: stores the
+// new value if there is one and returns the old value.
+bool fibre::endpoint_handler(int idx, cbufptr_t* input_buffer, bufptr_t* output_buffer) {
+    if (idx == 0) {
+        return endpoint0_handler(input_buffer, output_buffer);
+    } else if (idx < 0 || idx > (int)kNumProperties) {
+        return false;
+    }
+
+    size_t size = property_size(idx);
+    uint8_t old_value[4];
+    memcpy(old_value, property_values[idx], size);
+    if (input_buffer->size() >= size && idx != kReadOnlyProperty) {
+        memcpy(property_values[idx], input_buffer->begin(), size);
+        *input_buffer = input_buffer->skip(size);
+    }
+    if (output_buffer->size() < size) {
+        return false;
+    }
+    memcpy(output_buffer->begin(), old_value, size);
+    *output_buffer = output_buffer->skip(size);
+    return true;
+}
+
+
+/* Connection ----------------------------------------------------------------*/
+
+// One direction of a packet based connection. Writes complete right away (like
+// WriteQueueSink) and the packets are held until deliver() is called.
+struct PacketQueue : AsyncStreamSource, AsyncStreamSink {
+    void start_write(cbufptr_t buffer, TransferHandle* handle, Callback<void, WriteResult> completer) final {
+        *handle = 1;
+        if (n_queued_ >= kMaxPackets || buffer.size() > sizeof(packets_[0])) {
+            completer.invoke({kStreamError, buffer.begin()});
+            return;
+        }
+        size_t slot = (head_ + n_queued_) % kMaxPackets;
+        memcpy(packets_[slot], buffer.begin(), buffer.size());
+        lengths_[slot] = buffer.size();
+        n_queued_++;
+        n_packets++;
+        completer.invoke({kStreamOk, buffer.end()});
+    }
+
+    void cancel_write(TransferHandle transfer_handle) final {}
+
+    void start_read(bufptr_t buffer, TransferHandle* handle, Callback<void, ReadResult> completer) final {
+        *handle = 1;
+        read_buf_ = buffer;
+        read_completer_ = completer;
+    }
+
+    void cancel_read(TransferHandle transfer_handle) final {}
+
+    // Passes the queued packets to the reader. Returns false if there were none.
+    bool deliver() {
+        bool progress = false;
+        while (n_queued_ && read_completer_) {
+            size_t n_copy = std::min(lengths_[head_], read_buf_.size());
+            memcpy(read_buf_.begin(), packets_[head_], n_copy);
+            head_ = (head_ + 1) % kMaxPackets;
+            n_queued_--;
+            read_completer_.invoke_and_clear({kStreamOk, read_buf_.begin() + n_copy});
+            progress = true;
+        }
+        return progress;
+    }
+
+    size_t n_packets = 0;
+
+private:
+    static constexpr size_t kMaxPackets = 2 * FIBRE_LEGACY_WINDOW_SIZE;
+
+    uint8_t packets_[kMaxPackets][128];
+    size_t lengths_[kMaxPackets];
+    size_t head_ = 0;
+    size_t n_queued_ = 0;
+    bufptr_t read_buf_;
+    Callback<void, ReadResult> read_completer_;
+};
+
+struct Connection {
+    static constexpr size_t kMtu = 64; // USB full speed bulk endpoint
+
+    // Runs one round trip. Returns false if nothing happened.
+    bool round_trip() {
+        bool progress = to_device.deliver();
+        progress = to_host.deliver() || progress;
+        return progress;
+    }
+
+    PacketQueue to_device;
+    PacketQueue to_host;
+    LegacyProtocolPacketBased device{&to_device, &to_host, kMtu};
+    LegacyProtocolPacketBased host{&to_host, &to_device, kMtu};
+};
+
+
+/* Benchmark -----------------------------------------------------------------*/
+
+struct PropertyInfo {
+    LegacyObject* obj;
+    size_t size;
+};
+
+static LibFibreStatus on_call_completed(void* ctx, LibFibreStatus status,
+        const unsigned char* tx_end, unsigned char* rx_end,
+        const unsigned char** tx_buf, size_t* tx_len,
+        unsigned char** rx_buf, size_t* rx_len) {
+    *reinterpret_cast<LibFibreStatus*>(ctx) = status;
+    return ::kFibreBusy;
+}
+
+static void on_batch_completed(void* ctx, LibFibreStatus status) {
+    *reinterpret_cast<LibFibreStatus*>(ctx) = status;
+}
+
+// Reads the properties one after the other with libfibre_call(). Returns the
+// number of round trips or 0 on failure.
+static size_t read_one_at_a_time(Connection& conn, std::vector<PropertyInfo>& props) {
+    size_t n_round_trips = 0;
+    for (auto& prop: props) {
+        LibFibreFunction* func = reinterpret_cast<LibFibreFunction*>(static_cast<Function*>(&prop.obj->intf->functions.at("read")));
+        uintptr_t obj = reinterpret_cast<uintptr_t>(prop.obj);
+        uint8_t value[sizeof(uintptr_t)];
+        LibFibreCallContext* handle = nullptr;
+        const unsigned char* tx_end;
+        unsigned char* rx_end;
+        LibFibreStatus status = libfibre_call(func, &handle, ::kFibreClosed,
+                reinterpret_cast<const unsigned char*>(&obj), sizeof(obj), value, prop.size,
+                &tx_end, &rx_end, on_call_completed, &status);
+        while (status == ::kFibreBusy && conn.round_trip()) {
+            n_round_trips++;
+        }
+        if (status != ::kFibreClosed) {
+            printf("read failed with %d\n", status);
+            return 0;
+        }
+    }
+    return n_round_trips;
+}
+
+// Runs a batch and returns the number of round trips or 0 on failure.
+static size_t run_batch(Connection& conn, std::vector<LibFibreBatchItem>& items) {
+    LibFibreStatus status = libfibre_start_batch(items.data(), items.size(), on_batch_completed, &status);
+    size_t n_round_trips = 0;
+    while (status == ::kFibreBusy && conn.round_trip()) {
+        n_round_trips++;
+    }
+    if (status != ::kFibreOk) {
+        printf("batch failed with %d\n", status);
+        return 0;
+    }
+    return n_round_trips;
+}
+
+static std::vector<LibFibreBatchItem> make_read_batch(std::vector<PropertyInfo>& props, std::vector<uintptr_t>& values) {
+    std::vector<LibFibreBatchItem> items;
+    for (size_t i = 0; i < props.size(); ++i) {
+        items.push_back({reinterpret_cast<LibFibreObject*>(props[i].obj), nullptr, 0,
+                         reinterpret_cast<unsigned char*>(&values[i]), props[i].size, nullptr});
+    }
+    return items;
+}
+
+static void on_found_root_object(void* ctx, LegacyObjectClient* client, std::shared_ptr<LegacyObject> obj) {
+    *reinterpret_cast<LegacyObject**>(ctx) = obj.get();
+}
+
+static void on_lost_root_object(void* ctx, LegacyObjectClient* client, std::shared_ptr<LegacyObject> obj) {}
+
+static void on_stopped(void* ctx, LegacyProtocolPacketBased* protocol, StreamStatus status) {}
+
+int main(int argc, const char** argv) {
+    size_t n_bench = argc >= 2 ? strtoul(argv[1], nullptr, 10) : 20000;
+    setenv("FIBRE_CACHE_DIR", "", 1); // don't touch the JSON cache of the user
+
+    Connection conn;
+    LegacyObject* root = nullptr;
+    conn.device.start(nullptr, nullptr, nullptr); // server only
+    conn.host.start({on_found_root_object, &root}, {on_lost_root_object, nullptr}, {on_stopped, nullptr});
+    while (conn.round_trip()) {
+    }
+    if (!root || !(conn.host.remote_features_ & PROTOCOL_FEATURE_BATCH)) {
+        printf("failed to connect to the simulated device\n");
+        return 1;
+    }
+
+    LegacyObject* axis = root->intf->attributes.at("axis0").object.get();
+    std::vector<PropertyInfo> props;
+    for (size_t i = 1; i <= kNumProperties; ++i) {
+        LegacyObject* obj = axis->intf->attributes.at("prop" + std::to_string(i)).object.get();
+        props.push_back({obj, i == kNumProperties ? sizeof(uintptr_t) : property_size(i)});
+    }
+
+    // Write all properties in one batch and read them back
+    std::vector<float> floats;
+    std::vector<uintptr_t> new_values(kNumProperties, 0);
+    std::vector<LibFibreBatchItem> write_items;
+    for (size_t i = 0; i < kNumProperties; ++i) {
+        if ((int)i + 1 == kReadOnlyProperty) {
+            continue;
+        }
+        float f = 1.5f * i;
+        uint32_t u = 1000 + i;
+        if (i < 24) {
+            memcpy(&new_values[i], &f, sizeof(f));
+        } else if (i < 26) {
+            memcpy(&new_values[i], &u, sizeof(u));
+        } else if (i < 28) {
+            new_values[i] = i & 1;
+        } else {
+            new_values[i] = reinterpret_cast<uintptr_t>(props[0].obj);
+        }
+        write_items.push_back({reinterpret_cast<LibFibreObject*>(props[i].obj),
+                               reinterpret_cast<const unsigned char*>(&new_values[i]), props[i].size,
+                               nullptr, 0, nullptr});
+    }
+    if (!run_batch(conn, write_items)) {
+        return 1;
+    }
+
+    std::vector<uintptr_t> values(kNumProperties, 0);
+    std::vector<LibFibreBatchItem> read_items = make_read_batch(props, values);
+    size_t n_requests = conn.to_device.n_packets;
+    size_t n_round_trips = run_batch(conn, read_items);
+    n_requests = conn.to_device.n_packets - n_requests;
+    if (!n_round_trips) {
+        return 1;
+    }
+    for (size_t i = 0; i < kNumProperties; ++i) {
+        if (read_items[i].rx_end != read_items[i].rx_buf + props[i].size || values[i] != new_values[i]) {
+            printf("property %zu: read back %zx instead of %zx\n", i + 1, values[i], new_values[i]);
+            return 1;
+        }
+    }
+    printf("read %zu properties in a batch: %zu round trip(s), %zu requests\n", kNumProperties, n_round_trips, n_requests);
+
+    n_requests = conn.to_device.n_packets;
+    n_round_trips = read_one_at_a_time(conn, props);
+    n_requests = conn.to_device.n_packets - n_requests;
+    if (!n_round_trips) {
+        return 1;
+    }
+    printf("read %zu properties one at a time: %zu round trip(s), %zu requests\n", kNumProperties, n_round_trips, n_requests);
+
+    // Pretend that the device doesn't support batch requests
+    conn.host.remote_features_ = 0;
+    n_requests = conn.to_device.n_packets;
+    n_round_trips = run_batch(conn, read_items);
+    n_requests = conn.to_device.n_packets - n_requests;
+    if (!n_round_trips) {
+        return 1;
+    }
+    printf("read %zu properties in a batch without batch support on the device: %zu round trip(s), %zu requests\n", kNumProperties, n_round_trips, n_requests);
+    conn.host.remote_features_ = PROTOCOL_FEATURE_BATCH;
+
+    // Warm up
+    for (size_t i = 0; i < 10; ++i) {
+        if (!run_batch(conn, read_items)) {
+            return 1;
+        }
+    }
+
+    size_t allocs_before = alloc_counter.n_allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n_bench; ++i) {
+        if (!run_batch(conn, read_items)) {
+            return 1;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%.0f batches/s, %.2f allocations per batch (host)\n",
+           n_bench / elapsed, (double)(alloc_counter.n_allocs - allocs_before) / n_bench);
+    return 0;
+}
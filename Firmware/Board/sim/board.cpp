@@ -0,0 +1,608 @@
+/*
+* @brief Contains the variables and the peripheral emulation of the simulated
+* board.
+*
+* The object instantiation mirrors Board/v3/board.cpp. Instead of the timer and
+* ADC interrupts, sim_run_ticks() runs the same sequence of callbacks as the
+* v3 interrupt handlers and couples the PWM outputs and sensor inputs to the
+* motor models.
+*/
+
+#include <board.h>
+
+#include <odrive_main.h>
+#include <low_level.h>
+
+#include "sim_board.hpp"
+
+#include <arm_common_tables.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// this should technically be in task_timer.cpp but let's not make a one-line file
+bool TaskTimer::enabled = false;
+
+ODrive odrv{};
+
+uint64_t serial_number = 0x53494C000001; // "SIL" + 1
+char serial_number_str[13] = "53494C000001";
+uint32_t _reboot_cookie = 0;
+osSemaphoreId sem_can = nullptr;
+
+USBStats_t usb_stats_;
+I2CStats_t i2c_stats_;
+
+/* Peripherals -------------------------------------------------------------- */
+
+uint32_t sim_primask = 0;
+uint8_t sim_otp[16] = {0, 0, 0, HW_VERSION_MAJOR, HW_VERSION_MINOR, HW_VERSION_VOLTAGE};
+
+GPIO_TypeDef sim_gpio_ports[3];
+
+TIM_TypeDef sim_tim1, sim_tim2, sim_tim3, sim_tim4, sim_tim5, sim_tim8, sim_tim13, sim_tim14;
+TIM_HandleTypeDef htim1{&sim_tim1, {}};
+TIM_HandleTypeDef htim2{&sim_tim2, {}};
+TIM_HandleTypeDef htim3{&sim_tim3, {}};
+TIM_HandleTypeDef htim4{&sim_tim4, {}};
+TIM_HandleTypeDef htim5{&sim_tim5, {}};
+TIM_HandleTypeDef htim8{&sim_tim8, {}};
+
+ADC_TypeDef sim_adc1;
+ADC_HandleTypeDef hadc1, hadc2, hadc3;
+
+SPI_HandleTypeDef hspi3;
+CAN_HandleTypeDef hcan1;
+static USBD_HandleTypeDef usbd_handle;
+
+float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+/* Objects ------------------------------------------------------------------ */
+
+Stm32SpiArbiter spi3_arbiter{&hspi3};
+Stm32SpiArbiter& ext_spi_arbiter = spi3_arbiter;
+
+UART_HandleTypeDef* uart_a = nullptr;
+UART_HandleTypeDef* uart_b = nullptr;
+UART_HandleTypeDef* uart_c = nullptr;
+
+SimGateDriver m0_gate_driver;
+SimGateDriver m1_gate_driver;
+
+const float fet_thermistor_poly_coeffs[] =
+    {363.93910201f, -462.15369634f, 307.55129571f, -27.72569531f};
+const size_t fet_thermistor_num_coeffs = sizeof(fet_thermistor_poly_coeffs)/sizeof(fet_thermistor_poly_coeffs[1]);
+
+// ADC reading that corresponds to a FET temperature of 25°C
+static constexpr uint16_t kFetThermistorAdcValue = 997;
+
+OnboardThermistorCurrentLimiter fet_thermistors[AXIS_COUNT] = {
+    {
+        15, // adc_channel
+        &fet_thermistor_poly_coeffs[0], // coefficients
+        fet_thermistor_num_coeffs // num_coeffs
+    }, {
+        4, // adc_channel
+        &fet_thermistor_poly_coeffs[0], // coefficients
+        fet_thermistor_num_coeffs // num_coeffs
+    }
+};
+
+OffboardThermistorCurrentLimiter motor_thermistors[AXIS_COUNT];
+
+Motor motors[AXIS_COUNT] = {
+    {
+        &htim1, // timer
+        0b110, // current_sensor_mask
+        1.0f / SHUNT_RESISTANCE, // shunt_conductance [S]
+        m0_gate_driver, // gate_driver
+        m0_gate_driver, // opamp
+        fet_thermistors[0],
+        motor_thermistors[0]
+    },
+    {
+        &htim8, // timer
+        0b110, // current_sensor_mask
+        1.0f / SHUNT_RESISTANCE, // shunt_conductance [S]
+        m1_gate_driver, // gate_driver
+        m1_gate_driver, // opamp
+        fet_thermistors[1],
+        motor_thermistors[1]
+    }
+};
+
+Encoder encoders[AXIS_COUNT] = {
+    {
+        &htim3, // timer
+        {GPIOC, GPIO_PIN_9}, // index_gpio
+        {GPIOB, GPIO_PIN_4}, // hallA_gpio
+        {GPIOB, GPIO_PIN_5}, // hallB_gpio
+        {GPIOC, GPIO_PIN_9}, // hallC_gpio
+        &spi3_arbiter // spi_arbiter
+    },
+    {
+        &htim4, // timer
+        {GPIOC, GPIO_PIN_15}, // index_gpio
+        {GPIOB, GPIO_PIN_6}, // hallA_gpio
+        {GPIOB, GPIO_PIN_7}, // hallB_gpio
+        {GPIOC, GPIO_PIN_15}, // hallC_gpio
+        &spi3_arbiter // spi_arbiter
+    }
+};
+
+// TODO: this has no hardware dependency and should be allocated depending on config
+Endstop endstops[2 * AXIS_COUNT];
+MechanicalBrake mechanical_brakes[AXIS_COUNT];
+
+SensorlessEstimator sensorless_estimators[AXIS_COUNT];
+Controller controllers[AXIS_COUNT];
+TrapezoidalTrajectory trap[AXIS_COUNT];
+
+std::array<Axis, AXIS_COUNT> axes{{
+    {
+        0, // axis_num
+        1, // step_gpio_pin
+        2, // dir_gpio_pin
+        (osPriority)(osPriorityHigh + (osPriority)1), // thread_priority
+        encoders[0], // encoder
+        sensorless_estimators[0], // sensorless_estimator
+        controllers[0], // controller
+        motors[0], // motor
+        trap[0], // trap
+        endstops[0], endstops[1], // min_endstop, max_endstop
+        mechanical_brakes[0], // mechanical brake
+    },
+    {
+        1, // axis_num
+        7, // step_gpio_pin
+        8, // dir_gpio_pin
+        osPriorityHigh, // thread_priority
+        encoders[1], // encoder
+        sensorless_estimators[1], // sensorless_estimator
+        controllers[1], // controller
+        motors[1], // motor
+        trap[1], // trap
+        endstops[2], endstops[3], // min_endstop, max_endstop
+        mechanical_brakes[1], // mechanical brake
+    },
+}};
+
+// Same pinout as ODrive v3.6
+Stm32Gpio gpios[GPIO_COUNT] = {
+    {nullptr, 0}, // dummy GPIO0 so that PCB labels and software numbers match
+
+    {GPIOA, GPIO_PIN_0}, // GPIO1
+    {GPIOA, GPIO_PIN_1}, // GPIO2
+    {GPIOA, GPIO_PIN_2}, // GPIO3
+    {GPIOA, GPIO_PIN_3}, // GPIO4
+    {GPIOC, GPIO_PIN_4}, // GPIO5
+    {GPIOB, GPIO_PIN_2}, // GPIO6
+    {GPIOA, GPIO_PIN_15}, // GPIO7
+    {GPIOB, GPIO_PIN_3}, // GPIO8
+
+    {GPIOB, GPIO_PIN_4}, // ENC0_A
+    {GPIOB, GPIO_PIN_5}, // ENC0_B
+    {GPIOC, GPIO_PIN_9}, // ENC0_Z
+    {GPIOB, GPIO_PIN_6}, // ENC1_A
+    {GPIOB, GPIO_PIN_7}, // ENC1_B
+    {GPIOC, GPIO_PIN_15}, // ENC1_Z
+    {GPIOB, GPIO_PIN_8}, // CAN_R
+    {GPIOB, GPIO_PIN_9}, // CAN_D
+};
+
+// The simulated board has no alternate functions besides the encoder inputs
+std::array<GpioFunction, 3> alternate_functions[GPIO_COUNT] = {
+    /* GPIO0 (inexistent): */ {{}},
+    /* GPIO1: */ {{}},
+    /* GPIO2: */ {{}},
+    /* GPIO3: */ {{}},
+    /* GPIO4: */ {{}},
+    /* GPIO5: */ {{}},
+    /* GPIO6: */ {{}},
+    /* GPIO7: */ {{}},
+    /* GPIO8: */ {{}},
+    /* ENC0_A: */ {{{ODrive::GPIO_MODE_ENC0, 0}}},
+    /* ENC0_B: */ {{{ODrive::GPIO_MODE_ENC0, 0}}},
+    /* ENC0_Z: */ {{}},
+    /* ENC1_A: */ {{{ODrive::GPIO_MODE_ENC1, 0}}},
+    /* ENC1_B: */ {{{ODrive::GPIO_MODE_ENC1, 0}}},
+    /* ENC1_Z: */ {{}},
+    /* CAN_R: */ {{{ODrive::GPIO_MODE_CAN_A, 0}}},
+    /* CAN_D: */ {{{ODrive::GPIO_MODE_CAN_A, 0}}},
+};
+
+USBD_HandleTypeDef& usb_dev_handle = usbd_handle;
+
+/* Simulation state --------------------------------------------------------- */
+
+MotorModel sim_motors[AXIS_COUNT];
+float sim_supply_voltage = 24.0f;
+uint64_t sim_tick_count = 0;
+
+static bool timers_running = false;
+static uint32_t timestamp_ = 0;
+static std::chrono::steady_clock::time_point tim13_reload_time;
+
+// Phase voltages [V] (alpha, beta) that are in effect during the current
+// control period. On v3 the PWM timings computed in one control loop iteration
+// are loaded at the start of the next iteration and stay in effect for one
+// full period (the timestamp passed to pwm_update_cb() marks the middle of
+// that period).
+struct PhaseVoltages { double alpha = 0.0, beta = 0.0; bool floating = true; };
+static PhaseVoltages phase_voltages[AXIS_COUNT];
+
+TIM_TypeDef* sim_tim13_sample(void) {
+    // Reading the host clock is comparatively expensive, so it is only done
+    // while the task timers are recording.
+    if (!TaskTimer::enabled) {
+        return &sim_tim13;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - tim13_reload_time;
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    sim_tim13.CNT = (uint16_t)(ns * (TIM_APB1_CLOCK_HZ / 1000000) / 1000);
+    return &sim_tim13;
+}
+
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)(sim_tick_count * 1000 / current_meas_hz);
+}
+
+void NVIC_SystemReset(void) {
+    printf("reboot requested\n");
+    exit(0);
+}
+
+/* Stubs for hardware that is not simulated --------------------------------- */
+
+bool Stm32Gpio::config(uint32_t mode, uint32_t pull, uint32_t speed) {
+    return true;
+}
+
+bool Stm32Gpio::subscribe(bool rising_edge, bool falling_edge, void (*callback)(void*), void* ctx) {
+    return false;
+}
+
+void Stm32Gpio::unsubscribe() {}
+
+bool Stm32SpiArbiter::acquire_task(SpiTask* task) {
+    return !__atomic_exchange_n(&task->is_in_use, true, __ATOMIC_SEQ_CST);
+}
+
+void Stm32SpiArbiter::release_task(SpiTask* task) {
+    task->is_in_use = false;
+}
+
+void Stm32SpiArbiter::transfer_async(SpiTask* task) {
+    // There are no SPI devices on the simulated board
+    if (task->on_complete) {
+        (*task->on_complete)(task->on_complete_ctx, false);
+    }
+}
+
+bool Stm32SpiArbiter::transfer(SPI_InitTypeDef config, Stm32Gpio ncs_gpio, const uint8_t* tx_buf, uint8_t* rx_buf, size_t length, uint32_t timeout_ms) {
+    return false;
+}
+
+void Stm32SpiArbiter::on_complete() {}
+
+bool Stm32SpiArbiter::start() {
+    return false;
+}
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef* hcan) { return HAL_OK; }
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef* hcan) { return HAL_OK; }
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef* hcan) { return HAL_OK; }
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef* hcan, CAN_FilterTypeDef* filter) { return HAL_OK; }
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef* hcan, uint32_t active_its) { return HAL_OK; }
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef* hcan, uint32_t inactive_its) { return HAL_OK; }
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef* hcan) { return HAL_OK; }
+uint32_t HAL_CAN_GetError(CAN_HandleTypeDef* hcan) { return HAL_CAN_ERROR_NONE; }
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef* hcan, uint32_t fifo) { return 0; }
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef* hcan, uint32_t fifo, CAN_RxHeaderTypeDef* header, uint8_t data[]) { return HAL_ERROR; }
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef* hcan) { return 3; }
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef* hcan, CAN_TxHeaderTypeDef* header, uint8_t data[], uint32_t* mailbox) { return HAL_OK; }
+
+void uart_poll() {}
+
+// The communication stack is not part of the simulation, so there are no
+// endpoints that could be mapped to analog or PWM inputs or to oscilloscope
+// channels.
+bool fibre::is_endpoint_ref_valid(endpoint_ref_t endpoint_ref) {
+    return false;
+}
+
+bool fibre::set_endpoint_from_float(endpoint_ref_t endpoint_ref, float value) {
+    return false;
+}
+
+bool fibre::get_float_property(endpoint_ref_t endpoint_ref, Property<const float>* property) {
+    return false;
+}
+
+bool ODrive::save_configuration(void) {
+    return false;
+}
+
+void ODrive::erase_configuration(void) {}
+
+void ODrive::enter_dfu_mode() {}
+
+uint32_t ODrive::get_interrupt_status(int32_t irqn) {
+    return 0;
+}
+
+uint32_t ODrive::get_dma_status(uint8_t stream_num) {
+    return 0;
+}
+
+uint32_t ODrive::get_gpio_states() {
+    return sim_gpio_ports[0].IDR | (sim_gpio_ports[1].IDR << 16);
+}
+
+/* CMSIS-OS ------------------------------------------------------------------ */
+
+osThreadId osThreadCreate(const osThreadDef_t* thread_def, void* argument) {
+    return nullptr; // threads are not supported
+}
+
+osPriority osThreadGetPriority(osThreadId thread_id) {
+    return osPriorityNormal;
+}
+
+uint32_t osKernelSysTick(void) {
+    return HAL_GetTick();
+}
+
+osStatus osDelay(uint32_t millisec) {
+    sim_run_ticks(millisec * current_meas_hz / 1000);
+    return osOK;
+}
+
+int32_t osSignalSet(osThreadId thread_id, int32_t signals) {
+    return 0;
+}
+
+osEvent osSignalWait(int32_t signals, uint32_t millisec) {
+    sim_run_ticks(1);
+    osEvent evt;
+    evt.status = osEventSignal;
+    evt.value.signals = signals;
+    return evt;
+}
+
+int32_t osSemaphoreWait(osSemaphoreId semaphore_id, uint32_t millisec) {
+    return 0;
+}
+
+osStatus osSemaphoreRelease(osSemaphoreId semaphore_id) {
+    return osOK;
+}
+
+/* Board functions ---------------------------------------------------------- */
+
+void system_init() {
+    for (size_t i = 0; i < FAST_MATH_TABLE_SIZE + 1; ++i) {
+        sinTable_f32[i] = (float)sin(2.0 * M_PI * (double)i / FAST_MATH_TABLE_SIZE);
+    }
+}
+
+bool board_init() {
+    return true;
+}
+
+void start_timers() {
+    timers_running = true;
+}
+
+/**
+ * @brief Converts the PWM timings of a motor timer into phase voltages.
+ *
+ * The ODrive's PWM channels are active when the counter is above the compare
+ * value, so a lower compare value results in a higher phase voltage.
+ */
+static PhaseVoltages get_phase_voltages(TIM_TypeDef* tim) {
+    if (!(tim->BDTR & TIM_BDTR_MOE)) {
+        return {};
+    }
+    double v_a = (0.5 - (double)tim->CCR1 / TIM_1_8_PERIOD_CLOCKS) * vbus_voltage;
+    double v_b = (0.5 - (double)tim->CCR2 / TIM_1_8_PERIOD_CLOCKS) * vbus_voltage;
+    double v_c = (0.5 - (double)tim->CCR3 / TIM_1_8_PERIOD_CLOCKS) * vbus_voltage;
+    return {
+        (2.0 / 3.0) * (v_a - 0.5 * (v_b + v_c)),
+        (v_b - v_c) / sqrt(3.0),
+        false
+    };
+}
+
+static uint32_t adcval_from_current(Motor& motor, SimGateDriver& opamp, double current) {
+    double adcval = (double)(1 << 11) + current * SHUNT_RESISTANCE * opamp.gain_ * (double)(1 << 12) / 3.3;
+    return (uint32_t)std::clamp(lround(adcval), 0L, (long)(1 << 12) - 1);
+}
+
+static std::optional<Iph_ABC_t> sample_currents(Motor& motor, SimGateDriver& opamp, MotorModel& model) {
+    if (!opamp.is_ready()) {
+        return std::nullopt;
+    }
+
+    double i_a, i_b, i_c;
+    model.get_phase_currents(&i_a, &i_b, &i_c);
+    std::optional<float> phB = motor.phase_current_from_adcval(adcval_from_current(motor, opamp, i_b));
+    std::optional<float> phC = motor.phase_current_from_adcval(adcval_from_current(motor, opamp, i_c));
+    if (phB.has_value() && phC.has_value()) {
+        return Iph_ABC_t{-*phB - *phC, *phB, *phC};
+    }
+    return std::nullopt;
+}
+
+static void sample_encoder(TIM_TypeDef* tim, Encoder& encoder, MotorModel& model) {
+    double counts = model.theta_ / (2.0 * M_PI) * (double)encoder.config_.cpr;
+    tim->CNT = (uint16_t)(int64_t)floor(counts);
+}
+
+/**
+ * @brief Runs one iteration of the control loop and advances the motor models
+ * by one control period.
+ *
+ * This is the equivalent of the TIM8_UP_TIM13_IRQHandler and
+ * ControlLoop_IRQHandler of ODrive v3.
+ */
+static void run_tick() {
+    vbus_sense_adc_cb((uint32_t)lround(sim_supply_voltage / (3.3f * VBUS_S_DIVIDER_RATIO) * 4096.0f));
+    sample_encoder(TIM3, encoders[0], sim_motors[0]);
+    sample_encoder(TIM4, encoders[1], sim_motors[1]);
+
+    timestamp_ += TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1);
+    uint32_t timestamp = timestamp_;
+
+    TaskTimer::enabled = odrv.task_timers_armed_;
+    if (TaskTimer::enabled) {
+        tim13_reload_time = std::chrono::steady_clock::now();
+    }
+    odrv.sampling_cb();
+
+    std::optional<Iph_ABC_t> current0 = sample_currents(motors[0], m0_gate_driver, sim_motors[0]);
+    std::optional<Iph_ABC_t> current1 = sample_currents(motors[1], m1_gate_driver, sim_motors[1]);
+
+    // Same as on hardware: if the FETs are not switching we can't measure the
+    // current.
+    if (!(TIM1->BDTR & TIM_BDTR_MOE_Msk)) {
+        current0 = {0.0f, 0.0f, 0.0f};
+    }
+    if (!(TIM8->BDTR & TIM_BDTR_MOE_Msk)) {
+        current1 = {0.0f, 0.0f, 0.0f};
+    }
+
+    motors[0].current_meas_cb(timestamp - TIM1_INIT_COUNT, current0);
+    motors[1].current_meas_cb(timestamp, current1);
+
+    odrv.control_loop_cb(timestamp);
+
+    // The DC calibration measurement is taken in the zero vector where no
+    // current flows through the shunts. The simulated amplifiers have no offset.
+    MEASURE_TIME(odrv.task_times_.dc_calib_wait) {}
+    std::optional<Iph_ABC_t> zero0 = m0_gate_driver.is_ready() ? std::make_optional(Iph_ABC_t{0.0f, 0.0f, 0.0f}) : std::nullopt;
+    std::optional<Iph_ABC_t> zero1 = m1_gate_driver.is_ready() ? std::make_optional(Iph_ABC_t{0.0f, 0.0f, 0.0f}) : std::nullopt;
+
+    motors[0].dc_calib_cb(timestamp + TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1) - TIM1_INIT_COUNT, zero0);
+    motors[1].dc_calib_cb(timestamp + TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1), zero1);
+
+    motors[0].pwm_update_cb(timestamp + 3 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1) - TIM1_INIT_COUNT);
+    motors[1].pwm_update_cb(timestamp + 3 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1));
+
+    odrv.task_timers_armed_ = odrv.task_timers_armed_ && !TaskTimer::enabled;
+    TaskTimer::enabled = false;
+
+    timestamp_ += TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1);
+
+    // Advance the motor models with the voltages that were latched in the
+    // previous iteration, then latch the new PWM timings.
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        TIM_TypeDef* tim = motors[i].timer_->Instance;
+        sim_motors[i].step(CURRENT_MEAS_PERIOD, phase_voltages[i].alpha, phase_voltages[i].beta, phase_voltages[i].floating);
+
+        // Timer update event: the Automatic Output Enable sets the Master
+        // Output Enable.
+        if (tim->BDTR & TIM_BDTR_AOE) {
+            tim->BDTR |= TIM_BDTR_MOE;
+        }
+        phase_voltages[i] = get_phase_voltages(tim);
+    }
+
+    sim_tick_count++;
+}
+
+void sim_run_ticks(uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        if (timers_running) {
+            run_tick();
+        } else {
+            sim_tick_count++;
+        }
+    }
+}
+
+bool sim_apply_config() {
+    bool success = odrv.can_.apply_config();
+    for (size_t i = 0; (i < AXIS_COUNT) && success; ++i) {
+        success = encoders[i].apply_config(motors[i].config_.motor_type)
+               && axes[i].controller_.apply_config()
+               && axes[i].min_endstop_.apply_config()
+               && axes[i].max_endstop_.apply_config()
+               && motors[i].apply_config()
+               && motors[i].motor_thermistor_.apply_config()
+               && axes[i].apply_config();
+    }
+    return success;
+}
+
+void sim_start() {
+    system_init();
+
+    // Same as config_clear_all() in main.cpp
+    odrv.config_ = {};
+    odrv.can_.config_ = {};
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        encoders[i].config_ = {};
+        axes[i].sensorless_estimator_.config_ = {};
+        axes[i].controller_.config_ = {};
+        axes[i].controller_.config_.load_encoder_axis = i;
+        axes[i].trap_traj_.config_ = {};
+        axes[i].min_endstop_.config_ = {};
+        axes[i].max_endstop_.config_ = {};
+        axes[i].mechanical_brake_.config_ = {};
+        motors[i].config_ = {};
+        motors[i].fet_thermistor_.config_ = {};
+        motors[i].motor_thermistor_.config_ = {};
+        axes[i].clear_config();
+    }
+    sim_apply_config();
+
+    board_init();
+
+    adc_measurements_[fet_thermistors[0].adc_channel_] = kFetThermistorAdcValue;
+    adc_measurements_[fet_thermistors[1].adc_channel_] = kFetThermistorAdcValue;
+
+    // Remainder of rtos_main() in main.cpp
+    for (auto& axis: axes) {
+        axis.motor_.setup();
+    }
+
+    for (auto& axis: axes) {
+        axis.encoder_.setup();
+    }
+
+    for (auto& axis: axes) {
+        axis.acim_estimator_.idq_src_.connect_to(&axis.motor_.Idq_setpoint_);
+    }
+
+    odrv.build_component_graph();
+    odrv.update_component_graph();
+
+    start_adc_pwm();
+
+    for (size_t i = 0; i < 2000; ++i) {
+        bool motors_ready = std::all_of(axes.begin(), axes.end(), [](auto& axis) {
+            return axis.motor_.current_meas_.has_value();
+        });
+        if (motors_ready) {
+            break;
+        }
+        osDelay(1);
+    }
+
+    for (auto& axis: axes) {
+        axis.sensorless_estimator_.error_ &= ~SensorlessEstimator::ERROR_UNKNOWN_CURRENT_MEASUREMENT;
+    }
+
+    // The axis threads are not started. Instead the caller invokes the state
+    // handlers directly, so we take the place of the state machine and leave
+    // the axes in idle state.
+    for (auto& axis: axes) {
+        axis.requested_state_ = Axis::AXIS_STATE_UNDEFINED;
+        axis.current_state_ = Axis::AXIS_STATE_IDLE;
+    }
+
+    odrv.system_stats_.fully_booted = true;
+}
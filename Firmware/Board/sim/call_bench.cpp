@@ -0,0 +1,232 @@
+/*
+* @brief Host benchmark for the function call path of libfibre.
+*
+* Connects a Fibre client to a simulated device through an in-memory loopback
+* transport and reads a property with libfibre_call() over and over, first one
+* call at a time and then with several calls in flight. Reports the calls per
+* second and the heap allocations per call, which are counted through the
+* global operator new (see alloc_counter.hpp).
+*
+* Usage: fibre_call_bench [number of calls]
+*/
+
+#include <fibre/libfibre.h>
+#include <fibre/../../legacy_protocol.hpp>
+#include <fibre/../../legacy_object_client.hpp>
+#include <fibre/simple_serdes.hpp>
+#include <autogen/interface_json.hpp>
+#include "alloc_counter.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace fibre;
+
+// Device end of a packet based connection. It answers the requests in the
+// order in which they arrive: JSON reads on endpoint 0 with the interface JSON
+// and all other endpoint operations with zeros. Completions are deferred to
+// poll() so that the protocol never sees them from within start_read() or
+// start_write().
+struct LoopbackDevice : AsyncStreamSource, AsyncStreamSink {
+    void start_write(cbufptr_t buffer, TransferHandle* handle, Callback<void, WriteResult> completer) final {
+        *handle = 1;
+        handle_request(buffer);
+        write_end_ = buffer.end();
+        write_completer_ = completer;
+    }
+
+    void cancel_write(TransferHandle transfer_handle) final {}
+
+    void start_read(bufptr_t buffer, TransferHandle* handle, Callback<void, ReadResult> completer) final {
+        *handle = 1;
+        read_buf_ = buffer;
+        read_completer_ = completer;
+    }
+
+    void cancel_read(TransferHandle transfer_handle) final {}
+
+    // Completes the pending operations. Returns false if there was nothing to do.
+    bool poll() {
+        bool progress = false;
+        if (write_completer_) {
+            write_completer_.invoke_and_clear({kStreamOk, write_end_});
+            progress = true;
+        }
+        if (read_completer_ && n_responses_) {
+            size_t n_copy = std::min(response_lengths_[head_], read_buf_.size());
+            memcpy(read_buf_.begin(), responses_[head_], n_copy);
+            head_ = (head_ + 1) % kMaxResponses;
+            n_responses_--;
+            read_completer_.invoke_and_clear({kStreamOk, read_buf_.begin() + n_copy});
+            progress = true;
+        }
+        return progress;
+    }
+
+private:
+    static constexpr size_t kMaxResponses = 8;
+
+    void handle_request(cbufptr_t request) {
+        if (request.size() < 8 || n_responses_ >= kMaxResponses) {
+            return;
+        }
+        uint16_t seqno = *read_le<uint16_t>(&request);
+        uint16_t endpoint_id = *read_le<uint16_t>(&request) & 0x7fff;
+        uint16_t expected_length = *read_le<uint16_t>(&request);
+        cbufptr_t payload = request.take(request.size() - 2);
+
+        uint8_t* response = responses_[(head_ + n_responses_) % kMaxResponses];
+        write_le<uint16_t>(seqno | 0x8000, response);
+        size_t length = std::min((size_t)expected_length, sizeof(responses_[0]) - 2);
+
+        if (endpoint_id == 0) {
+            uint32_t offset = 0;
+            read_le<uint32_t>(&offset, payload.begin());
+            if (offset == 0xffffffff) {
+                length = 0; // no JSON version ID, so that the JSON cache is not used
+            } else if (offset == 0xfffffffe) {
+                write_le<uint32_t>(FIBRE_LEGACY_WINDOW_SIZE, response + 2);
+            } else {
+                length = std::min(length, interface_json_length - std::min((size_t)offset, interface_json_length));
+                memcpy(response + 2, interface_json + offset, length);
+            }
+        } else {
+            memset(response + 2, 0, length);
+        }
+
+        response_lengths_[(head_ + n_responses_) % kMaxResponses] = 2 + length;
+        n_responses_++;
+    }
+
+    const uint8_t* write_end_ = nullptr;
+    Callback<void, WriteResult> write_completer_;
+    bufptr_t read_buf_;
+    Callback<void, ReadResult> read_completer_;
+    uint8_t responses_[kMaxResponses][128];
+    size_t response_lengths_[kMaxResponses];
+    size_t head_ = 0;
+    size_t n_responses_ = 0;
+};
+
+struct PendingCall {
+    LibFibreCallContext* handle;
+    uintptr_t obj;
+    float value;
+    bool done;
+    LibFibreStatus status;
+};
+
+static LibFibreStatus on_call_completed(void* ctx, LibFibreStatus status,
+        const unsigned char* tx_end, unsigned char* rx_end,
+        const unsigned char** tx_buf, size_t* tx_len,
+        unsigned char** rx_buf, size_t* rx_len) {
+    PendingCall* call = reinterpret_cast<PendingCall*>(ctx);
+    call->done = true;
+    call->status = status;
+    return ::kFibreBusy;
+}
+
+// Starts a property read like pyfibre does: the object reference is the only
+// input and the application asks libfibre to close the call once the output
+// was received.
+static void start_call(LibFibreFunction* func, PendingCall* call) {
+    const unsigned char* tx_end;
+    unsigned char* rx_end;
+    call->handle = nullptr;
+    call->done = false;
+    LibFibreStatus status = libfibre_call(func, &call->handle, ::kFibreClosed,
+            reinterpret_cast<const unsigned char*>(&call->obj), sizeof(call->obj),
+            reinterpret_cast<unsigned char*>(&call->value), sizeof(call->value),
+            &tx_end, &rx_end, on_call_completed, call);
+    if (status != ::kFibreBusy) {
+        call->done = true;
+        call->status = status;
+    }
+}
+
+// Runs n_calls calls with up to n_parallel calls in flight. Returns false if
+// a call failed.
+static bool run_calls(LoopbackDevice& device, LibFibreFunction* func, uintptr_t obj, size_t n_calls, size_t n_parallel) {
+    PendingCall calls[FIBRE_LEGACY_WINDOW_SIZE];
+    size_t n_started = 0;
+    size_t n_finished = 0;
+
+    for (size_t i = 0; i < n_parallel; ++i) {
+        calls[i].obj = obj;
+        start_call(func, &calls[i]);
+        n_started++;
+    }
+
+    while (n_finished < n_calls) {
+        device.poll();
+        for (size_t i = 0; i < n_parallel; ++i) {
+            if (!calls[i].done) {
+                continue;
+            }
+            if (calls[i].status != ::kFibreClosed) {
+                printf("call failed with %d\n", calls[i].status);
+                return false;
+            }
+            n_finished++;
+            if (n_started < n_calls) {
+                start_call(func, &calls[i]);
+                n_started++;
+            } else {
+                calls[i].done = false;
+            }
+        }
+    }
+    return true;
+}
+
+static void on_found_root_object(void* ctx, LegacyObjectClient* client, std::shared_ptr<LegacyObject> obj) {
+    *reinterpret_cast<LegacyObject**>(ctx) = obj.get();
+}
+
+static void on_lost_root_object(void* ctx, LegacyObjectClient* client, std::shared_ptr<LegacyObject> obj) {}
+
+static void on_stopped(void* ctx, LegacyProtocolPacketBased* protocol, StreamStatus status) {}
+
+int main(int argc, const char** argv) {
+    size_t n_bench = argc >= 2 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+    LoopbackDevice device;
+    LegacyProtocolPacketBased protocol{&device, &device, 64};
+    LegacyObject* root = nullptr;
+    protocol.start({on_found_root_object, &root}, {on_lost_root_object, nullptr}, {on_stopped, nullptr});
+    while (device.poll()) {
+    }
+    if (!root) {
+        printf("failed to connect to the loopback device\n");
+        return 1;
+    }
+
+    auto attr = root->intf->attributes.find("vbus_voltage");
+    if (attr == root->intf->attributes.end()) {
+        printf("vbus_voltage not found\n");
+        return 1;
+    }
+    LegacyObject* prop = attr->second.object.get();
+    LibFibreFunction* func = reinterpret_cast<LibFibreFunction*>(static_cast<Function*>(&prop->intf->functions.at("read")));
+    uintptr_t obj = reinterpret_cast<uintptr_t>(prop);
+
+    for (size_t n_parallel: {(size_t)1, (size_t)FIBRE_LEGACY_WINDOW_SIZE}) {
+        // Warm up
+        if (!run_calls(device, func, obj, 100, n_parallel)) {
+            return 1;
+        }
+
+        size_t allocs_before = alloc_counter.n_allocs;
+        auto start = std::chrono::steady_clock::now();
+        if (!run_calls(device, func, obj, n_bench, n_parallel)) {
+            return 1;
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%zu call(s) in flight: %.0f calls/s, %.2f allocations per call (host)\n",
+               n_parallel, n_bench / elapsed, (double)(alloc_counter.n_allocs - allocs_before) / n_bench);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+* @brief Host benchmark for the interface JSON parser of the Fibre client.
+*
+* Builds the object tree of the real ODrive interface JSON (as the client does
+* when it connects to a device) and reports the time and heap usage per
+* connection. Heap usage is measured by counting the allocations that go
+* through the global operator new (see alloc_counter.hpp).
+*
+* Usage: fibre_json_bench [number of iterations]
+*/
+
+#include <fibre/../../legacy_object_client.hpp>
+#include <autogen/interface_json.hpp>
+#include "alloc_counter.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace fibre;
+
+int main(int argc, const char** argv) {
+    uint32_t n_bench = argc >= 2 ? strtoul(argv[1], nullptr, 10) : 200;
+    cbufptr_t json = {interface_json, interface_json + interface_json_length};
+
+    // Memory usage of a single connection
+    size_t live_before = alloc_counter.live_bytes;
+    size_t allocs_before = alloc_counter.n_allocs;
+    alloc_counter.peak_bytes = alloc_counter.live_bytes;
+    size_t n_objects;
+    size_t retained_bytes;
+    {
+        LegacyObjectClient client{nullptr};
+        if (!client.load_json(json)) {
+            printf("failed to load the interface JSON\n");
+            return 1;
+        }
+        n_objects = client.objects_.size();
+        retained_bytes = alloc_counter.live_bytes - live_before;
+    }
+    size_t n_allocs_per_load = alloc_counter.n_allocs - allocs_before;
+    size_t peak_per_load = alloc_counter.peak_bytes - live_before;
+    if (alloc_counter.live_bytes != live_before) {
+        printf("leaked %zu bytes\n", alloc_counter.live_bytes - live_before);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n_bench; ++i) {
+        LegacyObjectClient client{nullptr};
+        if (!client.load_json(json)) {
+            return 1;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("interface JSON: %zu bytes, %zu objects\n", interface_json_length, n_objects);
+    printf("load: %.1f us, %zu allocations, peak heap %.1f kB, retained %.1f kB (host)\n",
+           elapsed / n_bench * 1e6, n_allocs_per_load, peak_per_load / 1024.0, retained_bytes / 1024.0);
+    return 0;
+}
@@ -0,0 +1,750 @@
+/*
+* @brief Entry point of the software-in-the-loop simulation.
+*
+* Calibrates axis 0 against the simulated motor, performs a position step and
+* planned moves in closed loop control and then measures how fast the control
+* loop runs on the host. Finally it provokes a fault to check the flight
+* recorder.
+*
+* Usage: odrive_sil [number of benchmark iterations]
+*/
+
+#include <odrive_main.h>
+#include <autogen/type_info.hpp>
+#include "sim_board.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static void print_state(Axis& axis) {
+    printf("%8.4f s  pos %8.4f turns  vel %8.3f turns/s  Iq %7.3f A\n",
+           sim_time(),
+           axis.encoder_.pos_estimate_.any().value_or(NAN),
+           axis.encoder_.vel_estimate_.any().value_or(NAN),
+           axis.motor_.current_control_.Iq_measured_);
+}
+
+static bool check_errors(Axis& axis, const char* step) {
+    if (!odrv.any_error()) {
+        return true;
+    }
+    printf("%s failed: axis 0x%x, motor 0x%llx, encoder 0x%x, controller 0x%x, odrive 0x%llx\n",
+           step, (unsigned)axis.error_, (unsigned long long)axis.motor_.error_,
+           (unsigned)axis.encoder_.error_, (unsigned)axis.controller_.error_,
+           (unsigned long long)odrv.error_);
+    return false;
+}
+
+/**
+ * @brief Adds a synthetic cogging torque to the simulated motor, runs the
+ * continuous-sweep anticogging calibration and compares the resulting map
+ * against the synthetic profile.
+ */
+static bool run_anticogging_test(Axis& axis) {
+    MotorModel& motor = sim_motors[0];
+    motor.config_.cogging[0] = {84, 0.005, 0.0}; // LCM of 12 slots and 14 poles
+    motor.config_.cogging[1] = {12, 0.004, 1.0};
+    motor.config_.cogging[2] = {7, 0.002, 2.0};
+
+    axis.controller_.config_.anticogging.calib_sweep_vel = 0.1f;
+    axis.controller_.start_anticogging_calibration();
+    double start_time = sim_time();
+    while (axis.controller_.config_.anticogging.calib_anticogging && sim_time() - start_time < 60.0) {
+        sim_run_ticks(current_meas_hz / 10);
+    }
+    if (!check_errors(axis, "anticogging calibration")) {
+        return false;
+    }
+    if (axis.controller_.config_.anticogging.calib_anticogging) {
+        printf("anticogging calibration did not finish\n");
+        return false;
+    }
+    axis.controller_.remove_anticogging_bias();
+
+    // The encoder count is not necessarily zero at theta = 0
+    float pos_offset = axis.encoder_.pos_estimate_.any().value_or(NAN) - (float)(motor.theta_ / (2.0 * M_PI));
+
+    double sum_sq_err = 0.0;
+    double sum_sq_ref = 0.0;
+    for (size_t i = 0; i < 3600; ++i) {
+        double theta = 2.0 * M_PI * (((double)i + 0.5) * axis.encoder_.getCoggingRatio() - pos_offset);
+        double ref = motor.cogging_torque(theta);
+        double err = axis.controller_.config_.anticogging.cogging_map[i] - ref;
+        sum_sq_err += err * err;
+        sum_sq_ref += ref * ref;
+    }
+    double rel_err = sqrt(sum_sq_err / sum_sq_ref);
+    printf("anticogging calibration took %.1f s, RMS error %.2e Nm (%.1f%% of the cogging torque)\n",
+           sim_time() - start_time, sqrt(sum_sq_err / 3600), rel_err * 100.0);
+    if (rel_err > 0.15) {
+        printf("anticogging calibration is inaccurate\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Moves the axis with the trapezoidal and the S-curve planner and
+ * compares the position tracking error.
+ */
+static bool run_trajectory_test(Axis& axis) {
+    axis.trap_traj_.config_.vel_limit = 5.0f;
+    axis.trap_traj_.config_.accel_limit = 50.0f;
+    axis.trap_traj_.config_.decel_limit = 50.0f;
+    axis.trap_traj_.config_.jerk_limit = 1000.0f;
+
+    for (auto input_mode: {Controller::INPUT_MODE_TRAP_TRAJ, Controller::INPUT_MODE_SCURVE_TRAJ}) {
+        axis.controller_.config_.input_mode = input_mode;
+        float target_pos = axis.controller_.pos_setpoint_ + 2.0f;
+        axis.controller_.set_input_pos(target_pos);
+        while (axis.controller_.input_pos_updated_) {
+            sim_run_ticks(1); // the controller may not run on every tick
+        }
+
+        float max_error = 0.0f;
+        double start_time = sim_time();
+        do {
+            sim_run_ticks(1);
+            float pos_estimate = axis.encoder_.pos_estimate_.any().value_or(NAN);
+            max_error = std::max(max_error, std::abs(axis.controller_.pos_setpoint_ - pos_estimate));
+        } while (!axis.controller_.trajectory_done_ && sim_time() - start_time < 5.0);
+        double duration = sim_time() - start_time;
+        sim_run_ticks(current_meas_hz / 10);
+
+        const char* name = input_mode == Controller::INPUT_MODE_TRAP_TRAJ ? "trapezoidal" : "S-curve";
+        if (!check_errors(axis, name)) {
+            return false;
+        }
+        if (!axis.controller_.trajectory_done_) {
+            printf("%s move did not finish\n", name);
+            return false;
+        }
+        float final_error = target_pos - axis.encoder_.pos_estimate_.any().value_or(NAN);
+        printf("%s move took %.3f s, max tracking error %.5f turns, final error %.5f turns\n",
+               name, duration, max_error, final_error);
+        if (std::abs(final_error) > 0.01f) {
+            return false;
+        }
+    }
+
+    axis.controller_.config_.input_mode = Controller::INPUT_MODE_PASSTHROUGH;
+    return true;
+}
+
+/**
+ * @brief Moves both axes with move_coordinated() and checks that the setpoints
+ * follow a straight line and arrive together. Only axis0 is in closed loop.
+ */
+static bool run_coordinated_move_test() {
+    Axis& axis0 = axes[0];
+    Axis& axis1 = axes[1];
+    axis1.trap_traj_.config_.vel_limit = 5.0f;
+    axis1.trap_traj_.config_.accel_limit = 10.0f; // this makes axis1 the slower axis
+    axis1.trap_traj_.config_.decel_limit = 10.0f;
+    axis0.controller_.config_.input_mode = Controller::INPUT_MODE_TRAP_TRAJ;
+    axis1.controller_.config_.input_mode = Controller::INPUT_MODE_TRAP_TRAJ;
+
+    float start[] = {axis0.controller_.pos_setpoint_, axis1.controller_.pos_setpoint_};
+    float goal[] = {start[0] + 2.0f, start[1] - 1.0f};
+    if (!odrv.move_coordinated(goal[0], goal[1])) {
+        printf("move_coordinated() failed\n");
+        return false;
+    }
+
+    float max_path_error = 0.0f;
+    double start_time = sim_time();
+    do {
+        sim_run_ticks(1);
+        float p0 = (axis0.controller_.pos_setpoint_ - start[0]) / (goal[0] - start[0]);
+        float p1 = (axis1.controller_.pos_setpoint_ - start[1]) / (goal[1] - start[1]);
+        max_path_error = std::max(max_path_error, std::abs(p0 - p1));
+        if (axis0.controller_.trajectory_done_ != axis1.controller_.trajectory_done_) {
+            printf("coordinated move: axes finished at different times\n");
+            return false;
+        }
+    } while (!axis0.controller_.trajectory_done_ && sim_time() - start_time < 5.0);
+    double duration = sim_time() - start_time;
+    sim_run_ticks(current_meas_hz / 10);
+
+    TrapezoidalTrajectory single;
+    single.planTrapezoidal(goal[1], start[1], 0.0f, 5.0f, 10.0f, 10.0f);
+    float final_error = goal[0] - axis0.encoder_.pos_estimate_.any().value_or(NAN);
+    printf("coordinated move took %.3f s (axis1 alone: %.3f s), max path deviation %.2e, final error %.5f turns\n",
+           duration, single.Tf_, max_path_error, final_error);
+
+    axis0.controller_.config_.input_mode = Controller::INPUT_MODE_PASSTHROUGH;
+    axis1.controller_.config_.input_mode = Controller::INPUT_MODE_PASSTHROUGH;
+    return check_errors(axis0, "coordinated move") && axis0.controller_.trajectory_done_
+        && max_path_error < 1e-4f && std::abs(final_error) < 0.01f;
+}
+
+/**
+ * @brief Provokes a current limit violation with a position step and checks
+ * that the flight recorder froze with the history up to the fault.
+ * This leaves the axis disarmed.
+ */
+static bool run_flight_recorder_test(Axis& axis) {
+    FlightRecorder& recorder = axis.flight_recorder_;
+    if (recorder.frozen_ || recorder.n_samples_ != recorder.depth_) {
+        printf("flight recorder is not recording\n");
+        return false;
+    }
+
+    axis.motor_.config_.current_lim_margin = 1.0f - axis.motor_.effective_current_lim_; // trip at 1 A
+    axis.controller_.set_input_pos(axis.controller_.input_pos_ + 1.0f);
+    sim_run_ticks(current_meas_hz / 10);
+    sim_run_ticks(current_meas_hz / 10); // the recording must not change anymore
+    axis.motor_.config_.current_lim_margin = 8.0f;
+
+    const uint32_t period = 2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1);
+    bool timestamps_ok = true;
+    for (uint32_t i = 1; i < recorder.n_samples_; ++i) {
+        timestamps_ok = timestamps_ok && (recorder.get_timestamp(i) - recorder.get_timestamp(i - 1) == period);
+    }
+    // The step saturates the current setpoint right before the trip
+    uint32_t last = recorder.n_samples_ - 1;
+    float Iq_setpoint = recorder.get_sample(FlightRecorder::CHANNEL_IQ_SETPOINT, last);
+    printf("flight recorder: frozen %d, axis error 0x%x, motor error 0x%llx, last Iq setpoint %.2f A, recorded %.4f s\n",
+           recorder.frozen_, (unsigned)recorder.axis_error_, (unsigned long long)recorder.motor_error_, Iq_setpoint,
+           (float)(recorder.get_timestamp(last) - recorder.get_timestamp(0)) / TIM_1_8_CLOCK_HZ);
+
+    bool ok = recorder.frozen_ && recorder.n_samples_ == recorder.depth_ && timestamps_ok
+        && (recorder.motor_error_ & Motor::ERROR_CURRENT_LIMIT_VIOLATION)
+        && (recorder.axis_error_ & Axis::ERROR_MOTOR_FAILED)
+        && Iq_setpoint > 1.0f && !axis.motor_.is_armed_;
+    odrv.clear_errors();
+    return ok;
+}
+
+/**
+ * @brief Measures how fast the ASCII protocol resolves property paths.
+ */
+static bool run_lookup_benchmark(uint32_t n_bench) {
+    static const char* paths[] = {
+        "vbus_voltage",
+        "axis0.requested_state",
+        "axis0.controller.input_pos",
+        "axis0.controller.config.vel_limit",
+        "axis0.controller.config.anticogging.calib_sweep_vel",
+        "axis0.motor.config.current_lim",
+        "axis1.encoder.config.cpr",
+        "config.dc_max_negative_current",
+        "can.config.baud_rate",
+        "axis1.trap_traj.config.accel_limit",
+    };
+    Introspectable root = ODrive3TypeInfo<ODrive>::make_introspectable(odrv);
+
+    for (const char* path: paths) {
+        if (!root.get_child(path, strlen(path)).is_valid()) {
+            printf("failed to resolve %s\n", path);
+            return false;
+        }
+    }
+    for (const char* path: {"axis0.controller.config.vel_limi", "axis0.controller.config.vel_limit_", "axis2", "axis0..motor"}) {
+        if (root.get_child(path, strlen(path)).is_valid()) {
+            printf("resolved invalid path %s\n", path);
+            return false;
+        }
+    }
+
+    size_t n_valid = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n_bench; ++i) {
+        const char* path = paths[i % (sizeof(paths) / sizeof(paths[0]))];
+        n_valid += root.get_child(path, strlen(path)).is_valid();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double elapsed = std::chrono::duration<double>(end - start).count();
+    printf("%zu property lookups in %.3f s: %.0f lookups/s\n", n_valid, elapsed, n_bench / elapsed);
+    return true;
+}
+
+/**
+ * @brief Checks the fast sine/cosine functions against libm and measures how
+ * long they take on the host.
+ */
+static bool run_sincos_benchmark(uint32_t n_bench) {
+    // Accuracy over several periods, including the wrap-around points
+    const uint32_t n_check = 1000000;
+    double max_err = 0.0, max_diff = 0.0, max_advance_err = 0.0;
+    for (uint32_t i = 0; i <= n_check; ++i) {
+        float x = -4.0f * M_PI + (8.0f * M_PI) * (float)i / (float)n_check;
+        float s, c;
+        our_arm_sincos_f32(x, &s, &c);
+        max_err = std::max({max_err, std::abs(s - sin((double)x)), std::abs(c - cos((double)x))});
+        max_diff = std::max({max_diff, (double)std::abs(s - our_arm_sin_f32(x)), (double)std::abs(c - our_arm_cos_f32(x))});
+
+        // Rotation by the phase advance between current measurement and PWM
+        // update in the FOC
+        float dx = -0.5f + (float)(i % 1001) / 1000.0f;
+        float s_adv, c_adv;
+        sincos_advance(x, s, c, dx, &s_adv, &c_adv);
+        double x_adv = (double)x + (double)dx;
+        max_advance_err = std::max({max_advance_err, std::abs(s_adv - sin(x_adv)), std::abs(c_adv - cos(x_adv))});
+    }
+    printf("sincos max error %.2e (separate sin/cos: max difference %.2e), advanced by up to 0.5 rad: max error %.2e\n",
+           max_err, max_diff, max_advance_err);
+
+    // Timing
+    auto bench = [&](auto fn) {
+        float acc = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < n_bench; ++i) {
+            float x = (float)(i & 0xfff) * 0.00613f - 12.0f;
+            float s, c;
+            fn(x, &s, &c);
+            acc += s + c;
+        }
+        auto end = std::chrono::steady_clock::now();
+        volatile float sink = acc;
+        (void)sink;
+        return std::chrono::duration<double>(end - start).count() * 1e9 / n_bench;
+    };
+    double t_separate = bench([](float x, float* s, float* c) { *s = our_arm_sin_f32(x); *c = our_arm_cos_f32(x); });
+    double t_fused = bench([](float x, float* s, float* c) { our_arm_sincos_f32(x, s, c); });
+    double t_advance = bench([](float x, float* s, float* c) { sincos_advance(x, 0.6f, 0.8f, 0.01f * x, s, c); });
+    double t_libm = bench([](float x, float* s, float* c) { sincosf(x, s, c); });
+    printf("sin + cos: %.1f ns, sincos: %.1f ns, sincos_advance: %.1f ns, libm sincosf: %.1f ns (host)\n",
+           t_separate, t_fused, t_advance, t_libm);
+
+    return max_err < 2e-5 && max_diff < 1e-6 && max_advance_err < 4e-5;
+}
+
+/**
+ * @brief CAN bus that emulates the filter banks of the bxCAN peripheral and
+ * counts the sent frames.
+ *
+ * Each subscription takes the first free bank. A received frame goes to the
+ * first active bank whose filter matches, and the bus reports the filter match
+ * index like the hardware does. The frame is dispatched through the same
+ * CanFilterMap as in ODriveCAN.
+ */
+class FakeCanBus : public CanBusBase {
+public:
+    bool send_message(const can_Message_t& message) final {
+        n_sent_++;
+        if (sent_) {
+            sent_->push_back(message);
+        }
+        return true;
+    }
+
+    bool subscribe(const MsgIdFilterSpecs& filter, on_can_message_cb_t callback, void* ctx, CanSubscription** handle) final {
+        for (auto& s : banks_) {
+            if (s.fifo == kCanFifoNone) {
+                s.filter = filter;
+                s.callback = callback;
+                s.ctx = ctx;
+                s.fifo = CAN_RX_FIFO0;
+                s.bank_fifo = s.fifo;
+                filter_map_.update(banks_);
+                if (handle) {
+                    *handle = &s;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool unsubscribe(CanSubscription* handle) final {
+        static_cast<Bank*>(handle)->fifo = kCanFifoNone;
+        filter_map_.update(banks_);
+        return true;
+    }
+
+    // Returns false if the frame was dropped by the filters
+    bool receive(const can_Message_t& msg) {
+        uint32_t filter_match_index[2] = {0, 0};
+        for (auto& s : banks_) {
+            uint32_t index = filter_match_index[s.bank_fifo]++;
+            if (s.fifo == kCanFifoNone) {
+                continue;
+            }
+            bool is_extended = s.filter.id.index() == 1;
+            uint32_t id = is_extended ? std::get<1>(s.filter.id) : std::get<0>(s.filter.id);
+            uint32_t id_mask = is_extended ? 0x1fffffff : 0x7ff;
+            if ((msg.isExt == is_extended) && !((msg.id ^ id) & s.filter.mask & id_mask)) {
+                Bank* bank = filter_map_.get(s.fifo, index);
+                if (bank) {
+                    bank->callback(bank->ctx, msg);
+                }
+                return bank != nullptr;
+            }
+        }
+        return false;
+    }
+
+    size_t n_sent_ = 0;
+    std::vector<can_Message_t>* sent_ = nullptr; // if set, sent frames are appended here
+
+private:
+    struct Bank : CanSubscription {
+        uint8_t fifo = kCanFifoNone;
+        uint8_t bank_fifo = CAN_RX_FIFO0;
+        MsgIdFilterSpecs filter;
+        on_can_message_cb_t callback;
+        void* ctx;
+    };
+    std::array<Bank, 8> banks_ = {};
+    CanFilterMap<Bank, 8> filter_map_;
+};
+
+/**
+ * @brief Feeds a CAN Simple instance with frames at the rate of a fully loaded
+ * 1 Mbit/s bus and measures how long it takes to dispatch them on the host.
+ * Most frames are addressed to other nodes.
+ */
+static bool run_can_benchmark(uint32_t n_bench) {
+    FakeCanBus bus;
+    CANSimple can_simple{&bus};
+    if (!can_simple.init()) {
+        printf("CAN Simple init failed\n");
+        return false;
+    }
+
+    auto make_frame = [](uint32_t node_id, uint32_t cmd, bool rtr, float value) {
+        can_Message_t msg;
+        msg.id = (node_id << 5) | cmd;
+        msg.rtr = rtr;
+        msg.len = rtr ? 0 : 8;
+        can_setSignal(msg, value, 0, 32, true);
+        return msg;
+    };
+
+    // Dispatch to the right axis
+    float input_vel = axes[0].controller_.input_vel_;
+    bus.receive(make_frame(axes[1].config_.can.node_id, CANSimple::MSG_SET_INPUT_VEL, false, 0.5f));
+    bool dispatched = axes[1].controller_.input_vel_ == 0.5f && axes[0].controller_.input_vel_ == input_vel;
+    bus.receive(make_frame(axes[1].config_.can.node_id, CANSimple::MSG_SET_INPUT_VEL, false, 0.0f));
+    if (!dispatched) {
+        printf("CAN message was not dispatched to axis1\n");
+        return false;
+    }
+
+    const can_Message_t frames[] = {
+        make_frame(axes[0].config_.can.node_id, CANSimple::MSG_GET_ENCODER_ESTIMATES, true, 0.0f),
+        make_frame(axes[1].config_.can.node_id, CANSimple::MSG_GET_IQ, true, 0.0f),
+        make_frame(axes[1].config_.can.node_id, CANSimple::MSG_SET_INPUT_VEL, false, 0.0f),
+        make_frame(7, CANSimple::MSG_ODRIVE_HEARTBEAT, false, 0.0f),
+        make_frame(12, CANSimple::MSG_SET_INPUT_POS, false, 1.0f),
+        make_frame(13, CANSimple::MSG_GET_ENCODER_ESTIMATES, true, 0.0f),
+        make_frame(40, CANSimple::MSG_ODRIVE_HEARTBEAT, false, 0.0f),
+        make_frame(63, CANSimple::MSG_SET_INPUT_VEL, false, 2.0f),
+    };
+    const size_t n_frames = sizeof(frames) / sizeof(frames[0]);
+
+    size_t n_accepted = 0;
+    bus.n_sent_ = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n_bench; ++i) {
+        n_accepted += bus.receive(frames[i % n_frames]);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // Two of the three frames for this ODrive are requests
+    size_t n_expected = (n_bench / n_frames) * 3 + std::min<size_t>(n_bench % n_frames, 3);
+    size_t n_expected_sent = (n_bench / n_frames) * 2 + std::min<size_t>(n_bench % n_frames, 2);
+    if (n_accepted != n_expected || bus.n_sent_ != n_expected_sent) {
+        printf("CAN Simple accepted %zu frames (expected %zu) and sent %zu (expected %zu)\n",
+               n_accepted, n_expected, bus.n_sent_, n_expected_sent);
+        return false;
+    }
+
+    // An 8 byte standard frame takes at least 111 bit times
+    const double frame_time = 111e-6;
+    double ns_per_frame = std::chrono::duration<double>(end - start).count() * 1e9 / n_bench;
+    printf("CAN Simple: %.1f ns per received frame (host), %.3f%% of the frame time at 1 Mbit/s\n",
+           ns_per_frame, ns_per_frame * 1e-9 / frame_time * 100.0);
+    return true;
+}
+
+/**
+ * @brief Checks the packed telemetry message of CAN Simple: the configured
+ * rate, the frame length of the layout, the quantized values and the reply to
+ * a request.
+ */
+static bool run_can_telemetry_test(Axis& axis) {
+    FakeCanBus bus;
+    std::vector<can_Message_t> sent;
+    bus.sent_ = &sent;
+    CANSimple can_simple{&bus};
+    if (!can_simple.init()) {
+        printf("CAN Simple init failed\n");
+        return false;
+    }
+
+    const uint32_t id = (axis.config_.can.node_id << 5) | CANSimple::MSG_GET_PACKED_TELEMETRY;
+    auto& slots = axis.config_.can.packed_telemetry.slots;
+    constexpr size_t n_slots = sizeof(slots) / sizeof(slots[0]);
+    auto fields = [&]() {
+        std::array<can_TelemetryField_t, n_slots> fields;
+        for (size_t i = 0; i < n_slots; ++i) {
+            fields[i] = {slots[i].signal != Axis::TELEMETRY_SIGNAL_NONE ? slots[i].bits : (uint8_t)0, slots[i].scale};
+        }
+        return fields;
+    };
+
+    // Runs the simulation for the specified time and services CAN Simple every
+    // millisecond. Checks each packed telemetry frame against the values of
+    // the axis at the time it was sent.
+    auto run = [&](uint32_t duration_ms, size_t expected_len, size_t* n_frames) {
+        *n_frames = 0;
+        for (uint32_t i = 0; i < duration_ms; ++i) {
+            sim_run_ticks(current_meas_hz / 1000);
+            sent.clear();
+            can_simple.service_stack();
+            for (auto& msg: sent) {
+                if (msg.id != id) {
+                    continue;
+                }
+                (*n_frames)++;
+                auto f = fields();
+                float values[n_slots];
+                can_unpackTelemetry(msg, values, f.data(), n_slots);
+                float pos = axis.controller_.pos_estimate_linear_src_.any().value_or(0.0f);
+                float vel = axis.controller_.vel_estimate_src_.any().value_or(0.0f);
+                float iq = axis.motor_.current_control_.Iq_measured_;
+                if (msg.len != expected_len
+                        || std::abs(values[0] - pos) > slots[0].scale
+                        || std::abs(values[1] - vel) > slots[1].scale
+                        || std::abs(values[2] - iq) > slots[2].scale) {
+                    printf("packed telemetry frame: len %u (expected %zu), %f %f %f (expected %f %f %f)\n",
+                           msg.len, expected_len, values[0], values[1], values[2], pos, vel, iq);
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    Axis::CANPackedTelemetry_t default_layout = axis.config_.can.packed_telemetry;
+    size_t n_frames = 0;
+
+    // Disabled by default
+    if (!run(50, 0, &n_frames) || n_frames != 0) {
+        printf("packed telemetry was sent without being enabled\n");
+        return false;
+    }
+
+    // The default layout takes 64 bits
+    axis.config_.can.packed_telemetry_rate_ms = 5;
+    if (!run(100, 8, &n_frames)) {
+        return false;
+    }
+    if (n_frames < 19 || n_frames > 21) {
+        printf("%zu packed telemetry frames in 100 ms at 5 ms (expected 20)\n", n_frames);
+        return false;
+    }
+
+    // A shorter layout gives a shorter frame
+    slots[2].bits = 12;
+    slots[2].scale = 0.1f;
+    if (!run(20, 8, &n_frames)) {
+        return false;
+    }
+    slots[1].bits = 14;
+    slots[1].scale = 0.1f;
+    if (!run(20, 7, &n_frames)) {
+        return false;
+    }
+    slots[0].bits = 20;
+    slots[0].scale = 0.001f;
+    if (!run(20, 6, &n_frames) || n_frames < 3) {
+        return false;
+    }
+
+    // A request is answered right away, also when the rate is 0
+    axis.config_.can.packed_telemetry_rate_ms = 0;
+    can_Message_t request;
+    request.id = id;
+    request.rtr = true;
+    request.len = 0;
+    sent.clear();
+    bus.receive(request);
+    if (sent.size() != 1 || sent[0].id != id || sent[0].len != 6) {
+        printf("packed telemetry request was not answered\n");
+        return false;
+    }
+
+    axis.config_.can.packed_telemetry = default_layout;
+    printf("CAN packed telemetry: OK\n");
+    return true;
+}
+
+struct TimerStats {
+    const char* name;
+    TaskTimer* timer;
+    uint64_t sum = 0;
+};
+
+int main(int argc, char** argv) {
+    uint32_t n_bench = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+
+    sim_start();
+
+    Axis& axis = axes[0];
+
+    // ODrive D5065 motor (see MotorModel::Config_t) with a 8192 CPR encoder
+    axis.motor_.config_.pole_pairs = sim_motors[0].config_.pole_pairs;
+    axis.motor_.config_.torque_constant = (float)sim_motors[0].config_.torque_constant;
+    axis.motor_.config_.current_lim = 20.0f;
+    axis.encoder_.config_.cpr = 8192;
+    axis.controller_.config_.vel_limit = 20.0f;
+
+    // There's no brake resistor but the simulated power supply can sink current
+    odrv.config_.dc_max_negative_current = -INFINITY;
+
+    sim_apply_config();
+
+    if (!axis.motor_.run_calibration() || !check_errors(axis, "motor calibration")) {
+        return 1;
+    }
+    printf("phase resistance: %.4f Ohm (simulated: %.4f Ohm)\n",
+           axis.motor_.config_.phase_resistance, sim_motors[0].config_.phase_resistance);
+    printf("phase inductance: %.3e H (simulated: %.3e H)\n",
+           axis.motor_.config_.phase_inductance, sim_motors[0].config_.phase_inductance_q);
+
+    if (!axis.encoder_.run_offset_calibration() || !check_errors(axis, "encoder offset calibration")) {
+        return 1;
+    }
+    printf("encoder phase offset: %d + %.3f counts\n",
+           (int)axis.encoder_.config_.phase_offset, axis.encoder_.config_.phase_offset_float);
+
+    if (!axis.start_closed_loop_control() || !check_errors(axis, "closed loop control")) {
+        return 1;
+    }
+
+    // Position step of one turn
+    float target_pos = axis.encoder_.pos_estimate_.any().value_or(0.0f) + 1.0f;
+    axis.controller_.set_input_pos(target_pos);
+    for (size_t i = 0; i < 20; ++i) {
+        sim_run_ticks(current_meas_hz / 40); // 25ms
+        print_state(axis);
+    }
+    if (!check_errors(axis, "position step")) {
+        return 1;
+    }
+    printf("position error after step: %.5f turns\n",
+           target_pos - axis.encoder_.pos_estimate_.any().value_or(NAN));
+
+    if (!run_anticogging_test(axis)) {
+        return 1;
+    }
+
+    if (!run_trajectory_test(axis)) {
+        return 1;
+    }
+
+    // The same moves with the position/velocity controller at half the rate
+    // There is no background thread in the simulation to pick up the
+    // config change, so we resolve the component graph ourselves.
+    axis.controller_.config_.set_rate_divider(2);
+    odrv.update_component_graph();
+    printf("controller at %.0f Hz:\n", current_meas_hz / 2.0f);
+    if (!run_trajectory_test(axis)) {
+        return 1;
+    }
+    axis.controller_.config_.set_rate_divider(1);
+    odrv.update_component_graph();
+
+    if (!run_coordinated_move_test()) {
+        return 1;
+    }
+
+    if (!run_lookup_benchmark(n_bench)) {
+        return 1;
+    }
+
+    if (!run_sincos_benchmark(n_bench * 100)) {
+        return 1;
+    }
+
+    if (!run_can_benchmark(n_bench * 10)) {
+        return 1;
+    }
+
+    if (!run_can_telemetry_test(axis)) {
+        return 1;
+    }
+
+    // Benchmark the control loop while the axis holds its position
+    TimerStats stats[] = {
+        {"sampling", &odrv.task_times_.sampling},
+        {"control_loop_misc", &odrv.task_times_.control_loop_misc},
+        {"control_loop_checks", &odrv.task_times_.control_loop_checks},
+        {"axis0.encoder_update", &axis.task_times_.encoder_update},
+        {"axis0.controller_update", &axis.task_times_.controller_update},
+        {"axis0.motor_update", &axis.task_times_.motor_update},
+        {"axis0.current_controller_update", &axis.task_times_.current_controller_update},
+        {"axis0.current_sense", &axis.task_times_.current_sense},
+        {"axis0.dc_calib", &axis.task_times_.dc_calib},
+        {"axis0.pwm_update", &axis.task_times_.pwm_update},
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    sim_run_ticks(n_bench);
+    auto end = std::chrono::steady_clock::now();
+    if (!check_errors(axis, "benchmark")) {
+        return 1;
+    }
+
+    double elapsed = std::chrono::duration<double>(end - start).count();
+    printf("\n%u control loop iterations in %.3f s: %.0f iterations/s (%.1fx real time)\n",
+           n_bench, elapsed, n_bench / elapsed, n_bench * CURRENT_MEAS_PERIOD / elapsed);
+    printf("component graph: %zu of %zu components active, %zu output ports\n",
+           odrv.component_graph_.size(), odrv.component_graph_.n_components(), odrv.component_graph_.n_reset_ports());
+    if (odrv.component_graph_.has_cycle_ || odrv.component_graph_.port_overflow_) {
+        printf("FAIL: component graph is inconsistent\n");
+        return 1;
+    }
+
+    // The task timers are only armed for this second run because sampling the
+    // host clock slows down the simulation.
+    for (auto& stat: stats) {
+        stat.timer->set_histogram_enabled(true);
+    }
+    for (uint32_t i = 0; i < n_bench; ++i) {
+        odrv.task_timers_armed_ = true;
+        sim_run_ticks(1);
+        for (auto& stat: stats) {
+            stat.sum += stat.timer->length_;
+        }
+    }
+
+    auto to_ns = [](double clocks) { return clocks * 1e9 / TIM_1_8_CLOCK_HZ; };
+    printf("task times (host clock):\n");
+    printf("  %-32s %8s %8s %8s %8s\n", "", "avg [ns]", "p50", "p99", "p99.9");
+    for (auto& stat: stats) {
+        const LatencyHistogram& histogram = stat.timer->histogram_;
+        printf("  %-32s %8.1f %8.1f %8.1f %8.1f\n", stat.name,
+               to_ns((double)stat.sum / n_bench),
+               to_ns(histogram.get_percentile(0.5f)),
+               to_ns(histogram.get_percentile(0.99f)),
+               to_ns(histogram.get_percentile(0.999f)));
+    }
+
+    for (auto& axis: axes) {
+        axis.controller_.config_.set_rate_divider(2);
+    }
+    odrv.update_component_graph();
+    odrv.task_timers_armed_ = false;
+    start = std::chrono::steady_clock::now();
+    sim_run_ticks(n_bench);
+    end = std::chrono::steady_clock::now();
+    if (!check_errors(axis, "benchmark with decimated controllers")) {
+        return 1;
+    }
+    elapsed = std::chrono::duration<double>(end - start).count();
+    printf("with the controllers at %.0f Hz: %.0f iterations/s\n",
+           current_meas_hz / 2.0f, n_bench / elapsed);
+
+    if (!run_flight_recorder_test(axis)) {
+        return 1;
+    }
+
+    return 0;
+}
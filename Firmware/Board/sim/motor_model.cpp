@@ -0,0 +1,100 @@
+#include "motor_model.hpp"
+
+#include <math.h>
+#include <cmath>
+
+// Number of RK4 substeps per call to step(). The electrical time constant of
+// the default motor is 400us, so this keeps the step size well below that.
+static constexpr int kSubsteps = 4;
+
+MotorModel::State MotorModel::derivative(const State& x, double v_alpha, double v_beta) const {
+    const double pp = (double)config_.pole_pairs;
+    const double Ld = config_.phase_inductance_d;
+    const double Lq = config_.phase_inductance_q;
+    const double R = config_.phase_resistance;
+    const double lambda_m = 2.0 * config_.torque_constant / (3.0 * pp); // [Wb]
+    const double omega_e = x.omega * pp;
+
+    // Park transform of the applied voltage
+    const double c = cos(x.theta * pp);
+    const double s = sin(x.theta * pp);
+    const double v_d = c * v_alpha + s * v_beta;
+    const double v_q = c * v_beta - s * v_alpha;
+
+    const double torque = 1.5 * pp * (lambda_m * x.i_q + (Ld - Lq) * x.i_d * x.i_q);
+
+    const double cogging = cogging_torque(x.theta);
+
+    double friction = config_.viscous_friction * x.omega;
+    if (x.omega > 0.0) {
+        friction += config_.coulomb_friction;
+    } else if (x.omega < 0.0) {
+        friction -= config_.coulomb_friction;
+    }
+
+    return {
+        x.omega,
+        (torque - load_torque_ - cogging - friction) / config_.inertia,
+        (v_d - R * x.i_d + omega_e * Lq * x.i_q) / Ld,
+        (v_q - R * x.i_q - omega_e * Ld * x.i_d - omega_e * lambda_m) / Lq
+    };
+}
+
+void MotorModel::step(double dt, double v_alpha, double v_beta, bool floating) {
+    // Nothing moves if the phases are floating and the rotor is at rest
+    if (floating && omega_ == 0.0 && std::abs(load_torque_ + cogging_torque(theta_)) <= config_.coulomb_friction) {
+        i_d_ = i_q_ = 0.0;
+        return;
+    }
+
+    State x = {theta_, omega_, i_d_, i_q_};
+    const double h = dt / kSubsteps;
+
+    for (int i = 0; i < kSubsteps; ++i) {
+        if (floating) {
+            x.i_d = x.i_q = 0.0;
+        }
+
+        auto add = [](const State& a, const State& b, double k) -> State {
+            return {a.theta + k * b.theta, a.omega + k * b.omega, a.i_d + k * b.i_d, a.i_q + k * b.i_q};
+        };
+
+        State k1 = derivative(x, v_alpha, v_beta);
+        State k2 = derivative(add(x, k1, h / 2), v_alpha, v_beta);
+        State k3 = derivative(add(x, k2, h / 2), v_alpha, v_beta);
+        State k4 = derivative(add(x, k3, h), v_alpha, v_beta);
+
+        x.theta += h / 6 * (k1.theta + 2 * k2.theta + 2 * k3.theta + k4.theta);
+        x.omega += h / 6 * (k1.omega + 2 * k2.omega + 2 * k3.omega + k4.omega);
+        x.i_d += h / 6 * (k1.i_d + 2 * k2.i_d + 2 * k3.i_d + k4.i_d);
+        x.i_q += h / 6 * (k1.i_q + 2 * k2.i_q + 2 * k3.i_q + k4.i_q);
+    }
+
+    if (floating) {
+        x.i_d = x.i_q = 0.0;
+    }
+
+    theta_ = x.theta;
+    omega_ = x.omega;
+    i_d_ = x.i_d;
+    i_q_ = x.i_q;
+}
+
+double MotorModel::cogging_torque(double theta) const {
+    double torque = 0.0;
+    for (const auto& harmonic: config_.cogging) {
+        torque += harmonic.amplitude * sin(harmonic.order * theta + harmonic.phase);
+    }
+    return torque;
+}
+
+void MotorModel::get_phase_currents(double* i_a, double* i_b, double* i_c) const {
+    const double c = cos(electrical_phase());
+    const double s = sin(electrical_phase());
+    const double i_alpha = c * i_d_ - s * i_q_;
+    const double i_beta = s * i_d_ + c * i_q_;
+
+    *i_a = i_alpha;
+    *i_b = -0.5 * i_alpha + (sqrt(3.0) / 2.0) * i_beta;
+    *i_c = -0.5 * i_alpha - (sqrt(3.0) / 2.0) * i_beta;
+}
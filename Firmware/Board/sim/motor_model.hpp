@@ -0,0 +1,76 @@
+#ifndef __MOTOR_MODEL_HPP
+#define __MOTOR_MODEL_HPP
+
+#include <stdint.h>
+
+/**
+ * @brief Simulated permanent magnet synchronous motor.
+ *
+ * This is a dq-frame model of a PMSM with a single rigid inertia on the shaft.
+ * It is the C++ counterpart of analysis/Simulation/MotorSim.py. The default
+ * parameters describe an ODrive D5065 motor without load.
+ *
+ * All quantities are in SI units. The phase voltages are applied as
+ * alpha/beta components (amplitude-invariant Clarke transform), which is also
+ * how the firmware computes them.
+ */
+class MotorModel {
+public:
+    struct Config_t {
+        double phase_resistance = 0.039;       // [Ohm]
+        double phase_inductance_d = 1.57e-5;   // [H]
+        double phase_inductance_q = 1.57e-5;   // [H]
+        double torque_constant = 8.27 / 270.0; // [Nm/A]
+        int pole_pairs = 7;
+        double inertia = 1e-4;                 // [kg m^2]
+        double viscous_friction = 1e-5;        // [Nm/(rad/s)]
+        double coulomb_friction = 0.005;       // [Nm]
+
+        // Cogging torque as a sum of harmonics of the mechanical angle:
+        // sum(amplitude * sin(order * theta + phase))
+        struct CoggingHarmonic {
+            int order = 0;
+            double amplitude = 0.0;            // [Nm]
+            double phase = 0.0;                // [rad]
+        };
+        CoggingHarmonic cogging[4];
+    };
+
+    /**
+     * @brief Integrates the model over the duration dt.
+     *
+     * @param v_alpha, v_beta: Phase voltages which are held constant during
+     *        the step [V].
+     * @param floating: If true, the inverter output is disabled. The model
+     *        does not simulate the diode conduction in this case, it simply
+     *        forces the phase currents to zero.
+     */
+    void step(double dt, double v_alpha, double v_beta, bool floating);
+
+    /**
+     * @brief Returns the instantaneous phase currents [A].
+     */
+    void get_phase_currents(double* i_a, double* i_b, double* i_c) const;
+
+    double electrical_phase() const { return theta_ * config_.pole_pairs; }
+
+    /**
+     * @brief Returns the cogging torque that acts against the rotor at the
+     * specified mechanical angle [Nm].
+     */
+    double cogging_torque(double theta) const;
+
+    Config_t config_;
+    double load_torque_ = 0.0; // [Nm] external torque acting against the rotor
+
+    double theta_ = 0.0; // [rad] mechanical rotor position
+    double omega_ = 0.0; // [rad/s] mechanical rotor velocity
+    double i_d_ = 0.0;   // [A]
+    double i_q_ = 0.0;   // [A]
+
+private:
+    struct State { double theta, omega, i_d, i_q; };
+    State derivative(const State& x, double v_alpha, double v_beta) const;
+};
+
+#endif // __MOTOR_MODEL_HPP
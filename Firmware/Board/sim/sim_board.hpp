@@ -0,0 +1,48 @@
+#ifndef __SIM_BOARD_HPP
+#define __SIM_BOARD_HPP
+
+#include <board.h>
+#include "motor_model.hpp"
+
+/**
+ * @brief Interface between the simulated board (board.cpp) and the code that
+ * drives the simulation (main.cpp or a test).
+ *
+ * The simulation is single threaded. Time only advances when sim_run_ticks()
+ * is called, either directly or through one of the blocking CMSIS-OS calls
+ * (osDelay(), osSignalWait()). Each tick corresponds to one invocation of the
+ * control loop, i.e. 125us.
+ */
+
+extern MotorModel sim_motors[AXIS_COUNT];
+extern float sim_supply_voltage; // [V] voltage of the (ideal) DC supply
+extern uint64_t sim_tick_count; // number of control loop ticks since startup
+
+/**
+ * @brief Loads the default configuration and brings the simulated board up to
+ * the point where the axis threads would be started on real hardware.
+ *
+ * Configuration changes made before this call are lost. To change the
+ * configuration, modify the config structs after this call and then invoke
+ * sim_apply_config().
+ */
+void sim_start();
+
+/**
+ * @brief Applies the configuration of all objects (same as on startup).
+ */
+bool sim_apply_config();
+
+/**
+ * @brief Advances the simulation by the specified number of control loop ticks.
+ */
+void sim_run_ticks(uint32_t n);
+
+/**
+ * @brief Returns the simulated time since startup in seconds.
+ */
+inline double sim_time() {
+    return (double)sim_tick_count * (double)CURRENT_MEAS_PERIOD;
+}
+
+#endif // __SIM_BOARD_HPP
@@ -0,0 +1,118 @@
+
+#include "sim_nvm.hpp"
+
+#include <string.h>
+
+SimNvm sim_nvm;
+
+static uint8_t random_byte() {
+    // xorshift32
+    uint32_t x = sim_nvm.rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_nvm.rng_state = x;
+    return (uint8_t)x;
+}
+
+enum OpResult {
+    kOpDone,
+    kOpTorn, // the power was cut during this operation
+    kOpFailed, // the power was cut before this operation
+};
+
+static OpResult begin_op() {
+    if (!sim_nvm.powered) {
+        return kOpFailed;
+    }
+    sim_nvm.n_ops++;
+    if (sim_nvm.power_budget == 0) {
+        sim_nvm.powered = false;
+        return kOpTorn;
+    }
+    if (sim_nvm.power_budget != SIZE_MAX) {
+        sim_nvm.power_budget--;
+    }
+    return kOpDone;
+}
+
+void sim_nvm_reset() {
+    memset(sim_nvm.data, 0xff, sizeof(sim_nvm.data));
+    sim_nvm.n_ops = 0;
+    sim_nvm.n_violations = 0;
+    sim_nvm.n_erases = 0;
+    sim_nvm_power_on();
+}
+
+void sim_nvm_cut_power_after(size_t n, uint32_t seed) {
+    sim_nvm.power_budget = n;
+    sim_nvm.rng_state = seed ? seed : 1;
+}
+
+void sim_nvm_power_on() {
+    sim_nvm.power_budget = SIZE_MAX;
+    sim_nvm.powered = true;
+}
+
+size_t NVM_get_sector_size(void) {
+    return SimNvm::kSectorSize;
+}
+
+int NVM_read(size_t sector, size_t offset, uint8_t *data, size_t length) {
+    if (sector >= NVM_SECTOR_COUNT || offset + length > SimNvm::kSectorSize)
+        return -1;
+    if (!sim_nvm.powered)
+        return -1;
+    memcpy(data, &sim_nvm.data[sector][offset], length);
+    return 0;
+}
+
+int NVM_program(size_t sector, size_t offset, const uint8_t *data, size_t length) {
+    if (sector >= NVM_SECTOR_COUNT || offset + length > SimNvm::kSectorSize)
+        return -1;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t* dst = &sim_nvm.data[sector][offset + i];
+        if (*dst != 0xff) {
+            sim_nvm.n_violations++;
+            return -1;
+        }
+        OpResult result = begin_op();
+        if (result == kOpTorn) {
+            // only some of the bits were cleared
+            *dst = data[i] | random_byte();
+        }
+        if (result != kOpDone) {
+            return -1;
+        }
+        *dst = data[i];
+    }
+    return 0;
+}
+
+int NVM_erase_sector(size_t sector) {
+    if (sector >= NVM_SECTOR_COUNT)
+        return -1;
+    OpResult result = begin_op();
+    if (result == kOpTorn) {
+        // only a random part of the sector was erased
+        for (size_t i = 0; i < SimNvm::kSectorSize; ++i) {
+            if (random_byte() & 1) {
+                sim_nvm.data[sector][i] = 0xff;
+            }
+        }
+    }
+    if (result != kOpDone) {
+        return -1;
+    }
+    memset(sim_nvm.data[sector], 0xff, SimNvm::kSectorSize);
+    sim_nvm.n_erases++;
+    return 0;
+}
+
+int NVM_erase(void) {
+    int state = 0;
+    for (size_t i = 0; i < NVM_SECTOR_COUNT; ++i) {
+        state |= NVM_erase_sector(i);
+    }
+    return state;
+}
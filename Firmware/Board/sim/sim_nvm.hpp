@@ -0,0 +1,40 @@
+#ifndef __SIM_NVM_HPP
+#define __SIM_NVM_HPP
+
+#include <Drivers/STM32/stm32_nvm.h>
+
+/**
+ * @brief Simulated flash memory that backs the NVM_* functions on the host.
+ *
+ * Like real flash, programming can only turn erased bytes (0xff) into other
+ * values and erasing sets a whole sector back to 0xff. Programming a byte that
+ * is not erased fails and is counted as a violation.
+ *
+ * A power cut can be scheduled after a number of operations, where each
+ * programmed byte and each sector erase counts as one operation. The operation
+ * during which the power is cut leaves random data behind and all subsequent
+ * operations fail until sim_nvm_power_on() is called.
+ */
+struct SimNvm {
+    static constexpr size_t kSectorSize = 0x4000;
+
+    uint8_t data[NVM_SECTOR_COUNT][kSectorSize];
+    size_t n_ops = 0; // number of program and erase operations so far
+    size_t n_violations = 0; // number of attempts to program non-erased bytes
+    size_t n_erases = 0;
+    size_t power_budget = SIZE_MAX; // remaining operations until the power is cut
+    bool powered = true;
+    uint32_t rng_state = 1;
+};
+
+extern SimNvm sim_nvm;
+
+// Erases all sectors and clears the counters and the power cut.
+void sim_nvm_reset();
+
+// Cuts the power during the n-th operation from now (n = 0: the next operation).
+void sim_nvm_cut_power_after(size_t n, uint32_t seed);
+
+void sim_nvm_power_on();
+
+#endif // __SIM_NVM_HPP
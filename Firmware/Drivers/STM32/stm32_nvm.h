@@ -12,22 +12,22 @@ extern "C" {
 
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
+
+// Number of flash sectors that are reserved for non-volatile data
+#define NVM_SECTOR_COUNT 2
+
 /* Exported variables --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions --------------------------------------------------------*/
 
-int NVM_init(void);
+size_t NVM_get_sector_size(void);
+int NVM_read(size_t sector, size_t offset, uint8_t *data, size_t length);
+int NVM_program(size_t sector, size_t offset, const uint8_t *data, size_t length);
+int NVM_erase_sector(size_t sector);
 int NVM_erase(void);
-size_t NVM_get_max_read_length(void);
-size_t NVM_get_max_write_length(void);
-int NVM_read(size_t offset, uint8_t *data, size_t length);
-int NVM_start_write(size_t length);
-int NVM_write(size_t offset, uint8_t *data, size_t length);
-int NVM_commit(void);
-void NVM_demo(void);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif //__NVM_H
\ No newline at end of file
+#endif //__NVM_H
@@ -5,6 +5,8 @@
 #include <stm32f405xx.h>
 #elif defined(STM32F722xx)
 #include <stm32f722xx.h>
+#elif defined(ODRIVE_SIL)
+#include <sim_hal.h>
 #else
 #error "unknown STM32 microcontroller"
 #endif
@@ -0,0 +1,115 @@
+/* ----------------------------------------------------------------------
+ * Project:      CMSIS DSP Library
+ * Title:        arm_sincos_f32.c
+ * Description:  Fast combined sine and cosine calculation for floating-point values
+ *
+ * Derived from arm_sin_f32.c and arm_cos_f32.c (V.1.5.1)
+ *
+ * Target Processor: Cortex-M cores
+ * -------------------------------------------------------------------- */
+/*
+ * Copyright (C) 2010-2017 ARM Limited or its affiliates. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <board.h>
+#include "arm_math.h"
+#include "arm_common_tables.h"
+
+/**
+ * @ingroup groupFastMath
+ */
+
+/**
+ * @defgroup sincos Sine and Cosine
+ *
+ * Computes the trigonometric sine and cosine of the same angle using a
+ * combination of table lookup and linear interpolation.
+ *
+ * The range reduction and the fractional table index are shared between both
+ * results. The cosine is read from the sine table a quarter period further
+ * on. The results are equal to the ones of our_arm_sin_f32() and
+ * our_arm_cos_f32() up to rounding.
+ */
+
+/**
+ * @addtogroup sincos
+ * @{
+ */
+
+/**
+ * @brief  Fast approximation to the trigonometric sine and cosine functions for floating-point data.
+ * @param[in]  x        input value in radians.
+ * @param[out] pSinVal  points to the processed sine output.
+ * @param[out] pCosVal  points to the processed cosine output.
+ */
+
+void our_arm_sincos_f32(
+  float32_t x,
+  float32_t * pSinVal,
+  float32_t * pCosVal)
+{
+  float32_t fract, in;                           /* Temporary variables for input, output */
+  uint16_t indexS, indexC;                       /* Index variables */
+  float32_t a, b;                                /* Two nearest output values */
+  int32_t n;
+  float32_t findex;
+
+  /* input x is in radians */
+  /* Scale the input to [0 1] range from [0 2*PI] , divide input by 2*pi */
+  in = x * 0.159154943092f;
+
+  /* Calculation of floor value of input */
+  n = (int32_t) in;
+
+  /* Make negative values towards -infinity */
+  if (in < 0.0f)
+  {
+    n--;
+  }
+
+  /* Map input value to [0 1] */
+  in = in - (float32_t) n;
+
+  /* Calculation of index of the table */
+  findex = (float32_t)FAST_MATH_TABLE_SIZE * in;
+  indexS = (uint16_t)findex;
+
+  /* when "in" is exactly 1, we need to rotate the index down to 0 */
+  if (indexS >= FAST_MATH_TABLE_SIZE) {
+    indexS = 0;
+    findex -= (float32_t)FAST_MATH_TABLE_SIZE;
+  }
+
+  /* fractional value calculation */
+  fract = findex - (float32_t) indexS;
+
+  /* cos(x) = sin(x + pi/2) is a quarter of the table further on */
+  indexC = (indexS + FAST_MATH_TABLE_SIZE / 4) % FAST_MATH_TABLE_SIZE;
+
+  /* Read two nearest values of input value from the sin table and interpolate */
+  a = sinTable_f32[indexS];
+  b = sinTable_f32[indexS+1];
+  *pSinVal = (1.0f-fract)*a + fract*b;
+
+  a = sinTable_f32[indexC];
+  b = sinTable_f32[indexC+1];
+  *pCosVal = (1.0f-fract)*a + fract*b;
+}
+
+/**
+ * @} end of sincos group
+ */
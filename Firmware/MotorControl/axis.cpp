@@ -40,6 +40,7 @@ Axis::Axis(int axis_num,
     min_endstop_.axis_ = this;
     max_endstop_.axis_ = this;
     mechanical_brake_.axis_ = this;
+    flight_recorder_.axis_ = this;
 }
 
 Axis::LockinConfig_t Axis::default_calibration() {
@@ -209,6 +210,7 @@ bool Axis::run_lockin_spin(const LockinConfig_t &lockin_config, bool remain_arme
         motor_.current_control_.phase_vel_src_.connect_to(&open_loop_controller_.phase_vel_);
         acim_estimator_.rotor_phase_vel_src_.connect_to(&open_loop_controller_.phase_vel_);
     }
+    odrv.update_component_graph();
     wait_for_control_iteration();
 
     motor_.arm(&motor_.current_control_);
@@ -321,6 +323,7 @@ bool Axis::start_closed_loop_control() {
             controller_.vel_setpoint_ = vel;
         }
     }
+    odrv.update_component_graph();
 
     // In sensorless mode the motor is already armed.
     if (!motor_.is_armed_) {
@@ -11,6 +11,7 @@ class Axis;
 #include "trapTraj.hpp"
 #include "endstop.hpp"
 #include "mechanical_brake.hpp"
+#include "flight_recorder.hpp"
 #include "low_level.h"
 #include "utils.hpp"
 #include "task_timer.hpp"
@@ -51,6 +52,21 @@ public:
     static LockinConfig_t default_sensorless();
     static LockinConfig_t default_lockin();
 
+    struct CANTelemetrySlot_t {
+        TelemetrySignal signal = TELEMETRY_SIGNAL_NONE;
+        uint8_t bits = 16;
+        float scale = 0.01f;
+    };
+
+    struct CANPackedTelemetry_t {
+        CANTelemetrySlot_t slots[4] = {
+            {TELEMETRY_SIGNAL_POS_ESTIMATE, 24, 0.0001f}, // ±838 turn
+            {TELEMETRY_SIGNAL_VEL_ESTIMATE, 24, 0.0001f}, // ±838 turn/s
+            {TELEMETRY_SIGNAL_IQ_MEASURED, 16, 0.01f}, // ±327 A
+            {TELEMETRY_SIGNAL_NONE, 16, 0.01f},
+        };
+    };
+
     struct CANConfig_t {
         uint32_t node_id = 0;
         bool is_extended = false;
@@ -64,6 +80,8 @@ public:
         uint32_t iq_rate_ms = 0;
         uint32_t sensorless_rate_ms = 0;
         uint32_t bus_vi_rate_ms = 0;
+        uint32_t packed_telemetry_rate_ms = 0;
+        CANPackedTelemetry_t packed_telemetry;
     };
 
     struct Config_t {
@@ -86,6 +104,8 @@ public:
         float watchdog_timeout = 0.0f; // [s]
         bool enable_watchdog = false;
 
+        uint32_t housekeeping_rate_divider = 8; // endstops and thermistors run every n-th control loop iteration
+
         // Defaults loaded from hw_config in load_configuration in main.cpp
         uint16_t step_gpio_pin = 0;
         uint16_t dir_gpio_pin = 0;
@@ -100,6 +120,8 @@ public:
         Axis* parent = nullptr;
         void set_step_gpio_pin(uint16_t value) { step_gpio_pin = value; parent->decode_step_dir_pins(); }
         void set_dir_gpio_pin(uint16_t value) { dir_gpio_pin = value; parent->decode_step_dir_pins(); }
+        void set_enable_sensorless_mode(bool value) { enable_sensorless_mode = value; InputPortBase::notify_connections_changed(); }
+        void set_housekeeping_rate_divider(uint32_t value) { housekeeping_rate_divider = value; InputPortBase::notify_connections_changed(); }
     };
 
     struct Homing_t {
@@ -117,6 +139,7 @@ public:
         uint32_t last_iq = 0;
         uint32_t last_sensorless = 0;
         uint32_t last_bus_vi = 0;
+        uint32_t last_packed_telemetry = 0;
     };
 
     Axis(int axis_num,
@@ -183,6 +206,7 @@ public:
     Endstop& min_endstop_;
     Endstop& max_endstop_;
     MechanicalBrake& mechanical_brake_;
+    FlightRecorder flight_recorder_;
     TaskTimes task_times_;
 
     osThreadId thread_id_ = 0;
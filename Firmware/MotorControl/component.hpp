@@ -2,11 +2,22 @@
 #define __COMPONENT_HPP
 
 #include <stdint.h>
+#include <stddef.h>
+#include <atomic>
 #include <optional>
 #include <variant>
 
+class OutputPortBase;
+class PortList;
+
 class ComponentBase {
 public:
+    enum Activity {
+        ACTIVE,             // update() runs on every control loop iteration
+        ACTIVE_IF_CONSUMED, // update() only runs if an active component reads one of the outputs
+        INACTIVE,           // update() does not run
+    };
+
     /**
      * @brief Shall run the update action of this component.
      * 
@@ -17,8 +28,84 @@ public:
      * is run.
      */
     virtual void update(uint32_t timestamp) = 0;
+
+    /**
+     * @brief Shall list the output ports that update() reads (usually through
+     * the component's input ports) and the ones that it writes.
+     *
+     * ComponentGraph derives the update order and the ports to reset on every
+     * control loop iteration from this.
+     */
+    virtual void get_ports(PortList&, PortList&) {}
+
+    /**
+     * @brief Shall return whether update() needs to run in the current
+     * configuration. This is evaluated whenever ComponentGraph is resolved.
+     */
+    virtual Activity get_activity() { return ACTIVE; }
+
+    /**
+     * @brief Shall return the number of control loop iterations between two
+     * calls to update(). ComponentGraph rounds this down to a power of two of
+     * at most ComponentGraph::kMaxRateDivider.
+     *
+     * The outputs of a component that doesn't run on every iteration are not
+     * reset in between, so consumers see the last value.
+     */
+    virtual uint32_t get_rate_divider() { return 1; }
+
+    // Rate divider in effect, set by ComponentGraph when a resolved
+    // graph takes effect. update() shall scale its time step by this.
+    uint32_t rate_divider_ = 1;
 };
 
+/**
+ * @brief The type independent part of an output port.
+ */
+class OutputPortBase {
+public:
+    /**
+     * @brief Marks the contained value as outdated. The value is not actually
+     * deleted and can still be accessed through some of the member functions
+     * of OutputPort.
+     */
+    void reset() {
+        // This will eventually overflow to 0 so present() could
+        // theoretically return a very old value however it is very likely that
+        // the motor will be long disarmed by then.
+        age_++;
+    }
+
+protected:
+    uint32_t age_ = 2; // Age in number of control loop iterations
+};
+
+/**
+ * @brief The type independent part of an input port.
+ */
+class InputPortBase {
+public:
+    /**
+     * @brief Returns a number that changes whenever any input port in the
+     * system is connected or disconnected.
+     */
+    static uint32_t get_connection_generation() {
+        return connection_generation_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Shall be called when a dependency between components changes
+     * other than through an input port (e.g. a component reads an output port
+     * that is selected by a config value) or when the activity or rate divider
+     * of a component changes.
+     */
+    static void notify_connections_changed() {
+        connection_generation_.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    static inline std::atomic<uint32_t> connection_generation_ = 1;
+};
 
 template<typename T>
 class InputPort;
@@ -35,7 +122,7 @@ class InputPort;
  * Member functions of this class are not thread-safe unless noted otherwise.
  */
 template<typename T>
-class OutputPort {
+class OutputPort : public OutputPortBase {
 public:
     /**
      * @brief Initializes the output port with the specified value.
@@ -54,18 +141,6 @@ public:
         age_ = 0;
     }
 
-    /**
-     * @brief Marks the contained value as outdated. The value is not actually
-     * deleted and can still be accessed through some of the member functions
-     * of this class.
-     */
-    void reset() {
-        // This will eventually overflow to 0 so present() could
-        // theoretically return a very old value however it is very likely that
-        // the motor will be long disarmed by then.
-        age_++;
-    }
-
     /**
      * @brief Returns the value from this control loop iteration or std::nullopt
      * if the value was not yet set during this control loop iteration.
@@ -104,7 +179,6 @@ public:
     }
     
 private:
-    uint32_t age_ = 2; // Age in number of control loop iterations
     T content_;
 };
 
@@ -120,18 +194,29 @@ private:
  * Member functions of this class are not thread-safe unless otherwise noted.
  */
 template<typename T>
-class InputPort {
+class InputPort : public InputPortBase {
 public:
     void connect_to(OutputPort<T>* input_port) {
         content_ = input_port;
+        notify_connections_changed();
     }
 
     void connect_to(T* input_ptr) {
         content_ = input_ptr;
+        notify_connections_changed();
     }
 
     void disconnect() {
         content_ = (OutputPort<T>*)nullptr;
+        notify_connections_changed();
+    }
+
+    /**
+     * @brief Returns the output port that this input port is connected to or
+     * nullptr if it's not connected to an output port.
+     */
+    OutputPortBase* source() {
+        return content_.index() == 2 ? std::get<2>(content_) : nullptr;
     }
 
     std::optional<T> present() {
@@ -178,5 +263,42 @@ private:
     std::variant<T, T*, OutputPort<T>*> content_;
 };
 
+/**
+ * @brief Fixed-capacity list of output ports, used by ComponentBase::get_ports().
+ */
+class PortList {
+public:
+    static constexpr size_t kCapacity = 12;
+
+    void add(OutputPortBase* port) {
+        if (!port) {
+            return;
+        }
+        if (size_ < kCapacity) {
+            ports_[size_++] = port;
+        } else {
+            overflow_ = true;
+        }
+    }
+
+    template<typename T>
+    void add(InputPort<T>& port) {
+        add(port.source());
+    }
+
+    void clear() {
+        size_ = 0;
+        overflow_ = false;
+    }
+
+    size_t size() const { return size_; }
+    bool overflow() const { return overflow_; }
+    OutputPortBase* operator[](size_t i) const { return ports_[i]; }
+
+private:
+    OutputPortBase* ports_[kCapacity];
+    size_t size_ = 0;
+    bool overflow_ = false;
+};
 
 #endif // __COMPONENT_HPP
\ No newline at end of file
@@ -0,0 +1,208 @@
+
+#include "component_graph.hpp"
+#include <algorithm>
+
+static_assert(ComponentGraph::kMaxComponents <= 32, "dependency masks are 32 bit");
+static_assert((ComponentGraph::kMaxRateDivider & (ComponentGraph::kMaxRateDivider - 1)) == 0, "must be a power of two");
+
+static bool contains(const PortList& list, OutputPortBase* port) {
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i] == port) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ComponentGraph::add(ComponentBase* component, TaskTimer* timer) {
+    if (n_nodes_ >= kMaxComponents) {
+        return false;
+    }
+    nodes_[n_nodes_++] = {component, timer, 0, true, 1, 0, 0};
+    return true;
+}
+
+uint32_t ComponentGraph::round_rate_divider(uint32_t divider) {
+    if (divider >= kMaxRateDivider) {
+        return kMaxRateDivider;
+    }
+    uint32_t result = 1;
+    while (result * 2 <= divider) {
+        result *= 2;
+    }
+    return result;
+}
+
+bool ComponentGraph::resolve() {
+    Schedule_t* applied = applied_.load(std::memory_order_acquire);
+    if (applied != published_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    Schedule_t* schedule = applied == &schedules_[0] ? &schedules_[1] : &schedules_[0];
+
+    // Load the generation first so that a change during resolve() triggers
+    // another resolve().
+    resolved_generation_ = InputPortBase::get_connection_generation();
+    has_cycle_ = false;
+    port_overflow_ = false;
+
+    for (size_t i = 0; i < n_nodes_; ++i) {
+        inputs_[i].clear();
+        outputs_[i].clear();
+        nodes_[i].component->get_ports(inputs_[i], outputs_[i]);
+        port_overflow_ = port_overflow_ || inputs_[i].overflow() || outputs_[i].overflow();
+    }
+
+    // deps[i] has bit j set if component i reads an output of component j
+    uint32_t deps[kMaxComponents];
+    for (size_t i = 0; i < n_nodes_; ++i) {
+        deps[i] = 0;
+        for (size_t k = 0; k < inputs_[i].size(); ++k) {
+            for (size_t j = 0; j < n_nodes_; ++j) {
+                if (j != i && contains(outputs_[j], inputs_[i][k])) {
+                    deps[i] |= 1UL << j;
+                }
+            }
+        }
+    }
+
+    // Topological sort. Picking the first ready component in registration
+    // order keeps the order stable.
+    size_t topo[kMaxComponents];
+    uint32_t placed = 0;
+    for (size_t n = 0; n < n_nodes_; ++n) {
+        size_t i = 0;
+        while (i < n_nodes_ && ((placed & (1UL << i)) || (deps[i] & ~placed))) {
+            i++;
+        }
+        if (i == n_nodes_) {
+            has_cycle_ = true;
+            break;
+        }
+        topo[n] = i;
+        placed |= 1UL << i;
+    }
+    if (has_cycle_) {
+        for (size_t n = 0; n < n_nodes_; ++n) {
+            topo[n] = n;
+        }
+    }
+
+    // A component that is only active if consumed can in turn activate the
+    // components that it reads from, so iterate until nothing changes.
+    ComponentBase::Activity activity[kMaxComponents];
+    uint32_t active = 0;
+    for (size_t i = 0; i < n_nodes_; ++i) {
+        activity[i] = nodes_[i].component->get_activity();
+        if (activity[i] == ComponentBase::ACTIVE) {
+            active |= 1UL << i;
+        }
+    }
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t i = 0; i < n_nodes_; ++i) {
+            if (activity[i] != ComponentBase::ACTIVE_IF_CONSUMED || (active & (1UL << i))) {
+                continue;
+            }
+            for (size_t j = 0; j < n_nodes_; ++j) {
+                if ((active & (1UL << j)) && (deps[j] & (1UL << i))) {
+                    active |= 1UL << i;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Assign each decimated component to the iterations with the fewest
+    // decimated components so far. All components count the same since their
+    // execution time is not known here.
+    uint32_t load[kMaxRateDivider] = {0};
+
+    schedule->n_active = 0;
+    size_t n_ports = 0;
+    for (size_t n = 0; n < n_nodes_; ++n) {
+        size_t i = topo[n];
+        if (active & (1UL << i)) {
+            Node_t& node = schedule->order[schedule->n_active++];
+            node = nodes_[i];
+
+            uint32_t divider = round_rate_divider(node.component->get_rate_divider());
+            node.rate_divider = divider;
+            node.phase = 0;
+            if (divider > 1) {
+                uint32_t best_load = UINT32_MAX;
+                for (uint32_t phase = 0; phase < divider; ++phase) {
+                    uint32_t max_load = 0;
+                    for (uint32_t slot = phase; slot < kMaxRateDivider; slot += divider) {
+                        max_load = std::max(max_load, load[slot]);
+                    }
+                    if (max_load < best_load) {
+                        best_load = max_load;
+                        node.phase = phase;
+                    }
+                }
+                for (uint32_t slot = node.phase; slot < kMaxRateDivider; slot += divider) {
+                    load[slot]++;
+                }
+            }
+
+            node.reset_begin = n_ports;
+            for (size_t k = 0; k < outputs_[i].size(); ++k) {
+                if (n_ports < kMaxResetPorts) {
+                    schedule->reset_ports[n_ports++] = outputs_[i][k];
+                } else {
+                    port_overflow_ = true;
+                }
+            }
+            node.reset_end = n_ports;
+        }
+    }
+    schedule->n_reset_ports = n_ports;
+
+    for (size_t i = 0; i < n_nodes_; ++i) {
+        if (!(active & (1UL << i))) {
+            for (size_t k = 0; k < outputs_[i].size(); ++k) {
+                if (n_ports < kMaxResetPorts) {
+                    schedule->reset_ports[n_ports++] = outputs_[i][k];
+                } else {
+                    port_overflow_ = true;
+                }
+            }
+        }
+    }
+    schedule->n_stale_ports = n_ports;
+
+    published_.store(schedule, std::memory_order_release);
+    return true;
+}
+
+bool ComponentGraph::resolve_if_outdated() {
+    while (is_outdated()) {
+        if (resolving_.exchange(true)) {
+            return false;
+        }
+        // Check again in case the other thread finished just now
+        bool ok = !is_outdated() || resolve();
+        resolving_ = false;
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ComponentGraph::apply_schedule(Schedule_t* schedule) {
+    current_ = schedule;
+    applied_.store(schedule, std::memory_order_release);
+    for (size_t n = 0; n < schedule->n_active; ++n) {
+        schedule->order[n].component->rate_divider_ = schedule->order[n].rate_divider;
+    }
+
+    // Make sure that neither present() nor previous() of an inactive
+    // component returns a value that will never be updated.
+    for (size_t i = schedule->n_reset_ports; i < schedule->n_stale_ports; ++i) {
+        schedule->reset_ports[i]->reset();
+        schedule->reset_ports[i]->reset();
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef __COMPONENT_GRAPH_HPP
+#define __COMPONENT_GRAPH_HPP
+
+#include "component.hpp"
+
+struct TaskTimer;
+
+/**
+ * @brief Derives the update order of a set of components from the output
+ * ports that they read and write (see ComponentBase::get_ports()).
+ *
+ * Components are registered once in a default order. resolve() then
+ * computes:
+ *  - the update order: a topological order in which every component runs
+ *    after the components whose outputs it reads. Among components that
+ *    don't depend on each other, the registration order is kept. If the
+ *    dependencies are cyclic, the registration order is used as is.
+ *  - which components are active (see ComponentBase::get_activity()).
+ *    Inactive components are skipped.
+ *  - the schedule of components that don't run on every iteration (see
+ *    ComponentBase::get_rate_divider()). Components with the same rate
+ *    divider are spread over different iterations so that the load per
+ *    iteration is as even as possible.
+ *  - the list of output ports that must be reset whenever their component
+ *    runs. This covers the outputs of all active components. The outputs of
+ *    inactive components are invalidated once by resolve().
+ *
+ * resolve() is not cheap and should only run when is_outdated() returns true,
+ * i.e. after input ports were connected or disconnected. It runs in the
+ * thread that changed the connections, once the whole batch of changes is
+ * done. The result is published with a single pointer swap and takes effect
+ * at the next start_iteration(), so the control loop never sees a partially
+ * resolved graph. start_iteration() and the node iteration are cheap.
+ */
+class ComponentGraph {
+public:
+    static constexpr size_t kMaxComponents = 24;
+    static constexpr size_t kMaxResetPorts = 64;
+    static constexpr uint32_t kMaxRateDivider = 16;
+
+    struct Node_t {
+        ComponentBase* component;
+        TaskTimer* timer;
+        uint8_t phase;        // the component runs when the iteration count modulo the rate divider equals this
+        bool due;             // set by start_iteration(): update() shall run in this iteration
+        uint8_t rate_divider; // applied to the component when the schedule takes effect
+        uint16_t reset_begin; // range of the component's outputs in reset_ports_
+        uint16_t reset_end;
+    };
+
+    /**
+     * @brief Registers a component. The order of registration is the default
+     * update order.
+     * @param timer: Task timer that measures the component's update() or
+     *        nullptr. The graph itself doesn't touch it.
+     * @returns false if the graph is full.
+     */
+    bool add(ComponentBase* component, TaskTimer* timer);
+
+    /**
+     * @brief Recomputes the update order, the active components, their
+     * schedule and the reset list and publishes them for the next
+     * start_iteration().
+     *
+     * Can be interrupted by the control loop but must not run concurrently
+     * with another resolve() (see resolve_if_outdated()).
+     *
+     * @returns false if the previously published result didn't take effect
+     *          yet. Nothing is done in this case.
+     */
+    bool resolve();
+
+    /**
+     * @brief Calls resolve() until the graph is no longer outdated.
+     *
+     * Several threads can call this. If another thread is resolving at the
+     * moment or the control loop didn't pick up the previous result yet, this
+     * returns false right away and the caller should retry later.
+     */
+    bool resolve_if_outdated();
+
+    bool is_outdated() const {
+        return resolved_generation_ != InputPortBase::get_connection_generation();
+    }
+
+    /**
+     * @brief Marks the components that are due in this iteration and resets
+     * their outputs. The outputs of the other components keep their value.
+     */
+    void start_iteration() {
+        Schedule_t* schedule = published_.load(std::memory_order_acquire);
+        if (schedule != current_) {
+            apply_schedule(schedule);
+        }
+
+        iteration_++;
+        for (size_t n = 0; n < current_->n_active; ++n) {
+            Node_t& node = current_->order[n];
+            node.due = ((iteration_ - node.phase) & (node.rate_divider - 1)) == 0;
+            if (node.due) {
+                for (size_t i = node.reset_begin; i < node.reset_end; ++i) {
+                    current_->reset_ports[i]->reset();
+                }
+            }
+        }
+    }
+
+    // Active components in update order
+    const Node_t* begin() const { return current_->order; }
+    const Node_t* end() const { return current_->order + current_->n_active; }
+    size_t size() const { return current_->n_active; }
+
+    size_t n_components() const { return n_nodes_; }
+    size_t n_reset_ports() const { return current_->n_reset_ports; }
+
+    static uint32_t round_rate_divider(uint32_t divider);
+
+    // Set by resolve() if the dependencies are cyclic
+    bool has_cycle_ = false;
+    // Set by resolve() if a component lists more ports than a PortList can hold
+    // or if the outputs of all components don't fit into the reset list
+    bool port_overflow_ = false;
+
+private:
+    struct Schedule_t {
+        Node_t order[kMaxComponents];
+        size_t n_active = 0;
+        // The outputs of the active components followed by the outputs of
+        // the inactive ones, which are invalidated once when the schedule
+        // takes effect.
+        OutputPortBase* reset_ports[kMaxResetPorts];
+        size_t n_reset_ports = 0;
+        size_t n_stale_ports = 0;
+    };
+
+    void apply_schedule(Schedule_t* schedule);
+
+    Node_t nodes_[kMaxComponents];
+    size_t n_nodes_ = 0;
+
+    // Scratch space for resolve()
+    PortList inputs_[kMaxComponents];
+    PortList outputs_[kMaxComponents];
+
+    // resolve() writes to the schedule that the control loop doesn't use.
+    // It only does so once the control loop uses the published one.
+    Schedule_t schedules_[2];
+    std::atomic<Schedule_t*> published_ = &schedules_[0];
+    std::atomic<Schedule_t*> applied_ = &schedules_[0];
+    Schedule_t* current_ = &schedules_[0]; // schedule used by the control loop
+    std::atomic<bool> resolving_ = false;
+
+    uint32_t iteration_ = UINT32_MAX; // the first iteration is 0
+    uint32_t resolved_generation_ = 0; // the connection generation starts at 1
+};
+
+#endif // __COMPONENT_GRAPH_HPP
@@ -0,0 +1,254 @@
+/*
+* @brief Contains the system-level logic that runs in the board's interrupt
+* handlers. Nothing in here touches the hardware directly, so this file is also
+* compiled into the host simulation build (see Board/sim).
+*/
+
+#include "odrive_main.h"
+
+bool ODrive::any_error() {
+    return error_ != ODrive::ERROR_NONE
+        || std::any_of(axes.begin(), axes.end(), [](Axis& axis){
+            return axis.error_ != Axis::ERROR_NONE
+                || axis.motor_.error_ != Motor::ERROR_NONE
+                || axis.sensorless_estimator_.error_ != SensorlessEstimator::ERROR_NONE
+                || axis.encoder_.error_ != Encoder::ERROR_NONE
+                || axis.controller_.error_ != Controller::ERROR_NONE;
+        });
+}
+
+uint64_t ODrive::get_drv_fault() {
+#if AXIS_COUNT == 1
+    return motors[0].gate_driver_.get_error();
+#elif AXIS_COUNT == 2
+    return (uint64_t)motors[0].gate_driver_.get_error() | ((uint64_t)motors[1].gate_driver_.get_error() << 32ULL);
+#else
+    #error "not supported"
+#endif
+}
+
+void ODrive::clear_errors() {
+    for (auto& axis: axes) {
+        axis.motor_.error_ = Motor::ERROR_NONE;
+        axis.controller_.error_ = Controller::ERROR_NONE;
+        axis.sensorless_estimator_.error_ = SensorlessEstimator::ERROR_NONE;
+        axis.encoder_.error_ = Encoder::ERROR_NONE;
+        axis.encoder_.spi_error_rate_ = 0.0f;
+        axis.error_ = Axis::ERROR_NONE;
+    }
+    error_ = ERROR_NONE;
+    if (odrv.config_.enable_brake_resistor) {
+        safety_critical_arm_brake_resistor();
+    }
+}
+
+bool ODrive::move_coordinated(float axis0_pos, float axis1_pos) {
+    static_assert(AXIS_COUNT == 2, "not supported");
+    for (auto& axis: axes) {
+        if (axis.controller_.config_.input_mode != Controller::INPUT_MODE_TRAP_TRAJ) {
+            return false;
+        }
+    }
+    if (coordinated_move_pending_) {
+        return false; // previous request not yet picked up by the control loop
+    }
+    coordinated_goal_[0] = axis0_pos;
+    coordinated_goal_[1] = axis1_pos;
+    coordinated_move_pending_.store(true, std::memory_order_release);
+    return true;
+}
+
+// Starts the move requested by move_coordinated() on all axes in the same
+// control loop iteration.
+void ODrive::start_coordinated_move() {
+    TrapezoidalTrajectory* trajs[AXIS_COUNT];
+    float pos_setpoint[AXIS_COUNT];
+    float vel_setpoint[AXIS_COUNT];
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        trajs[i] = &axes[i].trap_traj_;
+        pos_setpoint[i] = axes[i].controller_.pos_setpoint_;
+        vel_setpoint[i] = axes[i].controller_.vel_setpoint_;
+    }
+
+    if (!TrapezoidalTrajectory::planCoordinated(trajs, AXIS_COUNT, coordinated_goal_, pos_setpoint, vel_setpoint)) {
+        for (auto& axis: axes) {
+            axis.controller_.set_error(Controller::ERROR_INVALID_INPUT_MODE);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        axes[i].controller_.input_pos_ = coordinated_goal_[i];
+        axes[i].controller_.input_pos_updated_ = false;
+        axes[i].controller_.trajectory_done_ = false;
+        axes[i].trap_traj_.t_ = 0.0f;
+    }
+}
+
+/**
+ * @brief Registers the components that control_loop_cb() runs in their
+ * default order. The actual order is derived from the port connections.
+ */
+void ODrive::build_component_graph() {
+    for (auto& axis: axes) {
+        component_graph_.add(&axis.min_endstop_, &axis.task_times_.endstop_update);
+        component_graph_.add(&axis.max_endstop_, &axis.task_times_.endstop_update);
+        component_graph_.add(&axis.motor_.fet_thermistor_, &axis.task_times_.thermistor_update);
+        component_graph_.add(&axis.motor_.motor_thermistor_, &axis.task_times_.thermistor_update);
+    }
+    // Controller of either axis might use the encoder estimate of the other
+    // axis so we process both encoders before we continue.
+    for (auto& axis: axes) {
+        component_graph_.add(&axis.encoder_, &axis.task_times_.encoder_update);
+    }
+    for (auto& axis: axes) {
+        component_graph_.add(&axis.sensorless_estimator_, &axis.task_times_.sensorless_estimator_update);
+        component_graph_.add(&axis.controller_, &axis.task_times_.controller_update);
+        component_graph_.add(&axis.open_loop_controller_, &axis.task_times_.open_loop_controller_update);
+        component_graph_.add(&axis.motor_, &axis.task_times_.motor_update); // also runs the acim_estimator_
+        component_graph_.add(&axis.motor_.current_control_, &axis.task_times_.current_controller_update);
+    }
+}
+
+/**
+ * @brief Resolves the component graph after port connections changed.
+ *
+ * Shall be called by the thread that changed the connections once the whole
+ * batch of changes is done, outside of any critical section. The new update
+ * order takes effect in the next control loop iteration.
+ */
+void ODrive::update_component_graph() {
+    while (!component_graph_.resolve_if_outdated()) {
+        osDelay(1);
+    }
+}
+
+/**
+ * @brief Runs system-level checks that need to be as real-time as possible.
+ * 
+ * This function is called after every current measurement of every motor.
+ * It should finish as quickly as possible.
+ */
+void ODrive::do_fast_checks() {
+    if (!(vbus_voltage >= config_.dc_bus_undervoltage_trip_level))
+        disarm_with_error(ERROR_DC_BUS_UNDER_VOLTAGE);
+    if (!(vbus_voltage <= config_.dc_bus_overvoltage_trip_level))
+        disarm_with_error(ERROR_DC_BUS_OVER_VOLTAGE);
+}
+
+/**
+ * @brief Floats all power phases on the system (all motors and brake resistors).
+ *
+ * This should be called if a system level exception ocurred that makes it
+ * unsafe to run power through the system in general.
+ */
+void ODrive::disarm_with_error(Error error) {
+    CRITICAL_SECTION() {
+        for (auto& axis: axes) {
+            axis.motor_.disarm_with_error(Motor::ERROR_SYSTEM_LEVEL);
+        }
+        safety_critical_disarm_brake_resistor();
+        error_ |= error;
+    }
+}
+
+/**
+ * @brief Runs the periodic sampling tasks
+ * 
+ * All components that need to sample real-world data should do it in this
+ * function as it runs on a high interrupt priority and provides lowest possible
+ * timing jitter.
+ * 
+ * All function called from this function should adhere to the following rules:
+ *  - Try to use the same number of CPU cycles in every iteration.
+ *    (reason: Tasks that run later in the function still want lowest possible timing jitter)
+ *  - Use as few cycles as possible.
+ *    (reason: The interrupt blocks other important interrupts (TODO: which ones?))
+ *  - Not call any FreeRTOS functions.
+ *    (reason: The interrupt priority is higher than the max allowed priority for syscalls)
+ * 
+ * Time consuming and undeterministic logic/arithmetic should live on
+ * control_loop_cb() instead.
+ */
+void ODrive::sampling_cb() {
+    n_evt_sampling_++;
+
+    MEASURE_TIME(task_times_.sampling) {
+        for (auto& axis: axes) {
+            axis.encoder_.sample_now();
+        }
+    }
+}
+
+/**
+ * @brief Runs the periodic control loop.
+ * 
+ * This function is executed in a low priority interrupt context and is allowed
+ * to call CMSIS functions.
+ * 
+ * Yet it runs at a higher priority than communication workloads.
+ * 
+ * @param update_cnt: The true count of update events (wrapping around at 16
+ *        bits). This is used for timestamp calculation in the face of
+ *        potentially missed timer update interrupts. Therefore this counter
+ *        must not rely on any interrupts.
+ */
+void ODrive::control_loop_cb(uint32_t timestamp) {
+    last_update_timestamp_ = timestamp;
+    n_evt_control_loop_++;
+
+    MEASURE_TIME(task_times_.control_loop_misc) {
+        // Reset the output ports of all components that run in this iteration
+        // so that we are certain about the freshness of all values that we
+        // use.
+        // TODO: maybe we should add a check to output ports that prevents
+        // double-setting the value.
+        component_graph_.start_iteration();
+
+        uart_poll();
+        odrv.oscilloscope_.update();
+    }
+
+    MEASURE_TIME(task_times_.control_loop_checks) {
+        for (auto& axis: axes) {
+            // look for errors at axis level and also all subcomponents
+            bool checks_ok = axis.do_checks(timestamp);
+
+            // make sure the watchdog is being fed. 
+            bool watchdog_ok = axis.watchdog_check();
+
+            if (!checks_ok || !watchdog_ok) {
+                axis.motor_.disarm();
+            }
+        }
+    }
+
+    // The coordinated move only touches the controllers' setpoints, so it
+    // can be started before any component runs.
+    if (coordinated_move_pending_.load(std::memory_order_acquire)) {
+        start_coordinated_move();
+        coordinated_move_pending_ = false;
+    }
+
+    for (auto& node: component_graph_) {
+        if (node.due) {
+            MEASURE_TIME(*node.timer)
+                node.component->update(timestamp);
+        }
+    }
+
+    // Record the outcome of this iteration. This also catches disarms that
+    // happened in the current measurement interrupts since the last iteration.
+    for (auto& axis: axes) {
+        axis.flight_recorder_.update(timestamp);
+    }
+
+    // Tell the axis threads that the control loop has finished
+    for (auto& axis: axes) {
+        if (axis.thread_id_) {
+            osSignalSet(axis.thread_id_, 0x0001);
+        }
+    }
+
+    get_gpio(odrv.config_.error_gpio_pin).write(odrv.any_error());
+}
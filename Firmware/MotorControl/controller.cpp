@@ -3,6 +3,10 @@
 #include <algorithm>
 #include <numeric>
 
+// Distance that the continuous-sweep anticogging calibration moves before and
+// after the recorded turn
+static constexpr float kAnticoggingSweepLeadIn = 0.05f; // [turns]
+
 bool Controller::apply_config() {
     config_.parent = this;
     update_filter_gains();
@@ -29,11 +33,22 @@ void Controller::set_error(Error error) {
 
 
 void Controller::move_to_pos(float goal_point) {
-    axis_->trap_traj_.planTrapezoidal(goal_point, pos_setpoint_, vel_setpoint_,
-                                 axis_->trap_traj_.config_.vel_limit,
-                                 axis_->trap_traj_.config_.accel_limit,
-                                 axis_->trap_traj_.config_.decel_limit);
-    axis_->trap_traj_.t_ = 0.0f;
+    if (config_.input_mode == INPUT_MODE_SCURVE_TRAJ) {
+        const TrapezoidalTrajectory::Config_t& limits = axis_->trap_traj_.config_;
+        if (!scurve_traj_.plan(goal_point, pos_setpoint_, vel_setpoint_,
+                               limits.vel_limit, limits.accel_limit,
+                               limits.decel_limit, limits.jerk_limit)) {
+            set_error(ERROR_INVALID_INPUT_MODE);
+            return;
+        }
+        scurve_traj_.t_ = 0.0f;
+    } else {
+        axis_->trap_traj_.planTrapezoidal(goal_point, pos_setpoint_, vel_setpoint_,
+                                     axis_->trap_traj_.config_.vel_limit,
+                                     axis_->trap_traj_.config_.accel_limit,
+                                     axis_->trap_traj_.config_.decel_limit);
+        axis_->trap_traj_.t_ = 0.0f;
+    }
     trajectory_done_ = false;
 }
 
@@ -49,9 +64,39 @@ void Controller::move_incremental(float displacement, bool from_input_pos = true
 
 void Controller::start_anticogging_calibration() {
     // Ensure the cogging map was correctly allocated earlier and that the motor is capable of calibrating
-    if (axis_->error_ == Axis::ERROR_NONE) {
-        config_.anticogging.calib_anticogging = true;
+    if (axis_->error_ != Axis::ERROR_NONE) {
+        return;
+    }
+
+    anticogging_sweep_ = {};
+    if (config_.anticogging.calib_sweep_vel > 0.0f) {
+        std::optional<float> pos_estimate = axis_->encoder_.pos_estimate_.any();
+        if (!pos_estimate.has_value()) {
+            set_error(ERROR_INVALID_ESTIMATE);
+            return;
+        }
+
+        // The recorded turn starts after a lead-in distance so that the
+        // velocity has settled and ends before the reversal point.
+        AnticoggingSweep_t& sweep = anticogging_sweep_;
+        sweep.start_pos = *pos_estimate;
+        sweep.end_pos = *pos_estimate + 1.0f + 2.0f * kAnticoggingSweepLeadIn;
+        sweep.first_bin = (int32_t)((sweep.start_pos + kAnticoggingSweepLeadIn) / axis_->encoder_.getCoggingRatio());
+        sweep.saved_input_mode = config_.input_mode;
+        sweep.direction = 1;
+
+        // The map is recorded from scratch, so the old one must not be applied
+        anticogging_valid_ = false;
+        config_.anticogging.index = 0;
+        config_.input_mode = INPUT_MODE_PASSTHROUGH;
+        config_.control_mode = CONTROL_MODE_POSITION_CONTROL;
+        input_pos_ = sweep.start_pos;
+        input_vel_ = 0.0f;
+        input_torque_ = 0.0f;
+        input_pos_updated();
     }
+
+    config_.anticogging.calib_anticogging = true;
 }
 
 float Controller::remove_anticogging_bias()
@@ -69,6 +114,133 @@ float Controller::remove_anticogging_bias()
 }
 
 
+/*
+ * Returns the feed-forward torque at the specified position [turns] according
+ * to the selected anticogging representation.
+ */
+float Controller::get_anticogging_torque(float pos) {
+    const Anticogging_t& anticogging = config_.anticogging;
+
+    if (anticogging.mode == ANTICOGGING_MODE_HARMONICS) {
+        float pos_frac = pos - floorf(pos);
+        size_t num_harmonics = std::min(anticogging.num_harmonics, (uint32_t)ANTICOGGING_MAX_HARMONICS);
+        float torque = 0.0f;
+        for (size_t i = 0; i < num_harmonics; ++i) {
+            float phase = (float)anticogging.harmonic_orders[i] * pos_frac;
+            phase = 2.0f * M_PI * (phase - floorf(phase));
+            float s, c;
+            our_arm_sincos_f32(phase, &s, &c);
+            torque += anticogging.harmonic_cos[i] * c + anticogging.harmonic_sin[i] * s;
+        }
+        return torque;
+    }
+
+    float anticogging_pos = pos / axis_->encoder_.getCoggingRatio();
+    return anticogging.cogging_map[std::clamp(mod((int)anticogging_pos, 3600), 0, 3600)];
+}
+
+/*
+ * Starts fitting the harmonics to the cogging map. The fit takes over half a
+ * second, so it is done by run_anticogging_fit() on a low priority thread
+ * rather than in the communication thread that calls this function.
+ */
+bool Controller::fit_anticogging_harmonics(uint32_t num_harmonics) {
+    if (num_harmonics > ANTICOGGING_MAX_HARMONICS || !anticogging_fit_done_) {
+        return false;
+    }
+
+    anticogging_fit_num_harmonics_ = num_harmonics;
+    anticogging_fit_done_ = false;
+    return true;
+}
+
+/*
+ * Approximates the cogging map by its strongest harmonics, similar to
+ * analysis/cogging_torque/cogging_harmonics.py. Instead of deriving the orders
+ * from the slot and pole count, all orders up to kMaxOrder are evaluated and
+ * the ones with the highest amplitude are kept.
+ */
+void Controller::run_anticogging_fit() {
+    constexpr size_t kMapSize = 3600;
+    constexpr uint32_t kMaxOrder = 600;
+
+    if (anticogging_fit_done_) {
+        return;
+    }
+
+    uint32_t num_harmonics = anticogging_fit_num_harmonics_;
+    const float* map = config_.anticogging.cogging_map;
+    uint32_t orders[ANTICOGGING_MAX_HARMONICS];
+    float cos_coeffs[ANTICOGGING_MAX_HARMONICS];
+    float sin_coeffs[ANTICOGGING_MAX_HARMONICS];
+    float amplitudes[ANTICOGGING_MAX_HARMONICS];
+    size_t n_found = 0;
+
+    for (uint32_t order = 0; order <= kMaxOrder; ++order) {
+        // The phase is tracked as an integer index into the map so that it
+        // doesn't accumulate rounding errors (the Goertzel algorithm is not
+        // accurate enough in single precision for this length).
+        float re = 0.0f, im = 0.0f;
+        uint32_t phase_idx = 0;
+        for (size_t i = 0; i < kMapSize; ++i) {
+            float phase = (2.0f * M_PI / (float)kMapSize) * (float)phase_idx;
+            float s, c;
+            our_arm_sincos_f32(phase, &s, &c);
+            re += map[i] * c;
+            im += map[i] * s;
+            phase_idx += order;
+            if (phase_idx >= kMapSize) {
+                phase_idx -= kMapSize;
+            }
+        }
+
+        float scale = (order == 0 ? 1.0f : 2.0f) / (float)kMapSize;
+        float cos_coeff = re * scale;
+        float sin_coeff = im * scale;
+        float amplitude = cos_coeff * cos_coeff + sin_coeff * sin_coeff;
+
+        // Insert into the list of strongest harmonics, which is sorted by
+        // descending amplitude
+        size_t pos = n_found;
+        while (pos > 0 && amplitudes[pos - 1] < amplitude) {
+            pos--;
+        }
+        if (pos >= num_harmonics) {
+            continue;
+        }
+        size_t n_move = std::min(n_found, (size_t)num_harmonics - 1) - pos;
+        std::copy_backward(orders + pos, orders + pos + n_move, orders + pos + n_move + 1);
+        std::copy_backward(cos_coeffs + pos, cos_coeffs + pos + n_move, cos_coeffs + pos + n_move + 1);
+        std::copy_backward(sin_coeffs + pos, sin_coeffs + pos + n_move, sin_coeffs + pos + n_move + 1);
+        std::copy_backward(amplitudes + pos, amplitudes + pos + n_move, amplitudes + pos + n_move + 1);
+        orders[pos] = order;
+        cos_coeffs[pos] = cos_coeff;
+        sin_coeffs[pos] = sin_coeff;
+        amplitudes[pos] = amplitude;
+        n_found = std::min(n_found + 1, (size_t)num_harmonics);
+    }
+
+    // Don't let the control loop see a partially updated set of harmonics
+    config_.anticogging.num_harmonics = 0;
+    for (size_t i = 0; i < n_found; ++i) {
+        config_.anticogging.harmonic_orders[i] = orders[i];
+        config_.anticogging.harmonic_cos[i] = cos_coeffs[i];
+        config_.anticogging.harmonic_sin[i] = sin_coeffs[i];
+    }
+    config_.anticogging.num_harmonics = n_found;
+    anticogging_fit_done_ = true;
+}
+
+bool Controller::set_anticogging_harmonic(uint32_t index, uint32_t order, float cos, float sin) {
+    if (index >= ANTICOGGING_MAX_HARMONICS) {
+        return false;
+    }
+    config_.anticogging.harmonic_orders[index] = order;
+    config_.anticogging.harmonic_cos[index] = cos;
+    config_.anticogging.harmonic_sin[index] = sin;
+    return true;
+}
+
 /*
  * This anti-cogging implementation iterates through each encoder position,
  * waits for zero velocity & position error,
@@ -102,6 +274,100 @@ bool Controller::anticogging_calibration(float pos_estimate, float vel_estimate)
     }
 }
 
+/*
+ * This anti-cogging implementation moves the axis at a constant, slow velocity
+ * (calib_sweep_vel) across one turn in both directions and records the
+ * torque that the controller applies at each position.
+ *
+ * Friction and damping act against the direction of motion, so they cancel
+ * out when the two directions are averaged. The samples are binned into the
+ * cogging map as the axis moves, which means that no extra memory is needed
+ * and the calibration takes only a few seconds.
+ */
+bool Controller::anticogging_sweep_calibration(float pos_estimate) {
+    AnticoggingSweep_t& sweep = anticogging_sweep_;
+    float* map = config_.anticogging.cogging_map;
+    int32_t first = sweep.direction > 0 ? sweep.first_bin : sweep.first_bin + 3599;
+    int32_t last = sweep.direction > 0 ? sweep.first_bin + 3599 : sweep.first_bin;
+
+    // Writes the average of the accumulated samples to all bins from the
+    // current one up to (but not including) the specified one. Bins are
+    // skipped if the axis moves by more than one bin per control loop
+    // iteration, so they get the same value as their neighbour.
+    auto flush_until = [&](int32_t end) {
+        float torque = sweep.n_samples ? sweep.torque_sum / (float)sweep.n_samples : 0.0f;
+        for (; sweep.bin != end; sweep.bin += sweep.direction) {
+            float& val = map[mod(sweep.bin, 3600)];
+            val = sweep.direction > 0 ? torque : 0.5f * (val + torque);
+        }
+        sweep.torque_sum = 0.0f;
+        sweep.n_samples = 0;
+        config_.anticogging.index = (sweep.bin - first) * sweep.direction;
+    };
+
+    // Record the torque of the last control loop iteration. The position is
+    // binned the same way as in get_anticogging_torque(). Jitter against the
+    // direction of motion doesn't go back to an earlier bin.
+    std::optional<float> torque = torque_output_.previous();
+    int32_t bin = (int32_t)(pos_estimate / axis_->encoder_.getCoggingRatio());
+    if (!sweep.recording && (bin - first) * sweep.direction >= 0) {
+        sweep.recording = true;
+        sweep.bin = first;
+    }
+    if (sweep.recording && !sweep.done_recording) {
+        if ((bin - sweep.bin) * sweep.direction > 0) {
+            bool past_last = (bin - last) * sweep.direction > 0;
+            flush_until(past_last ? last + sweep.direction : bin);
+            sweep.done_recording = past_last;
+        }
+        if (!sweep.done_recording && torque.has_value()) {
+            sweep.torque_sum += *torque;
+            sweep.n_samples++;
+        }
+    }
+
+    // Advance the setpoint
+    float vel = config_.anticogging.calib_sweep_vel * (float)sweep.direction;
+    input_pos_ += vel * current_meas_period * rate_divider_;
+    input_vel_ = vel;
+    input_torque_ = 0.0f;
+    config_.control_mode = CONTROL_MODE_POSITION_CONTROL;
+
+    bool reached_end = sweep.direction > 0 ? (input_pos_ >= sweep.end_pos) : (input_pos_ <= sweep.start_pos);
+    if (!reached_end) {
+        input_pos_updated();
+        return false;
+    }
+
+    // The position estimate lags behind the setpoint so the last bins might
+    // not have been reached yet.
+    if (!sweep.done_recording) {
+        if (!sweep.recording) {
+            sweep.bin = first;
+        }
+        flush_until(last + sweep.direction);
+    }
+
+    if (sweep.direction > 0) {
+        input_pos_ = sweep.end_pos;
+        sweep.direction = -1;
+        sweep.recording = false;
+        sweep.done_recording = false;
+        input_pos_updated();
+        return false;
+    }
+
+    sweep.direction = 0;
+    config_.anticogging.index = 0;
+    config_.input_mode = sweep.saved_input_mode;
+    input_pos_ = sweep.start_pos;
+    input_vel_ = 0.0f;
+    input_pos_updated();
+    anticogging_valid_ = true;
+    config_.anticogging.calib_anticogging = false;
+    return true;
+}
+
 void Controller::set_input_pos_and_steps(float const pos) {
     input_pos_ = pos;
     if (config_.circular_setpoints) {
@@ -129,9 +395,13 @@ bool Controller::control_mode_updated() {
 
 
 void Controller::update_filter_gains() {
-    float bandwidth = std::min(config_.input_filter_bandwidth, 0.25f * current_meas_hz);
+    uint32_t rate_divider = ComponentGraph::round_rate_divider(config_.rate_divider);
+    float rate = current_meas_hz / rate_divider;
+    float bandwidth = std::min(config_.input_filter_bandwidth, 0.25f * rate);
     input_filter_ki_ = 2.0f * bandwidth;  // basic conversion to discrete time
     input_filter_kp_ = 0.25f * (input_filter_ki_ * input_filter_ki_); // Critically damped
+    // Decays by 1% per control loop period, independent of the rate divider
+    vel_integrator_decay_ = powf(0.99f, (float)rate_divider);
 }
 
 static float limitVel(const float vel_limit, const float vel_estimate, const float vel_gain, const float torque) {
@@ -141,6 +411,8 @@ static float limitVel(const float vel_limit, const float vel_estimate, const flo
 }
 
 bool Controller::update() {
+    const float dt = current_meas_period * rate_divider_;
+
     std::optional<float> pos_estimate_linear = pos_estimate_linear_src_.present();
     std::optional<float> pos_estimate_circular = pos_estimate_circular_src_.present();
     std::optional<float> pos_wrap = pos_wrap_src_.present();
@@ -167,7 +439,11 @@ bool Controller::update() {
             return false;
         }
         // non-blocking
-        anticogging_calibration(*anticogging_pos_estimate, *anticogging_vel_estimate);
+        if (anticogging_sweep_.direction) {
+            anticogging_sweep_calibration(*anticogging_pos_estimate);
+        } else {
+            anticogging_calibration(*anticogging_pos_estimate, *anticogging_vel_estimate);
+        }
     }
 
     // TODO also enable circular deltas for 2nd order filter, etc.
@@ -190,15 +466,15 @@ bool Controller::update() {
             torque_setpoint_ = input_torque_; 
         } break;
         case INPUT_MODE_VEL_RAMP: {
-            float max_step_size = std::abs(current_meas_period * config_.vel_ramp_rate);
+            float max_step_size = std::abs(dt * config_.vel_ramp_rate);
             float full_step = input_vel_ - vel_setpoint_;
             float step = std::clamp(full_step, -max_step_size, max_step_size);
 
             vel_setpoint_ += step;
-            torque_setpoint_ = (step / current_meas_period) * config_.inertia;
+            torque_setpoint_ = (step / dt) * config_.inertia;
         } break;
         case INPUT_MODE_TORQUE_RAMP: {
-            float max_step_size = std::abs(current_meas_period * config_.torque_ramp_rate);
+            float max_step_size = std::abs(dt * config_.torque_ramp_rate);
             float full_step = input_torque_ - torque_setpoint_;
             float step = std::clamp(full_step, -max_step_size, max_step_size);
 
@@ -217,8 +493,8 @@ bool Controller::update() {
             float delta_vel = input_vel_ - vel_setpoint_; // Vel error
             float accel = input_filter_kp_*delta_pos + input_filter_ki_*delta_vel; // Feedback
             torque_setpoint_ = accel * config_.inertia; // Accel
-            vel_setpoint_ += current_meas_period * accel; // delta vel
-            pos_setpoint_ += current_meas_period * vel_setpoint_; // Delta pos
+            vel_setpoint_ += dt * accel; // delta vel
+            pos_setpoint_ += dt * vel_setpoint_; // Delta pos
         } break;
         case INPUT_MODE_MIRROR: {
             if (config_.axis_to_mirror < AXIS_COUNT) {
@@ -263,14 +539,51 @@ bool Controller::update() {
                 pos_setpoint_ = traj_step.Y;
                 vel_setpoint_ = traj_step.Yd;
                 torque_setpoint_ = traj_step.Ydd * config_.inertia;
-                axis_->trap_traj_.t_ += current_meas_period;
+                axis_->trap_traj_.t_ += dt;
+            }
+            anticogging_pos_estimate = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
+        } break;
+        case INPUT_MODE_SCURVE_TRAJ: {
+            if(input_pos_updated_){
+                move_to_pos(input_pos_);
+                input_pos_updated_ = false;
+            }
+            // Avoid updating uninitialized trajectory
+            if (trajectory_done_)
+                break;
+
+            if (scurve_traj_.t_ > scurve_traj_.Tf_) {
+                // Drop into position control mode when done to avoid problems on loop counter delta overflow
+                config_.control_mode = CONTROL_MODE_POSITION_CONTROL;
+                pos_setpoint_ = scurve_traj_.Xf_;
+                vel_setpoint_ = 0.0f;
+                torque_setpoint_ = 0.0f;
+                trajectory_done_ = true;
+            } else {
+                SCurveTrajectory::Step_t traj_step = scurve_traj_.eval(scurve_traj_.t_);
+                pos_setpoint_ = traj_step.Y;
+                vel_setpoint_ = traj_step.Yd;
+                torque_setpoint_ = traj_step.Ydd * config_.inertia;
+                scurve_traj_.t_ += dt;
+            }
+            anticogging_pos_estimate = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
+        } break;
+        case INPUT_MODE_PVT: {
+            PvtQueue::Step_t pvt_step;
+            if (pvt_queue_.update(dt, pos_setpoint_, vel_setpoint_, axis_->trap_traj_.config_.decel_limit, pvt_step)) {
+                pos_setpoint_ = pvt_step.Y;
+                vel_setpoint_ = pvt_step.Yd;
+                torque_setpoint_ = pvt_step.Ydd * config_.inertia;
+            } else {
+                vel_setpoint_ = 0.0f;
+                torque_setpoint_ = 0.0f;
             }
             anticogging_pos_estimate = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
         } break;
         case INPUT_MODE_TUNING: {
-            autotuning_phase_ = wrap_pm_pi(autotuning_phase_ + (2.0f * M_PI * autotuning_.frequency * current_meas_period));
-            float c = our_arm_cos_f32(autotuning_phase_);
-            float s = our_arm_sin_f32(autotuning_phase_);
+            autotuning_phase_ = wrap_pm_pi(autotuning_phase_ + (2.0f * M_PI * autotuning_.frequency * dt));
+            float c, s;
+            our_arm_sincos_f32(autotuning_phase_, &s, &c);
             pos_setpoint_ = input_pos_ + autotuning_.pos_amplitude * s; // + pos_amp_c * c
             vel_setpoint_ = input_vel_ + autotuning_.vel_amplitude * c;
             torque_setpoint_ = input_torque_ + autotuning_.torque_amplitude * -s;
@@ -366,8 +679,7 @@ bool Controller::update() {
             set_error(ERROR_INVALID_ESTIMATE);
             return false;
         }
-        float anticogging_pos = *anticogging_pos_estimate / axis_->encoder_.getCoggingRatio();
-        torque += config_.anticogging.cogging_map[std::clamp(mod((int)anticogging_pos, 3600), 0, 3600)];
+        torque += get_anticogging_torque(*anticogging_pos_estimate);
     }
 
     float v_err = 0.0f;
@@ -411,9 +723,9 @@ bool Controller::update() {
     } else {
         if (limited) {
             // TODO make decayfactor configurable
-            vel_integrator_torque_ *= 0.99f;
+            vel_integrator_torque_ *= vel_integrator_decay_;
         } else {
-            vel_integrator_torque_ += ((vel_integrator_gain * gain_scheduling_multiplier) * current_meas_period) * v_err;
+            vel_integrator_torque_ += ((vel_integrator_gain * gain_scheduling_multiplier) * dt) * v_err;
         }
         // integrator limiting to prevent windup 
         vel_integrator_torque_ = std::clamp(vel_integrator_torque_, -config_.vel_integrator_limit, config_.vel_integrator_limit);
@@ -428,8 +740,8 @@ bool Controller::update() {
     else {
         ideal_electrical_power = axis_->motor_.current_control_.power_;
     }
-    mechanical_power_ += config_.mechanical_power_bandwidth * current_meas_period * (torque * *vel_estimate * M_PI * 2.0f - mechanical_power_);
-    electrical_power_ += config_.electrical_power_bandwidth * current_meas_period * (ideal_electrical_power - electrical_power_);
+    mechanical_power_ += config_.mechanical_power_bandwidth * dt * (torque * *vel_estimate * M_PI * 2.0f - mechanical_power_);
+    electrical_power_ += config_.electrical_power_bandwidth * dt * (ideal_electrical_power - electrical_power_);
 
     // Spinout check
     // If mechanical power is negative (braking) and measured power is positive, something is wrong
@@ -449,3 +761,25 @@ bool Controller::update() {
     error_ &= ~ERROR_INVALID_ESTIMATE;
     return true;
 }
+
+void Controller::update(uint32_t timestamp) {
+    if (!update()) {
+        axis_->error_ |= Axis::ERROR_CONTROLLER_FAILED;
+    }
+}
+
+void Controller::get_ports(PortList& inputs, PortList& outputs) {
+    inputs.add(pos_estimate_linear_src_);
+    inputs.add(pos_estimate_circular_src_);
+    inputs.add(vel_estimate_src_);
+    inputs.add(pos_wrap_src_);
+    inputs.add(&axis_->encoder_.pos_estimate_); // anticogging
+    inputs.add(&axis_->encoder_.vel_estimate_);
+    if (config_.axis_to_mirror < AXIS_COUNT) {
+        Axis& other = axes[config_.axis_to_mirror];
+        inputs.add(&other.encoder_.pos_estimate_);
+        inputs.add(&other.encoder_.vel_estimate_);
+        inputs.add(&other.controller_.torque_output_);
+    }
+    outputs.add(&torque_output_);
+}
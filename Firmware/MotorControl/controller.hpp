@@ -1,7 +1,12 @@
 #ifndef __CONTROLLER_HPP
 #define __CONTROLLER_HPP
 
-class Controller : public ODriveIntf::ControllerIntf {
+#include "scurve_traj.hpp"
+#include "pvt_queue.hpp"
+
+#define ANTICOGGING_MAX_HARMONICS 16
+
+class Controller : public ODriveIntf::ControllerIntf, public ComponentBase {
 public:
     struct Anticogging_t {
         uint32_t index = 0;
@@ -10,8 +15,14 @@ public:
         bool calib_anticogging = false;
         float calib_pos_threshold = 1.0f;
         float calib_vel_threshold = 1.0f;
+        float calib_sweep_vel = 0.0f; // [turn/s] 0 selects the step-and-settle calibration
         float cogging_ratio = 1.0f;
         bool anticogging_enabled = true;
+        AnticoggingMode mode = ANTICOGGING_MODE_TABLE;
+        uint32_t num_harmonics = 0;
+        uint32_t harmonic_orders[ANTICOGGING_MAX_HARMONICS] = {0}; // [cycles/turn]
+        float harmonic_cos[ANTICOGGING_MAX_HARMONICS] = {0};      // [Nm]
+        float harmonic_sin[ANTICOGGING_MAX_HARMONICS] = {0};      // [Nm]
     };
 
     struct Autotuning_t {
@@ -46,6 +57,7 @@ public:
         bool enable_overspeed_error = true;
         bool enable_torque_mode_vel_limit = true;  // enable velocity limit in current control mode (requires a valid velocity estimator)
         uint8_t axis_to_mirror = -1;
+        uint32_t rate_divider = 1; // the controller runs every n-th control loop iteration
         float mirror_ratio = 1.0f;
         float torque_mirror_ratio = 0.0f;
         uint8_t load_encoder_axis = -1;  // default depends on Axis number and is set in load_configuration(). Set to -1 to select sensorless estimator.
@@ -59,6 +71,8 @@ public:
         void set_input_filter_bandwidth(float value) { input_filter_bandwidth = value; parent->update_filter_gains(); }
         void set_steps_per_circular_range(uint32_t value) { steps_per_circular_range = value > 0 ? value : steps_per_circular_range; }
         void set_control_mode(ControlMode value) { control_mode = value; parent->control_mode_updated(); }
+        void set_axis_to_mirror(uint8_t value) { axis_to_mirror = value; InputPortBase::notify_connections_changed(); }
+        void set_rate_divider(uint32_t value) { rate_divider = value; parent->update_filter_gains(); InputPortBase::notify_connections_changed(); }
     };
 
     
@@ -78,18 +92,30 @@ public:
     // Trajectory-Planned control
     void move_to_pos(float goal_point);
     void move_incremental(float displacement, bool from_goal_point);
+
+    // Streamed PVT control
+    bool push_pvt_point(float pos, float vel, float dt) { return pvt_queue_.push(pos, vel, dt); }
+    void clear_pvt_queue() { pvt_queue_.clear(); }
     
     // TODO: make this more similar to other calibration loops
     void start_anticogging_calibration();
     float remove_anticogging_bias();
     bool anticogging_calibration(float pos_estimate, float vel_estimate);
+    bool anticogging_sweep_calibration(float pos_estimate);
     
     float get_anticogging_value(uint32_t index) {
         return (index < 3600) ? config_.anticogging.cogging_map[index] : 0.0f;
     }
+    float get_anticogging_torque(float pos);
+    bool fit_anticogging_harmonics(uint32_t num_harmonics);
+    void run_anticogging_fit();
+    bool set_anticogging_harmonic(uint32_t index, uint32_t order, float cos, float sin);
 
     void update_filter_gains();
     bool update();
+    void update(uint32_t timestamp) final;
+    void get_ports(PortList& inputs, PortList& outputs) final;
+    uint32_t get_rate_divider() final { return config_.rate_divider; }
 
     Config_t config_;
     Axis* axis_ = nullptr; // set by Axis constructor
@@ -114,6 +140,7 @@ public:
     float input_torque_ = 0.0f;  // [Nm]
     float input_filter_kp_ = 0.0f;
     float input_filter_ki_ = 0.0f;
+    float vel_integrator_decay_ = 0.99f; // per update(), set by update_filter_gains()
 
     Autotuning_t autotuning_;
     float autotuning_phase_ = 0.0f;
@@ -121,8 +148,27 @@ public:
     bool input_pos_updated_ = false;
     
     bool trajectory_done_ = true;
+    SCurveTrajectory scurve_traj_; // limits are taken from axis_->trap_traj_.config_
+    PvtQueue pvt_queue_;
 
     bool anticogging_valid_ = false;
+    bool anticogging_fit_done_ = true;
+    uint32_t anticogging_fit_num_harmonics_ = 0;
+
+    // State of the continuous-sweep anticogging calibration
+    struct AnticoggingSweep_t {
+        int8_t direction = 0;       // +1: forward, -1: backward, 0: inactive
+        float start_pos = 0.0f;     // [turns]
+        float end_pos = 0.0f;       // [turns]
+        int32_t first_bin = 0;      // unwrapped bin index of the lowest recorded bin
+        int32_t bin = 0;            // unwrapped bin index that is currently being recorded
+        bool recording = false;
+        bool done_recording = false;
+        float torque_sum = 0.0f;    // [Nm]
+        uint32_t n_samples = 0;
+        InputMode saved_input_mode = INPUT_MODE_PASSTHROUGH;
+    } anticogging_sweep_;
+
     float mechanical_power_ = 0.0f; // [W]
     float electrical_power_ = 0.0f; // [W]
 
@@ -371,6 +371,7 @@ bool Encoder::run_offset_calibration() {
         axis_->motor_.current_control_.phase_vel_src_.connect_to(&axis_->open_loop_controller_.phase_vel_);
         axis_->acim_estimator_.rotor_phase_vel_src_.connect_to(&axis_->open_loop_controller_.phase_vel_);
     }
+    odrv.update_component_graph();
     axis_->wait_for_control_iteration();
 
     axis_->motor_.arm(&axis_->motor_.current_control_);
@@ -840,3 +841,11 @@ bool Encoder::update() {
 
     return true;
 }
+
+void Encoder::get_ports(PortList& inputs, PortList& outputs) {
+    outputs.add(&phase_);
+    outputs.add(&phase_vel_);
+    outputs.add(&pos_estimate_);
+    outputs.add(&vel_estimate_);
+    outputs.add(&pos_circular_);
+}
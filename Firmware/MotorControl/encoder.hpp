@@ -10,7 +10,7 @@ class Encoder;
 #include "component.hpp"
 
 
-class Encoder : public ODriveIntf::EncoderIntf {
+class Encoder : public ODriveIntf::EncoderIntf, public ComponentBase {
 public:
     static constexpr uint32_t MODE_FLAG_ABS = 0x100;
     static constexpr std::array<float, 6> hall_edge_defaults = 
@@ -82,6 +82,8 @@ public:
     void decode_hall_samples();
     int32_t hall_model(float internal_pos);
     bool update();
+    void update(uint32_t timestamp) final { update(); }
+    void get_ports(PortList& inputs, PortList& outputs) final;
 
     TIM_HandleTypeDef* timer_;
     Stm32Gpio index_gpio_;
@@ -20,6 +20,10 @@ void Endstop::update() {
     }
 }
 
+uint32_t Endstop::get_rate_divider() {
+    return axis_->config_.housekeeping_rate_divider;
+}
+
 bool Endstop::apply_config() {
     debounceTimer_.reset();
     if (config_.enabled) {
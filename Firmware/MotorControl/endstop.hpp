@@ -2,7 +2,9 @@
 #define __ENDSTOP_HPP
 
 #include "timer.hpp"
-class Endstop {
+#include "component.hpp"
+
+class Endstop : public ComponentBase {
    public:
     struct Config_t {
         float offset = 0;
@@ -25,6 +27,9 @@ class Endstop {
     bool apply_config();
 
     void update();
+    void update(uint32_t timestamp) final { update(); }
+    uint32_t get_rate_divider() final;
+
     constexpr bool get_state(){
         return endstop_state_;
     }
@@ -0,0 +1,79 @@
+
+#include "flight_recorder.hpp"
+#include <odrive_main.h>
+
+void FlightRecorder::restart() {
+    // update() runs in the control loop interrupt and doesn't touch the
+    // buffer while frozen, so clear the flag last.
+    write_pos_ = 0;
+    n_samples_ = 0;
+    axis_error_ = Axis::ERROR_NONE;
+    motor_error_ = Motor::ERROR_NONE;
+    frozen_ = false;
+}
+
+void FlightRecorder::update(uint32_t timestamp) {
+    Motor& motor = axis_->motor_;
+    bool armed = motor.is_armed_;
+    uint32_t axis_error = axis_->error_;
+
+    if (armed && !was_armed_) {
+        restart();
+    }
+
+    if (!frozen_) {
+        FieldOrientedController& foc = motor.current_control_;
+        float2D Idq_setpoint = foc.Idq_setpoint_.value_or(float2D{NAN, NAN});
+
+        float* sample = samples_[write_pos_];
+        sample[CHANNEL_ID_SETPOINT] = Idq_setpoint.first;
+        sample[CHANNEL_IQ_SETPOINT] = Idq_setpoint.second;
+        sample[CHANNEL_ID_MEASURED] = foc.Id_measured_;
+        sample[CHANNEL_IQ_MEASURED] = foc.Iq_measured_;
+        sample[CHANNEL_VBUS_VOLTAGE] = vbus_voltage;
+        sample[CHANNEL_PHASE] = foc.phase_.value_or(NAN);
+        sample[CHANNEL_VEL_ESTIMATE] = axis_->controller_.vel_estimate_src_.any().value_or(NAN);
+        sample[CHANNEL_POS_SETPOINT] = axis_->controller_.pos_setpoint_;
+        timestamps_[write_pos_] = timestamp;
+
+        if (++write_pos_ >= FLIGHT_RECORDER_DEPTH) {
+            write_pos_ = 0;
+        }
+        if (n_samples_ < FLIGHT_RECORDER_DEPTH) {
+            n_samples_++;
+        }
+
+        // The motor might have been disarmed by a higher priority interrupt at
+        // any point since the last iteration.
+        if ((was_armed_ && !armed) || (axis_error & ~last_axis_error_)) {
+            axis_error_ = (Axis::Error)axis_error;
+            motor_error_ = motor.error_;
+            frozen_ = true;
+        }
+    }
+
+    was_armed_ = armed;
+    last_axis_error_ = axis_error;
+}
+
+float FlightRecorder::get_sample(uint32_t channel, uint32_t index) {
+    if (channel >= kNumChannels || index >= n_samples_) {
+        return NAN;
+    }
+    uint32_t pos = (n_samples_ < FLIGHT_RECORDER_DEPTH ? 0 : write_pos_) + index;
+    if (pos >= FLIGHT_RECORDER_DEPTH) {
+        pos -= FLIGHT_RECORDER_DEPTH;
+    }
+    return samples_[pos][channel];
+}
+
+uint32_t FlightRecorder::get_timestamp(uint32_t index) {
+    if (index >= n_samples_) {
+        return 0;
+    }
+    uint32_t pos = (n_samples_ < FLIGHT_RECORDER_DEPTH ? 0 : write_pos_) + index;
+    if (pos >= FLIGHT_RECORDER_DEPTH) {
+        pos -= FLIGHT_RECORDER_DEPTH;
+    }
+    return timestamps_[pos];
+}
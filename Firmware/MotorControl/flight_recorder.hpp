@@ -0,0 +1,74 @@
+#ifndef __FLIGHT_RECORDER_HPP
+#define __FLIGHT_RECORDER_HPP
+
+class Axis;
+
+#include <autogen/interfaces.hpp>
+
+#define FLIGHT_RECORDER_DEPTH 256
+
+/**
+ * @brief Records key signals of an axis on every control loop iteration so
+ * that the history before a fault can be inspected afterwards.
+ *
+ * The recorder always runs. Every iteration writes one sample of fixed size
+ * into a ring buffer. When the motor gets disarmed or the axis reports a new
+ * error, the buffer freezes and keeps the last FLIGHT_RECORDER_DEPTH
+ * iterations up to and including the one in which the fault was observed.
+ * Recording resumes when the motor is armed again (which requires the errors
+ * to be cleared first) or when restart() is called.
+ */
+class FlightRecorder : public ODriveIntf::FlightRecorderIntf {
+public:
+    enum Channel {
+        CHANNEL_ID_SETPOINT,  // [A]
+        CHANNEL_IQ_SETPOINT,  // [A]
+        CHANNEL_ID_MEASURED,  // [A]
+        CHANNEL_IQ_MEASURED,  // [A]
+        CHANNEL_VBUS_VOLTAGE, // [V]
+        CHANNEL_PHASE,        // [rad] electrical
+        CHANNEL_VEL_ESTIMATE, // [turn/s]
+        CHANNEL_POS_SETPOINT, // [turn]
+        kNumChannels
+    };
+
+    void update(uint32_t timestamp);
+    void restart() override;
+
+    float get_sample(uint32_t channel, uint32_t index);
+    uint32_t get_timestamp(uint32_t index);
+
+    // All samples, channel by channel and from oldest to newest
+    Buffer<float> get_samples() {
+        return {this, [](void* ctx, uint32_t index) {
+            return ((FlightRecorder*)ctx)->get_sample(index / FLIGHT_RECORDER_DEPTH, index % FLIGHT_RECORDER_DEPTH);
+        }, kNumChannels * FLIGHT_RECORDER_DEPTH};
+    }
+
+    // The control loop timestamps of the samples, from oldest to newest
+    Buffer<uint32_t> get_timestamps() {
+        return {this, [](void* ctx, uint32_t index) {
+            return ((FlightRecorder*)ctx)->get_timestamp(index);
+        }, FLIGHT_RECORDER_DEPTH};
+    }
+
+    Axis* axis_ = nullptr; // set by Axis constructor
+
+    const uint32_t depth_ = FLIGHT_RECORDER_DEPTH;
+    uint32_t n_samples_ = 0; // number of valid samples, saturates at depth_
+    bool frozen_ = false;
+
+    // Errors at the time when the recorder froze
+    ODriveIntf::AxisIntf::Error axis_error_ = ODriveIntf::AxisIntf::ERROR_NONE;
+    ODriveIntf::MotorIntf::Error motor_error_ = ODriveIntf::MotorIntf::ERROR_NONE;
+
+private:
+    uint32_t write_pos_ = 0; // next slot in the ring buffer
+    bool was_armed_ = false;
+    uint32_t last_axis_error_ = 0;
+
+    float samples_[FLIGHT_RECORDER_DEPTH][kNumChannels] = {};
+    uint32_t timestamps_[FLIGHT_RECORDER_DEPTH] = {};
+};
+
+#endif // __FLIGHT_RECORDER_HPP
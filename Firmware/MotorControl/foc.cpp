@@ -93,13 +93,13 @@ ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
     float vbus_voltage = *vbus_voltage_measured_;
 
     std::optional<float2D> Idq;
+    float I_phase = 0.0f, c_I = 1.0f, s_I = 0.0f;
 
     // Park transform
     if (Ialpha_beta_measured_.has_value()) {
         auto [Ialpha, Ibeta] = *Ialpha_beta_measured_;
-        float I_phase = phase + phase_vel * ((float)(int32_t)(i_timestamp_ - ctrl_timestamp_) / (float)TIM_1_8_CLOCK_HZ);
-        float c_I = our_arm_cos_f32(I_phase);
-        float s_I = our_arm_sin_f32(I_phase);
+        I_phase = phase + phase_vel * ((float)(int32_t)(i_timestamp_ - ctrl_timestamp_) / (float)TIM_1_8_CLOCK_HZ);
+        our_arm_sincos_f32(I_phase, &s_I, &c_I);
         Idq = {
             c_I * Ialpha + s_I * Ibeta,
             c_I * Ibeta - s_I * Ialpha
@@ -160,9 +160,16 @@ ODriveIntf::MotorIntf::Error FieldOrientedController::get_alpha_beta_output(
     }
 
     // Inverse park transform
-    float pwm_phase = phase + phase_vel * ((float)(int32_t)(output_timestamp - ctrl_timestamp_) / (float)TIM_1_8_CLOCK_HZ);
-    float c_p = our_arm_cos_f32(pwm_phase);
-    float s_p = our_arm_sin_f32(pwm_phase);
+    // The PWM phase is usually close to the phase of the current measurement,
+    // so the rotation is derived from the one of the Park transform.
+    float c_p, s_p;
+    if (Idq.has_value()) {
+        float dphase = phase_vel * ((float)(int32_t)(output_timestamp - i_timestamp_) / (float)TIM_1_8_CLOCK_HZ);
+        sincos_advance(I_phase, s_I, c_I, dphase, &s_p, &c_p);
+    } else {
+        float pwm_phase = phase + phase_vel * ((float)(int32_t)(output_timestamp - ctrl_timestamp_) / (float)TIM_1_8_CLOCK_HZ);
+        our_arm_sincos_f32(pwm_phase, &s_p, &c_p);
+    }
     float mod_alpha = c_p * mod_d - s_p * mod_q;
     float mod_beta = c_p * mod_q + s_p * mod_d;
 
@@ -191,3 +198,10 @@ void FieldOrientedController::update(uint32_t timestamp) {
         phase_vel_ = phase_vel_src_.present();
     }
 }
+
+void FieldOrientedController::get_ports(PortList& inputs, PortList& outputs) {
+    inputs.add(Idq_setpoint_src_);
+    inputs.add(Vdq_setpoint_src_);
+    inputs.add(phase_src_);
+    inputs.add(phase_vel_src_);
+}
@@ -13,6 +13,7 @@
 class FieldOrientedController : public AlphaBetaFrameController, public ComponentBase {
 public:
     void update(uint32_t timestamp) final;
+    void get_ports(PortList& inputs, PortList& outputs) final;
 
     void reset() final;
     
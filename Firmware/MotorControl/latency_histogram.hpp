@@ -0,0 +1,88 @@
+#ifndef __LATENCY_HISTOGRAM_HPP
+#define __LATENCY_HISTOGRAM_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+
+/**
+ * @brief Histogram of task lengths (in timer clocks) with logarithmic buckets.
+ *
+ * Every power of two is split into 4 buckets, so the bucket width is at most
+ * 25% of the value. Bucket 0 starts at 4 clocks (shorter lengths are counted
+ * there as well) and the last bucket ends at 2^18 clocks (longer lengths are
+ * counted in the last bucket).
+ *
+ * add() is cheap enough to be called from the control loop: it computes the
+ * bucket index without branches and increments a 16-bit counter. When a
+ * counter saturates, all counters are halved, which keeps the shape of the
+ * distribution and gives more weight to recent samples.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t kSubBucketsLog2 = 2;
+    static constexpr size_t kMinLog2 = 2;
+    static constexpr size_t kMaxLog2 = 18;
+    static constexpr size_t kNumBuckets = (kMaxLog2 - kMinLog2) << kSubBucketsLog2;
+
+    static size_t get_bucket(uint32_t length) {
+        length = std::min(std::max(length, (uint32_t)1 << kMinLog2), ((uint32_t)1 << kMaxLog2) - 1);
+        uint32_t msb = 31 - __builtin_clz(length);
+        uint32_t sub_bucket = (length >> (msb - kSubBucketsLog2)) & ((1 << kSubBucketsLog2) - 1);
+        return ((msb - kMinLog2) << kSubBucketsLog2) + sub_bucket;
+    }
+
+    // Smallest length that falls into the specified bucket (except for bucket 0)
+    static uint32_t get_bucket_start(size_t bucket) {
+        uint32_t msb = (bucket >> kSubBucketsLog2) + kMinLog2;
+        uint32_t sub_bucket = bucket & ((1 << kSubBucketsLog2) - 1);
+        return (((1 << kSubBucketsLog2) + sub_bucket) << (msb - kSubBucketsLog2));
+    }
+
+    void add(uint32_t length) {
+        if (++counts_[get_bucket(length)] == UINT16_MAX) {
+            for (size_t i = 0; i < kNumBuckets; ++i) {
+                counts_[i] /= 2;
+            }
+        }
+    }
+
+    void reset() {
+        std::fill(counts_, counts_ + kNumBuckets, 0);
+    }
+
+    uint32_t get_count(size_t bucket) const {
+        return bucket < kNumBuckets ? counts_[bucket] : 0;
+    }
+
+    /**
+     * @brief Returns the length below which the fraction `p` of the recorded
+     * samples lies, interpolated linearly within a bucket.
+     * Returns 0 if the histogram is empty.
+     */
+    uint32_t get_percentile(float p) const {
+        uint32_t total = 0;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            total += counts_[i];
+        }
+        if (!total) {
+            return 0;
+        }
+
+        float rank = std::min(std::max(p, 0.0f), 1.0f) * (float)total;
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i < kNumBuckets - 1; ++i) {
+            if (counts_[i] && (float)(cumulative + counts_[i]) >= rank) {
+                uint32_t start = get_bucket_start(i);
+                uint32_t width = get_bucket_start(i + 1) - start;
+                return start + (uint32_t)((float)width * (rank - (float)cumulative) / (float)counts_[i]);
+            }
+            cumulative += counts_[i];
+        }
+        return get_bucket_start(kNumBuckets - 1);
+    }
+
+    uint16_t counts_[kNumBuckets] = {0};
+};
+
+#endif // __LATENCY_HISTOGRAM_HPP
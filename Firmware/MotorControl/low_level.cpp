@@ -401,6 +401,16 @@ static void analog_polling_thread(void *)
             if (fibre::is_endpoint_ref_valid(map->endpoint))
                 update_analog_endpoint(map, i);
         }
+
+        // Slow background work that must not block the communication threads
+        for (auto& axis: axes) {
+            axis.controller_.run_anticogging_fit();
+        }
+
+        // Picks up connection changes that were not followed by
+        // update_component_graph(), e.g. config changes
+        odrv.update_component_graph();
+
         osDelay(10);
     }
 }
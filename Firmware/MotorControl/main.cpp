@@ -83,42 +83,91 @@ void StatusLedController::update() {
 #endif
 }
 
+// IDs of the config objects in NVM. These must never change, otherwise the
+// objects can't be found after a firmware update. New objects must use new IDs.
+enum : uint16_t {
+    kConfigIdODrive = 0,
+    kConfigIdCan = 1,
+    kConfigIdAxisBase = 16, // each axis uses the IDs [16 + 16 * i, 32 + 16 * i)
+};
+
+enum : uint16_t {
+    kAxisConfigIdEncoder = 0,
+    kAxisConfigIdSensorlessEstimator = 1,
+    kAxisConfigIdController = 2,
+    kAxisConfigIdTrapTraj = 3,
+    kAxisConfigIdMinEndstop = 4,
+    kAxisConfigIdMaxEndstop = 5,
+    kAxisConfigIdMechanicalBrake = 6,
+    kAxisConfigIdMotor = 7,
+    kAxisConfigIdFetThermistor = 8,
+    kAxisConfigIdMotorThermistor = 9,
+    kAxisConfigIdAxis = 10,
+};
+
+static_assert(kConfigIdAxisBase + 16 * AXIS_COUNT <= ConfigManager::kMaxObjects, "too many config objects");
+
+static uint16_t axis_config_id(size_t axis, uint16_t id) {
+    return kConfigIdAxisBase + 16 * axis + id;
+}
+
+// Layouts of the config structs that changed since firmware v0.5.6, which
+// stored the raw structs. The members between the ranges were added later.
+static const std::initializer_list<LegacyRange> controller_legacy_layout = {
+    LEGACY_RANGE(Controller::Config_t, control_mode, anticogging.calib_vel_threshold),
+    LEGACY_RANGE(Controller::Config_t, anticogging.cogging_ratio, anticogging.anticogging_enabled),
+    LEGACY_RANGE(Controller::Config_t, gain_scheduling_width, axis_to_mirror),
+    LEGACY_RANGE(Controller::Config_t, mirror_ratio, spinout_mechanical_power_threshold),
+    LEGACY_RANGE(Controller::Config_t, parent, parent),
+};
+
+static const std::initializer_list<LegacyRange> trap_traj_legacy_layout = {
+    LEGACY_RANGE(TrapezoidalTrajectory::Config_t, vel_limit, decel_limit),
+};
+
+static const std::initializer_list<LegacyRange> axis_legacy_layout = {
+    LEGACY_RANGE(Axis::Config_t, startup_motor_calibration, enable_watchdog),
+    LEGACY_RANGE(Axis::Config_t, step_gpio_pin, dir_gpio_pin),
+    LEGACY_RANGE(Axis::Config_t, calibration_lockin, can.bus_vi_rate_ms),
+    LEGACY_RANGE(Axis::Config_t, parent, parent),
+};
+
 static bool config_read_all() {
     bool success = board_read_config() &&
-           config_manager.read(&odrv.config_) &&
-           config_manager.read(&odrv.can_.config_);
+           config_manager.read<ODrive3Intf::ConfigIntf>(kConfigIdODrive, &odrv.config_) &&
+           config_manager.read<ODriveIntf::CanIntf::ConfigIntf>(kConfigIdCan, &odrv.can_.config_);
     for (size_t i = 0; (i < AXIS_COUNT) && success; ++i) {
-        success = config_manager.read(&encoders[i].config_) &&
-                  config_manager.read(&axes[i].sensorless_estimator_.config_) &&
-                  config_manager.read(&axes[i].controller_.config_) &&
-                  config_manager.read(&axes[i].trap_traj_.config_) &&
-                  config_manager.read(&axes[i].min_endstop_.config_) &&
-                  config_manager.read(&axes[i].max_endstop_.config_) &&
-                  config_manager.read(&axes[i].mechanical_brake_.config_) &&
-                  config_manager.read(&motors[i].config_) &&
-                  config_manager.read(&motors[i].fet_thermistor_.config_) &&
-                  config_manager.read(&motors[i].motor_thermistor_.config_) &&
-                  config_manager.read(&axes[i].config_);
+        success = config_manager.read<ODriveIntf::EncoderIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdEncoder), &encoders[i].config_) &&
+                  config_manager.read<ODriveIntf::SensorlessEstimatorIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdSensorlessEstimator), &axes[i].sensorless_estimator_.config_) &&
+                  config_manager.read<ODriveIntf::ControllerIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdController), &axes[i].controller_.config_, controller_legacy_layout) &&
+                  config_manager.read<ODriveIntf::TrapezoidalTrajectoryIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdTrapTraj), &axes[i].trap_traj_.config_, trap_traj_legacy_layout) &&
+                  config_manager.read<ODriveIntf::EndstopIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMinEndstop), &axes[i].min_endstop_.config_) &&
+                  config_manager.read<ODriveIntf::EndstopIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMaxEndstop), &axes[i].max_endstop_.config_) &&
+                  config_manager.read<ODriveIntf::MechanicalBrakeIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMechanicalBrake), &axes[i].mechanical_brake_.config_) &&
+                  config_manager.read<ODriveIntf::MotorIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMotor), &motors[i].config_) &&
+                  config_manager.read<ODriveIntf::OnboardThermistorCurrentLimiterIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdFetThermistor), &motors[i].fet_thermistor_.config_) &&
+                  config_manager.read<ODriveIntf::OffboardThermistorCurrentLimiterIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMotorThermistor), &motors[i].motor_thermistor_.config_) &&
+                  config_manager.read<ODriveIntf::AxisIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdAxis), &axes[i].config_, axis_legacy_layout);
     }
     return success;
 }
 
 static bool config_write_all() {
     bool success = board_write_config() &&
-           config_manager.write(&odrv.config_) &&
-           config_manager.write(&odrv.can_.config_);
+           config_manager.write<ODrive3Intf::ConfigIntf>(kConfigIdODrive, &odrv.config_) &&
+           config_manager.write<ODriveIntf::CanIntf::ConfigIntf>(kConfigIdCan, &odrv.can_.config_);
     for (size_t i = 0; (i < AXIS_COUNT) && success; ++i) {
-        success = config_manager.write(&encoders[i].config_) &&
-                  config_manager.write(&axes[i].sensorless_estimator_.config_) &&
-                  config_manager.write(&axes[i].controller_.config_) &&
-                  config_manager.write(&axes[i].trap_traj_.config_) &&
-                  config_manager.write(&axes[i].min_endstop_.config_) &&
-                  config_manager.write(&axes[i].max_endstop_.config_) &&
-                  config_manager.write(&axes[i].mechanical_brake_.config_) &&
-                  config_manager.write(&motors[i].config_) &&
-                  config_manager.write(&motors[i].fet_thermistor_.config_) &&
-                  config_manager.write(&motors[i].motor_thermistor_.config_) &&
-                  config_manager.write(&axes[i].config_);
+        success = config_manager.write<ODriveIntf::EncoderIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdEncoder), &encoders[i].config_) &&
+                  config_manager.write<ODriveIntf::SensorlessEstimatorIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdSensorlessEstimator), &axes[i].sensorless_estimator_.config_) &&
+                  config_manager.write<ODriveIntf::ControllerIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdController), &axes[i].controller_.config_) &&
+                  config_manager.write<ODriveIntf::TrapezoidalTrajectoryIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdTrapTraj), &axes[i].trap_traj_.config_) &&
+                  config_manager.write<ODriveIntf::EndstopIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMinEndstop), &axes[i].min_endstop_.config_) &&
+                  config_manager.write<ODriveIntf::EndstopIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMaxEndstop), &axes[i].max_endstop_.config_) &&
+                  config_manager.write<ODriveIntf::MechanicalBrakeIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMechanicalBrake), &axes[i].mechanical_brake_.config_) &&
+                  config_manager.write<ODriveIntf::MotorIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMotor), &motors[i].config_) &&
+                  config_manager.write<ODriveIntf::OnboardThermistorCurrentLimiterIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdFetThermistor), &motors[i].fet_thermistor_.config_) &&
+                  config_manager.write<ODriveIntf::OffboardThermistorCurrentLimiterIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdMotorThermistor), &motors[i].motor_thermistor_.config_) &&
+                  config_manager.write<ODriveIntf::AxisIntf::ConfigIntf>(axis_config_id(i, kAxisConfigIdAxis), &axes[i].config_);
     }
     return success;
 }
@@ -157,22 +206,27 @@ static bool config_apply_all() {
 }
 
 bool ODrive::save_configuration(void) {
-    bool success;
+    // The communication interfaces run in separate threads
+    static std::atomic<bool> busy = false;
+    if (busy.exchange(true)) {
+        return false;
+    }
 
-    CRITICAL_SECTION() {
-        bool any_armed = std::any_of(axes.begin(), axes.end(),
-            [](auto& axis){ return axis.motor_.is_armed_; });
-        if (any_armed) {
-            return false;
-        }
+    bool any_armed = std::any_of(axes.begin(), axes.end(),
+        [](auto& axis){ return axis.motor_.is_armed_; });
 
-        size_t config_size = 0;
-        success = config_manager.prepare_store()
-               && config_write_all()
-               && config_manager.start_store(&config_size)
-               && config_write_all()
-               && config_manager.finish_store();
+    // Only the objects that changed since the last save are appended to the
+    // NVM. Programming them halts the CPU only for a few microseconds at a
+    // time, so this is safe while the control loop is running. Erasing a
+    // sector is not, so it is only allowed while all motors are disarmed.
+    size_t config_size = 0;
+    bool success = config_manager.prepare_store()
+                && config_write_all()
+                && config_manager.start_store(&config_size, !any_armed)
+                && config_write_all()
+                && config_manager.finish_store();
 
+    if (config_manager.erased_on_store_) {
         // FIXME: during save_configuration we might miss some interrupts
         // because the CPU gets halted during a flash erase. Missing events
         // (encoder updates, step/dir steps) is not good so to be sure we just
@@ -180,6 +234,7 @@ bool ODrive::save_configuration(void) {
         NVIC_SystemReset();
     }
 
+    busy = false;
     return success;
 }
 
@@ -212,42 +267,6 @@ void ODrive::enter_dfu_mode() {
     }
 }
 
-bool ODrive::any_error() {
-    return error_ != ODrive::ERROR_NONE
-        || std::any_of(axes.begin(), axes.end(), [](Axis& axis){
-            return axis.error_ != Axis::ERROR_NONE
-                || axis.motor_.error_ != Motor::ERROR_NONE
-                || axis.sensorless_estimator_.error_ != SensorlessEstimator::ERROR_NONE
-                || axis.encoder_.error_ != Encoder::ERROR_NONE
-                || axis.controller_.error_ != Controller::ERROR_NONE;
-        });
-}
-
-uint64_t ODrive::get_drv_fault() {
-#if AXIS_COUNT == 1
-    return motors[0].gate_driver_.get_error();
-#elif AXIS_COUNT == 2
-    return (uint64_t)motors[0].gate_driver_.get_error() | ((uint64_t)motors[1].gate_driver_.get_error() << 32ULL);
-#else
-    #error "not supported"
-#endif
-}
-
-void ODrive::clear_errors() {
-    for (auto& axis: axes) {
-        axis.motor_.error_ = Motor::ERROR_NONE;
-        axis.controller_.error_ = Controller::ERROR_NONE;
-        axis.sensorless_estimator_.error_ = SensorlessEstimator::ERROR_NONE;
-        axis.encoder_.error_ = Encoder::ERROR_NONE;
-        axis.encoder_.spi_error_rate_ = 0.0f;
-        axis.error_ = Axis::ERROR_NONE;
-    }
-    error_ = ERROR_NONE;
-    if (odrv.config_.enable_brake_resistor) {
-        safety_critical_arm_brake_resistor();
-    }
-}
-
 extern "C" {
 
 void vApplicationStackOverflowHook(xTaskHandle *pxTask, signed portCHAR *pcTaskName) {
@@ -291,180 +310,6 @@ void vApplicationIdleHook(void) {
 }
 }
 
-/**
- * @brief Runs system-level checks that need to be as real-time as possible.
- * 
- * This function is called after every current measurement of every motor.
- * It should finish as quickly as possible.
- */
-void ODrive::do_fast_checks() {
-    if (!(vbus_voltage >= config_.dc_bus_undervoltage_trip_level))
-        disarm_with_error(ERROR_DC_BUS_UNDER_VOLTAGE);
-    if (!(vbus_voltage <= config_.dc_bus_overvoltage_trip_level))
-        disarm_with_error(ERROR_DC_BUS_OVER_VOLTAGE);
-}
-
-/**
- * @brief Floats all power phases on the system (all motors and brake resistors).
- *
- * This should be called if a system level exception ocurred that makes it
- * unsafe to run power through the system in general.
- */
-void ODrive::disarm_with_error(Error error) {
-    CRITICAL_SECTION() {
-        for (auto& axis: axes) {
-            axis.motor_.disarm_with_error(Motor::ERROR_SYSTEM_LEVEL);
-        }
-        safety_critical_disarm_brake_resistor();
-        error_ |= error;
-    }
-}
-
-/**
- * @brief Runs the periodic sampling tasks
- * 
- * All components that need to sample real-world data should do it in this
- * function as it runs on a high interrupt priority and provides lowest possible
- * timing jitter.
- * 
- * All function called from this function should adhere to the following rules:
- *  - Try to use the same number of CPU cycles in every iteration.
- *    (reason: Tasks that run later in the function still want lowest possible timing jitter)
- *  - Use as few cycles as possible.
- *    (reason: The interrupt blocks other important interrupts (TODO: which ones?))
- *  - Not call any FreeRTOS functions.
- *    (reason: The interrupt priority is higher than the max allowed priority for syscalls)
- * 
- * Time consuming and undeterministic logic/arithmetic should live on
- * control_loop_cb() instead.
- */
-void ODrive::sampling_cb() {
-    n_evt_sampling_++;
-
-    MEASURE_TIME(task_times_.sampling) {
-        for (auto& axis: axes) {
-            axis.encoder_.sample_now();
-        }
-    }
-}
-
-/**
- * @brief Runs the periodic control loop.
- * 
- * This function is executed in a low priority interrupt context and is allowed
- * to call CMSIS functions.
- * 
- * Yet it runs at a higher priority than communication workloads.
- * 
- * @param update_cnt: The true count of update events (wrapping around at 16
- *        bits). This is used for timestamp calculation in the face of
- *        potentially missed timer update interrupts. Therefore this counter
- *        must not rely on any interrupts.
- */
-void ODrive::control_loop_cb(uint32_t timestamp) {
-    last_update_timestamp_ = timestamp;
-    n_evt_control_loop_++;
-
-    // TODO: use a configurable component list for most of the following things
-
-    MEASURE_TIME(task_times_.control_loop_misc) {
-        // Reset all output ports so that we are certain about the freshness of
-        // all values that we use.
-        // If we forget to reset a value here the worst that can happen is that
-        // this safety check doesn't work.
-        // TODO: maybe we should add a check to output ports that prevents
-        // double-setting the value.
-        for (auto& axis: axes) {
-            axis.acim_estimator_.slip_vel_.reset();
-            axis.acim_estimator_.stator_phase_vel_.reset();
-            axis.acim_estimator_.stator_phase_.reset();
-            axis.controller_.torque_output_.reset();
-            axis.encoder_.phase_.reset();
-            axis.encoder_.phase_vel_.reset();
-            axis.encoder_.pos_estimate_.reset();
-            axis.encoder_.vel_estimate_.reset();
-            axis.encoder_.pos_circular_.reset();
-            axis.motor_.Vdq_setpoint_.reset();
-            axis.motor_.Idq_setpoint_.reset();
-            axis.open_loop_controller_.Idq_setpoint_.reset();
-            axis.open_loop_controller_.Vdq_setpoint_.reset();
-            axis.open_loop_controller_.phase_.reset();
-            axis.open_loop_controller_.phase_vel_.reset();
-            axis.open_loop_controller_.total_distance_.reset();
-            axis.sensorless_estimator_.phase_.reset();
-            axis.sensorless_estimator_.phase_vel_.reset();
-            axis.sensorless_estimator_.vel_estimate_.reset();
-        }
-
-        uart_poll();
-        odrv.oscilloscope_.update();
-    }
-
-    for (auto& axis : axes) {
-        MEASURE_TIME(axis.task_times_.endstop_update) {
-            axis.min_endstop_.update();
-            axis.max_endstop_.update();
-        }
-    }
-
-    MEASURE_TIME(task_times_.control_loop_checks) {
-        for (auto& axis: axes) {
-            // look for errors at axis level and also all subcomponents
-            bool checks_ok = axis.do_checks(timestamp);
-
-            // make sure the watchdog is being fed. 
-            bool watchdog_ok = axis.watchdog_check();
-
-            if (!checks_ok || !watchdog_ok) {
-                axis.motor_.disarm();
-            }
-        }
-    }
-
-    for (auto& axis: axes) {
-        // Sub-components should use set_error which will propegate to this error_
-        MEASURE_TIME(axis.task_times_.thermistor_update) {
-            axis.motor_.fet_thermistor_.update();
-            axis.motor_.motor_thermistor_.update();
-        }
-
-        MEASURE_TIME(axis.task_times_.encoder_update)
-            axis.encoder_.update();
-    }
-
-    // Controller of either axis might use the encoder estimate of the other
-    // axis so we process both encoders before we continue.
-
-    for (auto& axis: axes) {
-        MEASURE_TIME(axis.task_times_.sensorless_estimator_update)
-            axis.sensorless_estimator_.update();
-
-        MEASURE_TIME(axis.task_times_.controller_update) {
-            if (!axis.controller_.update()) { // uses position and velocity from encoder
-                axis.error_ |= Axis::ERROR_CONTROLLER_FAILED;
-            }
-        }
-
-        MEASURE_TIME(axis.task_times_.open_loop_controller_update)
-            axis.open_loop_controller_.update(timestamp);
-
-        MEASURE_TIME(axis.task_times_.motor_update)
-            axis.motor_.update(timestamp); // uses torque from controller and phase_vel from encoder
-
-        MEASURE_TIME(axis.task_times_.current_controller_update)
-            axis.motor_.current_control_.update(timestamp); // uses the output of controller_ or open_loop_contoller_ and encoder_ or sensorless_estimator_ or acim_estimator_
-    }
-
-    // Tell the axis threads that the control loop has finished
-    for (auto& axis: axes) {
-        if (axis.thread_id_) {
-            osSignalSet(axis.thread_id_, 0x0001);
-        }
-    }
-
-    get_gpio(odrv.config_.error_gpio_pin).write(odrv.any_error());
-}
-
 
 /** @brief For diagnostics only */
 uint32_t ODrive::get_interrupt_status(int32_t irqn) {
@@ -554,6 +399,9 @@ static void rtos_main(void*) {
         axis.acim_estimator_.idq_src_.connect_to(&axis.motor_.Idq_setpoint_);
     }
 
+    odrv.build_component_graph();
+    odrv.update_component_graph();
+
     // Start PWM and enable adc interrupts/callbacks
     start_adc_pwm();
     start_analog_thread();
@@ -663,8 +511,12 @@ extern "C" int main(void) {
     // Load configuration from NVM. This needs to happen after system_init()
     // since the flash interface must be initialized and before board_init()
     // since board initialization can depend on the config.
+    // Fields that are not found in NVM (e.g. because they were added by a
+    // firmware update) keep their default value.
     size_t config_size = 0;
-    bool success = config_manager.start_load()
+    config_clear_all();
+    bool success = config_manager.init()
+            && config_manager.start_load()
             && config_read_all()
             && config_manager.finish_load(&config_size)
             && config_apply_all();
@@ -675,6 +527,12 @@ extern "C" int main(void) {
         config_apply_all();
     }
 
+    // A configuration of an older firmware version is converted to the new
+    // format once. It stays in NVM until this or a later save succeeds.
+    if (success && config_manager.has_legacy_config()) {
+        odrv.save_configuration();
+    }
+
     odrv.misconfigured_ = odrv.misconfigured_
             || (odrv.config_.enable_uart_a && !uart_a)
             || (odrv.config_.enable_uart_b && !uart_b)
@@ -556,8 +556,10 @@ void Motor::update(uint32_t timestamp) {
     // in this function.
     // A cleaner fix would be to take the feedforward calculation out of here
     // and turn it into a separate component.
-    MEASURE_TIME(axis_->task_times_.acim_estimator_update)
-        axis_->acim_estimator_.update(timestamp);
+    if (config_.motor_type == MOTOR_TYPE_ACIM) {
+        MEASURE_TIME(axis_->task_times_.acim_estimator_update)
+            axis_->acim_estimator_.update(timestamp);
+    }
 
     float vd = 0.0f;
     float vq = 0.0f;
@@ -593,6 +595,23 @@ void Motor::update(uint32_t timestamp) {
     }
 }
 
+// The ACIM estimator runs as part of update() so its ports are listed here.
+void Motor::get_ports(PortList& inputs, PortList& outputs) {
+    AcimEstimator& acim = axis_->acim_estimator_;
+    inputs.add(torque_setpoint_src_);
+    inputs.add(phase_vel_src_);
+    if (config_.motor_type == MOTOR_TYPE_ACIM) {
+        inputs.add(acim.rotor_phase_src_);
+        inputs.add(acim.rotor_phase_vel_src_);
+        inputs.add(acim.idq_src_);
+    }
+    outputs.add(&Vdq_setpoint_);
+    outputs.add(&Idq_setpoint_);
+    outputs.add(&acim.slip_vel_);
+    outputs.add(&acim.stator_phase_vel_);
+    outputs.add(&acim.stator_phase_);
+}
+
 
 /**
  * @brief Called when the underlying hardware timer triggers an update event.
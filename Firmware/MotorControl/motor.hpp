@@ -8,7 +8,7 @@ class Motor;
 #include <autogen/interfaces.hpp>
 #include "foc.hpp"
 
-class Motor : public ODriveIntf::MotorIntf {
+class Motor : public ODriveIntf::MotorIntf, public ComponentBase {
 public:
 
     // NOTE: for gimbal motors, all units of Nm are instead V.
@@ -83,7 +83,8 @@ public:
     bool measure_phase_resistance(float test_current, float max_voltage);
     bool measure_phase_inductance(float test_voltage);
     bool run_calibration();
-    void update(uint32_t timestamp);
+    void update(uint32_t timestamp) final;
+    void get_ports(PortList& inputs, PortList& outputs) final;
 
     // These functions are called as appropriate from the board.cpp file.
     void current_meas_cb(uint32_t timestamp, std::optional<Iph_ABC_t> current);
@@ -0,0 +1,668 @@
+
+#include "nvm_config.hpp"
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+// Sector layout:
+//  - SectorHeader
+//  - records, each consisting of a RecordHeader, the payload and padding to
+//    the next 4 byte boundary
+//  - erased area
+//
+// The payload of a record is a sequence of fields, each consisting of a
+// FieldHeader and the raw bytes of the member (see FieldEncoder).
+//
+// The sector header is written last during compaction, so a sector with a
+// valid header always contains a complete copy of the configuration.
+// Records that belong to the same store operation have the same sequence
+// number and only take effect once a commit record with that sequence number
+// follows them.
+
+static constexpr uint32_t kSectorMagic = 0x4f44524e; // "ODRN"
+static constexpr uint16_t kFormatVersion = 1;
+static constexpr uint16_t kCommitId = 0xffff;
+static constexpr size_t kChunkSize = 64;
+
+struct SectorHeader {
+    uint32_t magic;
+    uint32_t generation;
+    uint16_t format_version;
+    uint16_t crc16;
+};
+
+struct RecordHeader {
+    uint32_t sequence;
+    uint16_t object_id; // kCommitId for commit records
+    uint16_t version; // config_version at the time of writing
+    uint16_t length; // payload length in bytes
+    uint16_t payload_crc16;
+    uint16_t reserved;
+    uint16_t header_crc16;
+};
+
+static_assert(sizeof(SectorHeader) == 12, "unexpected padding");
+static_assert(sizeof(RecordHeader) == 16, "unexpected padding");
+
+static uint16_t calc_config_crc16(const uint8_t* data, size_t length) {
+    return calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT, data, length);
+}
+
+static size_t record_size(size_t length) {
+    return (sizeof(RecordHeader) + length + 3) & ~(size_t)3;
+}
+
+static RecordHeader make_record_header(uint16_t id, uint32_t sequence, uint16_t length, uint16_t payload_crc16) {
+    RecordHeader header;
+    header.sequence = sequence;
+    header.object_id = id;
+    header.version = config_version;
+    header.length = length;
+    header.payload_crc16 = payload_crc16;
+    header.reserved = 0;
+    header.header_crc16 = calc_config_crc16((const uint8_t*)&header, offsetof(RecordHeader, header_crc16));
+    return header;
+}
+
+static bool header_valid(const RecordHeader& header) {
+    return header.header_crc16 == calc_config_crc16((const uint8_t*)&header, offsetof(RecordHeader, header_crc16));
+}
+
+static bool read_sector_header(size_t sector, SectorHeader* header) {
+    return NVM_read(sector, 0, (uint8_t*)header, sizeof(*header)) == 0
+        && header->magic == kSectorMagic
+        && header->format_version == kFormatVersion
+        && header->crc16 == calc_config_crc16((const uint8_t*)header, offsetof(SectorHeader, crc16));
+}
+
+static bool is_erased(size_t sector, size_t offset, size_t length) {
+    uint8_t buf[kChunkSize];
+    while (length) {
+        size_t chunk = std::min(length, sizeof(buf));
+        if (NVM_read(sector, offset, buf, chunk) != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < chunk; ++i) {
+            if (buf[i] != 0xff) {
+                return false;
+            }
+        }
+        offset += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+static bool update_crc16(size_t sector, size_t offset, size_t length, uint16_t* crc16) {
+    uint8_t buf[kChunkSize];
+    while (length) {
+        size_t chunk = std::min(length, sizeof(buf));
+        if (NVM_read(sector, offset, buf, chunk) != 0) {
+            return false;
+        }
+        *crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(*crc16, buf, chunk);
+        offset += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+static bool payload_crc_matches(size_t sector, size_t offset, size_t length, uint16_t crc16) {
+    uint16_t crc = CONFIG_CRC16_INIT;
+    return update_crc16(sector, offset, length, &crc) && crc == crc16;
+}
+
+// Legacy format (raw config structs, see LegacyDecoder):
+// Each sector is an array of 64-bit fields. The first fields hold an
+// allocation table with a 2-bit state per field of the sector, so the
+// entries of the table's own fields are never written. A configuration is a
+// run of valid fields. The last written field of the sector that holds the
+// latest configuration is valid. If that applies to both sectors, the second
+// one holds the latest configuration.
+static constexpr uint8_t kLegacyFieldValid = 0;
+static constexpr uint8_t kLegacyFieldErased = 3;
+
+static uint8_t legacy_field_state(size_t sector, size_t index) {
+    uint8_t states;
+    if (NVM_read(sector, index >> 2, &states, 1) != 0) {
+        return kLegacyFieldErased;
+    }
+    return (states >> ((index & 0x3) << 1)) & 0x3;
+}
+
+struct FieldHeader {
+    uint16_t tag;
+    uint16_t length;
+};
+
+static_assert(sizeof(FieldHeader) == 4, "unexpected padding");
+
+void FieldEncoder::put(uint16_t tag, const uint8_t* data, size_t length) {
+    FieldHeader header = {tag, (uint16_t)length};
+    if (length > 0xffff) {
+        ok_ = false;
+        return;
+    }
+
+    switch (mode_) {
+        case kModeMeasure:
+            break;
+        case kModeCrc:
+            crc16_ = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(crc16_, (const uint8_t*)&header, sizeof(header));
+            crc16_ = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(crc16_, data, length);
+            break;
+        case kModeCompare: {
+            uint8_t buf[kChunkSize];
+            size_t offset = offset_;
+            if (!ok_ || NVM_read(sector_, offset, buf, sizeof(header)) != 0
+                    || memcmp(buf, &header, sizeof(header)) != 0) {
+                ok_ = false;
+                break;
+            }
+            offset += sizeof(header);
+            for (size_t pos = 0; pos < length; pos += sizeof(buf)) {
+                size_t chunk = std::min(length - pos, sizeof(buf));
+                if (NVM_read(sector_, offset + pos, buf, chunk) != 0
+                        || memcmp(buf, data + pos, chunk) != 0) {
+                    ok_ = false;
+                    break;
+                }
+            }
+        } break;
+        case kModeProgram:
+            if (!ok_ || NVM_program(sector_, offset_, (const uint8_t*)&header, sizeof(header)) != 0
+                    || NVM_program(sector_, offset_ + sizeof(header), data, length) != 0) {
+                ok_ = false;
+            }
+            break;
+    }
+
+    offset_ += sizeof(header) + length;
+    length_ += sizeof(header) + length;
+}
+
+void FieldDecoder::get(uint16_t tag, uint8_t* data, size_t length, size_t element_size) {
+    for (size_t pos = 0; pos + sizeof(FieldHeader) <= length_; ) {
+        FieldHeader header;
+        if (NVM_read(sector_, offset_ + pos, (uint8_t*)&header, sizeof(header)) != 0) {
+            ok_ = false;
+            return;
+        }
+        pos += sizeof(header);
+        if (header.length > length_ - pos) {
+            break; // can't happen unless the encoding has a bug
+        }
+
+        if (header.tag == tag) {
+            size_t n = 0;
+            if (header.length == length) {
+                n = length;
+            } else if (element_size && (header.length % element_size) == 0) {
+                n = std::min((size_t)header.length, length);
+            }
+            if (!n) {
+                break; // the type of the field changed
+            }
+            if (NVM_read(sector_, offset_ + pos, data, n) != 0) {
+                ok_ = false;
+                return;
+            }
+            n_loaded_++;
+            return;
+        }
+
+        pos += header.length;
+    }
+
+    n_defaulted_++;
+}
+
+void LegacyDecoder::get(uint8_t* data, size_t length) {
+    size_t member = (uintptr_t)data - (uintptr_t)obj_;
+    size_t pos = 0; // offset of the current range in the legacy layout
+    for (size_t i = 0; i < n_ranges_; ++i) {
+        const LegacyRange& range = layout_[i];
+        pos = (pos + range.align - 1) / range.align * range.align;
+        if (member >= range.begin && member + length <= range.end) {
+            if (NVM_read(sector_, offset_ + pos + (member - range.begin), data, length) != 0) {
+                ok_ = false;
+                return;
+            }
+            n_loaded_++;
+            return;
+        }
+        pos += range.end - range.begin;
+    }
+
+    n_defaulted_++;
+}
+
+size_t LegacyDecoder::legacy_size(const LegacyRange* layout, size_t n_ranges, size_t align) {
+    size_t pos = 0;
+    for (size_t i = 0; i < n_ranges; ++i) {
+        pos = (pos + layout[i].align - 1) / layout[i].align * layout[i].align;
+        pos += layout[i].end - layout[i].begin;
+    }
+    return (pos + align - 1) / align * align;
+}
+
+bool ConfigManager::init() {
+    active_sector_ = NVM_SECTOR_COUNT;
+    generation_ = 0;
+    legacy_sector_ = NVM_SECTOR_COUNT;
+
+    for (size_t i = 0; i < NVM_SECTOR_COUNT; ++i) {
+        SectorHeader header;
+        if (read_sector_header(i, &header) && header.generation > generation_) {
+            active_sector_ = i;
+            generation_ = header.generation;
+        }
+    }
+
+    // Without a log, the NVM may still hold the configuration of an older
+    // firmware version. It must survive until it was saved in the new format.
+    if (active_sector_ >= NVM_SECTOR_COUNT) {
+        find_legacy_config();
+    }
+
+    // Any other sector is either outdated or an incomplete compaction.
+    // Erasing it now keeps the spare sector ready for the next compaction.
+    for (size_t i = 0; i < NVM_SECTOR_COUNT; ++i) {
+        if (i != active_sector_ && i != legacy_sector_ && !is_erased(i, 0, NVM_get_sector_size())) {
+            if (NVM_erase_sector(i) != 0) {
+                return false;
+            }
+        }
+    }
+    spare_erased_ = !has_legacy_config();
+
+    if (active_sector_ >= NVM_SECTOR_COUNT) {
+        // With a legacy configuration, the sector header is written by the
+        // first store operation, so that an interrupted store operation
+        // leaves the legacy configuration in effect.
+        active_sector_ = has_legacy_config() ? (legacy_sector_ + 1) % NVM_SECTOR_COUNT : 0;
+        generation_ = 1;
+        if (!has_legacy_config() && !start_sector(active_sector_, generation_)) {
+            return false;
+        }
+    }
+
+    scan();
+
+    if (tail_corrupt_) {
+        // A store operation was interrupted at a point where the end of the
+        // log can't be found anymore. Move the valid records to a fresh sector.
+        size_t old_sector = active_sector_;
+        if (!compact(true) || NVM_erase_sector(old_sector) != 0) {
+            return false;
+        }
+        spare_erased_ = true;
+    }
+
+    return true;
+}
+
+bool ConfigManager::find_legacy_config() {
+    const size_t n_fields = NVM_get_sector_size() >> 3;
+    const size_t n_reserved = n_fields >> 5; // fields that hold the allocation table
+
+    for (size_t i = NVM_SECTOR_COUNT; i-- > 0; ) {
+        // The record log always writes to this area
+        if (!is_erased(i, 0, n_reserved >> 2)) {
+            continue;
+        }
+
+        size_t end = n_fields;
+        while (end > n_reserved && legacy_field_state(i, end - 1) == kLegacyFieldErased) {
+            end--;
+        }
+        size_t begin = end;
+        while (begin > n_reserved && legacy_field_state(i, begin - 1) == kLegacyFieldValid) {
+            begin--;
+        }
+
+        if (begin < end) {
+            legacy_sector_ = i;
+            legacy_offset_ = begin << 3;
+            legacy_length_ = (end - begin) << 3;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ConfigManager::start_sector(size_t sector, uint32_t generation) {
+    SectorHeader header;
+    header.magic = kSectorMagic;
+    header.generation = generation;
+    header.format_version = kFormatVersion;
+    header.crc16 = calc_config_crc16((const uint8_t*)&header, offsetof(SectorHeader, crc16));
+    return NVM_program(sector, 0, (const uint8_t*)&header, sizeof(header)) == 0;
+}
+
+void ConfigManager::scan() {
+    const size_t sector_size = NVM_get_sector_size();
+    uint32_t pending[kMaxObjects] = {};
+    uint32_t pending_sequence = 0;
+    bool poisoned = false;
+
+    memset(latest_, 0, sizeof(latest_));
+    tail_corrupt_ = false;
+    sequence_ = 0;
+
+    size_t offset = sizeof(SectorHeader);
+    while (offset + sizeof(RecordHeader) <= sector_size) {
+        RecordHeader header;
+        if (is_erased(active_sector_, offset, sizeof(header))) {
+            break; // end of log
+        }
+        if (NVM_read(active_sector_, offset, (uint8_t*)&header, sizeof(header)) != 0
+                || !header_valid(header)
+                || record_size(header.length) > sector_size - offset) {
+            tail_corrupt_ = true;
+            break;
+        }
+
+        if (header.sequence > sequence_) {
+            sequence_ = header.sequence;
+        }
+        if (header.sequence != pending_sequence) {
+            memset(pending, 0, sizeof(pending));
+            pending_sequence = header.sequence;
+            poisoned = false;
+        }
+
+        if (header.object_id == kCommitId) {
+            for (size_t i = 0; !poisoned && i < kMaxObjects; ++i) {
+                if (pending[i]) {
+                    latest_[i] = pending[i];
+                }
+            }
+            memset(pending, 0, sizeof(pending));
+        } else if (header.object_id < kMaxObjects
+                && payload_crc_matches(active_sector_, offset + sizeof(header), header.length, header.payload_crc16)) {
+            pending[header.object_id] = offset;
+        } else {
+            poisoned = true; // the store operation that wrote this record was interrupted
+        }
+
+        offset += record_size(header.length);
+    }
+
+    end_ = offset;
+}
+
+bool ConfigManager::append_record(uint16_t id, uint32_t sequence, void* obj, EncodeFn encode, uint32_t* record_offset) {
+    FieldEncoder crc_pass{FieldEncoder::kModeCrc};
+    if (encode) {
+        (*encode)(obj, crc_pass);
+    }
+
+    size_t length = crc_pass.length_;
+    size_t size = record_size(length);
+    if (tail_corrupt_ || length > 0xffff || end_ + size > NVM_get_sector_size()) {
+        return false;
+    }
+    if (!is_erased(active_sector_, end_, size)) {
+        tail_corrupt_ = true;
+        return false;
+    }
+
+    RecordHeader header = make_record_header(id, sequence, (uint16_t)length, crc_pass.crc16_);
+    if (NVM_program(active_sector_, end_, (const uint8_t*)&header, sizeof(header)) != 0) {
+        tail_corrupt_ = true;
+        return false;
+    }
+
+    FieldEncoder program_pass{FieldEncoder::kModeProgram, active_sector_, end_ + sizeof(header)};
+    if (encode) {
+        (*encode)(obj, program_pass);
+    }
+    if (!program_pass.ok_ || program_pass.length_ != length) {
+        tail_corrupt_ = true;
+        return false;
+    }
+
+    // The object is not protected against concurrent modification. If it
+    // changed between the two passes, the record is ignored on load.
+    size_t offset = end_;
+    end_ += size;
+    if (!payload_crc_matches(active_sector_, offset + sizeof(header), length, header.payload_crc16)) {
+        return false;
+    }
+
+    if (record_offset) {
+        *record_offset = offset;
+    }
+    n_records_written_++;
+    return true;
+}
+
+bool ConfigManager::compact(bool allow_erase) {
+    const size_t sector_size = NVM_get_sector_size();
+    size_t target = (active_sector_ + 1) % NVM_SECTOR_COUNT;
+
+    if (has_legacy_config()) {
+        return false; // the target still holds the legacy configuration
+    }
+
+    if (!spare_erased_) {
+        if (!allow_erase || NVM_erase_sector(target) != 0) {
+            return false;
+        }
+        erased_on_store_ = true;
+    }
+    spare_erased_ = false; // from here on the target is dirty
+
+    uint32_t sequence = sequence_ + 1;
+    size_t offset = sizeof(SectorHeader);
+
+    for (size_t i = 0; i < kMaxObjects; ++i) {
+        if (!latest_[i]) {
+            continue;
+        }
+        RecordHeader header;
+        if (NVM_read(active_sector_, latest_[i], (uint8_t*)&header, sizeof(header)) != 0) {
+            return false;
+        }
+        size_t size = record_size(header.length);
+        if (offset + size > sector_size) {
+            return false;
+        }
+
+        size_t src = latest_[i] + sizeof(header);
+        size_t dst = offset + sizeof(header);
+        for (size_t remaining = header.length; remaining; ) {
+            uint8_t buf[kChunkSize];
+            size_t chunk = std::min(remaining, sizeof(buf));
+            if (NVM_read(active_sector_, src, buf, chunk) != 0
+                    || NVM_program(target, dst, buf, chunk) != 0) {
+                return false;
+            }
+            src += chunk;
+            dst += chunk;
+            remaining -= chunk;
+        }
+
+        header.sequence = sequence;
+        header.header_crc16 = calc_config_crc16((const uint8_t*)&header, offsetof(RecordHeader, header_crc16));
+        if (NVM_program(target, offset, (const uint8_t*)&header, sizeof(header)) != 0) {
+            return false;
+        }
+        offset += size;
+    }
+
+    RecordHeader commit = make_record_header(kCommitId, sequence, 0, CONFIG_CRC16_INIT);
+    if (offset + sizeof(commit) > sector_size
+            || NVM_program(target, offset, (const uint8_t*)&commit, sizeof(commit)) != 0) {
+        return false;
+    }
+
+    if (!start_sector(target, generation_ + 1)) {
+        return false;
+    }
+
+    active_sector_ = target;
+    generation_++;
+    n_compactions_++;
+    scan();
+    return !tail_corrupt_;
+}
+
+bool ConfigManager::read_object(uint16_t id, void* obj, DecodeFn decode) {
+    RecordHeader header;
+    if (id >= kMaxObjects) {
+        return false;
+    }
+    if (!latest_[id]) {
+        return true; // never stored
+    }
+    if (NVM_read(active_sector_, latest_[id], (uint8_t*)&header, sizeof(header)) != 0) {
+        return false;
+    }
+    if (header.version != config_version) {
+        return true; // unknown encoding
+    }
+
+    FieldDecoder decoder{active_sector_, latest_[id] + sizeof(header), header.length};
+    (*decode)(obj, decoder);
+    load_size_ += header.length;
+    n_fields_loaded_ += decoder.n_loaded_;
+    n_fields_defaulted_ += decoder.n_defaulted_;
+    return decoder.ok_;
+}
+
+bool ConfigManager::read_legacy_object(void* obj, LegacyDecodeFn decode, const LegacyRange* layout, size_t n_ranges, size_t align) {
+    size_t size = LegacyDecoder::legacy_size(layout, n_ranges, align);
+    size_t offset = legacy_offset_ + load_size_;
+    if (load_size_ + size > legacy_length_
+            || !update_crc16(legacy_sector_, offset, size, &legacy_crc16_)) {
+        return false;
+    }
+
+    LegacyDecoder decoder{obj, legacy_sector_, offset, layout, n_ranges};
+    (*decode)(obj, decoder);
+    load_size_ += size;
+    n_fields_loaded_ += decoder.n_loaded_;
+    n_fields_defaulted_ += decoder.n_defaulted_;
+    return decoder.ok_;
+}
+
+bool ConfigManager::legacy_crc_matches() {
+    uint16_t crc16;
+    if (load_size_ + sizeof(crc16) > legacy_length_
+            || NVM_read(legacy_sector_, legacy_offset_ + load_size_, (uint8_t*)&crc16, sizeof(crc16)) != 0) {
+        return false;
+    }
+    load_size_ += sizeof(crc16);
+    return crc16 == legacy_crc16_;
+}
+
+bool ConfigManager::object_matches(uint16_t id, void* obj, EncodeFn encode) {
+    RecordHeader header;
+    if (id >= kMaxObjects || !latest_[id]
+            || NVM_read(active_sector_, latest_[id], (uint8_t*)&header, sizeof(header)) != 0
+            || header.version != config_version) {
+        return false;
+    }
+
+    FieldEncoder encoder{FieldEncoder::kModeCompare, active_sector_, latest_[id] + sizeof(header)};
+    (*encode)(obj, encoder);
+    return encoder.ok_ && encoder.length_ == header.length;
+}
+
+static size_t encoded_size(void* obj, ConfigManager::EncodeFn encode) {
+    FieldEncoder encoder{FieldEncoder::kModeMeasure};
+    (*encode)(obj, encoder);
+    return encoder.length_;
+}
+
+bool ConfigManager::prepare_store() {
+    store_count_ = 0;
+    store_size_ = 0;
+    erased_on_store_ = false;
+    store_state = (active_sector_ < NVM_SECTOR_COUNT) ? kStoreStatePreparing : kStoreStateFailed;
+    return store_state == kStoreStatePreparing;
+}
+
+bool ConfigManager::write_object(uint16_t id, void* obj, EncodeFn encode) {
+    store_count_++;
+    if (id >= kMaxObjects) {
+        return (store_state = kStoreStateFailed), false;
+    }
+
+    if (store_state == kStoreStatePreparing) {
+        if (!object_matches(id, obj, encode)) {
+            store_size_ += record_size(encoded_size(obj, encode));
+        }
+        return true;
+    } else if (store_state == kStoreStateInProgress) {
+        if (object_matches(id, obj, encode)) {
+            return true;
+        }
+        written_size_ += record_size(encoded_size(obj, encode));
+        if (written_size_ > store_size_
+                || !append_record(id, store_sequence_, obj, encode, &pending_[id])) {
+            return (store_state = kStoreStateFailed), false;
+        }
+        return true;
+    } else {
+        return (store_state = kStoreStateFailed), false;
+    }
+}
+
+bool ConfigManager::start_store(size_t* occupied_size, bool allow_erase) {
+    if (store_state != kStoreStatePreparing) {
+        return (store_state = kStoreStateFailed), false;
+    }
+
+    size_t required = store_size_ ? store_size_ + record_size(0) : 0;
+    if (tail_corrupt_ || end_ + required > NVM_get_sector_size()) {
+        if (!compact(allow_erase) || end_ + required > NVM_get_sector_size()) {
+            return (store_state = kStoreStateFailed), false;
+        }
+    }
+
+    if (occupied_size) {
+        *occupied_size = required;
+    }
+    n_objects_ = store_count_;
+    store_count_ = 0;
+    written_size_ = 0;
+    store_sequence_ = ++sequence_;
+    memset(pending_, 0, sizeof(pending_));
+    store_state = kStoreStateInProgress;
+    return true;
+}
+
+bool ConfigManager::finish_store() {
+    if (store_state != kStoreStateInProgress || store_count_ != n_objects_) {
+        return (store_state = kStoreStateFailed), false;
+    }
+
+    if (written_size_) {
+        if (!append_record(kCommitId, store_sequence_, nullptr, nullptr, nullptr)) {
+            return (store_state = kStoreStateFailed), false;
+        }
+        for (size_t i = 0; i < kMaxObjects; ++i) {
+            if (pending_[i]) {
+                latest_[i] = pending_[i];
+            }
+        }
+    }
+
+    if (has_legacy_config()) {
+        // The log now holds the complete configuration. From here on the
+        // legacy configuration is ignored and its sector is erased by the
+        // next init().
+        if (!start_sector(active_sector_, generation_)) {
+            return (store_state = kStoreStateFailed), false;
+        }
+        legacy_sector_ = NVM_SECTOR_COUNT;
+    }
+
+    store_state = kStoreStateIdle;
+    return true;
+}
@@ -1,14 +1,23 @@
 /*
 * Convenience functions to load and store multiple objects from and to NVM.
-* 
-* The NVM stores consecutive one-to-one copies of arbitrary objects.
-* The types of these objects are passed as template arguments to Config<Ts...>.
+*
+* The NVM holds an append-only log of records. Each record contains the
+* fields of one config object, and each field is identified by a tag. The
+* list of fields of a config object is generated from odrive-interface.yaml
+* (visit_config_fields() in autogen/interfaces.hpp).
 */
 
+#ifndef __NVM_CONFIG_HPP
+#define __NVM_CONFIG_HPP
+
 /* Includes ------------------------------------------------------------------*/
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <array>
+#include <initializer_list>
+#include <type_traits>
 
 #include <Drivers/STM32/stm32_nvm.h>
 #include <fibre/../../crc.hpp>
@@ -24,162 +33,317 @@
 /* Global variables ----------------------------------------------------------*/
 /* Private constant data -----------------------------------------------------*/
 
-// IMPORTANT: if you change, reorder or otherwise modify any of the fields in
-// the config structs without changing its total length, make sure to increment this number:
-static constexpr uint16_t config_version = 0x0001;
+// Version of the record encoding. Fields are matched by their tag, so adding,
+// removing or reordering fields in the config structs does not require a new
+// version. Records with a different version are ignored on load.
+static constexpr uint16_t config_version = 0x0002;
+
+// Version of the raw struct format that was used before the record log (see
+// LegacyDecoder)
+static constexpr uint16_t legacy_config_version = 0x0001;
 
 /* Private variables ---------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 /* Function implementations --------------------------------------------------*/
 
+/**
+ * @brief Serializes the fields of a config object into a record.
+ *
+ * The record payload is a sequence of fields, each consisting of a 16-bit tag,
+ * a 16-bit length and the raw bytes of the member. The payload is never held
+ * in RAM. Instead the object is visited once per pass (measure, checksum,
+ * compare or program).
+ */
+class FieldEncoder {
+public:
+    enum Mode {
+        kModeMeasure,
+        kModeCrc,
+        kModeCompare,
+        kModeProgram,
+    };
+
+    FieldEncoder(Mode mode, size_t sector = 0, size_t offset = 0)
+        : mode_(mode), sector_(sector), offset_(offset) {}
+
+    template<typename T>
+    void operator()(uint16_t tag, const T& member) {
+        static_assert(std::is_trivially_copyable<T>::value, "config fields must be trivially copyable");
+        put(tag, (const uint8_t*)&member, sizeof(T));
+    }
+
+    // Fields that are not persisted are left out of the record
+    template<typename T>
+    void operator()(uint16_t tag, const T& member, bool persist) {
+        if (persist) {
+            (*this)(tag, member);
+        }
+    }
+
+    void put(uint16_t tag, const uint8_t* data, size_t length);
+
+    Mode mode_;
+    size_t sector_;
+    size_t offset_; // current offset in the sector (compare and program mode)
+    size_t length_ = 0; // total length of the fields so far
+    uint16_t crc16_ = CONFIG_CRC16_INIT;
+    bool ok_ = true; // false if a field didn't match (compare mode) or couldn't be programmed
+};
+
+/**
+ * @brief Loads the fields of a config object from a record.
+ *
+ * Fields that are not found in the record keep their current value. This is
+ * the case for fields that were added after the record was written. Stored
+ * fields that don't exist anymore are skipped. If the size of a field changed,
+ * arrays load as many elements as were stored and all other fields keep their
+ * current value.
+ */
+class FieldDecoder {
+public:
+    FieldDecoder(size_t sector, size_t offset, size_t length)
+        : sector_(sector), offset_(offset), length_(length) {}
+
+    template<typename T>
+    void operator()(uint16_t tag, T& member) {
+        static_assert(std::is_trivially_copyable<T>::value, "config fields must be trivially copyable");
+        get(tag, (uint8_t*)&member, sizeof(T), element_size<T>::value);
+    }
+
+    // A conditionally persisted field is loaded whenever the record has it
+    template<typename T>
+    void operator()(uint16_t tag, T& member, bool) {
+        (*this)(tag, member);
+    }
+
+    void get(uint16_t tag, uint8_t* data, size_t length, size_t element_size);
+
+    size_t n_loaded_ = 0;
+    size_t n_defaulted_ = 0;
+    bool ok_ = true;
+
+private:
+    template<typename T> struct element_size : std::integral_constant<size_t, 0> {};
+    template<typename T, size_t N> struct element_size<T[N]> : std::integral_constant<size_t, sizeof(T)> {};
+    template<typename T, size_t N> struct element_size<std::array<T, N>> : std::integral_constant<size_t, sizeof(T)> {};
+
+    size_t sector_;
+    size_t offset_; // offset of the payload in the sector
+    size_t length_; // length of the payload
+};
+
+/**
+ * @brief A run of members of a config struct that is laid out the same way
+ * in the raw struct format of older firmware versions.
+ *
+ * The legacy layout of a struct is a list of such runs. Members between the
+ * runs were added later. Each run starts at the next offset with the alignment
+ * of its first member, so the first member must have the strictest alignment
+ * of the run.
+ */
+struct LegacyRange {
+    size_t begin; // offset of the first member in the current struct
+    size_t end; // end of the last member in the current struct
+    size_t align; // alignment of the first member
+};
+
+// The LegacyRange from member `first` to member `last` of `type`
+#define LEGACY_RANGE(type, first, last) LegacyRange{offsetof(type, first), \
+        offsetof(type, last) + sizeof(((type*)nullptr)->last), alignof(decltype(((type*)nullptr)->first))}
+
+/**
+ * @brief Loads the fields of a config object from the raw struct format of
+ * older firmware versions.
+ *
+ * Older firmware versions stored the config structs one after another as
+ * one-to-one copies, followed by a CRC16. Only the fields that are listed by
+ * the interface class are loaded, so pointers and padding are never copied.
+ * Fields that are not part of the legacy layout keep their current value.
+ */
+class LegacyDecoder {
+public:
+    LegacyDecoder(const void* obj, size_t sector, size_t offset, const LegacyRange* layout, size_t n_ranges)
+        : obj_((const uint8_t*)obj), sector_(sector), offset_(offset), layout_(layout), n_ranges_(n_ranges) {}
+
+    template<typename T>
+    void operator()(uint16_t, T& member) {
+        static_assert(std::is_trivially_copyable<T>::value, "config fields must be trivially copyable");
+        get((uint8_t*)&member, sizeof(T));
+    }
+
+    template<typename T>
+    void operator()(uint16_t tag, T& member, bool) {
+        (*this)(tag, member);
+    }
+
+    void get(uint8_t* data, size_t length);
+
+    // Returns the size of an object with the specified legacy layout
+    static size_t legacy_size(const LegacyRange* layout, size_t n_ranges, size_t align);
+
+    size_t n_loaded_ = 0;
+    size_t n_defaulted_ = 0;
+    bool ok_ = true;
+
+private:
+    const uint8_t* obj_;
+    size_t sector_;
+    size_t offset_; // offset of the object in the sector
+    const LegacyRange* layout_;
+    size_t n_ranges_;
+};
+
 /**
  * @brief Manages configuration load and store operations from and to NVM
- * 
+ *
  * Usage:
+ *  1. init() (once at startup)
+ *
  *  1. start_load()
  *  2. read() (as often needed)
- *  3. finish_load() (to see if all reads were successful and the CRC in the end is valid)
- * 
+ *  3. finish_load() (to see if all reads were successful)
+ *
  *  1. prepare_store()
  *  2. write() (as often as needed)
  *  3. start_store()
  *  4. write() (same sequence as before)
  *  5. finish_store()
- * 
- * The two store passes are required in order to measure the size on the first
- * pass. If the size increases between the first and second pass, finish_store()
- * will return an error.
+ *
+ * Each object is identified by an ID in [0, kMaxObjects), which must not
+ * change between firmware versions. The template argument TIntf of read() and
+ * write() is the generated interface class that provides the list of fields.
+ *
+ * A store operation only appends records for the objects that differ from
+ * their last stored copy, followed by a commit record. On load, records
+ * without a matching commit record are ignored, so a store operation that is
+ * interrupted (e.g. by a power loss) has no effect.
+ *
+ * The two store passes are required in order to measure the size of the
+ * changed objects on the first pass. If the size increases between the first
+ * and second pass, the second pass fails.
+ *
+ * When the active sector is full, the latest records are copied to the other
+ * sector (compaction). Compaction needs an erased sector. Erasing halts the
+ * CPU for a long time, so init() erases the unused sector at startup and
+ * start_store() only erases it if allowed by the caller.
+ *
+ * If init() finds a configuration in the raw struct format of older firmware
+ * versions, the next load operation reads it from there instead of the log.
+ * The sector that holds it is left untouched until the first store operation
+ * has finished. That store operation writes the new log to the other sector.
  */
 class ConfigManager {
 public:
+    static constexpr size_t kMaxObjects = 64;
+
+    using EncodeFn = void(*)(void* obj, FieldEncoder& encoder);
+    using DecodeFn = void(*)(void* obj, FieldDecoder& decoder);
+    using LegacyDecodeFn = void(*)(void* obj, LegacyDecoder& decoder);
+
+    /**
+     * @brief Finds the latest records in NVM and recovers from an interrupted
+     * store or compaction. This may erase sectors, so it must run at startup
+     * before the control loop is started.
+     */
+    bool init();
+
     /**
-     * @brief Starts a load operation. This can be called at any time, even half
-     * way through a previous load operation.
+     * @brief Starts a load operation. This can be called at any time after
+     * init(), even half way through a previous load operation.
      */
     bool start_load() {
-        if (NVM_init() != 0) {
+        if (active_sector_ >= NVM_SECTOR_COUNT) {
             return (load_state = kLoadStateFailed), false;
         }
-        load_offset = 0;
-        load_crc16 = CONFIG_CRC16_INIT ^ config_version;
+        load_size_ = 0;
+        legacy_crc16_ = CONFIG_CRC16_INIT ^ legacy_config_version;
+        n_fields_loaded_ = 0;
+        n_fields_defaulted_ = 0;
         load_state = kLoadStateInProgress;
         return true;
     }
 
     /**
-     * @brief Loads the next chunk from NVM.
-     * Note that this may return true even if invalid data was read. The user
-     * will know the final verdict by the return value of finish_load().
+     * @brief Loads the fields of an object from NVM. If the object was never
+     * stored, it keeps its current value.
+     * @param legacy_layout: The layout of the object in the raw struct format
+     *        of older firmware versions. Only needed if the struct changed
+     *        since then. Objects must be read in the same order as by these
+     *        firmware versions.
      */
-    template<typename T>
-    bool read(T* val) {
-        if (load_state != 1) {
+    template<typename TIntf, typename T>
+    bool read(uint16_t id, T* obj, std::initializer_list<LegacyRange> legacy_layout = {{0, sizeof(T), alignof(T)}}) {
+        if (load_state != kLoadStateInProgress) {
             return (load_state = kLoadStateFailed), false;
         }
-        size_t size = sizeof(T);
-        if (NVM_read(load_offset, (uint8_t *)val, size) != 0)
+        bool ok = has_legacy_config()
+            ? read_legacy_object(obj, [](void* obj, LegacyDecoder& decoder) { TIntf::visit_config_fields((T*)obj, decoder); },
+                                 legacy_layout.begin(), legacy_layout.size(), alignof(T))
+            : read_object(id, obj, [](void* obj, FieldDecoder& decoder) { TIntf::visit_config_fields((T*)obj, decoder); });
+        if (!ok) {
             return (load_state = kLoadStateFailed), false;
-        load_crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(load_crc16, (uint8_t *)val, size);
-        load_offset += size;
+        }
         return true;
     }
 
     /**
      * @brief Checks the final state of the load operation.
-     * If this function returns false, it is possible that previous read()
-     * operations actually returned garbage.
+     * If the configuration was loaded from the raw struct format of older
+     * firmware versions, this also checks its CRC. If that fails, the
+     * previous read() operations may have loaded garbage.
+     * @param occupied_size: Set to the size of the records that were loaded.
      */
     bool finish_load(size_t* occupied_size) {
         if (occupied_size) {
-            *occupied_size = load_offset + 2;
-        }
-
-        uint16_t crc16_calculated = load_crc16;
-        uint16_t crc16_loaded;
-        if (!read(&crc16_loaded)) {
-            return (load_state = kLoadStateFailed), false;
+            *occupied_size = load_size_;
         }
-        bool result = (load_state == 1) && (crc16_loaded == crc16_calculated);
+        bool result = (load_state == kLoadStateInProgress)
+                   && (!has_legacy_config() || legacy_crc_matches());
         load_state = kLoadStateIdle;
         return result;
     }
 
     /**
-     * @brief Starts preparation of a new store operation.
+     * @brief Returns true if init() found a configuration in the raw struct
+     * format of older firmware versions and no store operation has finished
+     * since then.
      */
-    bool prepare_store() {
-        if (store_state != kStoreStateIdle) {
-            // it might be possible to restart the store process from other states but let's be safe
-            return (store_state = kStoreStateFailed), false;
-        }
-        store_offset = 0;
-        store_crc16 = CONFIG_CRC16_INIT ^ config_version;
-        store_state = kStoreStatePreparing;
-        return true;
+    bool has_legacy_config() const {
+        return legacy_sector_ < NVM_SECTOR_COUNT;
     }
 
-    template<typename T>
-    bool write(T* val) {
-        if (store_state == kStoreStateInProgress) {
-            if (NVM_write(store_offset, (uint8_t*)val, sizeof(T)) != 0) {
-                return (store_state = kStoreStateFailed), false;
-            }
-        } else if (store_state != kStoreStatePreparing) {
-            return (store_state = kStoreStateFailed), false;
-        }
-        store_crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(store_crc16, (uint8_t *)val, sizeof(T));
-        store_offset += sizeof(T);
-        return true;
+    /**
+     * @brief Starts preparation of a new store operation. This abandons any
+     * store operation that did not finish.
+     */
+    bool prepare_store();
+
+    template<typename TIntf, typename T>
+    bool write(uint16_t id, T* obj) {
+        return write_object(id, obj, [](void* obj, FieldEncoder& encoder) { TIntf::visit_config_fields((T*)obj, encoder); });
     }
 
     /**
      * @brief Finishes the prepare pass and starts the actual store pass.
+     * @param occupied_size: Set to the number of bytes that the store
+     *        operation appends.
+     * @param allow_erase: If false, the store operation fails if it requires
+     *        a sector erase.
      */
-    bool start_store(size_t* occupied_size) {
-        if (occupied_size) {
-            *occupied_size = store_offset + 2;
-        }
-
-        if (store_state != kStoreStatePreparing) {
-            return (store_state = kStoreStateFailed), false;
-        }
-        store_offset += 2; // account for CRC16
-        if (store_offset > NVM_get_max_write_length()) {
-            return (store_state = kStoreStateFailed), false;
-        }
-        if (NVM_start_write(store_offset) != 0) {
-            return (store_state = kStoreStateFailed), false;
-        }
-        store_offset = 0;
-        store_crc16 = CONFIG_CRC16_INIT ^ config_version;
-        store_state = kStoreStateInProgress;
-        return true;
-    }
+    bool start_store(size_t* occupied_size, bool allow_erase);
 
     /**
      * @brief Commits the store operation.
      * If this function succeeds, the new configuration was successfully saved.
      * If this function fails, the old configuration was not touched.
      */
-    bool finish_store() {
-        uint16_t crc16 = store_crc16;
-        if (!write(&crc16)) {
-            return (store_state = kStoreStateFailed), false;
-        }
-        if (NVM_commit() != 0) {
-            return (store_state = kStoreStateFailed), false;
-        }
-        store_state = kStoreStateIdle;
-        return true;
-    }
+    bool finish_store();
 
     enum {
         kLoadStateIdle = 0,
         kLoadStateInProgress = 1,
         kLoadStateFailed = 2
     } load_state = kLoadStateIdle;
-    size_t load_offset;
-    size_t load_crc16;
 
     enum {
         kStoreStateIdle = 0,
@@ -187,6 +351,46 @@ public:
         kStoreStateInProgress = 2,
         kStoreStateFailed = 3
     } store_state = kStoreStateIdle;
-    size_t store_offset;
-    size_t store_crc16;
+
+    bool erased_on_store_ = false; // set by start_store() if it had to erase a sector
+    uint32_t n_records_written_ = 0;
+    uint32_t n_compactions_ = 0;
+    uint32_t n_fields_loaded_ = 0; // fields that were found by the last load operation
+    uint32_t n_fields_defaulted_ = 0; // fields of stored objects that were not found
+
+private:
+    bool read_object(uint16_t id, void* obj, DecodeFn decode);
+    bool read_legacy_object(void* obj, LegacyDecodeFn decode, const LegacyRange* layout, size_t n_ranges, size_t align);
+    bool legacy_crc_matches();
+    bool find_legacy_config();
+    bool write_object(uint16_t id, void* obj, EncodeFn encode);
+    bool object_matches(uint16_t id, void* obj, EncodeFn encode);
+    bool append_record(uint16_t id, uint32_t sequence, void* obj, EncodeFn encode, uint32_t* record_offset);
+    bool start_sector(size_t sector, uint32_t generation);
+    void scan();
+    bool compact(bool allow_erase);
+
+    size_t active_sector_ = NVM_SECTOR_COUNT; // NVM_SECTOR_COUNT: not initialized
+    uint32_t generation_ = 0; // generation of the active sector
+    bool spare_erased_ = false; // the sector after the active one is erased
+    bool tail_corrupt_ = false; // the end of the log is unknown, so nothing can be appended
+    size_t end_ = 0; // offset of the next record in the active sector
+    uint32_t sequence_ = 0; // highest sequence number in the log
+    uint32_t latest_[kMaxObjects] = {}; // offset of the latest committed record of each object or 0
+
+    size_t legacy_sector_ = NVM_SECTOR_COUNT; // NVM_SECTOR_COUNT: no legacy configuration
+    size_t legacy_offset_ = 0; // offset of the legacy configuration in its sector
+    size_t legacy_length_ = 0; // length of the legacy configuration including padding
+
+    size_t load_size_ = 0;
+    uint16_t legacy_crc16_ = 0;
+
+    size_t store_count_ = 0; // number of write() calls in the current pass
+    size_t n_objects_ = 0; // number of write() calls in the prepare pass
+    size_t store_size_ = 0; // size of the changed records as measured by the prepare pass
+    size_t written_size_ = 0;
+    uint32_t store_sequence_ = 0;
+    uint32_t pending_[kMaxObjects] = {}; // offsets of the records written by the current store operation
 };
+
+#endif // __NVM_CONFIG_HPP
@@ -152,6 +152,7 @@ inline ENUMTYPE operator ~ (ENUMTYPE a) { return static_cast<ENUMTYPE>(~static_c
 #include <mechanical_brake.hpp>
 #include <axis.hpp>
 #include <oscilloscope.hpp>
+#include <component_graph.hpp>
 #include <communication/communication.h>
 #include <communication/can/odrive_can.hpp>
 
@@ -167,7 +168,7 @@ static Stm32Gpio get_gpio(size_t gpio_num) {
     return (gpio_num < GPIO_COUNT) ? gpios[gpio_num] : GPIO_COUNT ? gpios[0] : Stm32Gpio::none;
 }
 
-// general system functions defined in main.cpp
+// general system functions defined in main.cpp and control_loop.cpp
 class ODrive : public ODriveIntf {
 public:
     bool save_configuration() override;
@@ -197,6 +198,10 @@ public:
     uint32_t get_gpio_states();
     uint64_t get_drv_fault();
     void disarm_with_error(Error error);
+    bool move_coordinated(float axis0_pos, float axis1_pos);
+    void start_coordinated_move();
+    void build_component_graph();
+    void update_component_graph();
 
     Error error_ = ERROR_NONE;
     float& vbus_voltage_ = ::vbus_voltage; // TODO: make this the actual variable
@@ -223,12 +228,7 @@ public:
 
     SystemStats_t system_stats_;
 
-    // Edit these to suit your capture needs
-    Oscilloscope oscilloscope_{
-        nullptr, // trigger_src
-        0.5f, // trigger_threshold
-        nullptr // data_src TODO: change data type
-    };
+    Oscilloscope oscilloscope_;
 
     ODriveCAN can_;
 
@@ -242,6 +242,9 @@ public:
     uint32_t n_evt_sampling_ = 0;
     uint32_t n_evt_control_loop_ = 0;
     bool task_timers_armed_ = false;
+    std::atomic<bool> coordinated_move_pending_ = false;
+    float coordinated_goal_[AXIS_COUNT];
+    ComponentGraph component_graph_;
     TaskTimes task_times_;
     const bool otp_valid_ = ((uint8_t*)FLASH_OTP_BASE)[0] != 0xff;
 };
@@ -28,3 +28,11 @@ void OpenLoopController::update(uint32_t timestamp) {
     total_distance_ = total_distance_.previous().value_or(0.0f) + phase_vel * dt;
     timestamp_ = timestamp;
 }
+
+void OpenLoopController::get_ports(PortList& inputs, PortList& outputs) {
+    outputs.add(&Idq_setpoint_);
+    outputs.add(&Vdq_setpoint_);
+    outputs.add(&phase_);
+    outputs.add(&phase_vel_);
+    outputs.add(&total_distance_);
+}
@@ -8,6 +8,8 @@
 class OpenLoopController : public ComponentBase {
 public:
     void update(uint32_t timestamp) final;
+    void get_ports(PortList& inputs, PortList& outputs) final;
+    Activity get_activity() final { return ACTIVE_IF_CONSUMED; }
 
     // Config
     float max_current_ramp_ = INFINITY; // [A/s]
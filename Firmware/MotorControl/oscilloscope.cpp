@@ -1,27 +1,114 @@
 
 #include "oscilloscope.hpp"
 
-// if you use the oscilloscope feature you can bump up this value
-#define OSCILLOSCOPE_SIZE 4096
+#include <algorithm>
+
+bool Oscilloscope::arm() {
+    // Stop the current capture before touching its settings. update() runs in
+    // the control loop interrupt and ignores everything while idle.
+    state_ = CAPTURE_STATE_IDLE;
+
+    Config_t config = config_;
+    if (config.num_channels < 1 || config.num_channels > OSCILLOSCOPE_MAX_CHANNELS
+            || config.trigger_channel >= config.num_channels) {
+        return false;
+    }
+
+    for (size_t i = 0; i < config.num_channels; ++i) {
+        Property<const float> property{nullptr, nullptr};
+        if (!fibre::get_float_property(config.channels[i], &property)) {
+            return false;
+        }
+        src_ctx_[i] = property.ctx_;
+        src_getter_[i] = property.getter_;
+    }
+
+    float pretrigger_fraction = std::clamp(config.pretrigger_fraction, 0.0f, 1.0f);
+
+    num_channels_ = config.num_channels;
+    trigger_channel_ = config.trigger_channel;
+    trigger_edge_ = config.trigger_edge;
+    trigger_threshold_ = config.trigger_threshold;
+    decimation_ = std::max(config.decimation, (uint32_t)1);
+
+    depth_ = OSCILLOSCOPE_SIZE / num_channels_;
+    // At least the trigger sample itself is recorded after the trigger
+    trigger_index_ = std::min((uint32_t)(pretrigger_fraction * (float)depth_), depth_ - 1);
+
+    write_pos_ = 0;
+    start_pos_ = 0;
+    n_recorded_ = 0;
+    n_remaining_ = 0;
+    decimation_cnt_ = 0;
+    prev_trigger_val_ = NAN;
+    force_trigger_ = false;
+
+    state_ = CAPTURE_STATE_ARMED;
+    return true;
+}
+
+bool Oscilloscope::is_trigger_edge(float prev, float val) {
+    bool rising = prev < trigger_threshold_ && val >= trigger_threshold_;
+    bool falling = prev > trigger_threshold_ && val <= trigger_threshold_;
+    switch (trigger_edge_) {
+        case TRIGGER_EDGE_RISING: return rising;
+        case TRIGGER_EDGE_FALLING: return falling;
+        case TRIGGER_EDGE_BOTH: return rising || falling;
+        default: return false;
+    }
+}
 
 void Oscilloscope::update() {
-    float trigger_data = trigger_src_ ? *trigger_src_ : 0.0f;
-    float trigger_threshold = trigger_threshold_;
-    float sample_data = data_src_ ? **data_src_ : 0.0f;
-
-    if (trigger_data < trigger_threshold) {
-        ready_ = true;
-    }
-    if (ready_ && trigger_data >= trigger_threshold) {
-        capturing_ = true;
-        ready_ = false;
-    }
-    if (capturing_) {
-        if (pos_ < OSCILLOSCOPE_SIZE) {
-            data_[pos_++] = sample_data;
-        } else {
-            pos_ = 0;
-            capturing_ = false;
+    if (state_ != CAPTURE_STATE_ARMED && state_ != CAPTURE_STATE_TRIGGERED) {
+        return;
+    }
+
+    if (state_ == CAPTURE_STATE_ARMED) {
+        // The trigger is evaluated at the full control loop rate, independent
+        // of the decimation. It is only accepted once the pre-trigger history
+        // is complete.
+        float trigger_val = (*src_getter_[trigger_channel_])(src_ctx_[trigger_channel_]);
+        bool triggered = (force_trigger_ || is_trigger_edge(prev_trigger_val_, trigger_val));
+        prev_trigger_val_ = trigger_val;
+
+        if (triggered && n_recorded_ >= trigger_index_) {
+            state_ = CAPTURE_STATE_TRIGGERED;
+            n_remaining_ = depth_ - trigger_index_;
+            decimation_cnt_ = 0; // the trigger sample is always recorded
+        }
+    }
+
+    if (decimation_cnt_ == 0) {
+        float* sample = &data_[write_pos_ * num_channels_];
+        for (size_t i = 0; i < num_channels_; ++i) {
+            sample[i] = (*src_getter_[i])(src_ctx_[i]);
+        }
+
+        if (++write_pos_ >= depth_) {
+            write_pos_ = 0;
+        }
+        if (n_recorded_ < depth_) {
+            n_recorded_++;
         }
+
+        if (state_ == CAPTURE_STATE_TRIGGERED && --n_remaining_ == 0) {
+            start_pos_ = write_pos_;
+            state_ = CAPTURE_STATE_DONE;
+        }
+    }
+
+    if (++decimation_cnt_ >= decimation_) {
+        decimation_cnt_ = 0;
+    }
+}
+
+float Oscilloscope::get_sample(uint32_t channel, uint32_t index) {
+    if (channel >= num_channels_ || index >= depth_) {
+        return NAN;
+    }
+    uint32_t pos = start_pos_ + index;
+    if (pos >= depth_) {
+        pos -= depth_;
     }
+    return data_[pos * num_channels_ + channel];
 }
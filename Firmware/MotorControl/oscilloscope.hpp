@@ -5,27 +5,74 @@
 
 // if you use the oscilloscope feature you can bump up this value
 #define OSCILLOSCOPE_SIZE 4096
+#define OSCILLOSCOPE_MAX_CHANNELS 8
 
+/**
+ * @brief Records up to OSCILLOSCOPE_MAX_CHANNELS float properties in the
+ * control loop.
+ *
+ * The samples of all channels are interleaved in a single ring buffer, so the
+ * capture depth per channel is OSCILLOSCOPE_SIZE / num_channels. The buffer is
+ * written continuously while armed, which makes the history before the trigger
+ * event available.
+ */
 class Oscilloscope : public ODriveIntf::OscilloscopeIntf {
 public:
-    Oscilloscope(float* trigger_src, float trigger_threshold, float** data_src)
-        : trigger_src_(trigger_src), trigger_threshold_(trigger_threshold), data_src_(data_src) {}
+    struct Config_t {
+        uint32_t num_channels = 1;
+        endpoint_ref_t channels[OSCILLOSCOPE_MAX_CHANNELS] = {};
+        uint32_t trigger_channel = 0;
+        TriggerEdge trigger_edge = TRIGGER_EDGE_RISING;
+        float trigger_threshold = 0.5f;
+        float pretrigger_fraction = 0.0f;
+        uint32_t decimation = 1;
+    };
 
-    float get_val(uint32_t index) override {
-        return index < OSCILLOSCOPE_SIZE ? data_[index] : NAN;
+    bool arm() override;
+    void force_trigger() override { force_trigger_ = true; }
+    float get_sample(uint32_t channel, uint32_t index) override;
+    float get_val(uint32_t index) override { return get_sample(0, index); }
+
+    // All samples of the capture, channel by channel
+    Buffer<float> get_samples() {
+        return {this, [](void* ctx, uint32_t index) {
+            Oscilloscope* osc = (Oscilloscope*)ctx;
+            return osc->get_sample(index / osc->depth_, index % osc->depth_);
+        }, num_channels_ * depth_};
     }
 
     void update();
 
+    Config_t config_;
+
     const uint32_t size_ = OSCILLOSCOPE_SIZE;
-    const float* trigger_src_;
-    const float trigger_threshold_;
-    float* const * data_src_;
+    uint32_t num_channels_ = 0; // copied from config_ on arm()
+    uint32_t depth_ = 0;
+    uint32_t trigger_index_ = 0;
+    CaptureState state_ = CAPTURE_STATE_IDLE;
+
+private:
+    bool is_trigger_edge(float prev, float val);
+
+    // Resolved on arm() so that update() doesn't need to look up the endpoints
+    void* src_ctx_[OSCILLOSCOPE_MAX_CHANNELS] = {};
+    float (*src_getter_[OSCILLOSCOPE_MAX_CHANNELS])(void*) = {};
+
+    // Settings of the current capture (copied from config_ on arm())
+    uint32_t trigger_channel_ = 0;
+    TriggerEdge trigger_edge_ = TRIGGER_EDGE_RISING;
+    float trigger_threshold_ = 0.0f;
+    uint32_t decimation_ = 1;
+
+    uint32_t write_pos_ = 0; // next sample slot in the ring buffer
+    uint32_t start_pos_ = 0; // slot of the oldest sample once the capture is done
+    uint32_t n_recorded_ = 0; // number of samples recorded since arm(), saturates at depth_
+    uint32_t n_remaining_ = 0; // number of samples left to record after the trigger
+    uint32_t decimation_cnt_ = 0;
+    float prev_trigger_val_ = NAN;
+    bool force_trigger_ = false;
 
     float data_[OSCILLOSCOPE_SIZE] = {0};
-    size_t pos_ = 0;
-    bool ready_ = false;
-    bool capturing_ = false;
 };
 
-#endif // __OSCILLOSCOPE_HPP
\ No newline at end of file
+#endif // __OSCILLOSCOPE_HPP
@@ -0,0 +1,196 @@
+#ifndef __PVT_QUEUE_HPP
+#define __PVT_QUEUE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <cmath>
+
+/**
+ * @brief Queue of position/velocity/time (PVT) points that is interpolated at
+ * control loop rate.
+ *
+ * Each point specifies the position and velocity that the setpoint should
+ * reach `dt` seconds after the previous point. Between two points, the
+ * setpoint follows the cubic Hermite polynomial that matches both positions
+ * and velocities, so position and velocity are continuous across points.
+ * Timing is exact: the time that overshoots the end of a segment is carried
+ * over into the next one.
+ *
+ * When the queue runs empty, the setpoint stops at the last point. If that
+ * point has a nonzero velocity, this counts as an underrun and the setpoint
+ * decelerates from the last point to rest. The next point then starts a new
+ * segment from the current setpoint, also while it is still decelerating.
+ *
+ * push() and clear() must be called from a single producer (e.g. the
+ * communication thread) and update() from a single consumer (the control
+ * loop). They can run concurrently without locks.
+ */
+class PvtQueue {
+public:
+    static constexpr size_t kCapacity = 32;
+
+    struct Point_t {
+        float pos; // [turn]
+        float vel; // [turn/s]
+        float dt;  // [s] time since the previous point
+    };
+
+    struct Step_t {
+        float Y = 0.0f;
+        float Yd = 0.0f;
+        float Ydd = 0.0f;
+    };
+
+    // Producer side ----------------------------------------------------------
+
+    bool push(float pos, float vel, float dt) {
+        if (!(dt > 0.0f) || !std::isfinite(dt) || !std::isfinite(pos) || !std::isfinite(vel)) {
+            return false;
+        }
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= kCapacity) {
+            return false;
+        }
+        points_[head % kCapacity] = {pos, vel, dt};
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Drops all queued points and stops the current segment at the setpoint
+    // where it is when update() sees the request.
+    void clear() {
+        discard_until_.store(head_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        clear_count_.fetch_add(1, std::memory_order_release);
+    }
+
+    uint32_t fill_level() const {
+        return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed);
+    }
+
+    // Time until the setpoint reaches the last queued point. This is
+    // approximate while update() is running concurrently.
+    float buffered_time() const {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        float time = (active_ && !stopping_) ? (T_ - t_) : 0.0f;
+        for (uint32_t i = tail_.load(std::memory_order_acquire); i != head; ++i) {
+            time += points_[i % kCapacity].dt;
+        }
+        return time;
+    }
+
+    // Consumer side ----------------------------------------------------------
+
+    /**
+     * @brief Advances the interpolation by dt.
+     *
+     * @param pos, vel: The current setpoint. A segment that starts while the
+     *        queue is idle starts from here.
+     * @param decel: Deceleration [turn/s^2] that is used to stop after an
+     *        underrun. If it is not positive, the velocity steps to zero.
+     * @param step: Receives the new setpoint unless the queue is idle.
+     * @returns: false if the queue is idle, i.e. there's no segment in
+     *           progress.
+     */
+    bool update(float dt, float pos, float vel, float decel, Step_t& step) {
+        uint32_t clear_count = clear_count_.load(std::memory_order_acquire);
+        if (clear_count != seen_clear_count_) {
+            seen_clear_count_ = clear_count;
+            uint32_t discard_until = discard_until_.load(std::memory_order_relaxed);
+            if ((int32_t)(discard_until - tail_.load(std::memory_order_relaxed)) > 0) {
+                tail_.store(discard_until, std::memory_order_release);
+            }
+            active_ = false;
+            stopping_ = false;
+        }
+
+        if (stopping_ && tail_.load(std::memory_order_relaxed) != head_.load(std::memory_order_acquire)) {
+            // A late point doesn't wait for the setpoint to come to rest
+            active_ = false;
+            stopping_ = false;
+        }
+
+        if (active_) {
+            t_ += dt;
+        }
+
+        while (!active_ || t_ >= T_) {
+            uint32_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail == head_.load(std::memory_order_acquire)) {
+                if (active_ && v1_ != 0.0f) {
+                    underrun_count_++;
+                    float T = decel > 0.0f ? std::abs(v1_) / decel : 0.0f;
+                    if (T > 0.0f && std::isfinite(T)) {
+                        // Constant deceleration from the last point to rest
+                        t_ -= T_;
+                        start_segment(p1_, v1_, {p1_ + 0.5f * v1_ * T, 0.0f, T});
+                        stopping_ = true;
+                        continue;
+                    }
+                }
+                if (active_) {
+                    // Stop at the last point
+                    active_ = false;
+                    stopping_ = false;
+                    step = {p1_, 0.0f, 0.0f};
+                    return true;
+                }
+                return false;
+            }
+
+            Point_t point = points_[tail % kCapacity];
+            tail_.store(tail + 1, std::memory_order_release);
+
+            if (active_) {
+                // Continue from the end of the previous segment
+                t_ -= T_;
+                start_segment(p1_, v1_, point);
+            } else {
+                t_ = 0.0f;
+                start_segment(pos, vel, point);
+                active_ = true;
+            }
+        }
+
+        float t = t_;
+        step = {
+            c0_ + t * (c1_ + t * (c2_ + t * c3_)),
+            c1_ + t * (2.0f * c2_ + t * 3.0f * c3_),
+            2.0f * c2_ + t * 6.0f * c3_
+        };
+        return true;
+    }
+
+    uint32_t underrun_count_ = 0;
+
+private:
+    void start_segment(float p0, float v0, const Point_t& point) {
+        float T = point.dt;
+        float dp = point.pos - p0;
+        c0_ = p0;
+        c1_ = v0;
+        c2_ = (3.0f * dp - (2.0f * v0 + point.vel) * T) / (T * T);
+        c3_ = ((v0 + point.vel) * T - 2.0f * dp) / (T * T * T);
+        T_ = T;
+        p1_ = point.pos;
+        v1_ = point.vel;
+    }
+
+    Point_t points_[kCapacity];
+    std::atomic<uint32_t> head_ = 0; // total number of pushed points
+    std::atomic<uint32_t> tail_ = 0; // total number of consumed points
+    std::atomic<uint32_t> discard_until_ = 0;
+    std::atomic<uint32_t> clear_count_ = 0;
+    uint32_t seen_clear_count_ = 0;
+
+    // Current segment
+    bool active_ = false;
+    bool stopping_ = false; // the current segment decelerates to rest after an underrun
+    float t_ = 0.0f;
+    float T_ = 0.0f;
+    float c0_ = 0.0f, c1_ = 0.0f, c2_ = 0.0f, c3_ = 0.0f;
+    float p1_ = 0.0f;
+    float v1_ = 0.0f;
+};
+
+#endif // __PVT_QUEUE_HPP
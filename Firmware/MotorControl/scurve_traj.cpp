@@ -0,0 +1,129 @@
+
+#include "scurve_traj.hpp"
+#include <cmath>
+
+// Jerk-limited change of velocity from v0 to v1 with zero acceleration at
+// both ends. The jerk is J during Tj, zero during Tc and -J during Tj again.
+struct VelChange_t {
+    float Tj;
+    float Tc;
+    float J;   // signed
+
+    float duration() const { return 2.0f * Tj + Tc; }
+};
+
+static VelChange_t plan_vel_change(float v0, float v1, float Amax, float Jmax) {
+    float dv = std::abs(v1 - v0);
+    float J = std::signbit(v1 - v0) ? -Jmax : Jmax;
+    if (dv * Jmax >= Amax * Amax) {
+        // Acceleration saturates at Amax
+        float Tj = Amax / Jmax;
+        return {Tj, dv / Amax - Tj, J};
+    } else {
+        return {std::sqrt(dv / Jmax), 0.0f, J};
+    }
+}
+
+// The velocity curve of a velocity change is point symmetric, so the average
+// velocity is (v0 + v1) / 2.
+static float vel_change_distance(float v0, float v1, float Amax, float Jmax) {
+    return 0.5f * (v0 + v1) * plan_vel_change(v0, v1, Amax, Jmax).duration();
+}
+
+// Symbol                     Description
+// Xi and Vi                  Initial conditions
+// Xf                         Position set-point
+// s                          Direction (sign) of the trajectory
+// Vmax, Amax, Dmax and Jmax  Kinematic bounds
+// Vr                         Reached (cruise or peak) velocity
+// Tv                         Duration of the cruise segment
+
+bool SCurveTrajectory::plan(float Xf, float Xi, float Vi,
+                            float Vmax, float Amax, float Dmax, float Jmax) {
+    if (!(Vmax > 0.0f && Amax > 0.0f && Dmax > 0.0f && Jmax > 0.0f)) {
+        return false;
+    }
+
+    float dX = Xf - Xi;  // Distance to travel
+    float dXstop = vel_change_distance(Vi, 0.0f, Dmax, Jmax); // Minimum stopping displacement
+    float s = std::signbit(dX - dXstop) ? -1.0f : 1.0f; // Sign of coast velocity (if any)
+
+    // If we move away from the goal, the first velocity change passes through
+    // zero. Limiting it to Dmax as well guarantees that the stop is no shorter
+    // than dXstop, so that the goal can still be reached without overshoot.
+    float A1 = (s * Vi < 0.0f) ? std::min(Amax, Dmax) : Amax;
+
+    // Displacement of a move that reaches the speed u (in direction s) and
+    // then stops immediately
+    auto move_distance = [&](float u) {
+        return vel_change_distance(Vi, s * u, A1, Jmax) + vel_change_distance(s * u, 0.0f, Dmax, Jmax);
+    };
+
+    float u;
+    if (s * (dX - move_distance(Vmax)) >= 0.0f) {
+        // Long move: cruise at Vmax
+        u = Vmax;
+    } else {
+        // Short move: find the highest speed that doesn't overshoot. The lower
+        // bound is the speed of the shortest possible stop, which never
+        // overshoots (see choice of s). The displacement is continuous in u,
+        // so a bisection converges, even in the over-speed case where the
+        // lower bound is above Vmax.
+        float u_ok = std::max(s * Vi, 0.0f);
+        float u_bad = Vmax;
+        for (size_t i = 0; i < 32; ++i) {
+            float u_mid = 0.5f * (u_ok + u_bad);
+            if (s * (dX - move_distance(u_mid)) >= 0.0f) {
+                u_ok = u_mid;
+            } else {
+                u_bad = u_mid;
+            }
+        }
+        u = u_ok;
+    }
+
+    // A short cruise segment absorbs the residual of the bisection
+    Vr_ = s * u;
+    float Tv = (u > 0.0f) ? std::max(0.0f, s * (dX - move_distance(u)) / u) : 0.0f;
+
+    VelChange_t accel = plan_vel_change(Vi, Vr_, A1, Jmax);
+    VelChange_t decel = plan_vel_change(Vr_, 0.0f, Dmax, Jmax);
+    const float durations[kNumSegments] = {accel.Tj, accel.Tc, accel.Tj, Tv, decel.Tj, decel.Tc, decel.Tj};
+    const float jerks[kNumSegments] = {accel.J, 0.0f, -accel.J, 0.0f, decel.J, 0.0f, -decel.J};
+
+    T_[0] = 0.0f;
+    for (size_t k = 1; k < kNumSegments; ++k) {
+        T_[k] = T_[k - 1] + durations[k - 1];
+    }
+    Tf_ = T_[kNumSegments - 1] + durations[kNumSegments - 1];
+
+    // Integrate the acceleration phase forward from the initial conditions
+    float p = Xi, v = Vi, a = 0.0f;
+    for (size_t k = 0; k < 3; ++k) {
+        float dt = durations[k];
+        float j = jerks[k];
+        P_[k] = p; V_[k] = v; A_[k] = a; J_[k] = j;
+        p += dt * (v + dt * (0.5f * a + dt * (1.0f / 6.0f) * j));
+        v += dt * (a + dt * 0.5f * j);
+        a += dt * j;
+    }
+    P_[3] = p; V_[3] = Vr_; A_[3] = 0.0f; J_[3] = 0.0f;
+
+    // Integrate the deceleration phase backward from the goal so that the
+    // trajectory ends exactly at Xf
+    p = Xf; v = 0.0f; a = 0.0f;
+    for (size_t k = kNumSegments - 1; k >= 4; --k) {
+        float dt = durations[k];
+        float j = jerks[k];
+        a -= dt * j;
+        v -= dt * (a + dt * 0.5f * j);
+        p -= dt * (v + dt * (0.5f * a + dt * (1.0f / 6.0f) * j));
+        P_[k] = p; V_[k] = v; A_[k] = a; J_[k] = j;
+    }
+
+    Xi_ = Xi;
+    Xf_ = Xf;
+    Vi_ = Vi;
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef __SCURVE_TRAJ_HPP
+#define __SCURVE_TRAJ_HPP
+
+#include <stddef.h>
+#include <algorithm>
+
+/**
+ * @brief Jerk-limited ("S-curve") point-to-point trajectory.
+ *
+ * The profile has seven segments of constant jerk: three to go from the
+ * initial velocity to the cruise velocity, one at cruise velocity and three
+ * to stop at the goal. The acceleration starts and ends at zero and is
+ * continuous in between.
+ *
+ * Like TrapezoidalTrajectory, the planner accepts a nonzero initial velocity,
+ * including velocities above Vmax and velocities pointing away from the goal.
+ * The initial acceleration is assumed to be zero.
+ */
+class SCurveTrajectory {
+public:
+    static constexpr size_t kNumSegments = 7;
+
+    struct Step_t {
+        float Y;
+        float Yd;
+        float Ydd;
+    };
+
+    bool plan(float Xf, float Xi, float Vi,
+              float Vmax, float Amax, float Dmax, float Jmax);
+
+    /**
+     * @brief Evaluates the trajectory at time t after the start.
+     *
+     * Times before the start return the initial position and times after the
+     * end return the goal. The cost does not depend on t.
+     */
+    Step_t eval(float t) const {
+        t = std::clamp(t, 0.0f, Tf_);
+        size_t i = 0;
+        for (size_t k = 1; k < kNumSegments; ++k) {
+            i += (t >= T_[k]);
+        }
+        float dt = t - T_[i];
+        return {
+            P_[i] + dt * (V_[i] + dt * (0.5f * A_[i] + dt * (1.0f / 6.0f) * J_[i])),
+            V_[i] + dt * (A_[i] + dt * 0.5f * J_[i]),
+            A_[i] + dt * J_[i]
+        };
+    }
+
+    float Xi_ = 0.0f;
+    float Xf_ = 0.0f;
+    float Vi_ = 0.0f;
+    float Vr_ = 0.0f; // cruise velocity (or peak velocity if there's no cruise segment)
+    float Tf_ = 0.0f;
+    float t_ = 0.0f;
+
+    // Start time and initial conditions of each segment
+    float T_[kNumSegments] = {};
+    float P_[kNumSegments] = {};
+    float V_[kNumSegments] = {};
+    float A_[kNumSegments] = {};
+    float J_[kNumSegments] = {};
+};
+
+#endif // __SCURVE_TRAJ_HPP
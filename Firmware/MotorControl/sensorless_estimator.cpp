@@ -106,3 +106,16 @@ bool SensorlessEstimator::update() {
 
     return true;
 };
+
+void SensorlessEstimator::get_ports(PortList& inputs, PortList& outputs) {
+    outputs.add(&phase_);
+    outputs.add(&phase_vel_);
+    outputs.add(&vel_estimate_);
+}
+
+// The observer needs some time to converge, so it keeps running during the
+// lock-in spin that precedes sensorless control, before anything is connected
+// to its outputs.
+ComponentBase::Activity SensorlessEstimator::get_activity() {
+    return axis_->config_.enable_sensorless_mode ? ACTIVE : INACTIVE;
+}
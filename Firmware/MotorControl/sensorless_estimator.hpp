@@ -3,7 +3,7 @@
 
 #include "component.hpp"
 
-class SensorlessEstimator : public ODriveIntf::SensorlessEstimatorIntf {
+class SensorlessEstimator : public ODriveIntf::SensorlessEstimatorIntf, public ComponentBase {
 public:
     struct Config_t {
         float observer_gain = 1000.0f; // [rad/s]
@@ -13,6 +13,9 @@ public:
 
     void reset();
     bool update();
+    void update(uint32_t timestamp) final { update(); }
+    void get_ports(PortList& inputs, PortList& outputs) final;
+    Activity get_activity() final;
 
     Axis* axis_ = nullptr; // set by Axis constructor
     Config_t config_;
@@ -3,11 +3,14 @@
 
 #include <stdint.h>
 #include <board.h>
+#include <fibre/../../protocol.hpp>
+#include "latency_histogram.hpp"
 
 #define MEASURE_START_TIME
 #define MEASURE_END_TIME
 #define MEASURE_LENGTH
 #define MEASURE_MAX_LENGTH
+#define MEASURE_HISTOGRAM
 
 inline uint16_t sample_TIM13() {
     constexpr uint16_t clocks_per_cnt = (uint16_t)((float)TIM_1_8_CLOCK_HZ / (float)TIM_APB1_CLOCK_HZ);
@@ -19,9 +22,24 @@ struct TaskTimer {
     uint32_t end_time_ = 0;
     uint32_t length_ = 0;
     uint32_t max_length_ = 0;
+    bool histogram_enabled_ = false;
+    LatencyHistogram histogram_;
 
     static bool enabled;
 
+    void set_histogram_enabled(bool enabled) {
+        if (enabled && !histogram_enabled_) {
+            histogram_.reset();
+        }
+        histogram_enabled_ = enabled;
+    }
+
+    Buffer<uint32_t> get_histogram() {
+        return {&histogram_, [](void* ctx, uint32_t index) {
+            return ((LatencyHistogram*)ctx)->get_count(index);
+        }, LatencyHistogram::kNumBuckets};
+    }
+
     uint32_t start() {
         return sample_TIM13();
     }
@@ -43,6 +61,11 @@ struct TaskTimer {
         }
 #ifdef MEASURE_MAX_LENGTH
         max_length_ = std::max(max_length_, length);
+#endif
+#ifdef MEASURE_HISTOGRAM
+        if (histogram_enabled_) {
+            histogram_.add(length);
+        }
 #endif
     }
 };
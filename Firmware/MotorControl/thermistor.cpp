@@ -23,7 +23,7 @@ void ThermistorCurrentLimiter::update() {
     float raw_temperature_ = horner_poly_eval(normalized_voltage, coefficients_, num_coeffs_);
 
     constexpr float tau = 0.1f; // [sec]
-    float k = current_meas_period / tau;
+    float k = current_meas_period * rate_divider_ / tau;
     float val = raw_temperature_;
     for (float& lpf_val : lpf_vals_) {
         lpf_val += k * (val - lpf_val);
@@ -35,6 +35,10 @@ void ThermistorCurrentLimiter::update() {
     temperature_ = lpf_vals_.back();
 }
 
+uint32_t ThermistorCurrentLimiter::get_rate_divider() {
+    return motor_ ? motor_->axis_->config_.housekeeping_rate_divider : 1;
+}
+
 bool ThermistorCurrentLimiter::do_checks() {
     if (enabled_ && temperature_ >= temp_limit_upper_ + 5) {
         return false;
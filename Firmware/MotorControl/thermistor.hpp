@@ -4,9 +4,10 @@
 class Motor; // declared in motor.hpp
 
 #include "current_limiter.hpp"
+#include "component.hpp"
 #include <autogen/interfaces.hpp>
 
-class ThermistorCurrentLimiter : public CurrentLimiter, public ODriveIntf::ThermistorCurrentLimiterIntf {
+class ThermistorCurrentLimiter : public CurrentLimiter, public ODriveIntf::ThermistorCurrentLimiterIntf, public ComponentBase {
 public:
     virtual ~ThermistorCurrentLimiter() = default;
 
@@ -18,6 +19,8 @@ public:
                              const bool& enabled);
 
     void update();
+    void update(uint32_t timestamp) final { update(); }
+    uint32_t get_rate_divider() final;
     bool do_checks();
     float get_current_limit(float base_current_lim) const override;
 
@@ -1,5 +1,5 @@
 #include <cmath>
-#include "odrive_main.h"
+#include "trapTraj.hpp"
 #include "utils.hpp"
 
 // A sign function where input 0 has positive sign (not 0)
@@ -61,6 +61,69 @@ bool TrapezoidalTrajectory::planTrapezoidal(float Xf, float Xi, float Vi,
     return true;
 }
 
+/**
+ * @brief Plans a straight-line move of several axes that start and finish
+ * together.
+ *
+ * A single trapezoidal profile is planned for the path parameter, which goes
+ * from 0 at Xi to 1 at Xf. Its limits are the tightest of all axes after
+ * scaling by the axis' distance, so the slowest axis sets the duration and
+ * all other axes are slowed down accordingly. The profile of each axis is the
+ * path profile scaled by the axis' distance.
+ *
+ * The initial velocities are projected onto the path. This is exact if the
+ * axes are at rest or already move along the path.
+ *
+ * @param trajs: The trajectories to plan. Their config_ provides the limits.
+ */
+bool TrapezoidalTrajectory::planCoordinated(TrapezoidalTrajectory* const trajs[], size_t n,
+                                            const float Xf[], const float Xi[], const float Vi[]) {
+    float Vmax = INFINITY, Amax = INFINITY, Dmax = INFINITY;
+    float dX_sq = 0.0f, Vi_dX = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float dX = std::abs(Xf[i] - Xi[i]);
+        if (dX > 0.0f) {
+            Vmax = std::min(Vmax, trajs[i]->config_.vel_limit / dX);
+            Amax = std::min(Amax, trajs[i]->config_.accel_limit / dX);
+            Dmax = std::min(Dmax, trajs[i]->config_.decel_limit / dX);
+        }
+        dX_sq += SQ(Xf[i] - Xi[i]);
+        Vi_dX += Vi[i] * (Xf[i] - Xi[i]);
+    }
+
+    if (!(Vmax > 0.0f && Amax > 0.0f && Dmax > 0.0f)) {
+        return false;
+    }
+
+    if (dX_sq == 0.0f) {
+        // Nothing moves
+        for (size_t i = 0; i < n; ++i) {
+            trajs[i]->planTrapezoidal(Xf[i], Xi[i], 0.0f, 1.0f, 1.0f, 1.0f);
+        }
+        return true;
+    }
+
+    TrapezoidalTrajectory path;
+    path.planTrapezoidal(1.0f, 0.0f, Vi_dX / dX_sq, Vmax, Amax, Dmax);
+
+    for (size_t i = 0; i < n; ++i) {
+        TrapezoidalTrajectory& traj = *trajs[i];
+        float dX = Xf[i] - Xi[i];
+        traj.Xi_ = Xi[i];
+        traj.Xf_ = Xf[i];
+        traj.Vi_ = dX * path.Vi_;
+        traj.Ar_ = dX * path.Ar_;
+        traj.Vr_ = dX * path.Vr_;
+        traj.Dr_ = dX * path.Dr_;
+        traj.Ta_ = path.Ta_;
+        traj.Tv_ = path.Tv_;
+        traj.Td_ = path.Td_;
+        traj.Tf_ = path.Tf_;
+        traj.yAccel_ = Xi[i] + dX * path.yAccel_;
+    }
+    return true;
+}
+
 TrapezoidalTrajectory::Step_t TrapezoidalTrajectory::eval(float t) {
     Step_t trajStep;
     if (t < 0.0f) {  // Initial Condition
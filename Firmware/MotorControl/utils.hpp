@@ -75,6 +75,7 @@ void delay_us(uint32_t us);
 extern "C" {
 float our_arm_sin_f32(float x);
 float our_arm_cos_f32(float x);
+void our_arm_sincos_f32(float x, float* sin_val, float* cos_val);
 }
 
 // ----------------
@@ -140,6 +141,21 @@ inline float wrap_pm_pi(float x) {
     return wrap_pm(x, 2 * M_PI);
 }
 
+// Computes sin and cos of (x + dx), given s = sin(x) and c = cos(x), by
+// rotating (c, s) by dx. This is cheaper than a table lookup for small dx and
+// at least as accurate for |dx| < 0.25 rad. Larger dx fall back to a lookup.
+inline void sincos_advance(float x, float s, float c, float dx, float* sin_val, float* cos_val) {
+    if (std::abs(dx) < 0.25f) {
+        float dx2 = dx * dx;
+        float c_dx = 1.0f - dx2 * (0.5f - dx2 * (1.0f / 24.0f));
+        float s_dx = dx * (1.0f - dx2 * (1.0f / 6.0f));
+        *sin_val = s * c_dx + c * s_dx;
+        *cos_val = c * c_dx - s * s_dx;
+    } else {
+        our_arm_sincos_f32(x + dx, sin_val, cos_val);
+    }
+}
+
 // Evaluate polynomials in an efficient way
 // coeffs[0] is highest order, as per numpy.polyfit
 // p(x) = coeffs[0] * x^deg + ... + coeffs[deg], for some degree "deg"
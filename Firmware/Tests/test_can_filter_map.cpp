@@ -0,0 +1,113 @@
+#include <doctest.h>
+#include <random>
+
+#include "communication/can/can_filter_map.hpp"
+
+struct Bank {
+    uint8_t fifo = kCanFifoNone;
+    uint8_t bank_fifo = 0;
+};
+
+using Banks = std::array<Bank, 8>;
+
+static void activate(Banks& banks, size_t i, uint8_t fifo) {
+    banks[i].fifo = fifo;
+    banks[i].bank_fifo = fifo;
+}
+
+static void deactivate(Banks& banks, size_t i) {
+    banks[i].fifo = kCanFifoNone; // the bank keeps its FIFO assignment
+}
+
+// Reference: the filter match index that the hardware reports for a bank is
+// the number of banks before it that are assigned to the same FIFO.
+static uint32_t hardware_index(const Banks& banks, size_t i) {
+    uint32_t index = 0;
+    for (size_t j = 0; j < i; ++j) {
+        index += banks[j].bank_fifo == banks[i].bank_fifo;
+    }
+    return index;
+}
+
+static void check_map(const Banks& banks, const CanFilterMap<Bank, 8>& map) {
+    size_t n_active = 0;
+    for (size_t i = 0; i < banks.size(); ++i) {
+        if (banks[i].fifo != kCanFifoNone) {
+            CHECK(map.get(banks[i].fifo, hardware_index(banks, i)) == &banks[i]);
+            n_active++;
+        }
+    }
+    size_t n_mapped = 0;
+    for (uint32_t fifo = 0; fifo < 2; ++fifo) {
+        for (uint32_t index = 0; index < 8; ++index) {
+            n_mapped += map.get(fifo, index) != nullptr;
+        }
+    }
+    CHECK(n_mapped == n_active);
+}
+
+TEST_SUITE("can_filter_map") {
+    TEST_CASE("inactive banks keep their filter number") {
+        Banks banks;
+        CanFilterMap<Bank, 8> map;
+        for (size_t i = 0; i < 3; ++i) {
+            activate(banks, i, 0);
+        }
+        map.update(banks);
+        CHECK(map.get(0, 0) == &banks[0]);
+        CHECK(map.get(0, 1) == &banks[1]);
+        CHECK(map.get(0, 2) == &banks[2]);
+
+        deactivate(banks, 1);
+        map.update(banks);
+        CHECK(map.get(0, 0) == &banks[0]);
+        CHECK(map.get(0, 1) == nullptr);
+        CHECK(map.get(0, 2) == &banks[2]);
+
+        activate(banks, 1, 0);
+        map.update(banks);
+        CHECK(map.get(0, 1) == &banks[1]);
+        check_map(banks, map);
+    }
+
+    TEST_CASE("filters are numbered per FIFO") {
+        Banks banks;
+        CanFilterMap<Bank, 8> map;
+        activate(banks, 0, 1);
+        activate(banks, 1, 0);
+        activate(banks, 2, 1);
+        activate(banks, 3, 1);
+        activate(banks, 4, 0);
+        deactivate(banks, 3);
+        map.update(banks);
+
+        CHECK(map.get(0, 0) == &banks[1]);
+        CHECK(map.get(0, 1) == &banks[4]);
+        CHECK(map.get(1, 0) == &banks[0]);
+        CHECK(map.get(1, 1) == &banks[2]);
+        CHECK(map.get(1, 2) == nullptr); // bank 3 is inactive but still on FIFO 1
+        CHECK(map.get(0, 2) == nullptr); // banks 5...7 were never configured
+        check_map(banks, map);
+
+        // Out of range
+        CHECK(map.get(2, 0) == nullptr);
+        CHECK(map.get(0, 8) == nullptr);
+        CHECK(map.get(0, 0xffffffff) == nullptr);
+    }
+
+    TEST_CASE("random subscribe and unsubscribe sequences") {
+        std::mt19937 rng(42);
+        Banks banks;
+        CanFilterMap<Bank, 8> map;
+        for (size_t i = 0; i < 2000; ++i) {
+            size_t bank = rng() % banks.size();
+            if (banks[bank].fifo == kCanFifoNone) {
+                activate(banks, bank, rng() % 2);
+            } else {
+                deactivate(banks, bank);
+            }
+            map.update(banks);
+            check_map(banks, map);
+        }
+    }
+}
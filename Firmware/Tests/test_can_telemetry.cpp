@@ -0,0 +1,145 @@
+
+#include <doctest.h>
+#include <vector>
+
+#include "communication/can/canbus.hpp"
+#include "communication/can/can_telemetry.hpp"
+
+// Delivers every sent message to all subscribers whose filter matches
+class LoopbackCanBus : public CanBusBase {
+public:
+    bool send_message(const can_Message_t& message) final {
+        for (auto& sub : subscriptions_) {
+            uint32_t id = std::visit([](auto id) { return (uint32_t)id; }, sub.filter.id);
+            bool is_ext = std::holds_alternative<uint32_t>(sub.filter.id);
+            if ((is_ext == message.isExt) && ((message.id & sub.filter.mask) == (id & sub.filter.mask))) {
+                sub.callback(sub.ctx, message);
+            }
+        }
+        return true;
+    }
+
+    bool subscribe(const MsgIdFilterSpecs& filter, on_can_message_cb_t callback, void* ctx, CanSubscription** handle) final {
+        subscriptions_.push_back({filter, callback, ctx});
+        if (handle) {
+            *handle = (CanSubscription*)subscriptions_.size();
+        }
+        return true;
+    }
+
+    bool unsubscribe(CanSubscription*) final {
+        return false;
+    }
+
+private:
+    struct Subscription {
+        MsgIdFilterSpecs filter;
+        on_can_message_cb_t callback;
+        void* ctx;
+    };
+    std::vector<Subscription> subscriptions_;
+};
+
+TEST_SUITE("CAN Telemetry") {
+    TEST_CASE("quantize") {
+        can_TelemetryField_t field = {16, 0.01f};
+        CHECK(can_quantizeTelemetry(1.234f, field) == 123);
+        CHECK(can_quantizeTelemetry(-1.236f, field) == -124);
+        CHECK(can_quantizeTelemetry(1000.0f, field) == 32767);
+        CHECK(can_quantizeTelemetry(-1000.0f, field) == -32768);
+        CHECK(can_quantizeTelemetry(NAN, field) == 0);
+        CHECK(can_quantizeTelemetry(INFINITY, field) == 32767);
+
+        can_TelemetryField_t wide = {32, 1.0f};
+        CHECK(can_quantizeTelemetry(1e10f, wide) == INT32_MAX);
+        CHECK(can_quantizeTelemetry(-1e10f, wide) == INT32_MIN);
+    }
+
+    TEST_CASE("pack and unpack") {
+        const can_TelemetryField_t fields[] = {
+            {24, 0.0001f},
+            {24, 0.0001f},
+            {0, 0.01f}, // unused
+            {16, 0.01f},
+        };
+        const float values[] = {-12.3456f, 3.3333f, 99.0f, -2.5f};
+
+        can_Message_t msg;
+        CHECK(can_packTelemetry(msg, values, fields, 4) == 64);
+        CHECK(msg.len == 8);
+
+        // The first field is in the lowest bits (Intel byte order)
+        CHECK(can_getSignal<int32_t>(msg, 0, 24, true) == (-123456 & 0xffffff));
+        CHECK(can_getSignal<int16_t>(msg, 48, 16, true) == -250);
+
+        float decoded[4];
+        can_unpackTelemetry(msg, decoded, fields, 4);
+        CHECK(decoded[0] == doctest::Approx(-12.3456f).epsilon(1e-5));
+        CHECK(decoded[1] == doctest::Approx(3.3333f).epsilon(1e-5));
+        CHECK(std::isnan(decoded[2]));
+        CHECK(decoded[3] == doctest::Approx(-2.5f));
+    }
+
+    TEST_CASE("frame length") {
+        const can_TelemetryField_t fields[] = {
+            {16, 0.01f},
+            {12, 0.1f},
+            {32, 1.0f},
+            {16, 0.01f}, // doesn't fit anymore
+            {2, 1.0f}, // would fit but comes after a field that didn't
+        };
+        const float values[] = {1.0f, -2.0f, 3.0f, 4.0f, 1.0f};
+
+        can_Message_t msg;
+        CHECK(can_packTelemetry(msg, values, fields, 2) == 28);
+        CHECK(msg.len == 4);
+
+        CHECK(can_packTelemetry(msg, values, fields, 5) == 60);
+        CHECK(msg.len == 8);
+
+        float decoded[5];
+        can_unpackTelemetry(msg, decoded, fields, 5);
+        CHECK(decoded[0] == doctest::Approx(1.0f));
+        CHECK(decoded[1] == doctest::Approx(-2.0f));
+        CHECK(decoded[2] == 3.0f);
+        CHECK(std::isnan(decoded[3]));
+        CHECK(std::isnan(decoded[4]));
+    }
+
+    TEST_CASE("loopback") {
+        // Three 21-bit signals per frame for each of 4 nodes
+        const can_TelemetryField_t fields[] = {{21, 0.001f}, {21, 0.001f}, {21, 0.01f}};
+
+        struct Receiver {
+            uint32_t node_id;
+            const can_TelemetryField_t* fields;
+            size_t n_received = 0;
+            float values[3] = {};
+        } receivers[4] = {{0, fields}, {1, fields}, {2, fields}, {3, fields}};
+
+        LoopbackCanBus bus;
+        for (auto& receiver : receivers) {
+            MsgIdFilterSpecs filter = {(uint16_t)((receiver.node_id << 5) | 0x1e), 0x7ff};
+            CHECK(bus.subscribe(filter, [](void* ctx, const can_Message_t& msg) {
+                Receiver* receiver = (Receiver*)ctx;
+                can_unpackTelemetry(msg, receiver->values, receiver->fields, 3);
+                receiver->n_received++;
+            }, &receiver, nullptr));
+        }
+
+        for (uint32_t node_id = 0; node_id < 4; ++node_id) {
+            const float values[] = {node_id * 1.5f, -0.25f, 400.0f};
+            can_Message_t msg;
+            msg.id = (node_id << 5) | 0x1e;
+            CHECK(can_packTelemetry(msg, values, fields, 3) == 63);
+            CHECK(bus.send_message(msg));
+        }
+
+        for (uint32_t node_id = 0; node_id < 4; ++node_id) {
+            CHECK(receivers[node_id].n_received == 1);
+            CHECK(receivers[node_id].values[0] == doctest::Approx(node_id * 1.5f));
+            CHECK(receivers[node_id].values[1] == doctest::Approx(-0.25f));
+            CHECK(receivers[node_id].values[2] == doctest::Approx(400.0f));
+        }
+    }
+}
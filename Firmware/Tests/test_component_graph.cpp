@@ -0,0 +1,209 @@
+#include <doctest.h>
+#include <vector>
+
+#include "MotorControl/component_graph.hpp"
+
+struct TestComponent : ComponentBase {
+    TestComponent(Activity activity = ACTIVE, uint32_t rate_divider = 1)
+        : activity_(activity), requested_rate_divider_(rate_divider) {}
+
+    void update(uint32_t timestamp) final {
+        output_ = input_.present().value_or(0.0f) + 1.0f;
+        n_updates_++;
+    }
+
+    void get_ports(PortList& inputs, PortList& outputs) final {
+        inputs.add(input_);
+        outputs.add(&output_);
+    }
+
+    Activity get_activity() final { return activity_; }
+    uint32_t get_rate_divider() final { return requested_rate_divider_; }
+
+    Activity activity_;
+    uint32_t requested_rate_divider_;
+    size_t n_updates_ = 0;
+    InputPort<float> input_;
+    OutputPort<float> output_ = 0.0f;
+};
+
+// Runs one control loop iteration and returns the update order
+static std::vector<TestComponent*> run(ComponentGraph& graph) {
+    std::vector<TestComponent*> log;
+    if (graph.is_outdated()) {
+        graph.resolve();
+    }
+    graph.start_iteration();
+    for (auto& node: graph) {
+        if (node.due) {
+            node.component->update(0);
+            log.push_back(static_cast<TestComponent*>(node.component));
+        }
+    }
+    return log;
+}
+
+TEST_SUITE("Component Graph") {
+    TEST_CASE("order follows connections") {
+        TestComponent a{}, b{}, c{};
+        ComponentGraph graph;
+        CHECK(graph.add(&a, nullptr));
+        CHECK(graph.add(&b, nullptr));
+        CHECK(graph.add(&c, nullptr));
+
+        // Unconnected: registration order
+        CHECK(run(graph) == std::vector<TestComponent*>{&a, &b, &c});
+
+        // c -> b -> a
+        a.input_.connect_to(&b.output_);
+        b.input_.connect_to(&c.output_);
+        CHECK(graph.is_outdated());
+        CHECK(run(graph) == std::vector<TestComponent*>{&c, &b, &a});
+        CHECK(!graph.is_outdated());
+        CHECK(!graph.has_cycle_);
+        CHECK(a.output_.present() == 3.0f);
+        CHECK(graph.n_reset_ports() == 3);
+    }
+
+    TEST_CASE("a resolved graph takes effect at the next iteration") {
+        TestComponent a{}, b{};
+        ComponentGraph graph;
+        graph.add(&a, nullptr);
+        graph.add(&b, nullptr);
+        CHECK(run(graph) == std::vector<TestComponent*>{&a, &b});
+
+        // Resolving while the control loop is between two iterations
+        // doesn't change the order that it is iterating over
+        a.input_.connect_to(&b.output_);
+        CHECK(graph.resolve_if_outdated());
+        CHECK(!graph.is_outdated());
+        CHECK(graph.begin()->component == &a);
+
+        // Another change must wait until the control loop picked up the
+        // previous one
+        a.input_.disconnect();
+        CHECK(!graph.resolve_if_outdated());
+        CHECK(graph.is_outdated());
+
+        graph.start_iteration();
+        CHECK(graph.begin()->component == &b);
+        CHECK(graph.resolve_if_outdated());
+        CHECK(run(graph) == std::vector<TestComponent*>{&a, &b});
+    }
+
+    TEST_CASE("cycle falls back to registration order") {
+        TestComponent a{}, b{};
+        ComponentGraph graph;
+        graph.add(&a, nullptr);
+        graph.add(&b, nullptr);
+        a.input_.connect_to(&b.output_);
+        b.input_.connect_to(&a.output_);
+        CHECK(run(graph) == std::vector<TestComponent*>{&a, &b});
+        CHECK(graph.has_cycle_);
+
+        b.input_.disconnect();
+        CHECK(run(graph) == std::vector<TestComponent*>{&b, &a});
+        CHECK(!graph.has_cycle_);
+    }
+
+    TEST_CASE("inactive components are skipped") {
+        TestComponent sink{};
+        TestComponent source{ComponentBase::ACTIVE_IF_CONSUMED};
+        TestComponent source_of_source{ComponentBase::ACTIVE_IF_CONSUMED};
+        TestComponent off{ComponentBase::INACTIVE};
+        ComponentGraph graph;
+        graph.add(&sink, nullptr);
+        graph.add(&source, nullptr);
+        graph.add(&source_of_source, nullptr);
+        graph.add(&off, nullptr);
+
+        source.input_.connect_to(&source_of_source.output_);
+        CHECK(run(graph) == std::vector<TestComponent*>{&sink});
+        CHECK(graph.n_reset_ports() == 1);
+
+        // Consumers activate the whole chain
+        sink.input_.connect_to(&source.output_);
+        CHECK(run(graph) == std::vector<TestComponent*>{&source_of_source, &source, &sink});
+        CHECK(sink.output_.present() == 3.0f);
+
+        // An inactive component's outputs are invalid even if it ran before
+        sink.input_.connect_to(&off.output_);
+        off.output_ = 5.0f;
+        CHECK(run(graph) == std::vector<TestComponent*>{&sink});
+        CHECK(!off.output_.present().has_value());
+        CHECK(!off.output_.previous().has_value());
+        CHECK(!source.output_.previous().has_value());
+        CHECK(sink.output_.present() == 1.0f);
+    }
+
+    TEST_CASE("previous values survive the reset") {
+        TestComponent a{};
+        ComponentGraph graph;
+        graph.add(&a, nullptr);
+        run(graph);
+        graph.start_iteration(); // start of the next iteration
+        CHECK(!a.output_.present().has_value());
+        CHECK(a.output_.previous() == 1.0f);
+    }
+
+    TEST_CASE("rate dividers") {
+        CHECK(ComponentGraph::round_rate_divider(0) == 1);
+        CHECK(ComponentGraph::round_rate_divider(1) == 1);
+        CHECK(ComponentGraph::round_rate_divider(3) == 2);
+        CHECK(ComponentGraph::round_rate_divider(8) == 8);
+        CHECK(ComponentGraph::round_rate_divider(1000) == ComponentGraph::kMaxRateDivider);
+    }
+
+    TEST_CASE("decimated components hold their outputs") {
+        TestComponent slow{ComponentBase::ACTIVE, 4};
+        TestComponent fast{};
+        ComponentGraph graph;
+        graph.add(&fast, nullptr);
+        graph.add(&slow, nullptr);
+        fast.input_.connect_to(&slow.output_);
+
+        for (size_t i = 0; i < 16; ++i) {
+            std::vector<TestComponent*> order = run(graph);
+            CHECK(order.back() == &fast);
+            if (slow.n_updates_) {
+                CHECK(fast.output_.present() == 2.0f); // the held value is still present
+            }
+        }
+        CHECK(slow.rate_divider_ == 4);
+        CHECK(slow.n_updates_ == 4);
+        CHECK(fast.n_updates_ == 16);
+    }
+
+    TEST_CASE("decimated components are staggered") {
+        TestComponent half[2] = {{ComponentBase::ACTIVE, 2}, {ComponentBase::ACTIVE, 2}};
+        TestComponent quarter[4] = {{ComponentBase::ACTIVE, 4}, {ComponentBase::ACTIVE, 4},
+                                    {ComponentBase::ACTIVE, 4}, {ComponentBase::ACTIVE, 4}};
+        ComponentGraph graph;
+        for (auto& c: half) {
+            graph.add(&c, nullptr);
+        }
+        for (auto& c: quarter) {
+            graph.add(&c, nullptr);
+        }
+
+        // 2/2 + 4/4 components per iteration on average
+        for (size_t i = 0; i < 8; ++i) {
+            CHECK(run(graph).size() == 2);
+        }
+        for (auto& c: half) {
+            CHECK(c.n_updates_ == 4);
+        }
+        for (auto& c: quarter) {
+            CHECK(c.n_updates_ == 2);
+        }
+    }
+
+    TEST_CASE("capacity") {
+        std::vector<TestComponent> components(ComponentGraph::kMaxComponents + 1, TestComponent{});
+        ComponentGraph graph;
+        for (size_t i = 0; i < ComponentGraph::kMaxComponents; ++i) {
+            CHECK(graph.add(&components[i], nullptr));
+        }
+        CHECK(!graph.add(&components.back(), nullptr));
+    }
+}
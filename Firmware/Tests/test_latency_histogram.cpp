@@ -0,0 +1,60 @@
+#include <doctest.h>
+#include "MotorControl/latency_histogram.hpp"
+
+TEST_SUITE("Latency Histogram") {
+    TEST_CASE("buckets") {
+        CHECK(LatencyHistogram::get_bucket(0) == 0);
+        CHECK(LatencyHistogram::get_bucket(4) == 0);
+        CHECK(LatencyHistogram::get_bucket(5) == 1);
+        CHECK(LatencyHistogram::get_bucket(8) == 4);
+        CHECK(LatencyHistogram::get_bucket(0xffffffff) == LatencyHistogram::kNumBuckets - 1);
+
+        // Every bucket starts where the previous one ends
+        for (size_t i = 1; i < LatencyHistogram::kNumBuckets; ++i) {
+            uint32_t start = LatencyHistogram::get_bucket_start(i);
+            CHECK(LatencyHistogram::get_bucket(start) == i);
+            CHECK(LatencyHistogram::get_bucket(start - 1) == i - 1);
+            // The bucket width is at most 25% of the value
+            CHECK(start - LatencyHistogram::get_bucket_start(i - 1) <= start / 4);
+        }
+    }
+
+    TEST_CASE("percentiles") {
+        LatencyHistogram histogram;
+        CHECK(histogram.get_percentile(0.5f) == 0);
+
+        // 990 samples of 1000 clocks, 9 of 5000 clocks, 1 of 20000 clocks
+        for (size_t i = 0; i < 990; ++i) {
+            histogram.add(1000);
+        }
+        for (size_t i = 0; i < 9; ++i) {
+            histogram.add(5000);
+        }
+        histogram.add(20000);
+
+        auto check_near = [](uint32_t val, uint32_t expected) {
+            CHECK(val >= expected - expected / 4);
+            CHECK(val <= expected + expected / 4);
+        };
+        check_near(histogram.get_percentile(0.5f), 1000);
+        check_near(histogram.get_percentile(0.99f), 1000);
+        check_near(histogram.get_percentile(0.995f), 5000);
+        check_near(histogram.get_percentile(1.0f), 20000);
+
+        histogram.reset();
+        CHECK(histogram.get_percentile(0.5f) == 0);
+    }
+
+    TEST_CASE("saturation") {
+        LatencyHistogram histogram;
+        histogram.add(100000);
+        for (size_t i = 0; i < 200000; ++i) {
+            histogram.add(100);
+        }
+        // The counters are halved instead of overflowing
+        CHECK(histogram.get_count(LatencyHistogram::get_bucket(100)) < UINT16_MAX);
+        CHECK(histogram.get_count(LatencyHistogram::get_bucket(100)) > UINT16_MAX / 4);
+        CHECK(histogram.get_percentile(0.5f) >= 80);
+        CHECK(histogram.get_percentile(0.5f) <= 128);
+    }
+}
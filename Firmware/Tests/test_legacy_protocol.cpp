@@ -0,0 +1,318 @@
+#include <doctest.h>
+#include <deque>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fibre/../../legacy_protocol.hpp>
+#include <fibre/../../protocol.hpp>
+#include <fibre/../../crc.hpp>
+#include <fibre/simple_serdes.hpp>
+
+using namespace fibre;
+
+// Server side: endpoint 1 returns the number of requests that it has handled,
+// so each response tells in which order the server saw the request.
+const unsigned char fibre::embedded_json[] = "["
+    "{\"name\":\"\",\"id\":0,\"type\":\"json\",\"access\":\"r\"},"
+    "{\"name\":\"counter\",\"id\":1,\"type\":\"uint32\",\"access\":\"r\"}"
+    "]";
+const size_t fibre::embedded_json_length = sizeof(fibre::embedded_json) - 1;
+const uint16_t fibre::json_crc_ = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION, embedded_json, embedded_json_length);
+const uint32_t fibre::json_version_id_ = 0;
+
+static uint32_t counter = 0;
+static size_t window_reply_length = 8; // 8: current firmware, 4: window size only, 0: before the window size existed
+
+bool fibre::endpoint_handler(int idx, cbufptr_t* input_buffer, bufptr_t* output_buffer) {
+    if (idx == 0) {
+        uint32_t offset = 0;
+        read_le<uint32_t>(&offset, input_buffer->begin());
+        if (offset == 0xfffffffe && window_reply_length < 8) {
+            uint8_t reply[8];
+            bufptr_t reply_buf = reply;
+            endpoint0_handler(input_buffer, &reply_buf);
+            size_t n_copy = std::min(window_reply_length, output_buffer->size());
+            memcpy(output_buffer->begin(), reply, n_copy);
+            *output_buffer = output_buffer->skip(n_copy);
+            return true;
+        }
+        return endpoint0_handler(input_buffer, output_buffer);
+    } else if (idx == 1) {
+        return write_le<uint32_t>(++counter, output_buffer);
+    }
+    return false;
+}
+
+// One direction of a packet based connection. By default writes complete right
+// away. With hold_writes, they complete when the test calls finish_write().
+// Packets only reach the reader when the test calls deliver(), in any order.
+struct Pipe : AsyncStreamSource, AsyncStreamSink {
+    struct Write {
+        std::vector<uint8_t> data;
+        Callback<void, WriteResult> completer;
+        const uint8_t* end;
+    };
+
+    void start_write(cbufptr_t buffer, TransferHandle* handle, Callback<void, WriteResult> completer) final {
+        *handle = ++n_writes;
+        if (hold_writes) {
+            writes.push_back({{buffer.begin(), buffer.end()}, completer, buffer.end()});
+        } else {
+            packets.push_back({buffer.begin(), buffer.end()});
+            completer.invoke({kStreamOk, buffer.end()});
+        }
+    }
+
+    void cancel_write(TransferHandle transfer_handle) final {}
+
+    void start_read(bufptr_t buffer, TransferHandle* handle, Callback<void, ReadResult> completer) final {
+        *handle = 1;
+        read_buf = buffer;
+        read_completer = completer;
+    }
+
+    void cancel_read(TransferHandle transfer_handle) final {}
+
+    void finish_write() {
+        REQUIRE(writes.size());
+        Write write = writes.front();
+        writes.pop_front();
+        packets.push_back(write.data);
+        write.completer.invoke({kStreamOk, write.end});
+    }
+
+    // Passes the packet with the specified index to the reader. Returns false
+    // if the reader is not ready or there is no such packet.
+    bool deliver(size_t index = 0) {
+        if (index >= packets.size() || !read_completer) {
+            return false;
+        }
+        std::vector<uint8_t> packet = packets[index];
+        packets.erase(packets.begin() + index);
+        REQUIRE(packet.size() <= read_buf.size());
+        std::copy(packet.begin(), packet.end(), read_buf.begin());
+        read_completer.invoke_and_clear({kStreamOk, read_buf.begin() + packet.size()});
+        return true;
+    }
+
+    bool is_reading() {
+        return read_completer ? true : false;
+    }
+
+    bool hold_writes = false;
+    std::deque<Write> writes;
+    std::deque<std::vector<uint8_t>> packets;
+    size_t n_writes = 0;
+    bufptr_t read_buf;
+    Callback<void, ReadResult> read_completer;
+};
+
+struct Connection {
+    Connection() {
+        counter = 0;
+        setenv("FIBRE_CACHE_DIR", "", 1); // don't touch the JSON cache of the user
+        device.start(nullptr, nullptr, nullptr); // server only
+    }
+
+    // Delivers all packets in both directions. Returns false if there were none.
+    bool round_trip() {
+        bool progress = false;
+        while (to_device.deliver()) {
+            progress = true;
+        }
+        while (to_host.deliver()) {
+            progress = true;
+        }
+        return progress;
+    }
+
+    void connect() {
+        host.start({on_found_root_object, this}, {on_lost_root_object, this}, {on_stopped, this});
+        while (round_trip()) {
+        }
+        REQUIRE(root.get() != nullptr);
+    }
+
+    static void on_found_root_object(void* ctx, LegacyObjectClient* client, std::shared_ptr<LegacyObject> obj) {
+        reinterpret_cast<Connection*>(ctx)->root = obj;
+    }
+
+    static void on_lost_root_object(void* ctx, LegacyObjectClient* client, std::shared_ptr<LegacyObject> obj) {}
+    static void on_stopped(void* ctx, LegacyProtocolPacketBased* protocol, StreamStatus status) {}
+
+    Pipe to_device;
+    Pipe to_host;
+    LegacyProtocolPacketBased device{&to_device, &to_host, 64};
+    LegacyProtocolPacketBased host{&to_host, &to_device, 64};
+    std::shared_ptr<LegacyObject> root;
+};
+
+// A read of the counter endpoint from the client side
+struct CounterRead {
+    void start(LegacyProtocolPacketBased& protocol) {
+        EndpointOperationHandle handle;
+        protocol.start_endpoint_operation(1, {}, rx_buf, &handle, MEMBER_CB(this, on_finished));
+    }
+
+    void on_finished(EndpointOperationResult result) {
+        status = result.status;
+        n_received = result.rx_end - rx_buf;
+        read_le<uint32_t>(&value, rx_buf);
+        order = ++n_finished;
+    }
+
+    uint8_t rx_buf[4] = {};
+    StreamStatus status = kStreamError;
+    size_t n_received = 0;
+    uint32_t value = 0;
+    size_t order = 0; // 1 for the operation that finished first
+    static size_t n_finished;
+};
+
+size_t CounterRead::n_finished = 0;
+
+static std::vector<uint8_t> make_request(uint16_t seqno, uint16_t endpoint_id, uint16_t rx_length) {
+    std::vector<uint8_t> request(8);
+    write_le<uint16_t>(seqno, request.data());
+    write_le<uint16_t>(endpoint_id | 0x8000, request.data() + 2);
+    write_le<uint16_t>(rx_length, request.data() + 4);
+    write_le<uint16_t>(endpoint_id ? json_crc_ : PROTOCOL_VERSION, request.data() + 6);
+    return request;
+}
+
+TEST_SUITE("legacy_protocol") {
+    TEST_CASE("window negotiation") {
+        CounterRead::n_finished = 0;
+
+        SUBCASE("current peer") {
+            window_reply_length = 8;
+            Connection conn;
+            conn.connect();
+            CHECK(conn.host.window_size_ == FIBRE_LEGACY_WINDOW_SIZE);
+            CHECK(conn.host.remote_features_ == PROTOCOL_FEATURE_BATCH);
+        }
+
+        SUBCASE("peer without protocol features") {
+            window_reply_length = 4;
+            Connection conn;
+            conn.connect();
+            CHECK(conn.host.window_size_ == FIBRE_LEGACY_WINDOW_SIZE);
+            CHECK(conn.host.remote_features_ == 0);
+        }
+
+        SUBCASE("old peer falls back to one operation at a time") {
+            window_reply_length = 0;
+            Connection conn;
+            conn.connect();
+            CHECK(conn.host.window_size_ == 1);
+            CHECK(conn.host.remote_features_ == 0);
+
+            CounterRead reads[3];
+            for (auto& read: reads) {
+                read.start(conn.host);
+            }
+            CHECK(conn.to_device.packets.size() == 1);
+
+            // Each response releases the next request
+            for (size_t i = 0; i < 3; ++i) {
+                REQUIRE(conn.to_device.deliver());
+                CHECK(conn.to_device.packets.empty());
+                REQUIRE(conn.to_host.deliver());
+                CHECK(reads[i].status == kStreamOk);
+                CHECK(reads[i].value == i + 1);
+            }
+            CHECK(conn.to_device.packets.empty());
+        }
+
+        window_reply_length = 8;
+    }
+
+    TEST_CASE("out-of-order ACKs") {
+        CounterRead::n_finished = 0;
+        Connection conn;
+        conn.connect();
+        REQUIRE(conn.host.window_size_ == FIBRE_LEGACY_WINDOW_SIZE);
+
+        // Only a full window of requests is sent, the last one waits
+        CounterRead reads[FIBRE_LEGACY_WINDOW_SIZE + 1];
+        for (auto& read: reads) {
+            read.start(conn.host);
+        }
+        CHECK(conn.to_device.packets.size() == FIBRE_LEGACY_WINDOW_SIZE);
+        while (conn.to_device.deliver()) {
+        }
+        CHECK(conn.to_host.packets.size() == FIBRE_LEGACY_WINDOW_SIZE);
+
+        // Answer the last request first. Its slot goes to the waiting request.
+        REQUIRE(conn.to_host.deliver(FIBRE_LEGACY_WINDOW_SIZE - 1));
+        CHECK(reads[FIBRE_LEGACY_WINDOW_SIZE - 1].order == 1);
+        CHECK(conn.to_device.packets.size() == 1);
+        REQUIRE(conn.to_device.deliver());
+
+        // An ACK that matches no operation is ignored
+        std::vector<uint8_t> bogus_ack = {0x7f, 0xff, 0, 0, 0, 0};
+        conn.to_host.packets.push_front(bogus_ack);
+        REQUIRE(conn.to_host.deliver());
+
+        // Then the others in reverse order
+        while (conn.to_host.packets.size()) {
+            REQUIRE(conn.to_host.deliver(conn.to_host.packets.size() - 1));
+        }
+
+        // Each operation got the response to its own request
+        for (size_t i = 0; i < FIBRE_LEGACY_WINDOW_SIZE + 1; ++i) {
+            CHECK(reads[i].status == kStreamOk);
+            CHECK(reads[i].n_received == 4);
+            CHECK(reads[i].value == i + 1);
+        }
+        CHECK(reads[FIBRE_LEGACY_WINDOW_SIZE].order == 2);
+        CHECK(reads[0].order == FIBRE_LEGACY_WINDOW_SIZE + 1);
+    }
+
+    TEST_CASE("server pauses RX while all response buffers are in use") {
+        Connection conn;
+        conn.to_host.hold_writes = true;
+
+        const size_t n_requests = FIBRE_LEGACY_WINDOW_SIZE + 2;
+        for (size_t i = 0; i < n_requests; ++i) {
+            conn.to_device.packets.push_back(make_request(0x80 + i, 1, 4));
+        }
+
+        // The first response is being sent and the next ones are queued. The
+        // request after them is received but held back, and no further read
+        // is started.
+        while (conn.to_device.deliver()) {
+        }
+        CHECK(conn.to_host.writes.size() == 1);
+        CHECK(conn.to_device.packets.size() == 1);
+        CHECK(!conn.to_device.is_reading());
+        CHECK(counter == FIBRE_LEGACY_WINDOW_SIZE);
+
+        // Sending one response frees a buffer for the held request
+        conn.to_host.finish_write();
+        CHECK(counter == FIBRE_LEGACY_WINDOW_SIZE + 1);
+        CHECK(conn.to_device.is_reading());
+        CHECK(conn.to_device.deliver());
+        CHECK(!conn.to_device.is_reading());
+
+        // All responses are sent in order
+        while (conn.to_host.writes.size()) {
+            conn.to_host.finish_write();
+            conn.to_device.deliver();
+        }
+        CHECK(counter == n_requests);
+        REQUIRE(conn.to_host.packets.size() == n_requests);
+        for (size_t i = 0; i < n_requests; ++i) {
+            std::vector<uint8_t>& response = conn.to_host.packets[i];
+            REQUIRE(response.size() == 6);
+            uint16_t seqno = 0;
+            uint32_t value = 0;
+            read_le<uint16_t>(&seqno, response.data());
+            read_le<uint32_t>(&value, response.data() + 2);
+            CHECK(seqno == ((0x80 + i) | 0x8000));
+            CHECK(value == i + 1);
+        }
+        CHECK(conn.to_device.is_reading());
+    }
+}
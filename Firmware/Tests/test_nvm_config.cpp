@@ -0,0 +1,652 @@
+#include <doctest.h>
+#include <string.h>
+#include <vector>
+
+#include "MotorControl/nvm_config.hpp"
+#include "Board/sim/sim_nvm.hpp"
+
+struct SmallConfig {
+    uint32_t a = 0;
+    float b = 0.0f;
+};
+
+struct LargeConfig {
+    uint8_t data[1000] = {};
+};
+
+// Hand-written equivalents of the interface classes in autogen/interfaces.hpp
+struct SmallConfigIntf {
+    template<typename T, typename TVisitor> static void visit_config_fields(T* obj, TVisitor&& visitor) {
+        visitor(0x1001, obj->a);
+        visitor(0x1002, obj->b);
+    }
+};
+
+struct LargeConfigIntf {
+    template<typename T, typename TVisitor> static void visit_config_fields(T* obj, TVisitor&& visitor) {
+        visitor(0x2001, obj->data);
+    }
+};
+
+struct TestConfig {
+    SmallConfig small;
+    LargeConfig large;
+    SmallConfig other;
+
+    bool operator==(const TestConfig& rhs) const {
+        return memcmp(this, &rhs, sizeof(*this)) == 0;
+    }
+};
+
+static TestConfig make_config(uint32_t seed) {
+    TestConfig config;
+    config.small.a = seed;
+    config.small.b = seed * 0.5f;
+    for (size_t i = 0; i < sizeof(config.large.data); ++i) {
+        config.large.data[i] = (uint8_t)(seed * 7 + i);
+    }
+    config.other.a = ~seed;
+    return config;
+}
+
+static bool load(ConfigManager& manager, TestConfig* config) {
+    return manager.start_load()
+        && manager.read<SmallConfigIntf>(0, &config->small)
+        && manager.read<LargeConfigIntf>(1, &config->large)
+        && manager.read<SmallConfigIntf>(2, &config->other)
+        && manager.finish_load(nullptr);
+}
+
+static bool write_all(ConfigManager& manager, TestConfig* config) {
+    return manager.write<SmallConfigIntf>(0, &config->small)
+        && manager.write<LargeConfigIntf>(1, &config->large)
+        && manager.write<SmallConfigIntf>(2, &config->other);
+}
+
+static bool store(ConfigManager& manager, TestConfig config, bool allow_erase = true, size_t* size = nullptr) {
+    size_t occupied_size = 0;
+    bool result = manager.prepare_store()
+        && write_all(manager, &config)
+        && manager.start_store(&occupied_size, allow_erase)
+        && write_all(manager, &config)
+        && manager.finish_store();
+    if (size) {
+        *size = occupied_size;
+    }
+    return result;
+}
+
+// Simulates a reboot and returns the configuration found in NVM
+static bool reboot_and_load(TestConfig* config) {
+    ConfigManager manager;
+    return manager.init() && load(manager, config);
+}
+
+TEST_CASE("nvm_config: round trip") {
+    sim_nvm_reset();
+    ConfigManager manager;
+    REQUIRE(manager.init());
+
+    // Nothing stored yet: all objects keep their values
+    TestConfig config = make_config(5);
+    CHECK(load(manager, &config));
+    CHECK(config == make_config(5));
+
+    REQUIRE(store(manager, make_config(1)));
+    CHECK(load(manager, &config));
+    CHECK(config == make_config(1));
+
+    TestConfig reloaded;
+    CHECK(reboot_and_load(&reloaded));
+    CHECK(reloaded == make_config(1));
+    CHECK(sim_nvm.n_violations == 0);
+}
+
+TEST_CASE("nvm_config: only changed objects are written") {
+    sim_nvm_reset();
+    ConfigManager manager;
+    REQUIRE(manager.init());
+    REQUIRE(store(manager, make_config(1)));
+    size_t n_records = manager.n_records_written_;
+    size_t n_erases = sim_nvm.n_erases;
+
+    // Nothing changed: nothing is written
+    size_t size = 1;
+    REQUIRE(store(manager, make_config(1), false, &size));
+    CHECK(size == 0);
+    CHECK(manager.n_records_written_ == n_records);
+
+    // One object changed: one record plus the commit record
+    TestConfig config = make_config(1);
+    config.other.b = 42.0f;
+    REQUIRE(store(manager, config, false, &size));
+    CHECK(size < sizeof(LargeConfig));
+    CHECK(manager.n_records_written_ == n_records + 2);
+    CHECK(sim_nvm.n_erases == n_erases);
+    CHECK_FALSE(manager.erased_on_store_);
+
+    TestConfig reloaded;
+    CHECK(reboot_and_load(&reloaded));
+    CHECK(reloaded == config);
+    CHECK(sim_nvm.n_violations == 0);
+}
+
+TEST_CASE("nvm_config: compaction") {
+    sim_nvm_reset();
+    ConfigManager manager;
+    REQUIRE(manager.init());
+
+    // Each store rewrites the large object, so the sector fills up quickly.
+    // The first compaction uses the spare sector that was erased by init().
+    uint32_t seed = 1;
+    while (manager.n_compactions_ == 0) {
+        REQUIRE(store(manager, make_config(seed++), false));
+    }
+    CHECK_FALSE(manager.erased_on_store_);
+
+    // The next compaction requires an erase
+    while (store(manager, make_config(seed), false)) {
+        seed++;
+    }
+    TestConfig config;
+    CHECK(load(manager, &config));
+    CHECK(config == make_config(seed - 1));
+
+    REQUIRE(store(manager, make_config(seed), true));
+    CHECK(manager.erased_on_store_);
+    CHECK(manager.n_compactions_ == 2);
+
+    CHECK(reboot_and_load(&config));
+    CHECK(config == make_config(seed));
+    CHECK(sim_nvm.n_violations == 0);
+}
+
+// Two versions of the same config object as they could appear in two
+// firmware versions. Compared to V1, V2 removes a field, adds a field, grows
+// an array and changes the type of a scalar.
+struct ConfigV1 {
+    uint32_t a = 1;
+    float removed = 2.0f;
+    float array[4] = {3.0f, 3.0f, 3.0f, 3.0f};
+    uint16_t resized = 4;
+};
+
+struct ConfigV1Intf {
+    template<typename T, typename TVisitor> static void visit_config_fields(T* obj, TVisitor&& visitor) {
+        visitor(0x3001, obj->a);
+        visitor(0x3002, obj->removed);
+        visitor(0x3003, obj->array);
+        visitor(0x3004, obj->resized);
+    }
+};
+
+struct ConfigV2 {
+    float added = 10.0f;
+    uint32_t a = 11;
+    std::array<float, 6> array = {12.0f, 12.0f, 12.0f, 12.0f, 12.0f, 12.0f};
+    uint32_t resized = 13;
+};
+
+struct ConfigV2Intf {
+    template<typename T, typename TVisitor> static void visit_config_fields(T* obj, TVisitor&& visitor) {
+        visitor(0x3005, obj->added);
+        visitor(0x3001, obj->a);
+        visitor(0x3003, obj->array);
+        visitor(0x3004, obj->resized);
+    }
+};
+
+template<typename TIntf, typename T>
+static bool store_one(ConfigManager& manager, T config) {
+    return manager.prepare_store()
+        && manager.write<TIntf>(7, &config)
+        && manager.start_store(nullptr, true)
+        && manager.write<TIntf>(7, &config)
+        && manager.finish_store();
+}
+
+template<typename TIntf, typename T>
+static bool load_one(ConfigManager& manager, T* config) {
+    return manager.start_load()
+        && manager.read<TIntf>(7, config)
+        && manager.finish_load(nullptr);
+}
+
+TEST_CASE("nvm_config: migration to a newer layout") {
+    sim_nvm_reset();
+    ConfigManager manager;
+    REQUIRE(manager.init());
+
+    ConfigV1 old_config;
+    old_config.a = 100;
+    old_config.removed = 101.0f;
+    for (size_t i = 0; i < 4; ++i) {
+        old_config.array[i] = 102.0f + i;
+    }
+    old_config.resized = 103;
+    REQUIRE(store_one<ConfigV1Intf>(manager, old_config));
+
+    ConfigManager rebooted;
+    REQUIRE(rebooted.init());
+    ConfigV2 config;
+    REQUIRE(load_one<ConfigV2Intf>(rebooted, &config));
+    CHECK(config.added == 10.0f); // new field: default
+    CHECK(config.a == 100);
+    CHECK(config.array[0] == 102.0f);
+    CHECK(config.array[3] == 105.0f);
+    CHECK(config.array[4] == 12.0f); // new array elements: default
+    CHECK(config.array[5] == 12.0f);
+    CHECK(config.resized == 13); // different type: default
+    CHECK(rebooted.n_fields_loaded_ == 2);
+    CHECK(rebooted.n_fields_defaulted_ == 2);
+
+    // Saving the migrated object replaces the old record
+    config.added = 200.0f;
+    REQUIRE(store_one<ConfigV2Intf>(rebooted, config));
+    ConfigV2 reloaded;
+    ConfigManager rebooted2;
+    REQUIRE(rebooted2.init());
+    REQUIRE(load_one<ConfigV2Intf>(rebooted2, &reloaded));
+    CHECK(memcmp(&reloaded, &config, sizeof(config)) == 0);
+    CHECK(rebooted2.n_fields_defaulted_ == 0);
+    CHECK(sim_nvm.n_violations == 0);
+}
+
+TEST_CASE("nvm_config: migration to an older layout") {
+    sim_nvm_reset();
+    ConfigManager manager;
+    REQUIRE(manager.init());
+
+    ConfigV2 new_config;
+    new_config.a = 300;
+    for (size_t i = 0; i < 6; ++i) {
+        new_config.array[i] = 301.0f + i;
+    }
+    REQUIRE(store_one<ConfigV2Intf>(manager, new_config));
+
+    ConfigV1 config;
+    REQUIRE(load_one<ConfigV1Intf>(manager, &config));
+    CHECK(config.a == 300);
+    CHECK(config.removed == 2.0f); // not stored: default
+    CHECK(config.array[0] == 301.0f); // array shrunk: leading elements
+    CHECK(config.array[3] == 304.0f);
+    CHECK(config.resized == 4);
+    CHECK(manager.n_fields_loaded_ == 2);
+    CHECK(manager.n_fields_defaulted_ == 2);
+}
+
+TEST_CASE("nvm_config: object that was never stored") {
+    sim_nvm_reset();
+    ConfigManager manager;
+    REQUIRE(manager.init());
+    REQUIRE(store(manager, make_config(1)));
+
+    // E.g. a config object that was added by a firmware update
+    SmallConfig added{42, 43.0f};
+    bool loaded = manager.start_load()
+        && manager.read<SmallConfigIntf>(3, &added)
+        && manager.finish_load(nullptr);
+    CHECK(loaded);
+    CHECK(added.a == 42);
+    CHECK(added.b == 43.0f);
+    CHECK(manager.n_fields_loaded_ == 0);
+    CHECK(manager.n_fields_defaulted_ == 0);
+}
+
+// A config object with a table that is only stored in one of two modes, like
+// the cogging map of the controller
+struct ModalConfig {
+    uint32_t mode = 0;
+    float table[100] = {};
+};
+
+struct ModalConfigIntf {
+    template<typename T, typename TVisitor> static void visit_config_fields(T* obj, TVisitor&& visitor) {
+        visitor(0x4001, obj->mode);
+        visitor(0x4002, obj->table, obj->mode == 0);
+    }
+};
+
+TEST_CASE("nvm_config: conditionally persisted field") {
+    sim_nvm_reset();
+    ConfigManager manager;
+    REQUIRE(manager.init());
+
+    ModalConfig config;
+    for (size_t i = 0; i < 100; ++i) {
+        config.table[i] = 1.0f + i;
+    }
+    REQUIRE(store_one<ModalConfigIntf>(manager, config));
+    ModalConfig loaded;
+    REQUIRE(load_one<ModalConfigIntf>(manager, &loaded));
+    CHECK(loaded.table[99] == 100.0f);
+    size_t occupied_with_table = 0;
+    REQUIRE(manager.start_load());
+    REQUIRE(manager.read<ModalConfigIntf>(7, &loaded));
+    REQUIRE(manager.finish_load(&occupied_with_table));
+
+    // In the other mode the table is left out and not loaded
+    config.mode = 1;
+    REQUIRE(store_one<ModalConfigIntf>(manager, config));
+    ModalConfig rebooted_config;
+    ConfigManager rebooted;
+    REQUIRE(rebooted.init());
+    size_t occupied_without_table = 0;
+    REQUIRE(rebooted.start_load());
+    REQUIRE(rebooted.read<ModalConfigIntf>(7, &rebooted_config));
+    REQUIRE(rebooted.finish_load(&occupied_without_table));
+    CHECK(rebooted_config.mode == 1);
+    CHECK(rebooted_config.table[99] == 0.0f);
+    CHECK(occupied_without_table + sizeof(config.table) <= occupied_with_table);
+
+    // Saving again in the same mode doesn't append a record
+    uint32_t n_records = rebooted.n_records_written_;
+    REQUIRE(store_one<ModalConfigIntf>(rebooted, rebooted_config));
+    CHECK(rebooted.n_records_written_ == n_records);
+}
+
+// A config struct as stored by older firmware versions in the raw struct
+// format, and its current version with members added in between. The
+// pointer must not be loaded.
+struct RawConfigV1 {
+    bool flag = false;
+    uint16_t pin = 0;
+    float gain = 0.0f;
+    void* parent = nullptr;
+};
+
+struct RawConfigV2 {
+    bool flag = false;
+    uint32_t added = 5;
+    uint16_t pin = 0;
+    float gain = 0.0f;
+    float added_array[2] = {6.0f, 6.0f};
+    void* parent = nullptr;
+};
+
+struct RawConfigV2Intf {
+    template<typename T, typename TVisitor> static void visit_config_fields(T* obj, TVisitor&& visitor) {
+        visitor(0x5001, obj->flag);
+        visitor(0x5002, obj->added);
+        visitor(0x5003, obj->pin);
+        visitor(0x5004, obj->gain);
+        visitor(0x5005, obj->added_array);
+    }
+};
+
+// pin and gain are separate ranges because the padding in front of pin
+// changed
+static const std::initializer_list<LegacyRange> raw_config_legacy_layout = {
+    LEGACY_RANGE(RawConfigV2, flag, flag),
+    LEGACY_RANGE(RawConfigV2, pin, pin),
+    LEGACY_RANGE(RawConfigV2, gain, gain),
+    LEGACY_RANGE(RawConfigV2, parent, parent),
+};
+
+struct LegacyTestConfig {
+    SmallConfig small;
+    RawConfigV2 raw;
+};
+
+static bool load_legacy_test_config(ConfigManager& manager, LegacyTestConfig* config) {
+    return manager.start_load()
+        && manager.read<SmallConfigIntf>(0, &config->small)
+        && manager.read<RawConfigV2Intf>(1, &config->raw, raw_config_legacy_layout)
+        && manager.finish_load(nullptr);
+}
+
+static bool store_legacy_test_config(ConfigManager& manager, LegacyTestConfig config) {
+    return manager.prepare_store()
+        && manager.write<SmallConfigIntf>(0, &config.small)
+        && manager.write<RawConfigV2Intf>(1, &config.raw)
+        && manager.start_store(nullptr, true)
+        && manager.write<SmallConfigIntf>(0, &config.small)
+        && manager.write<RawConfigV2Intf>(1, &config.raw)
+        && manager.finish_store();
+}
+
+template<typename T>
+static void append_raw(std::vector<uint8_t>* blob, const T& obj) {
+    const uint8_t* ptr = (const uint8_t*)&obj;
+    blob->insert(blob->end(), ptr, ptr + sizeof(T));
+}
+
+static std::vector<uint8_t> make_legacy_blob(uint32_t seed) {
+    SmallConfig small{seed, seed * 0.5f};
+    RawConfigV1 raw{};
+    raw.flag = true;
+    raw.pin = (uint16_t)(seed + 1);
+    raw.gain = seed * 0.25f;
+    raw.parent = &raw;
+
+    std::vector<uint8_t> blob;
+    append_raw(&blob, small);
+    append_raw(&blob, raw);
+    uint16_t crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT ^ legacy_config_version, blob.data(), blob.size());
+    append_raw(&blob, crc16);
+    return blob;
+}
+
+// Writes the blob to a sector like the NVM driver of older firmware versions:
+// The blob occupies the 64-bit fields from `index` on and the allocation
+// table at the beginning of the sector marks these fields as valid.
+static void write_legacy_blob(size_t sector, size_t index, const std::vector<uint8_t>& blob) {
+    REQUIRE(NVM_program(sector, index * 8, blob.data(), blob.size()) == 0);
+    for (size_t i = index; i < index + (blob.size() + 7) / 8; ++i) {
+        sim_nvm.data[sector][i >> 2] &= ~(0x3 << ((i & 0x3) << 1));
+    }
+}
+
+static void check_legacy_test_config(const LegacyTestConfig& config, uint32_t seed) {
+    CHECK(config.small.a == seed);
+    CHECK(config.small.b == seed * 0.5f);
+    CHECK(config.raw.flag == true);
+    CHECK(config.raw.added == 5); // added: default
+    CHECK(config.raw.pin == seed + 1);
+    CHECK(config.raw.gain == seed * 0.25f);
+    CHECK(config.raw.added_array[1] == 6.0f);
+}
+
+TEST_CASE("nvm_config: import from the legacy format") {
+    // The field after the allocation table
+    const size_t first_field = (SimNvm::kSectorSize >> 3) >> 5;
+
+    // An older copy in the first sector and the latest one in the second
+    sim_nvm_reset();
+    write_legacy_blob(0, first_field, make_legacy_blob(1));
+    write_legacy_blob(1, first_field, make_legacy_blob(2));
+    SimNvm legacy = sim_nvm;
+
+    {
+        ConfigManager manager;
+        REQUIRE(manager.init());
+        CHECK(manager.has_legacy_config());
+        LegacyTestConfig config;
+        int parent;
+        config.raw.parent = &parent;
+        REQUIRE(load_legacy_test_config(manager, &config));
+        check_legacy_test_config(config, 2);
+        CHECK(config.raw.parent == &parent);
+        CHECK(manager.n_fields_loaded_ == 5);
+        CHECK(manager.n_fields_defaulted_ == 2);
+    }
+    CHECK(memcmp(sim_nvm.data[1], legacy.data[1], sizeof(legacy.data[1])) == 0);
+
+    // An interrupted import leaves the legacy configuration in effect, unless
+    // the power was cut while the last byte was programmed
+    size_t n_ops;
+    {
+        ConfigManager manager;
+        LegacyTestConfig config;
+        REQUIRE(manager.init());
+        REQUIRE(load_legacy_test_config(manager, &config));
+        size_t ops_before = sim_nvm.n_ops;
+        REQUIRE(store_legacy_test_config(manager, config));
+        n_ops = sim_nvm.n_ops - ops_before;
+        CHECK_FALSE(manager.has_legacy_config());
+    }
+
+    for (size_t cut = 0; cut < n_ops; ++cut) {
+        CAPTURE(cut);
+        sim_nvm = legacy;
+
+        ConfigManager manager;
+        LegacyTestConfig config;
+        REQUIRE(manager.init());
+        REQUIRE(load_legacy_test_config(manager, &config));
+        sim_nvm_cut_power_after(cut, cut * 2654435761u + 1);
+        CHECK_FALSE(store_legacy_test_config(manager, config));
+        sim_nvm_power_on();
+
+        ConfigManager rebooted;
+        LegacyTestConfig reloaded;
+        REQUIRE(rebooted.init());
+        CHECK((rebooted.has_legacy_config() || cut == n_ops - 1));
+        REQUIRE(load_legacy_test_config(rebooted, &reloaded));
+        check_legacy_test_config(reloaded, 2);
+        if (rebooted.has_legacy_config()) {
+            CHECK(memcmp(sim_nvm.data[1], legacy.data[1], sizeof(legacy.data[1])) == 0);
+        }
+        CHECK(sim_nvm.n_violations == 0);
+    }
+
+    // Once the import succeeded, the legacy configuration is erased
+    sim_nvm = legacy;
+    {
+        ConfigManager manager;
+        LegacyTestConfig config;
+        REQUIRE(manager.init());
+        REQUIRE(load_legacy_test_config(manager, &config));
+        REQUIRE(store_legacy_test_config(manager, config));
+    }
+    ConfigManager rebooted;
+    LegacyTestConfig reloaded;
+    REQUIRE(rebooted.init());
+    CHECK_FALSE(rebooted.has_legacy_config());
+    REQUIRE(load_legacy_test_config(rebooted, &reloaded));
+    check_legacy_test_config(reloaded, 2);
+    CHECK(rebooted.n_fields_defaulted_ == 0);
+    for (size_t i = 0; i < SimNvm::kSectorSize; ++i) {
+        REQUIRE(sim_nvm.data[1][i] == 0xff);
+    }
+    CHECK(sim_nvm.n_violations == 0);
+}
+
+TEST_CASE("nvm_config: legacy configuration that can't be loaded") {
+    const size_t first_field = (SimNvm::kSectorSize >> 3) >> 5;
+
+    // E.g. stored by a firmware version with a different struct layout
+    sim_nvm_reset();
+    std::vector<uint8_t> blob = make_legacy_blob(3);
+    blob[0] ^= 1;
+    write_legacy_blob(0, first_field, blob);
+    SimNvm legacy = sim_nvm;
+
+    for (size_t boot = 0; boot < 2; ++boot) {
+        ConfigManager manager;
+        LegacyTestConfig config;
+        REQUIRE(manager.init());
+        CHECK(manager.has_legacy_config());
+        CHECK_FALSE(load_legacy_test_config(manager, &config));
+    }
+    CHECK(memcmp(sim_nvm.data[0], legacy.data[0], sizeof(legacy.data[0])) == 0);
+
+    // Kept until the first save
+    {
+        ConfigManager manager;
+        REQUIRE(manager.init());
+        REQUIRE(store_legacy_test_config(manager, LegacyTestConfig{}));
+    }
+    ConfigManager rebooted;
+    LegacyTestConfig reloaded;
+    REQUIRE(rebooted.init());
+    CHECK_FALSE(rebooted.has_legacy_config());
+    CHECK(load_legacy_test_config(rebooted, &reloaded));
+    CHECK(sim_nvm.n_violations == 0);
+}
+
+// Cuts the power at every possible point of a store operation and checks that
+// after the reboot either the old or the new configuration is loaded.
+static void power_loss_sweep(uint32_t old_seed, uint32_t new_seed, bool allow_erase) {
+    // Record the flash state before the store operation
+    SimNvm initial = sim_nvm;
+
+    size_t n_ops;
+    {
+        ConfigManager manager;
+        REQUIRE(manager.init());
+        size_t ops_before = sim_nvm.n_ops;
+        REQUIRE(store(manager, make_config(new_seed), allow_erase));
+        n_ops = sim_nvm.n_ops - ops_before;
+    }
+
+    for (size_t cut = 0; cut < n_ops; ++cut) {
+        CAPTURE(cut);
+        sim_nvm = initial;
+
+        ConfigManager manager;
+        REQUIRE(manager.init());
+        sim_nvm_cut_power_after(cut, cut * 2654435761u + 1);
+        CHECK_FALSE(store(manager, make_config(new_seed), allow_erase));
+        sim_nvm_power_on();
+
+        // Cut the power once more during the recovery at startup
+        SimNvm after_cut = sim_nvm;
+        sim_nvm_cut_power_after(cut % 7, cut);
+        ConfigManager interrupted;
+        interrupted.init();
+        sim_nvm_power_on();
+
+        TestConfig config;
+        REQUIRE(reboot_and_load(&config));
+        bool is_old = config == make_config(old_seed);
+        bool is_new = config == make_config(new_seed);
+        CHECK((is_old || is_new));
+
+        // The same result without the second interruption
+        sim_nvm = after_cut;
+        TestConfig config2;
+        REQUIRE(reboot_and_load(&config2));
+        CHECK(config2 == config);
+
+        // The NVM must remain usable
+        ConfigManager next;
+        REQUIRE(next.init());
+        CHECK(store(next, make_config(new_seed + 1)));
+        CHECK(reboot_and_load(&config));
+        CHECK(config == make_config(new_seed + 1));
+        CHECK(sim_nvm.n_violations == 0);
+    }
+}
+
+TEST_CASE("nvm_config: power loss during store") {
+    sim_nvm_reset();
+    {
+        ConfigManager manager;
+        REQUIRE(manager.init());
+        REQUIRE(store(manager, make_config(1)));
+        REQUIRE(store(manager, make_config(2)));
+    }
+
+    power_loss_sweep(2, 3, true);
+}
+
+TEST_CASE("nvm_config: power loss during compaction") {
+    sim_nvm_reset();
+
+    // Fill the sector up to the point where the next store compacts it
+    uint32_t seed = 1;
+    for (;;) {
+        SimNvm before = sim_nvm;
+        ConfigManager manager;
+        REQUIRE(manager.init());
+        REQUIRE(store(manager, make_config(seed)));
+        if (manager.n_compactions_) {
+            sim_nvm = before;
+            break;
+        }
+        seed++;
+    }
+
+    power_loss_sweep(seed - 1, seed, true);
+}
@@ -0,0 +1,201 @@
+#include <doctest.h>
+#include <cmath>
+
+#include "MotorControl/pvt_queue.hpp"
+
+static constexpr float kLoopPeriod = 0.000125f; // 8 kHz
+static constexpr float kDecel = 100.0f; // [turn/s^2]
+
+TEST_SUITE("PVT Queue") {
+    TEST_CASE("idle") {
+        PvtQueue queue;
+        PvtQueue::Step_t step;
+        CHECK(!queue.update(kLoopPeriod, 1.0f, 0.0f, kDecel, step));
+        CHECK(queue.fill_level() == 0);
+        CHECK(queue.buffered_time() == 0.0f);
+    }
+
+    TEST_CASE("invalid points") {
+        PvtQueue queue;
+        CHECK(!queue.push(1.0f, 0.0f, 0.0f));
+        CHECK(!queue.push(1.0f, 0.0f, -0.01f));
+        CHECK(!queue.push(1.0f, 0.0f, NAN));
+        CHECK(!queue.push(NAN, 0.0f, 0.01f));
+        CHECK(!queue.push(1.0f, INFINITY, 0.01f));
+        CHECK(queue.fill_level() == 0);
+    }
+
+    TEST_CASE("full queue") {
+        PvtQueue queue;
+        for (size_t i = 0; i < PvtQueue::kCapacity; ++i) {
+            CHECK(queue.push(i * 0.1f, 0.0f, 0.01f));
+        }
+        CHECK(!queue.push(0.0f, 0.0f, 0.01f));
+        CHECK(queue.fill_level() == PvtQueue::kCapacity);
+        CHECK(queue.buffered_time() == doctest::Approx(PvtQueue::kCapacity * 0.01f));
+
+        // Starting a segment frees up one slot
+        PvtQueue::Step_t step;
+        CHECK(queue.update(kLoopPeriod, 0.0f, 0.0f, kDecel, step));
+        CHECK(queue.fill_level() == PvtQueue::kCapacity - 1);
+        CHECK(queue.push(0.0f, 0.0f, 0.01f));
+        CHECK(!queue.push(0.0f, 0.0f, 0.01f));
+    }
+
+    TEST_CASE("sine tracking") {
+        // Stream a 2 Hz sine at 100 points per second and keep the queue
+        // topped up, like a host would
+        const float f = 2.0f;
+        const float w = 2.0f * (float)M_PI * f;
+        const float point_dt = 0.01f;
+        auto pos = [&](float t) { return std::sin(w * t); };
+        auto vel = [&](float t) { return w * std::cos(w * t); };
+
+        PvtQueue queue;
+        size_t n_pushed = 0;
+        float pos_setpoint = 0.0f, vel_setpoint = w;
+        float max_pos_err = 0.0f, max_vel_err = 0.0f, max_vel_jump = 0.0f;
+
+        for (size_t i = 1; i <= 8000; ++i) {
+            while (queue.fill_level() < 4) {
+                n_pushed++;
+                float t = n_pushed * point_dt;
+                REQUIRE(queue.push(pos(t), vel(t), point_dt));
+            }
+
+            PvtQueue::Step_t step;
+            REQUIRE(queue.update(kLoopPeriod, pos_setpoint, vel_setpoint, kDecel, step));
+            float t = (i - 1) * kLoopPeriod; // the first step is at the start of the segment
+            max_pos_err = std::max(max_pos_err, std::abs(step.Y - pos(t)));
+            max_vel_err = std::max(max_vel_err, std::abs(step.Yd - vel(t)));
+            max_vel_jump = std::max(max_vel_jump, std::abs(step.Yd - vel_setpoint));
+            pos_setpoint = step.Y;
+            vel_setpoint = step.Yd;
+        }
+
+        // Hermite interpolation error is O(point_dt^4) for position
+        CHECK(max_pos_err < 1e-4f);
+        CHECK(max_vel_err < 5e-3f * w);
+        // The velocity changes by at most peak_accel * loop period plus rounding
+        CHECK(max_vel_jump < w * w * kLoopPeriod * 1.01f + 1e-4f);
+        CHECK(queue.underrun_count_ == 0);
+    }
+
+    TEST_CASE("timing") {
+        // Points that aren't multiples of the loop period: the overshoot is
+        // carried over, so the setpoint stays on schedule
+        PvtQueue queue;
+        const float point_dt = 0.0033f;
+        for (size_t i = 1; i <= 30; ++i) {
+            CHECK(queue.push(i * 1.0f * point_dt, 1.0f, point_dt));
+        }
+        float pos_setpoint = 0.0f;
+        PvtQueue::Step_t step;
+        for (size_t i = 1; i <= 700; ++i) {
+            REQUIRE(queue.update(kLoopPeriod, pos_setpoint, 1.0f, kDecel, step));
+            pos_setpoint = step.Y;
+            CHECK(step.Y == doctest::Approx((i - 1) * kLoopPeriod).epsilon(1e-4));
+            CHECK(step.Yd == doctest::Approx(1.0f).epsilon(1e-4));
+        }
+    }
+
+    TEST_CASE("starts from the current setpoint") {
+        PvtQueue queue;
+        CHECK(queue.push(2.0f, 0.0f, 0.1f));
+
+        PvtQueue::Step_t step;
+        CHECK(queue.update(kLoopPeriod, 1.0f, 0.0f, kDecel, step));
+        CHECK(step.Y == doctest::Approx(1.0f).epsilon(1e-3));
+        CHECK(step.Yd == doctest::Approx(0.0f));
+
+        // Symmetric about the midpoint of the segment
+        for (size_t i = 1; i <= 400; ++i) {
+            CHECK(queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step));
+        }
+        CHECK(step.Y == doctest::Approx(1.5f).epsilon(1e-3));
+        CHECK(step.Yd == doctest::Approx(15.0f).epsilon(1e-3)); // 1.5 * average velocity
+        while (queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step)) {}
+        CHECK(step.Y == 2.0f);
+        CHECK(step.Yd == 0.0f);
+        CHECK(queue.underrun_count_ == 0);
+    }
+
+    TEST_CASE("underrun") {
+        PvtQueue queue;
+        CHECK(queue.push(0.01f, 1.0f, 0.01f));
+
+        PvtQueue::Step_t step = {0.0f, 1.0f, 0.0f};
+        size_t n_steps = 0;
+        while (queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step)) {
+            n_steps++;
+        }
+        // 80 steps to the end of the segment, 80 more to decelerate to rest
+        // (+1 each if t_ rounds down) plus the final stop
+        CHECK(n_steps >= 161);
+        CHECK(n_steps <= 163);
+        CHECK(step.Y == doctest::Approx(0.015f)); // 0.01 + v^2 / (2 * decel)
+        CHECK(step.Yd == 0.0f);
+        CHECK(queue.underrun_count_ == 1);
+
+        // A late point starts a new segment from where the setpoint stopped
+        CHECK(queue.push(0.02f, 0.0f, 0.01f));
+        CHECK(queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step));
+        CHECK(step.Y == doctest::Approx(0.015f).epsilon(1e-3));
+        CHECK(std::abs(step.Yd) < 0.1f);
+    }
+
+    TEST_CASE("velocity stays continuous on underrun") {
+        PvtQueue queue;
+        CHECK(queue.push(0.01f, 1.0f, 0.01f));
+
+        PvtQueue::Step_t step = {0.0f, 1.0f, 0.0f};
+        float max_vel_jump = 0.0f;
+        for (size_t i = 0; i < 100; ++i) {
+            float vel = step.Yd;
+            REQUIRE(queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step));
+            max_vel_jump = std::max(max_vel_jump, std::abs(step.Yd - vel));
+        }
+        CHECK(queue.underrun_count_ == 1);
+        CHECK(step.Yd > 0.6f);
+        CHECK(step.Yd < 0.9f);
+
+        // A point that arrives while decelerating continues from the current
+        // setpoint without waiting for it to come to rest
+        float pos = step.Y, vel = step.Yd;
+        CHECK(queue.push(pos + 0.01f * vel, vel, 0.01f));
+        REQUIRE(queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step));
+        CHECK(step.Y == doctest::Approx(pos));
+        CHECK(step.Yd == doctest::Approx(vel));
+        while (queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step)) {
+            max_vel_jump = std::max(max_vel_jump, std::abs(step.Yd - vel));
+            vel = step.Yd;
+        }
+        CHECK(queue.underrun_count_ == 2);
+        CHECK(step.Yd == 0.0f);
+        CHECK(max_vel_jump <= kDecel * kLoopPeriod * 1.01f);
+    }
+
+    TEST_CASE("clear") {
+        PvtQueue queue;
+        for (size_t i = 1; i <= 10; ++i) {
+            CHECK(queue.push(i * 0.1f, 10.0f, 0.01f));
+        }
+        PvtQueue::Step_t step;
+        CHECK(queue.update(kLoopPeriod, 0.0f, 10.0f, kDecel, step));
+        CHECK(queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step));
+
+        queue.clear();
+        // Points pushed after clear() are kept
+        CHECK(queue.push(step.Y, 0.0f, 0.01f));
+        CHECK(queue.fill_level() == 10);
+
+        PvtQueue::Step_t step2;
+        CHECK(queue.update(kLoopPeriod, step.Y, step.Yd, kDecel, step2));
+        CHECK(queue.fill_level() == 0);
+        CHECK(step2.Y == doctest::Approx(step.Y).epsilon(1e-3));
+        CHECK(queue.underrun_count_ == 0);
+
+        queue.clear();
+        CHECK(!queue.update(kLoopPeriod, step2.Y, step2.Yd, kDecel, step2));
+    }
+}
@@ -0,0 +1,119 @@
+#include <doctest.h>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "MotorControl/scurve_traj.hpp"
+
+void run_scurve_test(float goal, float position, float velocity, float Vmax, float Amax, float Dmax, float Jmax) {
+    SCurveTrajectory traj;
+    REQUIRE(traj.plan(goal, position, velocity, Vmax, Amax, Dmax, Jmax));
+
+    float Vmax_test = std::max(Vmax, std::abs(velocity)) * 1.001f;
+    float Amax_test = std::max(Amax, Dmax) * 1.001f;
+    float tol = 1e-4f * std::max(1.0f, std::abs(goal) + std::abs(position));
+
+    // The segments join continuously
+    for (size_t k = 1; k < SCurveTrajectory::kNumSegments; ++k) {
+        float t = traj.T_[k];
+        float dt = traj.T_[k] - traj.T_[k - 1];
+        float p = traj.P_[k - 1] + dt * (traj.V_[k - 1] + dt * (0.5f * traj.A_[k - 1] + dt / 6.0f * traj.J_[k - 1]));
+        float v = traj.V_[k - 1] + dt * (traj.A_[k - 1] + dt * 0.5f * traj.J_[k - 1]);
+        float a = traj.A_[k - 1] + dt * traj.J_[k - 1];
+        CHECK(p == doctest::Approx(traj.eval(t).Y).epsilon(tol));
+        CHECK(std::abs(v - traj.eval(t).Yd) <= 1e-3f * Vmax_test);
+        CHECK(std::abs(a - traj.eval(t).Ydd) <= 1e-3f * Amax_test);
+    }
+
+    // Step through the trajectory like the controller does
+    float dt = 0.000125f;
+    SCurveTrajectory::Step_t prev = traj.eval(0.0f);
+    CHECK(prev.Y == position);
+    CHECK(prev.Yd == doctest::Approx(velocity));
+    CHECK(prev.Ydd == 0.0f);
+
+    float s = std::signbit(traj.Vr_) ? -1.0f : 1.0f;
+    float t_prev = 0.0f;
+    for (size_t i = 1; t_prev <= traj.Tf_; ++i) {
+        float t = i * dt;
+        float h = t - t_prev; // differs from dt due to rounding
+        float t_err = 2.0f * t * std::numeric_limits<float>::epsilon(); // rounding of t within eval()
+        t_prev = t;
+        SCurveTrajectory::Step_t step = traj.eval(t);
+
+        // Limits
+        CHECK(std::abs(step.Yd) <= Vmax_test);
+        CHECK(std::abs(step.Ydd) <= Amax_test);
+        CHECK(std::abs(step.Ydd - prev.Ydd) <= Jmax * (h + t_err) * 1.001f);
+
+        // Each derivative is consistent with the next higher one
+        CHECK(std::abs((step.Y - prev.Y) - 0.5f * (step.Yd + prev.Yd) * h) <= tol);
+        CHECK(std::abs((step.Yd - prev.Yd) - 0.5f * (step.Ydd + prev.Ydd) * h) <= Amax_test * t_err + 1e-3f * Vmax_test * h + 1e-6f);
+
+        // No overshoot during the final stop
+        if (t >= traj.T_[4]) {
+            CHECK(s * (step.Y - goal) <= tol);
+        }
+
+        prev = step;
+    }
+
+    SCurveTrajectory::Step_t end = traj.eval(traj.Tf_);
+    CHECK(end.Y == doctest::Approx(goal).epsilon(1e-6));
+    CHECK(std::abs(end.Yd) <= 1e-3f * Vmax_test);
+    CHECK(std::abs(end.Ydd) <= 1e-3f * Amax_test);
+    CHECK(traj.eval(traj.Tf_ + 1.0f).Y == end.Y);
+}
+
+TEST_SUITE("S-Curve Trajectory Planner") {
+    TEST_CASE("long-move") {
+        run_scurve_test(10.0f, 0.0f, 0.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+        run_scurve_test(-10.0f, 0.0f, 0.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+    }
+    TEST_CASE("short-move") {
+        // Neither the velocity nor the acceleration limit is reached
+        run_scurve_test(0.01f, 0.0f, 0.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+        run_scurve_test(-0.01f, 0.0f, 0.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+    }
+    TEST_CASE("asymmetric-limits") {
+        run_scurve_test(3.0f, 0.0f, 0.0f, 2.0f, 8.0f, 2.0f, 20.0f);
+        run_scurve_test(3.0f, 0.0f, 0.0f, 2.0f, 2.0f, 8.0f, 20.0f);
+    }
+    TEST_CASE("not-enough-braking-distance") {
+        run_scurve_test(0.1f, 0.0f, 2.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+        run_scurve_test(-0.1f, 0.0f, -2.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+    }
+    TEST_CASE("over-speed") {
+        run_scurve_test(10.0f, 0.0f, 4.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+        run_scurve_test(-10.0f, 0.0f, -4.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+        run_scurve_test(1.5f, 0.0f, 4.0f, 2.0f, 5.0f, 5.0f, 50.0f);
+    }
+    TEST_CASE("reversal") {
+        run_scurve_test(1.0f, 0.0f, -2.0f, 2.0f, 5.0f, 2.0f, 50.0f);
+        run_scurve_test(1.0f, 0.0f, -2.0f, 2.0f, 2.0f, 5.0f, 50.0f);
+    }
+    TEST_CASE("zero-move") {
+        SCurveTrajectory traj;
+        CHECK(traj.plan(1.0f, 1.0f, 0.0f, 2.0f, 5.0f, 5.0f, 50.0f));
+        CHECK(traj.Tf_ == 0.0f);
+        CHECK(traj.eval(0.0f).Y == 1.0f);
+    }
+    TEST_CASE("invalid-limits") {
+        SCurveTrajectory traj;
+        CHECK(!traj.plan(1.0f, 0.0f, 0.0f, 2.0f, 5.0f, 5.0f, 0.0f));
+        CHECK(!traj.plan(1.0f, 0.0f, 0.0f, 2.0f, NAN, 5.0f, 50.0f));
+    }
+    TEST_CASE("randomized") {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> pos(-20.0f, 20.0f);
+        std::uniform_real_distribution<float> log_limit(std::log(0.5f), std::log(20.0f));
+        for (size_t i = 0; i < 100; ++i) {
+            float Vmax = std::exp(log_limit(rng));
+            float Amax = std::exp(log_limit(rng));
+            float Dmax = std::exp(log_limit(rng));
+            float Jmax = 10.0f * std::exp(log_limit(rng));
+            float Vi = std::uniform_real_distribution<float>(-1.5f * Vmax, 1.5f * Vmax)(rng);
+            run_scurve_test(pos(rng), pos(rng), Vi, Vmax, Amax, Dmax, Jmax);
+        }
+    }
+}
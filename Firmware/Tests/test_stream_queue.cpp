@@ -0,0 +1,256 @@
+#include <doctest.h>
+#include <deque>
+#include <vector>
+
+#include <fibre/../../stream_queue.hpp>
+
+using namespace fibre;
+
+// Stand-in for a USB bulk IN endpoint: accepts any number of concurrent reads
+// and completes them in order when the test feeds a packet.
+struct FakeSource : AsyncStreamSource {
+    struct Read {
+        bufptr_t buf;
+        Callback<void, ReadResult> completer;
+    };
+
+    void start_read(bufptr_t buffer, TransferHandle* handle, Callback<void, ReadResult> completer) final {
+        *handle = ++n_started;
+        reads.push_back({buffer, completer});
+    }
+
+    void cancel_read(TransferHandle) final {
+        n_cancelled++;
+    }
+
+    void feed(std::vector<uint8_t> packet) {
+        REQUIRE(reads.size());
+        Read read = reads.front();
+        reads.pop_front();
+        REQUIRE(packet.size() <= read.buf.size());
+        std::copy(packet.begin(), packet.end(), read.buf.begin());
+        read.completer.invoke({kStreamOk, read.buf.begin() + packet.size()});
+    }
+
+    void fail(StreamStatus status) {
+        REQUIRE(reads.size());
+        Read read = reads.front();
+        reads.pop_front();
+        read.completer.invoke({status, read.buf.begin()});
+    }
+
+    std::deque<Read> reads;
+    size_t n_started = 0;
+    size_t n_cancelled = 0;
+};
+
+// Stand-in for a USB bulk OUT endpoint
+struct FakeSink : AsyncStreamSink {
+    struct Write {
+        std::vector<uint8_t> data;
+        Callback<void, WriteResult> completer;
+        const uint8_t* end;
+    };
+
+    void start_write(cbufptr_t buffer, TransferHandle* handle, Callback<void, WriteResult> completer) final {
+        *handle = ++n_started;
+        writes.push_back({{buffer.begin(), buffer.end()}, completer, buffer.end()});
+    }
+
+    void cancel_write(TransferHandle) final {}
+
+    std::vector<uint8_t> finish(StreamStatus status = kStreamOk) {
+        REQUIRE(writes.size());
+        Write write = writes.front();
+        writes.pop_front();
+        write.completer.invoke({status, write.end});
+        return write.data;
+    }
+
+    std::deque<Write> writes;
+    size_t n_started = 0;
+};
+
+// Reads from the source like LegacyProtocolPacketBased: one read at a time and
+// the next read is started from within the completion handler.
+struct Reader {
+    void start() {
+        TransferHandle handle;
+        source->start_read(buf, &handle, MEMBER_CB(this, on_read_finished));
+    }
+
+    void on_read_finished(ReadResult result) {
+        statuses.push_back(result.status);
+        if (result.status == kStreamOk) {
+            packets.push_back({buf, result.end});
+            if (restart) {
+                start();
+            }
+        }
+    }
+
+    AsyncStreamSource* source = nullptr;
+    bool restart = true;
+    uint8_t buf[8] = {};
+    std::vector<std::vector<uint8_t>> packets = {};
+    std::vector<StreamStatus> statuses = {};
+};
+
+struct Writer {
+    void write(std::vector<uint8_t> data) {
+        this->data = data;
+        TransferHandle handle;
+        sink->start_write({this->data.data(), this->data.size()}, &handle, MEMBER_CB(this, on_write_finished));
+    }
+
+    void on_write_finished(WriteResult result) {
+        results.push_back(result.status);
+        n_written.push_back(result.end - data.data());
+    }
+
+    AsyncStreamSink* sink = nullptr;
+    std::vector<uint8_t> data = {};
+    std::vector<StreamStatus> results = {};
+    std::vector<size_t> n_written = {};
+};
+
+TEST_SUITE("stream_queue") {
+    TEST_CASE("reads stay posted") {
+        FakeSource source;
+        ReadAheadSource queue;
+        queue.start(&source, 3, 8);
+        CHECK(source.reads.size() == 3);
+
+        // Packets arrive before the application reads
+        source.feed({1, 2});
+        source.feed({3});
+        CHECK(queue.n_buffered() == 2);
+        CHECK(source.reads.size() == 1);
+
+        // The application gets them in order and the reads are reposted
+        Reader reader{&queue};
+        reader.start();
+        CHECK(reader.packets == std::vector<std::vector<uint8_t>>{{1, 2}, {3}});
+        CHECK(queue.n_buffered() == 0);
+        CHECK(source.reads.size() == 3);
+        CHECK(queue.n_posted() == 3);
+
+        // Packets that arrive while the application waits are delivered right away
+        source.feed({4, 5, 6});
+        source.feed({});
+        source.feed({7});
+        CHECK(reader.packets.size() == 5);
+        CHECK(reader.packets[2] == std::vector<uint8_t>{4, 5, 6});
+        CHECK(reader.packets[3].empty());
+        CHECK(reader.packets[4] == std::vector<uint8_t>{7});
+        CHECK(source.reads.size() == 3);
+        CHECK(source.n_started == 8);
+    }
+
+    TEST_CASE("small application buffer") {
+        FakeSource source;
+        ReadAheadSource queue;
+        queue.start(&source, 2, 16);
+        std::vector<uint8_t> packet = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+        source.feed(packet);
+        source.feed({12});
+
+        // The rest of a packet is returned before the next packet
+        Reader reader{&queue};
+        reader.start();
+        CHECK(reader.packets == std::vector<std::vector<uint8_t>>{{1, 2, 3, 4, 5, 6, 7, 8}, {9, 10, 11}, {12}});
+    }
+
+    TEST_CASE("cancelled application read") {
+        FakeSource source;
+        ReadAheadSource queue;
+        queue.start(&source, 2, 8);
+
+        Reader reader{&queue};
+        TransferHandle handle;
+        queue.start_read(reader.buf, &handle, MEMBER_CB(&reader, on_read_finished));
+        queue.cancel_read(handle);
+        CHECK(reader.statuses == std::vector<StreamStatus>{kStreamCancelled});
+        CHECK(source.n_cancelled == 0);
+
+        // The data that arrives afterwards is not lost
+        source.feed({1});
+        reader.restart = false;
+        reader.start();
+        CHECK(reader.packets == std::vector<std::vector<uint8_t>>{{1}});
+    }
+
+    TEST_CASE("source failure") {
+        FakeSource source;
+        ReadAheadSource queue;
+        queue.start(&source, 3, 8);
+        source.feed({1});
+        source.fail(kStreamClosed);
+        source.fail(kStreamClosed);
+
+        // The data before the failure is delivered first
+        Reader reader{&queue};
+        reader.start();
+        CHECK(reader.packets == std::vector<std::vector<uint8_t>>{{1}});
+        CHECK(reader.statuses == std::vector<StreamStatus>{kStreamOk, kStreamClosed});
+
+        // Nothing is reposted after a failure
+        CHECK(source.n_started == 4);
+        reader.start();
+        CHECK(reader.statuses.back() == kStreamClosed);
+    }
+
+    TEST_CASE("writes are queued back-to-back") {
+        FakeSink sink;
+        WriteQueueSink queue;
+        queue.start(&sink, 2, 4);
+        Writer writer{&queue};
+
+        // Writes complete right away while there are free buffers
+        writer.write({1, 2});
+        writer.write({3, 4, 5});
+        CHECK(writer.results == std::vector<StreamStatus>{kStreamOk, kStreamOk});
+        CHECK(sink.writes.size() == 2);
+        CHECK(queue.n_busy() == 2);
+
+        // The third write waits for the first one to finish on the sink
+        writer.write({6, 7, 8, 9, 10});
+        CHECK(writer.results.size() == 2);
+        CHECK(sink.finish() == std::vector<uint8_t>{1, 2});
+        CHECK(writer.results.size() == 3);
+        CHECK(writer.n_written.back() == 4); // larger than the transfer size
+        CHECK(sink.finish() == std::vector<uint8_t>{3, 4, 5});
+        CHECK(sink.finish() == std::vector<uint8_t>{6, 7, 8, 9});
+        CHECK(queue.n_busy() == 0);
+    }
+
+    TEST_CASE("cancelled write") {
+        FakeSink sink;
+        WriteQueueSink queue;
+        queue.start(&sink, 1, 4);
+        Writer writer{&queue};
+        writer.write({1});
+        writer.write({2});
+        TransferHandle handle = reinterpret_cast<TransferHandle>(&queue);
+        queue.cancel_write(handle);
+        CHECK(writer.results == std::vector<StreamStatus>{kStreamOk, kStreamCancelled});
+        sink.finish();
+        CHECK(sink.writes.empty());
+    }
+
+    TEST_CASE("sink failure") {
+        FakeSink sink;
+        WriteQueueSink queue;
+        queue.start(&sink, 2, 4);
+        Writer writer{&queue};
+        writer.write({1});
+        writer.write({2});
+        sink.finish(kStreamClosed);
+
+        // The failure is reported by the next write and all writes after it
+        writer.write({3});
+        writer.write({4});
+        CHECK(writer.results == std::vector<StreamStatus>{kStreamOk, kStreamOk, kStreamClosed, kStreamClosed});
+        CHECK(sink.n_started == 2);
+    }
+}
@@ -0,0 +1,155 @@
+#include <doctest.h>
+#include <map>
+#include <set>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <fibre/../../platform_support/timer_wheel.hpp>
+
+using namespace fibre;
+
+// Reference model of the wheel: a timer must be returned by the first
+// advance() whose tick reaches its expiry, and not before. Timers that are
+// inserted with an expiry in the past are due at the next advance().
+struct WheelTester {
+    EventLoopTimer* insert(uint64_t expiry) {
+        timers.emplace_back(new EventLoopTimer());
+        EventLoopTimer* timer = timers.back().get();
+        timer->expiry = expiry;
+        wheel.insert(timer);
+        due[timer] = std::max(expiry, now + 1);
+        by_due.insert({due[timer], timer});
+        return timer;
+    }
+
+    void cancel(EventLoopTimer* timer) {
+        wheel.remove(timer);
+        by_due.erase({due[timer], timer});
+        due.erase(timer);
+    }
+
+    // Advances the wheel to the specified tick and checks that exactly the
+    // due timers expired.
+    void advance(uint64_t tick) {
+        REQUIRE(tick >= now);
+        // The event loop wakes up at next_tick(), so it must not be later
+        // than the earliest due timer.
+        uint64_t earliest = by_due.empty() ? UINT64_MAX : by_due.begin()->first;
+        CHECK(wheel.next_tick() <= earliest);
+
+        now = tick;
+        wheel.advance(now);
+
+        size_t n_expired = 0;
+        while (EventLoopTimer* timer = wheel.pop_expired()) {
+            auto it = due.find(timer);
+            REQUIRE(it != due.end());
+            CHECK(it->second <= now); // not early
+            CHECK(timer->expiry <= now);
+            by_due.erase({it->second, timer});
+            due.erase(it);
+            n_expired++;
+        }
+        if (by_due.size()) {
+            CHECK(by_due.begin()->first > now); // not late
+        }
+        total_expired += n_expired;
+        CHECK(wheel.empty() == due.empty());
+    }
+
+    TimerWheel wheel;
+    uint64_t now = 0;
+    std::vector<std::unique_ptr<EventLoopTimer>> timers;
+    std::map<EventLoopTimer*, uint64_t> due; // pending timers and the tick at which they are due
+    std::set<std::pair<uint64_t, EventLoopTimer*>> by_due; // the same, ordered by that tick
+    size_t total_expired = 0;
+};
+
+TEST_SUITE("timer_wheel") {
+    TEST_CASE("expires at the exact tick") {
+        WheelTester tester;
+        tester.advance(1000);
+        // One timer per level and one beyond the range of the wheel
+        for (uint64_t delta: {1ull, 63ull, 64ull, 4095ull, 4096ull, 262143ull, 262144ull, (1ull << 24) - 1, 1ull << 24, 1ull << 30}) {
+            tester.insert(tester.now + delta);
+        }
+        while (tester.due.size()) {
+            uint64_t tick = tester.wheel.next_tick();
+            REQUIRE(tick != UINT64_MAX);
+            tester.advance(tick);
+        }
+        CHECK(tester.total_expired == 10);
+        CHECK(tester.wheel.next_tick() == UINT64_MAX);
+    }
+
+    TEST_CASE("expiry in the past") {
+        WheelTester tester;
+        tester.advance(500);
+        tester.insert(10);
+        tester.insert(500);
+        tester.advance(500);
+        CHECK(tester.total_expired == 0);
+        tester.advance(501);
+        CHECK(tester.total_expired == 2);
+    }
+
+    TEST_CASE("cancel after expiry but before pop_expired()") {
+        TimerWheel wheel;
+        EventLoopTimer a, b;
+        a.expiry = 5;
+        b.expiry = 5;
+        wheel.insert(&a);
+        wheel.insert(&b);
+        wheel.advance(5);
+        wheel.remove(&a);
+        CHECK(wheel.pop_expired() == &b);
+        CHECK(wheel.pop_expired() == nullptr);
+        CHECK(wheel.empty());
+    }
+
+    TEST_CASE("random inserts, cancels and time jumps") {
+        std::mt19937_64 rng(12345);
+        WheelTester tester;
+
+        auto random_delta = [&]() -> uint64_t {
+            switch (rng() % 6) {
+                case 0: return rng() % 4; // zero or very short
+                case 1: return rng() % 64;
+                case 2: return rng() % 5000;
+                case 3: return rng() % 300000;
+                case 4: return rng() % (1ull << 26); // up to beyond the range of the wheel
+                default: return ((uint64_t)1 << (6 * (1 + rng() % 4))) + (rng() % 3) - 1; // around level boundaries
+            }
+        };
+
+        for (size_t i = 0; i < 200000; ++i) {
+            uint32_t op = rng() % 10;
+            if (op < 5) {
+                // Some expiries are slightly in the past
+                uint64_t delta = random_delta();
+                uint64_t expiry = (rng() % 16) ? tester.now + delta : tester.now - std::min(tester.now, delta);
+                tester.insert(expiry);
+            } else if (op < 7 && tester.due.size()) {
+                auto it = tester.due.begin();
+                std::advance(it, rng() % std::min(tester.due.size(), (size_t)32));
+                tester.cancel(it->first);
+            } else if (op < 8) {
+                // Jump to the next due tick, like the event loop does
+                uint64_t tick = tester.wheel.next_tick();
+                if (tick != UINT64_MAX) {
+                    tester.advance(std::max(tick, tester.now));
+                }
+            } else {
+                tester.advance(tester.now + random_delta());
+            }
+        }
+
+        // Drain the wheel
+        while (tester.due.size()) {
+            tester.advance(std::max(tester.wheel.next_tick(), tester.now));
+        }
+        CHECK(tester.total_expired > 10000);
+        CHECK(tester.wheel.empty());
+    }
+}
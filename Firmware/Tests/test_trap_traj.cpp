@@ -1,139 +1,13 @@
 
 #include <doctest.h>
 #include <limits.h>
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
 #include <random>
 
-#include "MotorControl/utils.hpp"
-
-// TODO: This is currently a copy-paste of the real code due to non-trivial
-// include dependencies. Should include real code.
-
-class TrapezoidalTrajectory {
-public:
-    struct Step_t {
-        float Y;
-        float Yd;
-        float Ydd;
-    };
-
-    explicit TrapezoidalTrajectory();
-    bool planTrapezoidal(float Xf, float Xi, float Vi,
-                         float Vmax, float Amax, float Dmax);
-    Step_t eval(float t);
-
-    float Xi_;
-    float Xf_;
-    float Vi_;
-
-    float Ar_;
-    float Vr_;
-    float Dr_;
-
-    float Ta_;
-    float Tv_;
-    float Td_;
-    float Tf_;
-
-    float yAccel_;
-
-    float t_;
-};
-
-
-
-// A sign function where input 0 has positive sign (not 0)
-float sign_hard(float val) {
-    return (std::signbit(val)) ? -1.0f : 1.0f;
-}
-
-// Symbol                     Description
-// Ta, Tv and Td              Duration of the stages of the AL profile
-// Xi and Vi                  Adapted initial conditions for the AL profile
-// Xf                         Position set-point
-// s                          Direction (sign) of the trajectory
-// Vmax, Amax, Dmax and jmax  Kinematic bounds
-// Ar, Dr and Vr              Reached values of acceleration and velocity
-
-TrapezoidalTrajectory::TrapezoidalTrajectory() {}
-
-bool TrapezoidalTrajectory::planTrapezoidal(float Xf, float Xi, float Vi,
-                                            float Vmax, float Amax, float Dmax) {
-    float dX = Xf - Xi;  // Distance to travel
-    float stop_dist = (Vi * Vi) / (2.0f * Dmax); // Minimum stopping distance
-    float dXstop = std::copysign(stop_dist, Vi); // Minimum stopping displacement
-    float s = sign_hard(dX - dXstop); // Sign of coast velocity (if any)
-    Ar_ = s * Amax;  // Maximum Acceleration (signed)
-    Dr_ = -s * Dmax; // Maximum Deceleration (signed)
-    Vr_ = s * Vmax;  // Maximum Velocity (signed)
-
-    // If we start with a speed faster than cruising, then we need to decel instead of accel
-    // aka "double deceleration move" in the paper
-    if ((s * Vi) > (s * Vr_)) {
-        Ar_ = -s * Amax;
-    }
-
-    // Time to accel/decel to/from Vr (cruise speed)
-    Ta_ = (Vr_ - Vi) / Ar_;
-    Td_ = -Vr_ / Dr_;
-
-    // Integral of velocity ramps over the full accel and decel times to get
-    // minimum displacement required to reach cuising speed
-    float dXmin = 0.5f*Ta_*(Vr_ + Vi) + 0.5f*Td_*Vr_;
-
-    // Are we displacing enough to reach cruising speed?
-    if (s*dX < s*dXmin) {
-        // Short move (triangle profile)
-        Vr_ = s * std::sqrt(std::max((Dr_*SQ(Vi) + 2*Ar_*Dr_*dX) / (Dr_ - Ar_), 0.0f));
-        //Vr_ = s * std::sqrt((Dr_*SQ(Vi) + 2*Ar_*Dr_*dX) / (Dr_ - Ar_));
-        Ta_ = std::max(0.0f, (Vr_ - Vi) / Ar_);
-        Td_ = std::max(0.0f, -Vr_ / Dr_);
-        Tv_ = 0.0f;
-    } else {
-        // Long move (trapezoidal profile)
-        Tv_ = (dX - dXmin) / Vr_;
-    }
-
-    // Fill in the rest of the values used at evaluation-time
-    Tf_ = Ta_ + Tv_ + Td_;
-    Xi_ = Xi;
-    Xf_ = Xf;
-    Vi_ = Vi;
-    yAccel_ = Xi + Vi*Ta_ + 0.5f*Ar_*SQ(Ta_); // pos at end of accel phase
-
-    return true;
-}
-
-TrapezoidalTrajectory::Step_t TrapezoidalTrajectory::eval(float t) {
-    Step_t trajStep;
-    if (t < 0.0f) {  // Initial Condition
-        trajStep.Y   = Xi_;
-        trajStep.Yd  = Vi_;
-        trajStep.Ydd = 0.0f;
-    } else if (t < Ta_) {  // Accelerating
-        trajStep.Y   = Xi_ + Vi_*t + 0.5f*Ar_*SQ(t);
-        trajStep.Yd  = Vi_ + Ar_*t;
-        trajStep.Ydd = Ar_;
-    } else if (t < Ta_ + Tv_) {  // Coasting
-        trajStep.Y   = yAccel_ + Vr_*(t - Ta_);
-        trajStep.Yd  = Vr_;
-        trajStep.Ydd = 0.0f;
-    } else if (t < Tf_) {  // Deceleration
-        float td     = t - Tf_;
-        trajStep.Y   = Xf_ + 0.5f*Dr_*SQ(td);
-        trajStep.Yd  = Dr_*td;
-        trajStep.Ydd = Dr_;
-    } else if (t >= Tf_) {  // Final Condition
-        trajStep.Y   = Xf_;
-        trajStep.Yd  = 0.0f;
-        trajStep.Ydd = 0.0f;
-    } else {
-        // TODO: report error here
-    }
-
-    return trajStep;
-}
+#include "MotorControl/trapTraj.hpp"
 
 static_assert(sizeof(float) * CHAR_BIT == 32);
 
@@ -200,6 +74,42 @@ void run_trajectory_test(float goal, float position, float velocity, float Vmax,
     CHECK(velocity <= Dmax * dt);
 }
 
+using Vec2 = std::array<float, 2>;
+
+void run_coordinated_test(Vec2 goal, Vec2 position, Vec2 velocity,
+                          const TrapezoidalTrajectory::Config_t limits[2]) {
+    TrapezoidalTrajectory traj[2];
+    TrapezoidalTrajectory* trajs[2] = {&traj[0], &traj[1]};
+    traj[0].config_ = limits[0];
+    traj[1].config_ = limits[1];
+    REQUIRE(TrapezoidalTrajectory::planCoordinated(trajs, 2, goal.data(), position.data(), velocity.data()));
+
+    // Both axes finish together, no earlier than the slower one on its own
+    CHECK(traj[0].Tf_ == traj[1].Tf_);
+    for (size_t i = 0; i < 2; ++i) {
+        TrapezoidalTrajectory single;
+        single.planTrapezoidal(goal[i], position[i], velocity[i], limits[i].vel_limit, limits[i].accel_limit, limits[i].decel_limit);
+        CHECK(traj[i].Tf_ >= single.Tf_ * 0.999f);
+    }
+
+    float dX[2] = {goal[0] - position[0], goal[1] - position[1]};
+    float dt = 0.000125f;
+    for (float t = 0.0f; t <= traj[0].Tf_ + dt; t += dt) {
+        TrapezoidalTrajectory::Step_t step[2] = {traj[0].eval(t), traj[1].eval(t)};
+        for (size_t i = 0; i < 2; ++i) {
+            CHECK(std::abs(step[i].Yd) <= std::max(limits[i].vel_limit, std::abs(velocity[i])) * 1.001f);
+            CHECK(std::abs(step[i].Ydd) <= std::max(limits[i].accel_limit, limits[i].decel_limit) * 1.001f);
+        }
+        // The axes move along a straight line
+        float cross = (step[0].Y - position[0]) * dX[1] - (step[1].Y - position[1]) * dX[0];
+        CHECK(std::abs(cross) <= 1e-4f * (dX[0] * dX[0] + dX[1] * dX[1]));
+    }
+    for (size_t i = 0; i < 2; ++i) {
+        CHECK(traj[i].eval(traj[i].Tf_).Y == goal[i]);
+        CHECK(traj[i].eval(traj[i].Tf_).Yd == 0.0f);
+    }
+}
+
 
 TEST_SUITE("Trajectory Planner") {
     // these form a triangle trajectory because 2*v^2/(2*a) = 2 * 27712^2 / (2*22288) = 34456 > 16384
@@ -232,4 +142,33 @@ TEST_SUITE("Trajectory Planner") {
     TEST_CASE("pos-dir-over-speed") {
         run_trajectory_test(8192.0f, -8192.0f, 40000.0f, 27712.0f, 22288.0f, 22288.0f);
     }
+
+    TEST_CASE("coordinated") {
+        const TrapezoidalTrajectory::Config_t same[2] = {{2.0f, 5.0f, 5.0f}, {2.0f, 5.0f, 5.0f}};
+        const TrapezoidalTrajectory::Config_t different[2] = {{2.0f, 8.0f, 3.0f}, {5.0f, 2.0f, 6.0f}};
+        const Vec2 zero = {0.0f, 0.0f};
+
+        run_coordinated_test(Vec2{3.0f, -1.0f}, zero, zero, same);
+        run_coordinated_test(Vec2{0.1f, 0.05f}, zero, zero, same);
+        run_coordinated_test(Vec2{3.0f, -1.0f}, zero, zero, different);
+        run_coordinated_test(Vec2{-2.0f, 6.0f}, Vec2{1.0f, 1.0f}, zero, different);
+        run_coordinated_test(Vec2{2.0f, 1.0f}, zero, Vec2{1.0f, 0.5f}, same); // already moving along the path
+        run_coordinated_test(Vec2{2.0f, 0.0f}, zero, zero, different); // one axis stays put
+
+        // With equal limits the longer axis sets the pace as if it moved alone
+        TrapezoidalTrajectory traj[2], single;
+        TrapezoidalTrajectory* trajs[2] = {&traj[0], &traj[1]};
+        const float goal[2] = {3.0f, -1.0f}, position[2] = {0.0f, 0.0f};
+        CHECK(TrapezoidalTrajectory::planCoordinated(trajs, 2, goal, position, position));
+        single.planTrapezoidal(3.0f, 0.0f, 0.0f, 2.0f, 0.5f, 0.5f);
+        CHECK(traj[0].Tf_ == doctest::Approx(single.Tf_));
+    }
+
+    TEST_CASE("coordinated-invalid-limits") {
+        TrapezoidalTrajectory traj[2];
+        TrapezoidalTrajectory* trajs[2] = {&traj[0], &traj[1]};
+        traj[1].config_.accel_limit = 0.0f;
+        const float goal[2] = {1.0f, 1.0f}, zero[2] = {0.0f, 0.0f};
+        CHECK(!TrapezoidalTrajectory::planCoordinated(trajs, 2, goal, zero, zero));
+    }
 }
@@ -72,6 +72,7 @@ odrive_firmware_pkg = {
         'MotorControl/utils.cpp',
         'MotorControl/arm_sin_f32.c',
         'MotorControl/arm_cos_f32.c',
+        'MotorControl/arm_sincos_f32.c',
         'MotorControl/low_level.cpp',
         'MotorControl/axis.cpp',
         'MotorControl/motor.cpp',
@@ -84,10 +85,15 @@ odrive_firmware_pkg = {
         'MotorControl/foc.cpp',
         'MotorControl/open_loop_controller.cpp',
         'MotorControl/oscilloscope.cpp',
+        'MotorControl/flight_recorder.cpp',
         'MotorControl/sensorless_estimator.cpp',
         'MotorControl/trapTraj.cpp',
+        'MotorControl/scurve_traj.cpp',
+        'MotorControl/component_graph.cpp',
         'MotorControl/pwm_input.cpp',
+        'MotorControl/nvm_config.cpp',
         'MotorControl/main.cpp',
+        'MotorControl/control_loop.cpp',
         'Drivers/STM32/stm32_system.cpp',
         'Drivers/STM32/stm32_gpio.cpp',
         'Drivers/STM32/stm32_nvm.c',
@@ -458,7 +464,103 @@ end
 
 if tup.getconfig('DOCTEST') == 'true' then
     TEST_INCLUDES = '-I. -I./MotorControl -I./fibre-cpp/include -I./Drivers/DRV8301 -I./doctest'
-    tup.foreach_rule('Tests/*.cpp', 'g++ -O3 -std=c++17 '..TEST_INCLUDES..' -c %f -o %o', 'Tests/bin/%B.o')
+    -- The protocol tests connect a Fibre client to a Fibre server
+    TEST_FLAGS = '-DFIBRE_COMPILE -DFIBRE_ENABLE_SERVER=1 -DFIBRE_ENABLE_CLIENT=1 -DFIBRE_ALLOW_HEAP=1 -DFIBRE_MAX_LOG_VERBOSITY=5 -DFIBRE_DEFAULT_LOG_VERBOSITY=1'
+    tup.foreach_rule({'Tests/*.cpp', 'MotorControl/scurve_traj.cpp', 'MotorControl/trapTraj.cpp', 'MotorControl/component_graph.cpp', 'MotorControl/nvm_config.cpp', 'Board/sim/sim_nvm.cpp', 'fibre-cpp/legacy_protocol.cpp', 'fibre-cpp/legacy_object_client.cpp', 'fibre-cpp/logging.cpp'}, 'g++ -O3 -std=c++17 '..TEST_INCLUDES..' '..TEST_FLAGS..' -c %f -o %o', 'Tests/bin/%B.o')
     tup.frule{inputs='Tests/bin/*.o', command='g++ %f -o %o', outputs='Tests/test_runner.exe'}
     tup.frule{inputs='Tests/test_runner.exe', command='%f'}
 end
+
+if tup.getconfig('SIL') == 'true' then
+    -- Host build of the control code with a simulated board and motor (see Board/sim)
+    SIL_FLAGS = '-O2 -g -DODRIVE_SIL -DHW_VERSION_MAJOR=3 -DHW_VERSION_MINOR=6 -DHW_VERSION_VOLTAGE=56 -I. -IMotorControl -Ifibre-cpp/include -IBoard/sim/Inc'
+    sil_code_files = {
+        'MotorControl/utils.cpp',
+        'MotorControl/arm_sin_f32.c',
+        'MotorControl/arm_cos_f32.c',
+        'MotorControl/arm_sincos_f32.c',
+        'MotorControl/low_level.cpp',
+        'MotorControl/axis.cpp',
+        'MotorControl/motor.cpp',
+        'MotorControl/thermistor.cpp',
+        'MotorControl/encoder.cpp',
+        'MotorControl/endstop.cpp',
+        'MotorControl/acim_estimator.cpp',
+        'MotorControl/mechanical_brake.cpp',
+        'MotorControl/controller.cpp',
+        'MotorControl/foc.cpp',
+        'MotorControl/open_loop_controller.cpp',
+        'MotorControl/oscilloscope.cpp',
+        'MotorControl/flight_recorder.cpp',
+        'MotorControl/sensorless_estimator.cpp',
+        'MotorControl/trapTraj.cpp',
+        'MotorControl/scurve_traj.cpp',
+        'MotorControl/component_graph.cpp',
+        'MotorControl/control_loop.cpp',
+        'communication/can/can_simple.cpp',
+        'communication/can/odrive_can.cpp',
+        'autogen/version.c',
+        'Board/sim/board.cpp',
+        'Board/sim/motor_model.cpp',
+        'Board/sim/main.cpp',
+    }
+    sil_object_files = {}
+    for _, src_file in pairs(sil_code_files) do
+        obj_file = "build/sil/obj/"..src_file:gsub("/","_"):gsub("%.","")..".o"
+        sil_object_files += obj_file
+        compiler = (tup.ext(src_file) == 'c') and 'gcc -std=c99' or 'g++ -std=c++17'
+        tup.frule{
+            inputs={src_file},
+            extra_inputs = {'autogen/interfaces.hpp', 'autogen/function_stubs.hpp', 'autogen/endpoints.hpp', 'autogen/type_info.hpp'},
+            command='^o^ '..compiler..' -c %f '..SIL_FLAGS..' -o %o',
+            outputs={obj_file}
+        }
+    end
+    tup.frule{inputs=sil_object_files, command='g++ %f -lm -o %o', outputs='build/sil/odrive_sil'}
+
+    -- Host benchmark for the JSON parser of the Fibre client (libfibre) with the
+    -- interface JSON of this firmware
+    tup.frule{inputs={'Board/sim/interface_json_template.j2', extra_inputs='odrive-interface.yaml'}, command=python_command..' interface_generator_stub.py --definitions odrive-interface.yaml --generate-endpoints '..root_interface..' --template %f --output %o', outputs='autogen/interface_json.hpp'}
+    JSON_BENCH_FLAGS = '-O2 -g -DFIBRE_COMPILE -DFIBRE_ENABLE_SERVER=0 -DFIBRE_ENABLE_CLIENT=1 -DFIBRE_ALLOW_HEAP=1 -DFIBRE_MAX_LOG_VERBOSITY=5 -DFIBRE_DEFAULT_LOG_VERBOSITY=2 -I. -Ifibre-cpp/include'
+    json_bench_object_files = {}
+    for _, src_file in pairs({'Board/sim/json_bench.cpp', 'Board/sim/alloc_counter.cpp', 'fibre-cpp/legacy_object_client.cpp', 'fibre-cpp/legacy_protocol.cpp', 'fibre-cpp/logging.cpp'}) do
+        obj_file = "build/sil/obj/json_bench_"..src_file:gsub("/","_"):gsub("%.","")..".o"
+        json_bench_object_files += obj_file
+        tup.frule{
+            inputs={src_file},
+            extra_inputs = {'autogen/interface_json.hpp'},
+            command='^o^ g++ -std=c++11 -c %f '..JSON_BENCH_FLAGS..' -o %o',
+            outputs={obj_file}
+        }
+    end
+    tup.frule{inputs=json_bench_object_files, command='g++ %f -o %o', outputs='build/sil/fibre_json_bench'}
+
+    -- Host benchmark for libfibre_call() against a loopback device
+    call_bench_object_files = {}
+    for _, src_file in pairs({'Board/sim/call_bench.cpp', 'Board/sim/alloc_counter.cpp', 'fibre-cpp/libfibre.cpp', 'fibre-cpp/fibre.cpp', 'fibre-cpp/channel_discoverer.cpp', 'fibre-cpp/legacy_object_client.cpp', 'fibre-cpp/legacy_protocol.cpp', 'fibre-cpp/logging.cpp'}) do
+        obj_file = "build/sil/obj/call_bench_"..src_file:gsub("/","_"):gsub("%.","")..".o"
+        call_bench_object_files += obj_file
+        tup.frule{
+            inputs={src_file},
+            extra_inputs = {'autogen/interface_json.hpp'},
+            command='^o^ g++ -std=c++11 -c %f '..JSON_BENCH_FLAGS..' -o %o',
+            outputs={obj_file}
+        }
+    end
+    tup.frule{inputs=call_bench_object_files, command='g++ %f -o %o', outputs='build/sil/fibre_call_bench'}
+
+    -- Host benchmark for batched property access between a libfibre client
+    -- and the server side of the protocol
+    BATCH_BENCH_FLAGS = '-O2 -g -DFIBRE_COMPILE -DFIBRE_ENABLE_SERVER=1 -DFIBRE_ENABLE_CLIENT=1 -DFIBRE_ALLOW_HEAP=1 -DFIBRE_MAX_LOG_VERBOSITY=5 -DFIBRE_DEFAULT_LOG_VERBOSITY=2 -I. -Ifibre-cpp/include'
+    batch_bench_object_files = {}
+    for _, src_file in pairs({'Board/sim/batch_bench.cpp', 'Board/sim/alloc_counter.cpp', 'fibre-cpp/libfibre.cpp', 'fibre-cpp/fibre.cpp', 'fibre-cpp/channel_discoverer.cpp', 'fibre-cpp/legacy_object_client.cpp', 'fibre-cpp/legacy_protocol.cpp', 'fibre-cpp/logging.cpp'}) do
+        obj_file = "build/sil/obj/batch_bench_"..src_file:gsub("/","_"):gsub("%.","")..".o"
+        batch_bench_object_files += obj_file
+        tup.frule{
+            inputs={src_file},
+            command='^o^ g++ -std=c++11 -c %f '..BATCH_BENCH_FLAGS..' -o %o',
+            outputs={obj_file}
+        }
+    end
+    tup.frule{inputs=batch_bench_object_files, command='g++ %f -o %o', outputs='build/sil/fibre_batch_bench'}
+end
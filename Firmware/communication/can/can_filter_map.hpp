@@ -0,0 +1,53 @@
+#ifndef __CAN_FILTER_MAP_HPP
+#define __CAN_FILTER_MAP_HPP
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+// FIFO of a filter bank that is not in use
+static constexpr uint8_t kCanFifoNone = 0xff;
+
+/**
+ * @brief Finds the filter bank that accepted a received frame from the filter
+ * match index that the bxCAN peripheral reports along with it.
+ *
+ * The hardware numbers the filters of each FIFO in the order of the filter
+ * banks, including inactive banks. Each bank is expected to hold a single
+ * 32-bit mask filter. Banks that were never configured are counted like
+ * inactive banks of FIFO 0, which is correct as long as they come after all
+ * configured banks.
+ *
+ * TBank must have the members `fifo` (FIFO of the active filter or
+ * kCanFifoNone if the bank is inactive) and `bank_fifo` (FIFO assignment of
+ * the bank, which the hardware keeps while the bank is inactive).
+ */
+template<typename TBank, size_t NBanks>
+class CanFilterMap {
+public:
+    /**
+     * @brief Rebuilds the map. Must be called whenever a bank is activated,
+     * deactivated or assigned to a different FIFO.
+     */
+    void update(std::array<TBank, NBanks>& banks) {
+        size_t n_filters[2] = {0, 0};
+        map_ = {};
+        for (auto& bank : banks) {
+            size_t idx = n_filters[bank.bank_fifo]++;
+            map_[bank.bank_fifo][idx] = (bank.fifo == kCanFifoNone) ? nullptr : &bank;
+        }
+    }
+
+    /**
+     * @brief Returns the active bank with the specified filter match index in
+     * the specified FIFO, or nullptr if there is none.
+     */
+    TBank* get(uint32_t fifo, uint32_t filter_match_index) const {
+        return (fifo < map_.size() && filter_match_index < NBanks) ? map_[fifo][filter_match_index] : nullptr;
+    }
+
+private:
+    std::array<std::array<TBank*, NBanks>, 2> map_ = {};
+};
+
+#endif // __CAN_FILTER_MAP_HPP
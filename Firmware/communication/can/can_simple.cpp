@@ -30,28 +30,32 @@ bool CANSimple::renew_subscription(size_t i) {
         filter.id = (uint16_t)(axis.config_.can.node_id << NUM_CMD_ID_BITS);
     }
 
-    if (subscription_handles_[i]) {
-        canbus_->unsubscribe(subscription_handles_[i]);
+    AxisSubscription& subscription = subscriptions_[i];
+    if (subscription.handle) {
+        canbus_->unsubscribe(subscription.handle);
+        subscription.handle = nullptr;
     }
 
+    subscription.parent = this;
+    subscription.axis = &axis;
     return canbus_->subscribe(
         filter, [](void* ctx, const can_Message_t& msg) {
-            ((CANSimple*)ctx)->handle_can_message(msg);
+            AxisSubscription* subscription = (AxisSubscription*)ctx;
+            subscription->parent->handle_can_message(*subscription->axis, msg);
         },
-        this, &subscription_handles_[i]);
+        &subscription, &subscription.handle);
 }
 
-void CANSimple::handle_can_message(const can_Message_t& msg) {
+void CANSimple::handle_can_message(Axis& axis, const can_Message_t& msg) {
     //     Frame
     // nodeID | CMD
     // 6 bits | 5 bits
     uint32_t nodeID = get_node_id(msg.id);
 
-    for (auto& axis : axes) {
-        if ((axis.config_.can.node_id == nodeID) && (axis.config_.can.is_extended == msg.isExt)) {
-            do_command(axis, msg);
-            return;
-        }
+    // The filter already matched the node ID, unless it changed and the
+    // subscription was not renewed yet
+    if ((axis.config_.can.node_id == nodeID) && (axis.config_.can.is_extended == msg.isExt)) {
+        do_command(axis, msg);
     }
 }
 
@@ -158,6 +162,10 @@ void CANSimple::do_command(Axis& axis, const can_Message_t& msg) {
         case MSG_GET_CONTROLLER_ERROR:
             get_controller_error_callback(axis);
             break;
+        case MSG_GET_PACKED_TELEMETRY:
+            if (msg.rtr || msg.len == 0)
+                get_packed_telemetry_callback(axis);
+            break;
         default:
             break;
     }
@@ -365,6 +373,43 @@ bool CANSimple::get_bus_voltage_current_callback(const Axis& axis) {
     return canbus_->send_message(txmsg);
 }
 
+float CANSimple::get_telemetry_signal(const Axis& axis, Axis::TelemetrySignal signal) {
+    switch (signal) {
+        case Axis::TELEMETRY_SIGNAL_POS_ESTIMATE: return axis.controller_.pos_estimate_linear_src_.any().value_or(0.0f);
+        case Axis::TELEMETRY_SIGNAL_VEL_ESTIMATE: return axis.controller_.vel_estimate_src_.any().value_or(0.0f);
+        case Axis::TELEMETRY_SIGNAL_POS_SETPOINT: return axis.controller_.pos_setpoint_;
+        case Axis::TELEMETRY_SIGNAL_VEL_SETPOINT: return axis.controller_.vel_setpoint_;
+        case Axis::TELEMETRY_SIGNAL_TORQUE_SETPOINT: return axis.controller_.torque_setpoint_;
+        case Axis::TELEMETRY_SIGNAL_IQ_SETPOINT: return axis.motor_.current_control_.Idq_setpoint_.has_value() ? axis.motor_.current_control_.Idq_setpoint_->second : 0.0f;
+        case Axis::TELEMETRY_SIGNAL_IQ_MEASURED: return axis.motor_.current_control_.Iq_measured_;
+        case Axis::TELEMETRY_SIGNAL_VBUS_VOLTAGE: return vbus_voltage;
+        case Axis::TELEMETRY_SIGNAL_IBUS: return ibus_;
+        case Axis::TELEMETRY_SIGNAL_MOTOR_TEMPERATURE: return axis.motor_.motor_thermistor_.temperature_;
+        case Axis::TELEMETRY_SIGNAL_FET_TEMPERATURE: return axis.motor_.fet_thermistor_.temperature_;
+        default: return NAN;
+    }
+}
+
+bool CANSimple::get_packed_telemetry_callback(const Axis& axis) {
+    can_Message_t txmsg;
+    txmsg.id = axis.config_.can.node_id << NUM_CMD_ID_BITS;
+    txmsg.id += MSG_GET_PACKED_TELEMETRY;
+    txmsg.isExt = axis.config_.can.is_extended;
+
+    constexpr size_t n_slots = sizeof(Axis::CANPackedTelemetry_t::slots) / sizeof(Axis::CANPackedTelemetry_t::slots[0]);
+    float values[n_slots];
+    can_TelemetryField_t fields[n_slots];
+    for (size_t i = 0; i < n_slots; ++i) {
+        const auto& slot = axis.config_.can.packed_telemetry.slots[i];
+        bool enabled = slot.signal != Axis::TELEMETRY_SIGNAL_NONE;
+        values[i] = enabled ? get_telemetry_signal(axis, slot.signal) : 0.0f;
+        fields[i] = {enabled ? slot.bits : (uint8_t)0, slot.scale};
+    }
+
+    can_packTelemetry(txmsg, values, fields, n_slots);
+    return canbus_->send_message(txmsg);
+}
+
 bool CANSimple::get_adc_voltage_callback(const Axis& axis, const can_Message_t& msg) {
     can_Message_t txmsg;
 
@@ -406,7 +451,7 @@ uint32_t CANSimple::service_stack() {
     };
 
     for (auto& axis : axes) {
-        std::array<periodic, 10> periodics = {{
+        std::array<periodic, 11> periodics = {{
             {axis.config_.can.heartbeat_rate_ms, axis.can_.last_heartbeat, &CANSimple::send_heartbeat},
             {axis.config_.can.encoder_rate_ms, axis.can_.last_encoder, &CANSimple::get_encoder_estimates_callback},
             {axis.config_.can.motor_error_rate_ms, axis.can_.last_motor_error, &CANSimple::get_motor_error_callback},
@@ -417,6 +462,7 @@ uint32_t CANSimple::service_stack() {
             {axis.config_.can.iq_rate_ms, axis.can_.last_iq, &CANSimple::get_iq_callback},
             {axis.config_.can.sensorless_rate_ms, axis.can_.last_sensorless, &CANSimple::get_sensorless_estimates_callback},
             {axis.config_.can.bus_vi_rate_ms, axis.can_.last_bus_vi, &CANSimple::get_bus_voltage_current_callback},
+            {axis.config_.can.packed_telemetry_rate_ms, axis.can_.last_packed_telemetry, &CANSimple::get_packed_telemetry_callback},
         }};
 
         MEASURE_TIME(axis.task_times_.can_heartbeat) {
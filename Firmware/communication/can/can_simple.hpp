@@ -2,6 +2,7 @@
 #define __CAN_SIMPLE_HPP_
 
 #include "canbus.hpp"
+#include "can_telemetry.hpp"
 #include "axis.hpp"
 
 class CANSimple {
@@ -37,6 +38,7 @@ class CANSimple {
         MSG_SET_VEL_GAINS,
         MSG_GET_ADC_VOLTAGE,
         MSG_GET_CONTROLLER_ERROR,
+        MSG_GET_PACKED_TELEMETRY,
         MSG_CO_HEARTBEAT_CMD = 0x700,  // CANOpen NMT Heartbeat  SEND
     };
 
@@ -50,7 +52,7 @@ class CANSimple {
     bool renew_subscription(size_t i);
     bool send_heartbeat(const Axis& axis);
 
-    void handle_can_message(const can_Message_t& msg);
+    void handle_can_message(Axis& axis, const can_Message_t& msg);
 
     void do_command(Axis& axis, const can_Message_t& cmd);
     
@@ -64,6 +66,7 @@ class CANSimple {
     bool get_iq_callback(const Axis& axis);
     bool get_sensorless_estimates_callback(const Axis& axis);
     bool get_bus_voltage_current_callback(const Axis& axis);
+    bool get_packed_telemetry_callback(const Axis& axis);
     // msg.rtr bit must NOT be set
     bool get_adc_voltage_callback(const Axis& axis, const can_Message_t& msg);
 
@@ -83,6 +86,8 @@ class CANSimple {
     static void set_pos_gain_callback(Axis& axis, const can_Message_t& msg);
     static void set_vel_gains_callback(Axis& axis, const can_Message_t& msg);
 
+    static float get_telemetry_signal(const Axis& axis, Axis::TelemetrySignal signal);
+
     // Other functions
     static void nmt_callback(const Axis& axis, const can_Message_t& msg);
     static void estop_callback(Axis& axis, const can_Message_t& msg);
@@ -101,13 +106,21 @@ class CANSimple {
         return (msgID & 0x01F);  // Bottom 5 bits
     }
 
+    // Context of the CAN filter of each axis, so that a received message is
+    // dispatched straight to its axis.
+    struct AxisSubscription {
+        CANSimple* parent = nullptr;
+        Axis* axis = nullptr;
+        CanBusBase::CanSubscription* handle = nullptr;
+    };
+
     CanBusBase* canbus_;
-    CanBusBase::CanSubscription* subscription_handles_[AXIS_COUNT];
+    AxisSubscription subscriptions_[AXIS_COUNT] = {};
 
     // TODO: we this is a hack but actually we should use protocol hooks to
     // renew our filter when the node ID changes
-    uint32_t node_ids_[AXIS_COUNT];
-    bool extended_node_ids_[AXIS_COUNT];
+    uint32_t node_ids_[AXIS_COUNT] = {};
+    bool extended_node_ids_[AXIS_COUNT] = {};
 };
 
 #endif
@@ -0,0 +1,90 @@
+#ifndef __CAN_TELEMETRY_HPP
+#define __CAN_TELEMETRY_HPP
+
+#include "can_helpers.hpp"
+#include <cmath>
+
+/**
+ * @brief One quantized signal in a packed telemetry frame.
+ *
+ * The signal is transmitted as a signed integer `round(value / scale)` of
+ * `bits` bits (2...32). Values outside of the representable range saturate
+ * and NaN is sent as 0.
+ */
+struct can_TelemetryField_t {
+    uint8_t bits;
+    float scale;
+};
+
+inline bool can_isValidTelemetryField(const can_TelemetryField_t& field) {
+    return field.bits >= 2 && field.bits <= 32 && field.scale != 0.0f && std::isfinite(field.scale);
+}
+
+inline int32_t can_quantizeTelemetry(float value, const can_TelemetryField_t& field) {
+    int64_t max = (1LL << (field.bits - 1)) - 1;
+    float scaled = value / field.scale;
+    if (std::isnan(scaled)) {
+        return 0;
+    }
+    // Clamp as float first so that the conversion to an integer is defined
+    scaled = std::min(std::max(scaled, -(float)max - 1.0f), (float)max);
+    int64_t raw = (int64_t)std::round(scaled);
+    return (int32_t)std::min(std::max(raw, -max - 1), max);
+}
+
+/**
+ * @brief Packs the specified values back to back into msg, starting at bit 0
+ * (Intel byte order).
+ *
+ * Fields that are invalid (see can_isValidTelemetryField()) are skipped.
+ * Packing stops at the first field that does not fit into the remaining bits
+ * of the frame.
+ *
+ * @returns: The number of bits used. msg.len is set to the number of bytes
+ * needed to hold them.
+ */
+inline size_t can_packTelemetry(can_Message_t& msg, const float* values, const can_TelemetryField_t* fields, size_t n) {
+    uint64_t data = 0;
+    size_t bit = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!can_isValidTelemetryField(fields[i])) {
+            continue;
+        }
+        if (bit + fields[i].bits > 64) {
+            break;
+        }
+        uint64_t mask = (1ULL << fields[i].bits) - 1ULL;
+        data |= ((uint64_t)(int64_t)can_quantizeTelemetry(values[i], fields[i]) & mask) << bit;
+        bit += fields[i].bits;
+    }
+    std::memcpy(msg.buf, &data, sizeof(data));
+    msg.len = (bit + 7) / 8;
+    return bit;
+}
+
+/**
+ * @brief Inverse of can_packTelemetry(). Values of fields that were not packed
+ * are set to NaN.
+ */
+inline void can_unpackTelemetry(const can_Message_t& msg, float* values, const can_TelemetryField_t* fields, size_t n) {
+    uint64_t data = 0;
+    std::memcpy(&data, msg.buf, sizeof(data));
+    size_t bit = 0;
+    bool full = false;
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = NAN;
+        if (full || !can_isValidTelemetryField(fields[i])) {
+            continue;
+        }
+        if (bit + fields[i].bits > 64) {
+            full = true;
+            continue;
+        }
+        // Sign-extend by shifting the field to the top of the word
+        int64_t raw = (int64_t)(data << (64 - bit - fields[i].bits)) >> (64 - fields[i].bits);
+        values[i] = (float)raw * fields[i].scale;
+        bit += fields[i].bits;
+    }
+}
+
+#endif // __CAN_TELEMETRY_HPP
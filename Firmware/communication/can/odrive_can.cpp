@@ -63,7 +63,7 @@ void ODriveCAN::can_server_thread() {
             HAL_CAN_ActivateNotification(handle_, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
 
             // wait at least 1ms to prevent busy-spin on failed sends
-            osSemaphoreWait(sem_can, std::max(next_service_time, 1UL));
+            osSemaphoreWait(sem_can, std::max(next_service_time, (uint32_t)1));
         } else if (status == HAL_CAN_ERROR_TIMEOUT) {
             HAL_CAN_ResetError(handle_);
             status = HAL_CAN_Start(handle_);
@@ -103,23 +103,10 @@ void ODriveCAN::process_rx_fifo(uint32_t fifo) {
         rxmsg.len = header.DLC;
         rxmsg.rtr = header.RTR;
 
-        // TODO: this could be optimized with an ahead-of-time computed
-        // index-to-filter map
-
-        size_t fifo0_idx = 0;
-        size_t fifo1_idx = 0;
-
-        // Find the triggered subscription item based on header.FilterMatchIndex
-        auto it = std::find_if(subscriptions_.begin(), subscriptions_.end(), [&](auto& s) {
-            size_t current_idx = (s.fifo == 0 ? fifo0_idx : fifo1_idx)++;
-            return (header.FilterMatchIndex == current_idx) && (s.fifo == fifo);
-        });
-
-        if (it == subscriptions_.end()) {
-            continue;
+        ODriveCanSubscription* subscription = filter_map_.get(fifo, header.FilterMatchIndex);
+        if (subscription) {
+            subscription->callback(subscription->ctx, rxmsg);
         }
-
-        it->callback(it->ctx, rxmsg);
     }
 }
 
@@ -161,6 +148,7 @@ bool ODriveCAN::subscribe(const MsgIdFilterSpecs& filter, on_can_message_cb_t ca
     it->callback = callback;
     it->ctx = ctx;
     it->fifo = CAN_RX_FIFO0; // TODO: make customizable
+    it->bank_fifo = it->fifo;
     if (handle) {
         *handle = &*it;
     }
@@ -184,8 +172,10 @@ bool ODriveCAN::subscribe(const MsgIdFilterSpecs& filter, on_can_message_cb_t ca
     hal_filter.FilterScale = CAN_FILTERSCALE_32BIT;
 
     if (HAL_CAN_ConfigFilter(handle_, &hal_filter) != HAL_OK) {
+        it->fifo = kCanFifoNone;
         return false;
     }
+    filter_map_.update(subscriptions_);
     return true;
 }
 
@@ -194,14 +184,21 @@ bool ODriveCAN::unsubscribe(CanSubscription* handle) {
     if (subscription < subscriptions_.begin() || subscription >= subscriptions_.end()) {
         return false;
     }
-    if (subscription->fifo != kCanFifoNone) {
+    if (subscription->fifo == kCanFifoNone) {
         return false; // not in use
     }
 
     subscription->fifo = kCanFifoNone;
+    filter_map_.update(subscriptions_);
 
+    // Keep the FIFO assignment, mode and scale of the bank so that the
+    // hardware numbering of the other filters doesn't change
     CAN_FilterTypeDef hal_filter = {};
     hal_filter.FilterActivation = DISABLE;
+    hal_filter.FilterBank = subscription - &subscriptions_[0];
+    hal_filter.FilterFIFOAssignment = subscription->bank_fifo;
+    hal_filter.FilterMode = CAN_FILTERMODE_IDMASK;
+    hal_filter.FilterScale = CAN_FILTERSCALE_32BIT;
     return HAL_CAN_ConfigFilter(handle_, &hal_filter) == HAL_OK;
 }
 
@@ -4,6 +4,7 @@
 #include <cmsis_os.h>
 
 #include "canbus.hpp"
+#include "can_filter_map.hpp"
 #include "can_simple.hpp"
 #include <autogen/interfaces.hpp>
 
@@ -43,10 +44,9 @@ public:
     const uint32_t stack_size_ = 1024;  // Bytes
 
 private:
-    static const uint8_t kCanFifoNone = 0xff;
-
     struct ODriveCanSubscription : CanSubscription {
         uint8_t fifo = kCanFifoNone;
+        uint8_t bank_fifo = CAN_RX_FIFO0; // FIFO assignment of the filter bank, kept while the bank is inactive
         on_can_message_cb_t callback;
         void* ctx;
     };
@@ -62,6 +62,10 @@ private:
     // Hardware supports at most 28 filters unless we do optimizations. For now
     // we don't need that many.
     std::array<ODriveCanSubscription, 8> subscriptions_;
+
+    // Subscription for each filter match index of each FIFO. Rebuilt whenever
+    // a subscription changes.
+    CanFilterMap<ODriveCanSubscription, 8> filter_map_;
     CAN_HandleTypeDef *handle_ = nullptr;
 };
 
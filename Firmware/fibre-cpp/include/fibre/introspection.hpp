@@ -94,9 +94,24 @@ public:
     }
 
 private:
+    // The property table is sorted by name (see type_info_template.j2), so
+    // this is a binary search.
     Introspectable get_direct_child(const char * name, size_t length) const {
-        for (size_t i = 0; i < type_info_->property_table_length_; ++i) {
-            if (!strncmp(name, type_info_->property_table_[i].name, length) && (length == strlen(type_info_->property_table_[i].name))) {
+        size_t begin = 0;
+        size_t end = type_info_->property_table_length_;
+        while (begin < end) {
+            size_t i = begin + (end - begin) / 2;
+            const char * candidate = type_info_->property_table_[i].name;
+            int cmp = strncmp(name, candidate, length);
+            if (!cmp && candidate[length] != '\0') {
+                cmp = -1; // name is a prefix of candidate
+            }
+
+            if (cmp < 0) {
+                end = i;
+            } else if (cmp > 0) {
+                begin = i + 1;
+            } else {
                 Introspectable result;
                 result.storage_ = type_info_->get_child(storage_, i);
                 result.type_info_ = type_info_->property_table_[i].type_info;
@@ -214,6 +229,26 @@ const PropertyInfo FibrePropertyTypeInfo<Property<T>>::property_table[] = {};
 template<typename T>
 const FibrePropertyTypeInfo<Property<T>> FibrePropertyTypeInfo<Property<T>>::singleton{FibrePropertyTypeInfo<Property<T>>::property_table, sizeof(FibrePropertyTypeInfo<Property<T>>::property_table) / sizeof(FibrePropertyTypeInfo<Property<T>>::property_table[0])};
 
+// buffer (not accessible through the introspection API)
+template<typename T>
+struct FibreBufferTypeInfo;
+
+template<typename T>
+struct FibreBufferTypeInfo<Buffer<T>> : TypeInfo {
+    using TypeInfo::TypeInfo;
+    static const PropertyInfo property_table[];
+    static const FibreBufferTypeInfo<Buffer<T>> singleton;
+
+    introspectable_storage_t get_child(introspectable_storage_t obj, size_t idx) const override {
+        return {};
+    }
+};
+
+template<typename T>
+const PropertyInfo FibreBufferTypeInfo<Buffer<T>>::property_table[] = {};
+template<typename T>
+const FibreBufferTypeInfo<Buffer<T>> FibreBufferTypeInfo<Buffer<T>>::singleton{FibreBufferTypeInfo<Buffer<T>>::property_table, sizeof(FibreBufferTypeInfo<Buffer<T>>::property_table) / sizeof(FibreBufferTypeInfo<Buffer<T>>::property_table[0])};
+
 #pragma GCC pop_options
 
 #endif // __FIBRE_INTROSPECTION_HPP
\ No newline at end of file
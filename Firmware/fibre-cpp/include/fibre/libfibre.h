@@ -226,6 +226,31 @@ typedef LibFibreStatus (*libfibre_call_cb_t)(void* ctx,
         const unsigned char** tx_buf, size_t* tx_len,
         unsigned char** rx_buf, size_t* rx_len);
 
+/**
+ * @brief One property access of a batch (see libfibre_start_batch()).
+ * 
+ * The values use the same encoding as the arguments of the property's read()
+ * and exchange() functions.
+ */
+struct LibFibreBatchItem {
+    LibFibreObject* prop; //!< A property object, i.e. an object that implements read() and, if it is writable, exchange().
+    const unsigned char* tx_buf; //!< The new value or NULL to only read the property.
+    size_t tx_len; //!< Length of tx_buf. Must be zero if tx_buf is NULL.
+    unsigned char* rx_buf; //!< Receives the value (the old value if tx_buf is not NULL) or NULL to only write the property.
+    size_t rx_len; //!< Length of rx_buf. Must be zero if rx_buf is NULL.
+    unsigned char* rx_end; //!< Set by libfibre to the end of the received value once the batch completed.
+};
+
+/**
+ * @brief Completion callback type for libfibre_start_batch().
+ * 
+ * @param ctx: The context pointer that was passed to libfibre_start_batch().
+ * @param status: kFibreOk if all items were accessed successfully. Otherwise
+ *        some of the accesses may have taken effect and the rx_end fields
+ *        show which values were received.
+ */
+typedef void (*libfibre_batch_cb_t)(void* ctx, LibFibreStatus status);
+
 /**
  * @brief TX completion callback type for libfibre_start_tx().
  * 
@@ -516,6 +541,40 @@ FIBRE_PUBLIC LibFibreStatus libfibre_call(LibFibreFunction* func, LibFibreCallCo
         unsigned char** rx_end,
         libfibre_call_cb_t callback, void* cb_ctx);
 
+/**
+ * @brief Reads and/or writes several properties with as few requests as
+ * possible.
+ * 
+ * If the device supports batch requests, libfibre packs as many property
+ * accesses into each request as fit into the MTU of the connection and gets
+ * all values back in one response per request. For instance 30 float
+ * properties are read with 3 requests over USB. The requests of a batch are
+ * sent back-to-back, so they are in flight at the same time. Devices that
+ * don't support batch requests are accessed with one request per property.
+ * 
+ * The properties are accessed in the order of the items but the batch as a
+ * whole is not atomic.
+ * 
+ * @param items: The property accesses. All properties must belong to the same
+ *        device. If libfibre_start_batch() returns kFibreBusy then the items
+ *        and their buffers must remain valid until `callback` is invoked.
+ * @param n_items: Number of items.
+ * @param callback: Will be invoked eventually if and only if
+ *        libfibre_start_batch() returns kFibreBusy. This callback is never
+ *        invoked from inside libfibre_start_batch().
+ * @param cb_ctx: An opaque application-defined handle that gets passed to
+ *        `callback`.
+ * 
+ * @retval kFibreBusy: The batch was started and will complete asynchronously.
+ * @retval kFibreOk: The batch completed synchronously (e.g. because it was
+ *         empty).
+ * @retval kFibreInvalidArgument: One of the items is not a property of the
+ *         same device as the first item or its buffer sizes don't match the
+ *         property. None of the properties were accessed.
+ */
+FIBRE_PUBLIC LibFibreStatus libfibre_start_batch(struct LibFibreBatchItem* items, size_t n_items,
+        libfibre_batch_cb_t callback, void* cb_ctx);
+
 /**
  * @brief Starts sending data on the specified TX stream.
  * 
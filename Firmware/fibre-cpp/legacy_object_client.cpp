@@ -7,166 +7,216 @@
 #include "crc.hpp"
 #include <variant>
 #include <algorithm>
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 DEFINE_LOG_TOPIC(LEGACY_OBJ);
 USE_LOG_TOPIC(LEGACY_OBJ);
 
 using namespace fibre;
 
+// The JSON parser stores all values of a document in a single vector (arena)
+// and strings refer to the original JSON buffer instead of being copied, so
+// parsing the interface of a device takes only a handful of allocations.
+// The buffer must outlive the parsed document.
+
+struct json_str {
+    const char* begin;
+    const char* end;
+};
+
+enum json_type {
+    kJsonStr,
+    kJsonInt,
+    kJsonList,
+    kJsonDict,
+};
+
+struct json_node {
+    json_type type;
+    json_str key; // key of this value if it's an item of a dict
+    json_str str; // only valid for kJsonStr
+    int int_val; // only valid for kJsonInt
+    uint32_t first_child; // first item of a list or dict or 0 if empty
+    uint32_t next; // next item of the parent list or dict or 0 if last
+};
+
 struct json_error {
     const char* ptr;
-    std::string str;
+    const char* str;
 };
 
-struct json_value;
-using json_list = std::vector<std::shared_ptr<json_value>>;
-using json_dict = std::vector<std::pair<std::shared_ptr<json_value>, std::shared_ptr<json_value>>>;
-using json_value_variant = std::variant<std::string, int, json_list, json_dict, json_error>;
-
-struct json_value : json_value_variant {
-    //json_value(const json_value_variant& v) : json_value_variant{v} {}
-    template<typename T> json_value(T&& arg) : json_value_variant{std::forward<T>(arg)} {}
-    //json_value_variant v;
+struct json_doc {
+    std::vector<json_node> nodes; // nodes[0] is the root value
+    json_error error;
 };
 
-// helper functions
-bool json_is_str(json_value val) { return val.index() == 0; }
-bool json_is_int(json_value val) { return val.index() == 1; }
-bool json_is_list(json_value val) { return val.index() == 2; }
-bool json_is_dict(json_value val) { return val.index() == 3; }
-bool json_is_err(json_value val) { return val.index() == 4; }
-std::string json_as_str(json_value val) { return std::get<0>(val); }
-int json_as_int(json_value val) { return std::get<1>(val); }
-json_list json_as_list(json_value val) { return std::get<2>(val); }
-json_dict json_as_dict(json_value val) { return std::get<3>(val); }
-json_error json_as_err(json_value val) { return std::get<4>(val); }
+// helper functions (all of them accept nullptr)
+static bool json_is_str(const json_node* node) { return node && node->type == kJsonStr; }
+static bool json_is_int(const json_node* node) { return node && node->type == kJsonInt; }
+static bool json_is_list(const json_node* node) { return node && node->type == kJsonList; }
+static bool json_is_dict(const json_node* node) { return node && node->type == kJsonDict; }
+static std::string json_as_str(const json_node* node) { return {node->str.begin, node->str.end}; }
+
+static bool json_str_eq(json_str str, const char* cstr) {
+    size_t length = strlen(cstr);
+    return (size_t)(str.end - str.begin) == length && !memcmp(str.begin, cstr, length);
+}
+
+static bool json_str_contains(json_str str, char c) {
+    return std::find(str.begin, str.end, c) != str.end;
+}
 
-json_value json_make_error(const char* ptr, std::string str) {
-    return {json_error{ptr, str}};
+static const json_node* json_first_child(const json_doc& doc, const json_node* node) {
+    return (node && node->first_child) ? &doc.nodes[node->first_child] : nullptr;
 }
 
+static const json_node* json_next_sibling(const json_doc& doc, const json_node* node) {
+    return node->next ? &doc.nodes[node->next] : nullptr;
+}
 
-void json_skip_whitespace(const char** begin, const char* end) {
+static bool json_make_error(json_doc* doc, const char* ptr, const char* str) {
+    doc->error = {ptr, str};
+    return false;
+}
+
+static void json_skip_whitespace(const char** begin, const char* end) {
     while (*begin < end && std::isspace(**begin)) {
         (*begin)++;
     }
 }
 
-bool json_comp(const char* begin, const char* end, char c) {
+static bool json_comp(const char* begin, const char* end, char c) {
     return begin < end && *begin == c;
 }
 
-json_value json_parse(const char** begin, const char* end) {
-    // skip whitespace
+static bool json_parse_str(json_doc* doc, const char** begin, const char* end, json_str* str) {
+    (*begin)++; // consume leading '"'
+    const char* str_begin = *begin;
+
+    while (!json_comp(*begin, end, '"')) {
+        if (*begin >= end) {
+            return json_make_error(doc, *begin, "expected '\"' but got EOF");
+        }
+        if (json_comp(*begin, end, '\\')) {
+            return json_make_error(doc, *begin, "escaped strings not supported");
+        }
+        (*begin)++;
+    }
+
+    *str = {str_begin, *begin};
+    (*begin)++; // consume trailing '"'
+    return true;
+}
+
+// Parses one value and appends it to doc->nodes, followed by its items if it
+// is a list or dict. On failure, doc->error is set.
+static bool json_parse(json_doc* doc, const char** begin, const char* end) {
+    json_skip_whitespace(begin, end);
 
     if (*begin >= end) {
-        return json_make_error(*begin, "expected value but got EOF");
+        return json_make_error(doc, *begin, "expected value but got EOF");
     }
 
-    if (json_comp(*begin, end, '{')) {
-        // parse dict
-        (*begin)++; // consume leading '{'
-        json_dict dict;
-        bool expect_comma = false;
+    // Items are appended after their parent, so indices must be used instead
+    // of pointers to refer to the parent.
+    uint32_t idx = (uint32_t)doc->nodes.size();
+    doc->nodes.push_back({kJsonStr, {nullptr, nullptr}, {nullptr, nullptr}, 0, 0, 0});
+
+    if (json_comp(*begin, end, '{') || json_comp(*begin, end, '[')) {
+        // parse dict or list
+        bool is_dict = **begin == '{';
+        char closing = is_dict ? '}' : ']';
+        doc->nodes[idx].type = is_dict ? kJsonDict : kJsonList;
+        (*begin)++; // consume leading '{' or '['
+        uint32_t prev = 0;
 
         json_skip_whitespace(begin, end);
-        while (!json_comp(*begin, end, '}')) {
-            if (expect_comma) {
+        while (!json_comp(*begin, end, closing)) {
+            if (prev) {
                 if (!json_comp(*begin, end, ',')) {
-                    return json_make_error(*begin, "expected ',' or '}'");
+                    return json_make_error(doc, *begin, is_dict ? "expected ',' or '}'" : "expected ',' or ']'");
                 }
                 (*begin)++; // consume comma
                 json_skip_whitespace(begin, end);
             }
-            expect_comma = true;
 
-            // Parse key-value pair
-            json_value key = json_parse(begin, end);
-            if (json_is_err(key)) return key;
-            json_skip_whitespace(begin, end);
-            if (!json_comp(*begin, end, ':')) {
-                return json_make_error(*begin, "expected :");
-            }
-            (*begin)++;
-            json_value val = json_parse(begin, end);
-            if (json_is_err(val)) return val;
-            dict.push_back({std::make_shared<json_value>(key), std::make_shared<json_value>(val)});
-
-            json_skip_whitespace(begin, end);
-        }
-
-        (*begin)++;
-        return {dict};
-
-    } else if (json_comp(*begin, end, '[')) {
-        // parse list
-        (*begin)++; // consume leading '['
-        json_list list;
-        bool expect_comma = false;
-
-        json_skip_whitespace(begin, end);
-        while (!json_comp(*begin, end, ']')) {
-            if (expect_comma) {
-                if (!json_comp(*begin, end, ',')) {
-                    return json_make_error(*begin, "expected ',' or ']'");
+            json_str key = {nullptr, nullptr};
+            if (is_dict) {
+                if (!json_comp(*begin, end, '"')) {
+                    return json_make_error(doc, *begin, "expected string as key");
+                }
+                if (!json_parse_str(doc, begin, end, &key)) {
+                    return false;
                 }
-                (*begin)++; // consume comma
                 json_skip_whitespace(begin, end);
+                if (!json_comp(*begin, end, ':')) {
+                    return json_make_error(doc, *begin, "expected :");
+                }
+                (*begin)++;
             }
-            expect_comma = true;
 
             // Parse item
-            json_value val = json_parse(begin, end);
-            if (json_is_err(val)) return val;
-            list.push_back(std::make_shared<json_value>(val));
+            uint32_t item = (uint32_t)doc->nodes.size();
+            if (!json_parse(doc, begin, end)) {
+                return false;
+            }
+            doc->nodes[item].key = key;
+            (prev ? doc->nodes[prev].next : doc->nodes[idx].first_child) = item;
+            prev = item;
 
             json_skip_whitespace(begin, end);
         }
 
-        (*begin)++; // consume trailing ']'
-        return {list};
+        (*begin)++; // consume trailing '}' or ']'
+        return true;
 
     } else if (json_comp(*begin, end, '"')) {
         // parse string
-        (*begin)++; // consume leading '"'
-        std::string str;
-
-        while (!json_comp(*begin, end, '"')) {
-            if (*begin >= end) {
-                return json_make_error(*begin, "expected '\"' but got EOF");
-            }
-            if (json_comp(*begin, end, '\\')) {
-                return json_make_error(*begin, "escaped strings not supported");
-            }
-            str.push_back(**begin);
-            (*begin)++;
-        }
-
-        (*begin)++; // consume trailing '"'
-        return {str};
+        return json_parse_str(doc, begin, end, &doc->nodes[idx].str);
 
     } else if (std::isdigit(**begin)) {
         // parse int
-
-        std::string str;
+        int val = 0;
         while (*begin < end && std::isdigit(**begin)) {
-            str.push_back(**begin);
+            int digit = **begin - '0';
+            if (val > (INT_MAX - digit) / 10) {
+                return json_make_error(doc, *begin, "integer too large");
+            }
+            val = val * 10 + digit;
             (*begin)++;
         }
 
-        return {std::stoi(str)}; // note: this can throw an exception if the int is too long
+        doc->nodes[idx].type = kJsonInt;
+        doc->nodes[idx].int_val = val;
+        return true;
 
     } else {
-        return json_make_error(*begin, "unexpected character '" + std::string(*begin, *begin + 1) + "'");
+        return json_make_error(doc, *begin, "unexpected character");
     }
 }
 
-json_value json_dict_find(json_dict dict, std::string key) {
-    auto it = std::find_if(dict.begin(), dict.end(),
-        [&](std::pair<std::shared_ptr<json_value>, std::shared_ptr<json_value>>& kv){
-            return json_is_str(*kv.first) && json_as_str(*kv.first) == key;
-        });
-    return (it == dict.end()) ? json_make_error(nullptr, "key not found") : *it->second;
+// Returns the value of the specified key or nullptr if the key doesn't exist
+// or if dict is not a dict.
+static const json_node* json_dict_find(const json_doc& doc, const json_node* dict, const char* key) {
+    if (!json_is_dict(dict)) {
+        return nullptr;
+    }
+    for (const json_node* item = json_first_child(doc, dict); item; item = json_next_sibling(doc, item)) {
+        if (json_str_eq(item->key, key)) {
+            return item;
+        }
+    }
+    return nullptr;
 }
 
 // not sure if this function exists in the STL
@@ -193,53 +243,164 @@ std::unordered_map<std::string, size_t> codecs = {
     {"endpoint_ref", 4}
 };
 
-size_t get_codec_size(std::string codec) {
+// Splits an array codec such as "float[15]" into element codec and length.
+bool parse_array_codec(const std::string& codec, std::string* elem_codec, size_t* length) {
+    size_t open = codec.find('[');
+    if (open == std::string::npos || codec.size() < open + 3 || codec.back() != ']') {
+        return false;
+    }
+    *elem_codec = codec.substr(0, open);
+    *length = strtoul(codec.substr(open + 1, codec.size() - open - 2).c_str(), nullptr, 10);
+    return *length != 0;
+}
+
+size_t get_codec_size(const std::string& codec) {
+    std::string elem_codec;
+    size_t length;
+    if (parse_array_codec(codec, &elem_codec, &length)) {
+        return get_codec_size(elem_codec) * length;
+    }
     auto it = codecs.find(codec);
     return (it == codecs.end()) ? 0 : it->second;
 }
 
-std::vector<LegacyFibreArg> parse_arglist(const json_value& list_val) {
+std::vector<LegacyFibreArg> parse_arglist(const json_doc& doc, const json_node* list_val) {
     std::vector<LegacyFibreArg> arglist;
 
-    for (auto& arg : json_is_list(list_val) ? json_as_list(list_val) : json_list()) {
-        if (!json_is_dict(*arg)) {
-            FIBRE_LOG(W) << "arglist is invalid";
-            continue;
-        }
-        auto dict = json_as_dict(*arg);
-        
-        json_value name_val = json_dict_find(dict, "name");
-        json_value id_val = json_dict_find(dict, "id");
-        json_value type_val = json_dict_find(dict, "type");
+    for (const json_node* arg = json_is_list(list_val) ? json_first_child(doc, list_val) : nullptr; arg; arg = json_next_sibling(doc, arg)) {
+        const json_node* name_val = json_dict_find(doc, arg, "name");
+        const json_node* id_val = json_dict_find(doc, arg, "id");
+        const json_node* type_val = json_dict_find(doc, arg, "type");
 
-        if (!json_is_str(name_val) || !json_is_int(id_val) || ((int)(size_t)json_as_int(id_val) != json_as_int(id_val)) || !json_is_str(type_val)) {
+        if (!json_is_str(name_val) || !json_is_int(id_val) || !json_is_str(type_val)) {
             FIBRE_LOG(W) << "arglist is invalid";
             continue;
         }
 
-
+        std::string type = json_as_str(type_val);
+        bool is_ref = type == "endpoint_ref";
+        size_t size = get_codec_size(type);
         arglist.push_back({
             json_as_str(name_val),
-            json_as_str(type_val),
-            (json_as_str(type_val) == "endpoint_ref") ? "object_ref" : json_as_str(type_val),
-            get_codec_size(json_as_str(type_val)),
-            (json_as_str(type_val) == "endpoint_ref") ? sizeof(uintptr_t) : get_codec_size(json_as_str(type_val)),
-            (size_t)json_as_int(id_val),
+            type,
+            is_ref ? "object_ref" : type,
+            size,
+            is_ref ? sizeof(uintptr_t) : size,
+            (size_t)id_val->int_val,
         });
     }
 
     return arglist;
 }
 
+// Returns the directory in which the interface JSON of known peers is cached
+// or an empty string if caching is disabled.
+// The directory can be overridden with the environment variable
+// FIBRE_CACHE_DIR. Setting it to an empty string disables the cache.
+static std::string get_json_cache_dir() {
+    const char* dir = std::getenv("FIBRE_CACHE_DIR");
+    if (dir) {
+        return dir;
+    }
+#if defined(__EMSCRIPTEN__)
+    return "";
+#elif defined(_WIN32)
+    const char* local_app_data = std::getenv("LOCALAPPDATA");
+    return local_app_data ? std::string{local_app_data} + "\\fibre" : "";
+#else
+    const char* xdg_cache_home = std::getenv("XDG_CACHE_HOME");
+    if (xdg_cache_home && *xdg_cache_home) {
+        return std::string{xdg_cache_home} + "/fibre";
+    }
+    const char* home = std::getenv("HOME");
+    return home ? std::string{home} + "/.cache/fibre" : "";
+#endif
+}
+
+static std::string get_json_cache_file(const std::string& dir, uint32_t json_version_id) {
+    char name[32];
+    snprintf(name, sizeof(name), "/interface-%08x.json", (unsigned int)json_version_id);
+    return dir + name;
+}
+
+// Returns the JSON version ID that the server would report for this JSON
+// (see json_version_id_ in endpoints_template.j2).
+static uint32_t calc_json_version_id(const std::vector<uint8_t>& json) {
+    uint16_t json_crc = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION, json.data(), json.size());
+    return ((uint32_t)json_crc << 16) | calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(json_crc, json.data(), json.size());
+}
+
+static bool load_cached_json(uint32_t json_version_id, std::vector<uint8_t>* json) {
+    std::string dir = get_json_cache_dir();
+    if (dir.empty()) {
+        return false;
+    }
+
+    FILE* file = fopen(get_json_cache_file(dir, json_version_id).c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    json->clear();
+    uint8_t buf[4096];
+    size_t n_read;
+    while ((n_read = fread(buf, 1, sizeof(buf), file)) > 0) {
+        json->insert(json->end(), buf, buf + n_read);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+
+    // The file name alone could be stale or the file could be truncated
+    return ok && calc_json_version_id(*json) == json_version_id;
+}
+
+static void store_cached_json(uint32_t json_version_id, const std::vector<uint8_t>& json) {
+    std::string dir = get_json_cache_dir();
+    if (dir.empty()) {
+        return;
+    }
+
+    // Create the directory and its parents. Errors show up when opening the file.
+    for (size_t pos = 1; pos <= dir.size(); ++pos) {
+        if (pos == dir.size() || dir[pos] == '/' || dir[pos] == '\\') {
+#if defined(_WIN32)
+            _mkdir(dir.substr(0, pos).c_str());
+#else
+            mkdir(dir.substr(0, pos).c_str(), 0755);
+#endif
+        }
+    }
+
+    // Several processes may connect to devices with the same firmware at the
+    // same time, so the file is written under a temporary name first.
+    std::string path = get_json_cache_file(dir, json_version_id);
+#if defined(_WIN32)
+    std::string tmp_path = path + "." + std::to_string(_getpid()) + ".tmp";
+#else
+    std::string tmp_path = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        FIBRE_LOG(D) << "can't write JSON cache file " << tmp_path;
+        return;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str()); // e.g. another process was faster (Windows)
+    }
+}
+
 void LegacyObjectClient::start(Callback<void, LegacyObjectClient*, std::shared_ptr<LegacyObject>> on_found_root_object, Callback<void, LegacyObjectClient*, std::shared_ptr<LegacyObject>> on_lost_root_object) {
     FIBRE_LOG(D) << "start";
     on_found_root_object_ = on_found_root_object;
     on_lost_root_object_ = on_lost_root_object;
     json_.clear();
-    receive_more_json();
+    json_version_id_ = 0;
+    receive_json_version();
 }
 
-std::shared_ptr<FibreInterface> LegacyObjectClient::get_property_interfaces(std::string codec, bool write) {
+std::shared_ptr<FibreInterface> LegacyObjectClient::get_property_interfaces(const std::string& codec, bool write) {
     auto& dict = write ? rw_property_interfaces : ro_property_interfaces;
 
     auto it = dict.find(codec);
@@ -257,19 +418,26 @@ std::shared_ptr<FibreInterface> LegacyObjectClient::get_property_interfaces(std:
     if (!size || !app_codec_size) {
         FIBRE_LOG(W) << "unknown size for codec " << codec;
     }
+
+    std::string elem_codec;
+    size_t length;
+    if (parse_array_codec(codec, &elem_codec, &length)) {
+        // Buffer endpoint: takes an offset and returns a chunk of the array
+        intf.name = std::string{} + "fibre.Buffer<" + elem_codec + ">";
+        intf.functions.emplace("read", LegacyFunction{this, 0, nullptr, {{"offset", "uint32", "uint32", 4, 4, 0}}, {{"data", codec, codec, size, size, 0}}});
+        return intf_ptr;
+    }
     
     intf.name = std::string{} + "fibre.Property<" + (write ? "readwrite" : "readonly") + " " + codec + ">";
-    intf.functions.emplace("read", LegacyFunction{0, nullptr, {}, {{"value", codec, app_codec, size, app_codec_size, 0}}});
+    intf.functions.emplace("read", LegacyFunction{this, 0, nullptr, {}, {{"value", codec, app_codec, size, app_codec_size, 0}}});
     if (write) {
-        intf.functions.emplace("exchange", LegacyFunction{0, nullptr, {{"newval", codec, app_codec, size, app_codec_size, 0}}, {{"oldval", codec, app_codec, size, app_codec_size, 0}}});
+        intf.functions.emplace("exchange", LegacyFunction{this, 0, nullptr, {{"newval", codec, app_codec, size, app_codec_size, 0}}, {{"oldval", codec, app_codec, size, app_codec_size, 0}}});
     }
     
     return intf_ptr;
 }
 
-std::shared_ptr<LegacyObject> LegacyObjectClient::load_object(json_value list_val) {
-    
-
+std::shared_ptr<LegacyObject> LegacyObjectClient::load_object(const json_doc& doc, const json_node* list_val) {
     if (!json_is_list(list_val)) {
         FIBRE_LOG(W) << "interface members must be a list";
         return nullptr;
@@ -284,56 +452,54 @@ std::shared_ptr<LegacyObject> LegacyObjectClient::load_object(json_value list_va
     auto obj_ptr = std::make_shared<LegacyObject>(obj);
     FibreInterface& intf = *obj_ptr->intf;
 
-    for (auto& item: json_as_list(list_val)) {
-        if (!json_is_dict(*item)) {
+    for (const json_node* item = json_first_child(doc, list_val); item; item = json_next_sibling(doc, item)) {
+        if (!json_is_dict(item)) {
             FIBRE_LOG(W) << "expected dict";
             continue;
         }
-        auto dict = json_as_dict(*item);
 
-        json_value type = json_dict_find(dict, "type");
-        json_value name_val = json_dict_find(dict, "name");
+        const json_node* type = json_dict_find(doc, item, "type");
+        const json_node* name_val = json_dict_find(doc, item, "name");
         std::string name = json_is_str(name_val) ? json_as_str(name_val) : "[anonymous]";
 
-        if (json_is_str(type) && json_as_str(type) == "object") {
-            std::shared_ptr<LegacyObject> subobj = load_object(json_dict_find(dict, "members"));
-            intf.attributes[name] = {subobj};
+        if (json_is_str(type) && json_str_eq(type->str, "object")) {
+            std::shared_ptr<LegacyObject> subobj = load_object(doc, json_dict_find(doc, item, "members"));
+            intf.attributes[std::move(name)] = {subobj};
 
-        } else if (json_is_str(type) && json_as_str(type) == "function") {
-            json_value id = json_dict_find(dict, "id");
-            if (!json_is_int(id) || ((int)(size_t)json_as_int(id) != json_as_int(id))) {
+        } else if (json_is_str(type) && json_str_eq(type->str, "function")) {
+            const json_node* id = json_dict_find(doc, item, "id");
+            if (!json_is_int(id)) {
                 continue;
             }
-            intf.functions.emplace(name, LegacyFunction{
-                (size_t)json_as_int(id),
+            intf.functions.emplace(std::move(name), LegacyFunction{
+                this,
+                (size_t)id->int_val,
                 obj_ptr.get(),
-                parse_arglist(json_dict_find(dict, "inputs")),
-                parse_arglist(json_dict_find(dict, "outputs"))
+                parse_arglist(doc, json_dict_find(doc, item, "inputs")),
+                parse_arglist(doc, json_dict_find(doc, item, "outputs"))
             });
 
-        } else if (json_is_str(type) && json_as_str(type) == "json") {
+        } else if (json_is_str(type) && json_str_eq(type->str, "json")) {
             // Ignore
 
         } else if (json_is_str(type)) {
-            std::string type_str = json_as_str(type);
-            json_value access = json_dict_find(dict, "access");
-            std::string access_str = json_is_str(access) ? json_as_str(access) : "r";
-            bool can_write = access_str.find('w') != std::string::npos;
+            const json_node* access = json_dict_find(doc, item, "access");
+            bool can_write = json_is_str(access) && json_str_contains(access->str, 'w');
 
-            json_value id = json_dict_find(dict, "id");
-            if (!json_is_int(id) || ((int)(size_t)json_as_int(id) != json_as_int(id))) {
+            const json_node* id = json_dict_find(doc, item, "id");
+            if (!json_is_int(id)) {
                 continue;
             }
 
             LegacyObject subobj{
                 .client = this,
-                .ep_num = (size_t)json_as_int(id),
-                .intf = get_property_interfaces(type_str, can_write),
+                .ep_num = (size_t)id->int_val,
+                .intf = get_property_interfaces(json_as_str(type), can_write),
                 .known_to_application = false
             };
             auto subobj_ptr = std::make_shared<LegacyObject>(subobj);
             objects_.push_back(subobj_ptr);
-            intf.attributes[name] = {subobj_ptr};
+            intf.attributes[std::move(name)] = {subobj_ptr};
 
         } else {
             FIBRE_LOG(W) << "unsupported codec";
@@ -344,6 +510,38 @@ std::shared_ptr<LegacyObject> LegacyObjectClient::load_object(json_value list_va
     return obj_ptr;
 }
 
+void LegacyObjectClient::receive_json_version() {
+    write_le<uint32_t>(0xffffffff, tx_buf_);
+    protocol_->start_endpoint_operation(0, tx_buf_, json_version_buf_, &op_handle_, MEMBER_CB(this, on_received_json_version));
+}
+
+void LegacyObjectClient::on_received_json_version(EndpointOperationResult result) {
+    op_handle_ = 0;
+
+    if (result.status == kStreamCancelled) {
+        return;
+    } else if (result.status == kStreamClosed) {
+        return;
+    }
+
+    if (result.status == kStreamOk && result.rx_end == json_version_buf_ + sizeof(json_version_buf_)) {
+        read_le<uint32_t>(&json_version_id_, json_version_buf_);
+        FIBRE_LOG(D) << "JSON version ID: " << as_hex(json_version_id_);
+    }
+
+    if (json_version_id_ && load_cached_json(json_version_id_, &json_)) {
+        FIBRE_LOG(D) << "loaded JSON of length " << json_.size() << " from cache";
+        if (load_json({json_.data(), json_.data() + json_.size()})) {
+            std::vector<uint8_t>().swap(json_); // the object tree doesn't refer to the JSON
+            receive_window_size();
+            return;
+        }
+    }
+
+    json_.clear();
+    receive_more_json();
+}
+
 void LegacyObjectClient::receive_more_json() {
     write_le<uint32_t>(json_.size(), tx_buf_);
     json_.resize(json_.size() + 1024);
@@ -376,28 +574,111 @@ void LegacyObjectClient::on_received_json(EndpointOperationResult result) {
         FIBRE_LOG(D) << "received JSON of length " << json_.size();
         //FIBRE_LOG(D) << "JSON: " << str{json_.data(), json_.data() + json_.size()};
 
-        const char *begin = reinterpret_cast<const char*>(json_.data());
-        auto val = json_parse(&begin, begin + json_.size());
-
-        if (json_is_err(val)) {
-            size_t pos = json_as_err(val).ptr - reinterpret_cast<const char*>(json_.data());
-            FIBRE_LOG(E) << "JSON parsing error: " << json_as_err(val).str << " at position " << pos;
-            return;
-        } else if (!json_is_list(val)) {
-            FIBRE_LOG(E) << "JSON data must be a list";
+        if (!load_json({json_.data(), json_.data() + json_.size()})) {
             return;
         }
 
-        FIBRE_LOG(D) << "sucessfully parsed JSON";
-        root_obj_ = load_object(val);
-        json_crc_ = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION, json_.data(), json_.size());
-        if (root_obj_) {
-            on_found_root_object_.invoke_and_clear(this, root_obj_);
+        // Only cache the JSON if it is consistent with the version ID, so
+        // that a corrupted transfer doesn't persist
+        if (json_version_id_ && calc_json_version_id(json_) == json_version_id_) {
+            store_cached_json(json_version_id_, json_);
         }
+        std::vector<uint8_t>().swap(json_); // the object tree doesn't refer to the JSON
+
+        receive_window_size();
+    }
+}
+
+bool LegacyObjectClient::load_json(cbufptr_t json) {
+    json_doc doc;
+    // The ODrive interface JSON has about one value per 13 bytes
+    doc.nodes.reserve(json.size() / 8);
+
+    const char *begin = reinterpret_cast<const char*>(json.begin());
+    if (!json_parse(&doc, &begin, reinterpret_cast<const char*>(json.end()))) {
+        size_t pos = doc.error.ptr - reinterpret_cast<const char*>(json.begin());
+        FIBRE_LOG(E) << "JSON parsing error: " << doc.error.str << " at position " << pos;
+        return false;
+    } else if (!json_is_list(&doc.nodes[0])) {
+        FIBRE_LOG(E) << "JSON data must be a list";
+        return false;
+    }
+
+    FIBRE_LOG(D) << "sucessfully parsed JSON (" << doc.nodes.size() << " values)";
+    objects_.clear();
+    root_obj_ = load_object(doc, &doc.nodes[0]);
+    objects_.shrink_to_fit();
+    json_crc_ = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION, json.begin(), json.size());
+    return !!root_obj_;
+}
+
+void LegacyObjectClient::receive_window_size() {
+    write_le<uint32_t>(0xfffffffe, tx_buf_);
+    protocol_->start_endpoint_operation(0, tx_buf_, window_size_buf_, &op_handle_, MEMBER_CB(this, on_received_window_size));
+}
+
+void LegacyObjectClient::on_received_window_size(EndpointOperationResult result) {
+    op_handle_ = 0;
+
+    if (result.status == kStreamCancelled) {
+        return;
+    } else if (result.status == kStreamClosed) {
+        return;
+    }
+
+    // Older peers return an empty response. In this case only one operation
+    // at a time is sent. Peers that don't report any protocol features only
+    // return the window size.
+    size_t n_received = result.status == kStreamOk ? result.rx_end - window_size_buf_ : 0;
+    if (n_received >= 4) {
+        uint32_t window_size = 1;
+        read_le<uint32_t>(&window_size, window_size_buf_);
+        protocol_->window_size_ = std::max((uint32_t)1, std::min(window_size, (uint32_t)FIBRE_LEGACY_WINDOW_SIZE));
+        FIBRE_LOG(D) << "remote window size: " << window_size;
+    } else {
+        FIBRE_LOG(D) << "remote doesn't support pipelining";
+    }
+    if (n_received >= 8) {
+        uint32_t features = 0;
+        read_le<uint32_t>(&features, window_size_buf_ + 4);
+        protocol_->remote_features_ = features;
+        FIBRE_LOG(D) << "remote features: " << as_hex(features);
     }
+
+    on_found_root_object_.invoke_and_clear(this, root_obj_);
 }
 
 
+LegacyCallContext* LegacyFunction::start_call() {
+    // A recycled context keeps the capacity of its buffers, so calls don't
+    // use the heap once the pool is warmed up.
+    LegacyCallContext* ctx = client_->call_pool_.acquire();
+    ctx->func_ = this;
+    ctx->progress = 0;
+    ctx->op_handle_ = 0;
+    ctx->tx_pos_ = 0;
+    ctx->rx_pos_ = 0;
+    ctx->callback = nullptr;
+    ctx->ep_result = std::nullopt;
+    ctx->obj_ = nullptr;
+    ctx->user_callback_ = nullptr;
+    ctx->user_ctx_ = nullptr;
+
+    size_t total_tx_decoded_size = sizeof(uintptr_t);
+    for (auto& arg: inputs) {
+        total_tx_decoded_size += arg.app_size;
+    }
+
+    size_t total_rx_encoded_size = 0;
+    for (auto& arg: outputs) {
+        total_rx_encoded_size += arg.protocol_size;
+    }
+
+    ctx->tx_buf_.resize(total_tx_decoded_size);
+    ctx->rx_buf_.resize(total_rx_encoded_size);
+    return ctx;
+}
+
 std::optional<CallBufferRelease> LegacyFunction::call(void** call_handle,
         CallBuffers buffers,
         Callback<std::optional<CallBuffers>, CallBufferRelease> callback) {
@@ -406,22 +687,7 @@ std::optional<CallBufferRelease> LegacyFunction::call(void** call_handle,
 
     if (!*call_handle) {
         // Instantiate new call
-        ctx = new LegacyCallContext();
-        ctx->func_ = this;
-
-        size_t total_tx_decoded_size = sizeof(uintptr_t);
-        for (auto& arg: inputs) {
-            total_tx_decoded_size += arg.app_size;
-        }
-
-        size_t total_rx_encoded_size = 0;
-        for (auto& arg: outputs) {
-            total_rx_encoded_size += arg.protocol_size;
-        }
-
-        ctx->tx_buf_.resize(total_tx_decoded_size);
-        ctx->rx_buf_.resize(total_rx_encoded_size);
-
+        ctx = start_call();
         *call_handle = ctx;
     } else {
         // Resume call
@@ -436,6 +702,10 @@ std::optional<CallBufferRelease> LegacyFunction::call(void** call_handle,
     for (;;) {
         auto continuation = ctx->get_next_task(result);
         if (continuation.index() == 0) {
+            if (std::get<0>(continuation).status != kFibreOk) {
+                // The call ended synchronously
+                client_->call_pool_.release(ctx);
+            }
             return std::get<0>(continuation);
         } else if (continuation.index() == 1) {
             auto proto_continuation = std::get<1>(continuation);
@@ -482,7 +752,7 @@ void LegacyCallContext::resume_from_protocol(EndpointOperationResult result) {
                     FIBRE_LOG(W) << "app tried to continue a closed call";
                 }
                 FIBRE_LOG(T) << "closing call";
-                delete this;
+                func_->client_->call_pool_.release(this);
                 return;
             } else {
                 res = *app_result;
@@ -501,7 +771,7 @@ void LegacyCallContext::resume_from_protocol(EndpointOperationResult result) {
     }
 }
 
-bool LegacyObjectClient::transcode(cbufptr_t src, bufptr_t dst, std::string src_codec, std::string dst_codec) {
+bool LegacyObjectClient::transcode(cbufptr_t src, bufptr_t dst, const std::string& src_codec, const std::string& dst_codec) {
     if (src_codec == "object_ref" && dst_codec == "endpoint_ref") {
         if (src.size() < sizeof(uintptr_t) || dst.size() < 4) {
             return false;
@@ -612,7 +882,7 @@ std::variant<LegacyCallContext::ContinueWithApp, LegacyCallContext::ContinueWith
         FIBRE_LOG(T) << "object is " << as_hex(reinterpret_cast<uintptr_t>(obj_));
         FIBRE_LOG(T) << "tx buf is " << as_hex(cbufptr_t{tx_buf_});
 
-        std::vector<uint8_t> transcoded;
+        std::vector<uint8_t>& transcoded = scratch_buf_;
         size_t transcoded_size = calc_sum(func_->inputs.begin(), func_->inputs.end(),
             [](LegacyFibreArg& arg) { return arg.protocol_size; });
         FIBRE_LOG(T) << "transcoding " << func_->inputs.size() << " inputs from " << tx_buf_.size() << " B to " << transcoded_size << " B";
@@ -630,16 +900,13 @@ std::variant<LegacyCallContext::ContinueWithApp, LegacyCallContext::ContinueWith
             tx_pos_ += arg.app_size;
         }
 
-        tx_buf_ = transcoded;
+        std::swap(tx_buf_, transcoded);
         tx_pos_ = 0;
 
     } else if (progress == func_->inputs.size() + 1 + func_->outputs.size()) {
         // Transcode from protocol codec to application codec
 
-        std::vector<uint8_t> transcoded;
-        for (auto& arg: func_->outputs) {
-            FIBRE_LOG(T) << "arg size " << arg.app_size;
-        }
+        std::vector<uint8_t>& transcoded = scratch_buf_;
         size_t transcoded_size = calc_sum(func_->outputs.begin(), func_->outputs.end(),
             [](LegacyFibreArg& arg) { return arg.app_size; });
         FIBRE_LOG(T) << "transcoding " << func_->outputs.size() << " outputs from " << rx_buf_.size() << " B to " << transcoded_size << " B";
@@ -657,7 +924,7 @@ std::variant<LegacyCallContext::ContinueWithApp, LegacyCallContext::ContinueWith
             rx_pos_ += arg.protocol_size;
         }
 
-        rx_buf_ = transcoded;
+        std::swap(rx_buf_, transcoded);
         rx_pos_ = 0;
 
         FIBRE_LOG(T) << "rx buf is " << as_hex(cbufptr_t{rx_buf_});
@@ -672,14 +939,14 @@ std::variant<LegacyCallContext::ContinueWithApp, LegacyCallContext::ContinueWith
 
     } else if (progress <= func_->inputs.size()) {
         // send arg
-        auto arg = func_->inputs[progress - 1];
+        auto& arg = func_->inputs[progress - 1];
         return ContinueWithProtocol{obj_->client->protocol_, arg.ep_num, {tx_buf_.data() + tx_pos_, arg.protocol_size}, {}};
     } else if (progress == func_->inputs.size() + 1) {
         // send trigger
         return ContinueWithProtocol{obj_->client->protocol_, func_->ep_num, {}, {}};
     } else if (progress <= func_->inputs.size() + 1 + func_->outputs.size()) {
         // receive arg
-        auto arg = func_->outputs[progress - 2 - func_->inputs.size()];
+        auto& arg = func_->outputs[progress - 2 - func_->inputs.size()];
         return ContinueWithProtocol{obj_->client->protocol_, arg.ep_num, {}, {rx_buf_.data() + rx_pos_, arg.protocol_size}};
     } else if (progress == func_->inputs.size() + 2 + func_->outputs.size()) {
         // return data to application
@@ -692,3 +959,177 @@ std::variant<LegacyCallContext::ContinueWithApp, LegacyCallContext::ContinueWith
 
     return InternalError{};
 }
+
+
+LegacyBatch* LegacyObjectClient::start_batch() {
+    LegacyBatch* batch = batch_pool_.acquire();
+    batch->client_ = this;
+    batch->items_.clear();
+    batch->user_items_ = nullptr;
+    batch->user_callback_ = nullptr;
+    batch->user_ctx_ = nullptr;
+    return batch;
+}
+
+std::optional<Status> LegacyBatch::run(Callback<void, LegacyBatch*, Status> callback) {
+    status_ = pack(client_->protocol_->remote_features_ & PROTOCOL_FEATURE_BATCH);
+    if (status_ != kFibreOk) {
+        return status_;
+    }
+
+    FIBRE_LOG(D) << "starting batch of " << items_.size() << " items in " << packets_.size() << " requests";
+
+    // The packets must not move from here on because the protocol refers to
+    // them.
+    callback_ = callback;
+    n_pending_ = packets_.size();
+    starting_ = true;
+    for (auto& packet: packets_) {
+        client_->protocol_->start_endpoint_operation(packet.endpoint_id,
+                {packet.tx_buf, packet.tx_len}, {packet.rx_buf, packet.rx_len},
+                &packet.handle, MEMBER_CB(&packet, on_finished));
+    }
+    starting_ = false;
+
+    if (n_pending_) {
+        return std::nullopt;
+    }
+    callback_ = nullptr;
+    return status_;
+}
+
+// Encodes the items into as few packets as possible. Batch requests are
+// limited by the MTU in both directions, so a new packet is started once
+// either the request or the response would not fit.
+Status LegacyBatch::pack(bool use_batch_requests) {
+    LegacyProtocolPacketBased* protocol = client_->protocol_;
+    size_t mtu = std::max(std::min(protocol->tx_mtu_, sizeof(Packet::tx_buf)), (size_t)8);
+    size_t max_request_length = mtu - 8;
+    size_t max_response_length = mtu - 2;
+    packets_.clear();
+    outputs_.clear();
+
+    for (size_t i = 0; i < items_.size(); ++i) {
+        LegacyBatchItem& item = items_[i];
+        item.rx_end = item.rx_buf.begin();
+
+        if (!item.prop || item.prop->client != client_ || !item.prop->ep_num) {
+            FIBRE_LOG(W) << "batch item " << i << " is not a property of this device";
+            return kFibreInvalidArgument;
+        }
+
+        // Writes need exchange(), which only read/write properties implement.
+        // Buffers implement read() too but it takes an offset.
+        auto& functions = item.prop->intf->functions;
+        auto func = functions.find(item.tx_buf.size() ? "exchange" : "read");
+        if (func == functions.end() || func->second.outputs.size() != 1
+                || func->second.inputs.size() != (item.tx_buf.size() ? 1 : 0)) {
+            FIBRE_LOG(W) << "batch item " << i << " can't be accessed this way";
+            return kFibreInvalidArgument;
+        }
+
+        const LegacyFibreArg& out = func->second.outputs[0];
+        const LegacyFibreArg* in = func->second.inputs.size() ? &func->second.inputs[0] : nullptr;
+        outputs_.push_back(&out);
+        size_t tx_length = in ? in->protocol_size : 0;
+        size_t rx_length = item.rx_buf.size() ? out.protocol_size : 0;
+
+        if ((in && item.tx_buf.size() != in->app_size)
+                || (item.rx_buf.size() && item.rx_buf.size() < out.app_size)
+                || 4 + tx_length > max_request_length
+                || 1 + rx_length > max_response_length) {
+            FIBRE_LOG(W) << "batch item " << i << " has invalid buffer sizes";
+            return kFibreInvalidArgument;
+        }
+
+        Packet* packet = packets_.size() ? &packets_.back() : nullptr;
+        bool fits = packet && use_batch_requests
+                 && packet->tx_len + 4 + tx_length <= max_request_length
+                 && packet->rx_len + 1 + rx_length <= max_response_length;
+
+        if (!fits) {
+            packets_.emplace_back();
+            packet = &packets_.back();
+            packet->batch = this;
+            packet->first_item = i;
+            packet->n_items = 0;
+            packet->endpoint_id = use_batch_requests ? BATCH_ENDPOINT_ID : item.prop->ep_num;
+            packet->tx_len = 0;
+            packet->rx_len = 0;
+            packet->handle = 0;
+        }
+
+        uint8_t* pos = packet->tx_buf + packet->tx_len;
+        if (use_batch_requests) {
+            pos += write_le<uint16_t>(item.prop->ep_num, pos);
+            pos += write_le<uint8_t>(rx_length, pos);
+            pos += write_le<uint8_t>(tx_length, pos);
+            packet->rx_len += 1;
+        }
+        if (tx_length && !client_->transcode(item.tx_buf, {pos, tx_length}, in->app_codec, in->protocol_codec)) {
+            return kFibreInternalError;
+        }
+        packet->tx_len = pos + tx_length - packet->tx_buf;
+        packet->rx_len += rx_length;
+        packet->n_items++;
+    }
+
+    return kFibreOk;
+}
+
+void LegacyBatch::Packet::on_finished(EndpointOperationResult result) {
+    batch->on_packet_finished(this, result);
+}
+
+void LegacyBatch::on_packet_finished(Packet* packet, EndpointOperationResult result) {
+    packet->handle = 0;
+
+    if (result.status != kStreamOk) {
+        FIBRE_LOG(W) << "batch request failed with " << result.status;
+        if (status_ == kFibreOk) {
+            status_ = kFibreHostUnreachable;
+        }
+    } else {
+        cbufptr_t response = {packet->rx_buf, result.rx_end};
+
+        for (size_t i = packet->first_item; i < packet->first_item + packet->n_items; ++i) {
+            LegacyBatchItem& item = items_[i];
+            cbufptr_t value = response;
+
+            if (packet->endpoint_id == BATCH_ENDPOINT_ID) {
+                std::optional<uint8_t> length = read_le<uint8_t>(&response);
+                if (!length.has_value() || *length > response.size()) {
+                    FIBRE_LOG(W) << "batch response ends before item " << i;
+                    if (status_ == kFibreOk) {
+                        status_ = kFibreProtocolError;
+                    }
+                    break;
+                }
+                value = response.take(*length);
+                response = response.skip(*length);
+            }
+
+            if (!item.rx_buf.size()) {
+                continue;
+            }
+
+            const LegacyFibreArg& out = *outputs_[i];
+            if (value.size() != out.protocol_size
+                    || !client_->transcode(value, item.rx_buf.take(out.app_size), out.protocol_codec, out.app_codec)) {
+                FIBRE_LOG(W) << "invalid value for batch item " << i;
+                if (status_ == kFibreOk) {
+                    status_ = kFibreProtocolError;
+                }
+                continue;
+            }
+            item.rx_end = item.rx_buf.begin() + out.app_size;
+        }
+    }
+
+    if (--n_pending_ || starting_) {
+        return;
+    }
+
+    callback_.invoke_and_clear(this, status_);
+    client_->batch_pool_.release(this);
+}
@@ -9,8 +9,10 @@
 #include <fibre/callback.hpp>
 #include <fibre/cpp_utils.hpp> // std::variant and std::optional C++ backport
 #include <fibre/fibre.hpp>
+#include "object_pool.hpp"
 
-struct json_value;
+struct json_doc;
+struct json_node;
 
 namespace fibre {
 
@@ -36,16 +38,23 @@ struct LegacyFibreArg {
 };
 
 struct LegacyObject;
+class LegacyObjectClient;
+struct LegacyCallContext;
 
 struct LegacyFunction : Function {
-    LegacyFunction(std::vector<LegacyFibreArg> inputs, std::vector<LegacyFibreArg> outputs)
-        : ep_num(0), obj_(nullptr), inputs(inputs), outputs(outputs) {}
-    LegacyFunction(size_t ep_num, LegacyObject* obj, std::vector<LegacyFibreArg> inputs, std::vector<LegacyFibreArg> outputs)
-        : ep_num(ep_num), obj_(obj), inputs(inputs), outputs(outputs) {}
+    LegacyFunction(LegacyObjectClient* client, std::vector<LegacyFibreArg> inputs, std::vector<LegacyFibreArg> outputs)
+        : client_(client), ep_num(0), obj_(nullptr), inputs(std::move(inputs)), outputs(std::move(outputs)) {}
+    LegacyFunction(LegacyObjectClient* client, size_t ep_num, LegacyObject* obj, std::vector<LegacyFibreArg> inputs, std::vector<LegacyFibreArg> outputs)
+        : client_(client), ep_num(ep_num), obj_(obj), inputs(std::move(inputs)), outputs(std::move(outputs)) {}
 
     std::optional<CallBufferRelease>
     call(void**, CallBuffers, Callback<std::optional<CallBuffers>, CallBufferRelease>) final;
 
+    // Takes a call context from the client's pool and prepares it for a new
+    // call of this function. call() does this if the call handle is null.
+    LegacyCallContext* start_call();
+
+    LegacyObjectClient* client_;
     size_t ep_num; // 0 for property read/write/exchange functions
     LegacyObject* obj_; // null for property read/write/exchange functions (all other functions are associated with one object only)
     std::vector<LegacyFibreArg> inputs;
@@ -53,7 +62,6 @@ struct LegacyFunction : Function {
 };
 
 struct FibreInterface;
-class LegacyObjectClient;
 
 struct LegacyFibreAttribute {
     std::shared_ptr<LegacyObject> object;
@@ -87,6 +95,7 @@ struct LegacyCallContext {
     size_t tx_pos_ = 0;
     std::vector<uint8_t> rx_buf_;
     size_t rx_pos_ = 0;
+    std::vector<uint8_t> scratch_buf_; // target of transcoding, swapped with tx_buf_ or rx_buf_
 
     const uint8_t* app_tx_end_;
     bufptr_t app_rx_buf_;
@@ -96,6 +105,11 @@ struct LegacyCallContext {
 
     LegacyObject* obj_;
 
+    // Used by libfibre to store the application's callback, so that the call
+    // context is the only state per call.
+    void (*user_callback_)() = nullptr;
+    void* user_ctx_ = nullptr;
+
     std::optional<CallBufferRelease>
     resume_from_app(CallBuffers, Callback<std::optional<CallBuffers>, CallBufferRelease>);
 
@@ -117,12 +131,84 @@ struct LegacyCallContext {
     std::variant<ContinueWithApp, ContinueWithProtocol, InternalError> get_next_task(std::variant<ResultFromApp, ResultFromProtocol> continue_from);
 };
 
+// One property access of a LegacyBatch. The values use the application codec
+// of the property, i.e. the same encoding as the arguments of its read() and
+// exchange() functions.
+struct LegacyBatchItem {
+    LegacyObject* prop;
+    cbufptr_t tx_buf; // new value or empty to only read the property
+    bufptr_t rx_buf; // receives the value (the old value if tx_buf is not empty) or empty to only write the property
+    uint8_t* rx_end; // end of the received value, set when the batch finishes
+};
+
+/**
+ * @brief Reads and writes several properties of one remote peer with as few
+ * requests as possible.
+ *
+ * If the peer supports batch requests (PROTOCOL_FEATURE_BATCH), as many
+ * property accesses as fit into the MTU are packed into each request.
+ * Otherwise each property is accessed with its own request. All requests are
+ * queued on the protocol right away, so they are only limited by its window
+ * size.
+ *
+ * Batches are recycled through a pool of the object client like call
+ * contexts. Get one with LegacyObjectClient::start_batch(), add the items and
+ * then call run().
+ */
+struct LegacyBatch {
+    /**
+     * @brief Starts the property accesses.
+     *
+     * @returns The status if the batch finished synchronously (e.g. because of
+     *          an invalid item). In this case the callback is not invoked and
+     *          the caller must return the batch to the pool of the client.
+     *          Otherwise std::nullopt, and the callback is invoked once all
+     *          accesses finished. The batch goes back to the pool when the
+     *          callback returns.
+     */
+    std::optional<Status> run(Callback<void, LegacyBatch*, Status> callback);
+
+    LegacyObjectClient* client_;
+    std::vector<LegacyBatchItem> items_;
+
+    // Used by libfibre to store the application's items and callback
+    void* user_items_ = nullptr;
+    void (*user_callback_)() = nullptr;
+    void* user_ctx_ = nullptr;
+
+private:
+    // One request of the batch, holding a contiguous range of items_
+    struct Packet {
+        LegacyBatch* batch;
+        size_t first_item;
+        size_t n_items;
+        uint16_t endpoint_id; // BATCH_ENDPOINT_ID or the endpoint of the only item
+        uint8_t tx_buf[128];
+        size_t tx_len;
+        uint8_t rx_buf[128];
+        size_t rx_len;
+        EndpointOperationHandle handle;
+
+        void on_finished(EndpointOperationResult result);
+    };
+
+    Status pack(bool use_batch_requests);
+    void on_packet_finished(Packet* packet, EndpointOperationResult result);
+
+    std::vector<Packet> packets_;
+    std::vector<const LegacyFibreArg*> outputs_; // output argument of the function that accesses each item
+    size_t n_pending_ = 0;
+    bool starting_ = false;
+    Status status_ = kFibreOk;
+    Callback<void, LegacyBatch*, Status> callback_;
+};
+
 class LegacyObjectClient {
 public:
     LegacyObjectClient(LegacyProtocolPacketBased* protocol) : protocol_(protocol) {}
 
     void start(Callback<void, LegacyObjectClient*, std::shared_ptr<LegacyObject>> on_found_root_object, Callback<void, LegacyObjectClient*, std::shared_ptr<LegacyObject>> on_lost_root_object);
-    bool transcode(cbufptr_t src, bufptr_t dst, std::string src_codec, std::string dst_codec);
+    bool transcode(cbufptr_t src, bufptr_t dst, const std::string& src_codec, const std::string& dst_codec);
 
     // For direct access by LegacyProtocolPacketBased and libfibre.cpp
     uint16_t json_crc_ = 0;
@@ -131,17 +217,33 @@ public:
     std::vector<std::shared_ptr<LegacyObject>> objects_;
     void* user_data_; // used by libfibre to store the libfibre context pointer
     LegacyProtocolPacketBased* protocol_;
+    ObjectPool<LegacyCallContext> call_pool_; // contexts of finished calls, reused by new calls
+    ObjectPool<LegacyBatch> batch_pool_; // finished batches, reused by new batches
+
+    // Takes a batch from the pool and prepares it for new items.
+    LegacyBatch* start_batch();
+
+    // Parses the interface JSON and builds the object tree. The object tree
+    // doesn't refer to the JSON buffer. Returns false on failure.
+    bool load_json(cbufptr_t json);
 
 private:
-    std::shared_ptr<FibreInterface> get_property_interfaces(std::string codec, bool write);
-    std::shared_ptr<LegacyObject> load_object(json_value list_val);
+    std::shared_ptr<FibreInterface> get_property_interfaces(const std::string& codec, bool write);
+    std::shared_ptr<LegacyObject> load_object(const json_doc& doc, const json_node* list_val);
+    void receive_json_version();
+    void on_received_json_version(EndpointOperationResult result);
     void receive_more_json();
     void on_received_json(EndpointOperationResult result);
+    void receive_window_size();
+    void on_received_window_size(EndpointOperationResult result);
 
     Callback<void, LegacyObjectClient*, std::shared_ptr<LegacyObject>> on_found_root_object_;
     uint8_t tx_buf_[4] = {0xff, 0xff, 0xff, 0xff};
+    uint8_t json_version_buf_[4];
+    uint32_t json_version_id_ = 0; // 0 if the peer didn't report it
+    uint8_t window_size_buf_[8]; // window size and protocol features
     EndpointOperationHandle op_handle_ = 0;
-    std::vector<uint8_t> json_;
+    std::vector<uint8_t> json_; // only used while the JSON is received
     //std::vector<LegacyCallContext*> pending_calls_;
     std::unordered_map<std::string, std::shared_ptr<FibreInterface>> rw_property_interfaces;
     std::unordered_map<std::string, std::shared_ptr<FibreInterface>> ro_property_interfaces;
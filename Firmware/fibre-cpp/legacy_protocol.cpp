@@ -216,10 +216,11 @@ void LegacyProtocolPacketBased::start_endpoint_operation(uint16_t endpoint_id, c
         *handle = op.seqno | 0xffff0000;
     }
 
-    if (tx_handle_) {
+    if (tx_handle_ || pending_operations_.size() || expected_acks_.size() >= window_size_) {
         FIBRE_LOG(D) << "Endpoint operation already in progress. Enqueuing this one.";
 
-        // A TX operation is already in progress. Enqueue this one.
+        // A TX operation is already in progress or the remote peer can't take
+        // more requests. Enqueue this one.
         pending_operations_.push_back(op);
         return;
     }
@@ -232,7 +233,7 @@ void LegacyProtocolPacketBased::start_endpoint_operation(EndpointOperation op) {
     write_le<uint16_t>(op.endpoint_id | 0x8000, tx_buf_ + 2);
     write_le<uint16_t>(op.rx_buf.size(), tx_buf_ + 4);
 
-    size_t mtu = std::min(sizeof(tx_buf_), tx_mtu_);
+    size_t mtu = tx_mtu_;
     size_t n_payload = std::min(std::max(mtu, (size_t)8) - 8, op.tx_buf.size());
 
     memcpy(tx_buf_ + 6, op.tx_buf.begin(), n_payload);
@@ -242,12 +243,18 @@ void LegacyProtocolPacketBased::start_endpoint_operation(EndpointOperation op) {
 
     write_le<uint16_t>(trailer, tx_buf_ + 6 + n_payload);
 
-    expected_acks_[op.seqno] = op;
+    expected_acks_.push_back(op);
     transmitting_op_ = op.seqno | 0xffff0000;
     tx_channel_->start_write(cbufptr_t{tx_buf_}.take(8 + n_payload), &tx_handle_, MEMBER_CB(this, on_write_finished));
 }
 
 
+std::vector<LegacyProtocolPacketBased::EndpointOperation>::iterator LegacyProtocolPacketBased::find_expected_ack(uint16_t seqno) {
+    return std::find_if(expected_acks_.begin(), expected_acks_.end(), [&](EndpointOperation& op) {
+        return op.seqno == seqno;
+    });
+}
+
 void LegacyProtocolPacketBased::cancel_endpoint_operation(EndpointOperationHandle handle) {
     if (!handle) {
         return;
@@ -270,12 +277,12 @@ void LegacyProtocolPacketBased::cancel_endpoint_operation(EndpointOperationHandl
         pending_operations_.erase(it0);
     }
 
-    auto it1 = expected_acks_.find(seqno);
+    auto it1 = find_expected_ack(seqno);
 
     if (it1 != expected_acks_.end()) {
-        callback = it1->second.callback;
-        tx_end = it1->second.tx_buf.begin();
-        rx_end = it1->second.rx_buf.begin();
+        callback = it1->callback;
+        tx_end = it1->tx_buf.begin();
+        rx_end = it1->rx_buf.begin();
         expected_acks_.erase(it1);
     }
 
@@ -287,6 +294,7 @@ void LegacyProtocolPacketBased::cancel_endpoint_operation(EndpointOperationHandl
         // Either we're waiting for an ack on this operation or it has not yet
         // been sent. In both cases we can just complete immediately.
         callback.invoke_and_clear({kStreamCancelled, tx_end, rx_end});
+        start_next_write();
     }
 }
 
@@ -305,6 +313,15 @@ bool fibre::endpoint0_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* o
     } else if (*offset == 0xffffffff) {
         // If the offset is special value 0xFFFFFFFF, send back the JSON version ID instead
         return write_le<uint32_t>(json_version_id_, output_buffer);
+    } else if (*offset == 0xfffffffe) {
+        // If the offset is special value 0xFFFFFFFE, send back the number of
+        // requests that the client can keep in flight, followed by the
+        // supported protocol features. Older clients only ask for the former.
+        if (!write_le<uint32_t>(FIBRE_LEGACY_WINDOW_SIZE, output_buffer)) {
+            return false;
+        }
+        write_le<uint32_t>(PROTOCOL_FEATURE_BATCH, output_buffer);
+        return true;
     } else if (*offset >= embedded_json_length) {
         // Attempt to read beyond the buffer end - return empty response
         return true;
@@ -317,8 +334,61 @@ bool fibre::endpoint0_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* o
     }
 }
 
+// Executes the sub-requests of a batch request (see BATCH_ENDPOINT_ID).
+static void batch_handler(fibre::cbufptr_t* input_buffer, fibre::bufptr_t* output_buffer) {
+    while (input_buffer->size() >= 4) {
+        uint16_t endpoint_id = *read_le<uint16_t>(input_buffer);
+        uint8_t rx_length = *read_le<uint8_t>(input_buffer);
+        uint8_t tx_length = *read_le<uint8_t>(input_buffer);
+
+        if (!endpoint_id || endpoint_id == BATCH_ENDPOINT_ID
+                || tx_length > input_buffer->size()
+                || (size_t)rx_length + 1 > output_buffer->size()) {
+            FIBRE_LOG(W) << "dropping rest of batch at endpoint " << endpoint_id;
+            break;
+        }
+
+        fibre::cbufptr_t sub_input = input_buffer->take(tx_length);
+        fibre::bufptr_t sub_output = output_buffer->skip(1).take(rx_length);
+        fibre::endpoint_handler(endpoint_id, &sub_input, &sub_output);
+
+        size_t n_written = rx_length - sub_output.size();
+        *output_buffer->begin() = (uint8_t)n_written;
+        *input_buffer = input_buffer->skip(tx_length);
+        *output_buffer = output_buffer->skip(1 + n_written);
+    }
+}
+
 #endif
 
+void LegacyProtocolPacketBased::start_next_write() {
+    if (tx_handle_) {
+        return;
+    }
+
+    // TODO: should we prioritize the server or client side here?
+
+#if FIBRE_ENABLE_SERVER
+    if (n_responses_) {
+        // There is a write operation pending from the server side (i.e. an ack
+        // for a local endpoint operation).
+        transmitting_response_ = true;
+        tx_channel_->start_write({response_bufs_[response_head_], response_lengths_[response_head_]}, &tx_handle_, MEMBER_CB(this, on_write_finished));
+        return;
+    }
+#endif
+
+#if FIBRE_ENABLE_CLIENT
+    if (pending_operations_.size() > 0 && expected_acks_.size() < window_size_) {
+        // There is a write operation pending from the client side (i.e. an
+        // outgoing remote endpoint operation).
+        EndpointOperation op = pending_operations_[0];
+        pending_operations_.erase(pending_operations_.begin());
+        start_endpoint_operation(op);
+    }
+#endif
+}
+
 void LegacyProtocolPacketBased::on_write_finished(WriteResult result) {
     tx_handle_ = 0;
 
@@ -327,65 +397,51 @@ void LegacyProtocolPacketBased::on_write_finished(WriteResult result) {
         return;
     }
 
+#if FIBRE_ENABLE_SERVER
+    if (transmitting_response_) {
+        transmitting_response_ = false;
+        response_head_ = (response_head_ + 1) % FIBRE_LEGACY_WINDOW_SIZE;
+        n_responses_--;
+    }
+#endif
+
 #if FIBRE_ENABLE_CLIENT
     if (transmitting_op_) {
         uint16_t seqno = transmitting_op_ & 0xffff;
         transmitting_op_ = 0;
 
-        auto it = expected_acks_.find(seqno);
+        auto it = find_expected_ack(seqno);
 
         size_t n_sent = std::max((size_t)(result.end - tx_buf_), (size_t)8) - 8;
-        it->second.tx_buf = it->second.tx_buf.skip(n_sent);
-        it->second.tx_done = true;
+        it->tx_buf = it->tx_buf.skip(n_sent);
+        it->tx_done = true;
 
-        if (it->second.rx_done) {
+        if (it->rx_done) {
             // It's possible that the RX operation completes before the TX operation
-            auto op = it->second;
+            auto op = *it;
             expected_acks_.erase(it);
             op.callback.invoke_and_clear({kStreamOk, op.tx_buf.begin(), op.rx_buf.begin()});
         } else if (result.status != kStreamOk) {
             // If the TX task was a remote endpoint operation but didn't succeed
             // we terminate that operation
-            auto op = it->second;
+            auto op = *it;
             expected_acks_.erase(it);
             op.callback.invoke_and_clear({result.status, result.end, op.rx_buf.begin()});
         }
-
-        if (transmitting_op_) {
-            return;
-        }
     }
 #endif
 
-    // TODO: should we prioritize the server or client side here?
-
 #if FIBRE_ENABLE_SERVER
     if (rx_end_) {
-        // There is a write operation pending from the server side (i.e. an ack
-        // for a local endpoint operation).
+        // A request was held back because all response buffers were in use.
+        // One of them is free now.
         uint8_t* rx_end = rx_end_;
         rx_end_ = nullptr;
         on_read_finished({kStreamOk, rx_end});
-#if FIBRE_ENABLE_CLIENT
-        if (transmitting_op_) {
-            return;
-        }
-#endif
     }
 #endif
 
-#if FIBRE_ENABLE_CLIENT
-    if (pending_operations_.size() > 0) {
-        // There is a write operation pending from the client side (i.e. an
-        // outgoing remote endpoint operation).
-        EndpointOperation op = pending_operations_[0];
-        pending_operations_.erase(pending_operations_.begin());
-        start_endpoint_operation(op);
-        if (transmitting_op_) {
-            return;
-        }
-    }
-#endif
+    start_next_write();
 }
 
 void LegacyProtocolPacketBased::on_read_finished(ReadResult result) {
@@ -420,22 +476,25 @@ void LegacyProtocolPacketBased::on_read_finished(ReadResult result) {
 
 #if FIBRE_ENABLE_CLIENT
         
-        auto it = expected_acks_.find(*seq_no & 0x7fff);
+        auto it = find_expected_ack(*seq_no & 0x7fff);
 
         if (it == expected_acks_.end()) {
             FIBRE_LOG(W) << "received unexpected ACK: " << (*seq_no & 0x7fff);
         } else {
-            size_t n_copy = std::min((size_t)(result.end - rx_buf.begin()), it->second.rx_buf.size());
-            memcpy(it->second.rx_buf.begin(), rx_buf.begin(), n_copy);
-            it->second.rx_buf = it->second.rx_buf.skip(n_copy);
-            it->second.rx_done = true;
+            size_t n_copy = std::min((size_t)(result.end - rx_buf.begin()), it->rx_buf.size());
+            memcpy(it->rx_buf.begin(), rx_buf.begin(), n_copy);
+            it->rx_buf = it->rx_buf.skip(n_copy);
+            it->rx_done = true;
             FIBRE_LOG(T) << "received ACK: " << (*seq_no & 0x7fff);
 
             // It's possible that the RX operation completes before the TX operation
-            if (it->second.tx_done) {
-                auto op = it->second;
+            if (it->tx_done) {
+                auto op = *it;
                 expected_acks_.erase(it);
                 op.callback.invoke_and_clear({kStreamOk, op.tx_buf.begin(), op.rx_buf.begin()});
+
+                // The remote peer can take another request now
+                start_next_write();
             }
         }
 
@@ -459,10 +518,10 @@ void LegacyProtocolPacketBased::on_read_finished(ReadResult result) {
         bool expect_response = endpoint_id & 0x8000;
         endpoint_id &= 0x7fff;
 
-        if (expect_response && tx_handle_) {
-            // The operation expects a response but the output channel is still
-            // busy. Stop receiving for now. This function will be invoked again
-            // once the TX operation is finished.
+        if (n_responses_ >= FIBRE_LEGACY_WINDOW_SIZE) {
+            // All response buffers are waiting for the output channel. Stop
+            // receiving for now. This function will be invoked again once a
+            // TX operation is finished.
             rx_end_ = result.end;
             return;
         }
@@ -487,17 +546,26 @@ void LegacyProtocolPacketBased::on_read_finished(ReadResult result) {
         if (expected_response_length > tx_mtu_ - 2)
             expected_response_length = tx_mtu_ - 2;
 
+        size_t slot = (response_head_ + n_responses_) % FIBRE_LEGACY_WINDOW_SIZE;
+        uint8_t* tx_buf = response_bufs_[slot];
+
         fibre::cbufptr_t input_buffer{rx_buf.begin(), rx_buf.end() - 2};
-        fibre::bufptr_t output_buffer{tx_buf_ + 2, expected_response_length};
-        fibre::endpoint_handler(endpoint_id, &input_buffer, &output_buffer);
+        fibre::bufptr_t output_buffer{tx_buf + 2, expected_response_length};
+        if (endpoint_id == BATCH_ENDPOINT_ID) {
+            batch_handler(&input_buffer, &output_buffer);
+        } else {
+            fibre::endpoint_handler(endpoint_id, &input_buffer, &output_buffer);
+        }
 
-        // Send response
+        // Queue response. It is sent right away if the output channel is idle.
         if (expect_response) {
             size_t actual_response_length = expected_response_length - output_buffer.size() + 2;
-            write_le<uint16_t>(*seq_no | 0x8000, tx_buf_);
+            write_le<uint16_t>(*seq_no | 0x8000, tx_buf);
 
-            FIBRE_LOG(D) << "send packet: " << as_hex(cbufptr_t{tx_buf_, actual_response_length});
-            tx_channel_->start_write({tx_buf_, actual_response_length}, &tx_handle_, MEMBER_CB(this, on_write_finished));
+            FIBRE_LOG(D) << "send packet: " << as_hex(cbufptr_t{tx_buf, actual_response_length});
+            response_lengths_[slot] = actual_response_length;
+            n_responses_++;
+            start_next_write();
         }
 #else
         FIBRE_LOG(W) << "received request but server support is not compiled in";
@@ -533,12 +601,15 @@ void LegacyProtocolPacketBased::on_rx_tx_closed(StreamStatus status) {
     pending_operations_.clear();
 
     // Cancel all ongoing endpoint operations
-    for (auto& item: expected_acks_) {
-        if (item.second.callback) {
-            item.second.callback.invoke_and_clear({status, item.second.tx_buf.begin(), item.second.rx_buf.begin()});
+    for (size_t i = 0; i < expected_acks_.size(); ++i) {
+        auto op = expected_acks_[i];
+        if (op.callback) {
+            op.callback.invoke_and_clear({status, op.tx_buf.begin(), op.rx_buf.begin()});
         }
     }
     expected_acks_.clear();
+    window_size_ = 1;
+    remote_features_ = 0;
 
     // Report that the root object was lost
     if (client_.on_lost_root_object_ && client_.root_obj_) {
@@ -547,6 +618,15 @@ void LegacyProtocolPacketBased::on_rx_tx_closed(StreamStatus status) {
         client_.on_lost_root_object_.invoke(&client_, root_obj);
     }
 #endif
+
+#if FIBRE_ENABLE_SERVER
+    // Drop the responses that were not sent
+    response_head_ = 0;
+    n_responses_ = 0;
+    transmitting_response_ = false;
+    rx_end_ = nullptr;
+#endif
+
     on_stopped_.invoke_and_clear(this, status);
 }
 
@@ -560,6 +640,7 @@ void LegacyProtocolPacketBased::start(Callback<void, LegacyProtocolPacketBased*,
     rx_channel_->start_read(rx_buf_, &dummy, MEMBER_CB(this, on_read_finished));
 
 #if FIBRE_ENABLE_CLIENT
+    expected_acks_.reserve(FIBRE_LEGACY_WINDOW_SIZE);
     if (on_stopped_) {
         client_.start(on_found_root_object, on_lost_root_object);
     }
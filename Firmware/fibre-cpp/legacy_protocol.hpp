@@ -29,6 +29,30 @@ constexpr uint8_t CANONICAL_PREFIX = 0xAA;
 
 constexpr uint16_t PROTOCOL_VERSION = 1;
 
+// Number of responses that the server side can queue while the TX channel is
+// busy. Requests are only held back if all of them are in use.
+// The value is reported to clients when they read endpoint 0 at offset
+// 0xfffffffe and clients keep up to this many requests in flight. Peers that
+// don't support this get an empty response and stay at one request.
+#ifndef FIBRE_LEGACY_WINDOW_SIZE
+#define FIBRE_LEGACY_WINDOW_SIZE 4
+#endif
+
+// Optional protocol features. The server reports them after the window size
+// (see above). Peers that don't report them support none of them.
+constexpr uint32_t PROTOCOL_FEATURE_BATCH = 0x00000001;
+
+// Endpoint ID of batch requests, which carry several endpoint operations in a
+// single packet. The payload is a sequence of sub-requests:
+//   [endpoint_id: u16] [rx_length: u8] [tx_length: u8] [tx_length bytes]
+// The server executes them in order and responds with one entry per
+// sub-request:
+//   [length: u8] [length bytes]
+// It stops at the first sub-request that doesn't fit into the response.
+// Endpoint 0 can't be accessed from within a batch. Only servers that report
+// PROTOCOL_FEATURE_BATCH understand batch requests.
+constexpr uint16_t BATCH_ENDPOINT_ID = 0x7fff;
+
 
 class PacketWrapper : public AsyncStreamSink {
 public:
@@ -91,16 +115,17 @@ private:
 struct LegacyProtocolPacketBased {
 public:
     LegacyProtocolPacketBased(AsyncStreamSource* rx_channel, AsyncStreamSink* tx_channel, size_t tx_mtu)
-        : rx_channel_(rx_channel), tx_channel_(tx_channel), tx_mtu_(std::min(tx_mtu, sizeof(tx_buf_))) {}
+        : rx_channel_(rx_channel), tx_channel_(tx_channel), tx_mtu_(std::min(tx_mtu, kMaxPacketSize)) {}
+
+    static constexpr size_t kMaxPacketSize = 128;
 
     AsyncStreamSource* rx_channel_ = nullptr;
     AsyncStreamSink* tx_channel_ = nullptr;
     size_t tx_mtu_;
-    uint8_t tx_buf_[128];
-    uint8_t rx_buf_[128];
+    uint8_t rx_buf_[kMaxPacketSize];
 
     TransferHandle tx_handle_ = 0; // non-zero while a TX operation is in progress
-    uint8_t* rx_end_ = nullptr; // non-zero if an RX operation has finished but wasn't handled yet because the TX channel was busy
+    uint8_t* rx_end_ = nullptr; // non-zero if an RX operation has finished but wasn't handled yet because all response buffers were in use
     StreamStatus rx_status_ = kStreamOk; // non-ok if the RX process was terminated permanently.
                                          // This signals to the TX process that it should close
                                          // the protocol instance at the next possible instant.
@@ -112,6 +137,8 @@ public:
     void cancel_endpoint_operation(EndpointOperationHandle handle);
 
     LegacyObjectClient client_{this};
+    size_t window_size_ = 1; // Max number of operations that wait for an ACK. Set by client_ once the remote window size is known.
+    uint32_t remote_features_ = 0; // PROTOCOL_FEATURE_* flags of the remote peer. Set by client_ together with window_size_.
 #endif
 
 #if FIBRE_ENABLE_CLIENT
@@ -134,13 +161,26 @@ private:
     };
 
     void start_endpoint_operation(EndpointOperation op);
+    std::vector<EndpointOperation>::iterator find_expected_ack(uint16_t seqno);
 
     uint16_t outbound_seq_no_ = 0;
     std::vector<EndpointOperation> pending_operations_; // operations that are waiting for TX
     EndpointOperationHandle transmitting_op_ = 0; // operation that is in TX
-    std::unordered_map<uint16_t, EndpointOperation> expected_acks_; // operations that are waiting for RX
+    std::vector<EndpointOperation> expected_acks_; // operations that are waiting for RX (at most window_size_, so a linear search is fine)
+    uint8_t tx_buf_[kMaxPacketSize]; // request that is in TX
+#endif
+
+#if FIBRE_ENABLE_SERVER
+    // Ring buffer of responses that are waiting for TX. The oldest one is
+    // transmitted first. A server-only build has no other TX buffer.
+    uint8_t response_bufs_[FIBRE_LEGACY_WINDOW_SIZE][kMaxPacketSize];
+    size_t response_lengths_[FIBRE_LEGACY_WINDOW_SIZE];
+    size_t response_head_ = 0;
+    size_t n_responses_ = 0;
+    bool transmitting_response_ = false;
 #endif
 
+    void start_next_write();
     void on_write_finished(WriteResult result);
     void on_read_finished(ReadResult result);
     void on_rx_closed(StreamStatus status);
@@ -56,7 +56,7 @@ fibre::ChannelDiscoveryContext* from_c(LibFibreChannelDiscoveryCtx* ptr) {
 }
 
 
-static const struct LibFibreVersion libfibre_version = { 0, 1, 4 };
+static const struct LibFibreVersion libfibre_version = { 0, 1, 5 };
 
 class FIBRE_PRIVATE ExternalEventLoop final : public fibre::EventLoop {
 public:
@@ -487,19 +487,6 @@ LibFibreStatus libfibre_get_attribute(LibFibreObject* parent_obj, LibFibreAttrib
     return kFibreOk;
 }
 
-/**
- * @brief Inserts or removes the specified number of elements
- * @param delta: Positive value: insert elements, negative value: remove elements
- */
-void resize_at(std::vector<uint8_t>& vec, size_t pos, ssize_t delta) {
-    if (delta > 0) {
-        std::fill_n(std::inserter(vec, vec.begin() + pos), delta, 0);
-    } else {
-        vec.erase(std::min(vec.begin() + pos, vec.end()),
-                  std::min(vec.begin() + pos + -delta, vec.end()));
-    }
-}
-
 LibFibreStatus libfibre_call(LibFibreFunction* func, LibFibreCallContext** handle,
         LibFibreStatus status,
         const unsigned char* tx_buf, size_t tx_len,
@@ -517,19 +504,27 @@ LibFibreStatus libfibre_call(LibFibreFunction* func, LibFibreCallContext** handl
         return kFibreInvalidArgument;
     }
 
-    struct Ctx { libfibre_call_cb_t callback; void* ctx; };
-    struct Ctx* ctx = new Ctx{callback, cb_ctx};
+    // The application's callback is stored in the call context, which comes
+    // from a pool of the object client. This way a call doesn't use the heap.
+    auto legacy_func = static_cast<fibre::LegacyFunction*>(from_c(func)); // all functions are created by LegacyObjectClient
+    fibre::LegacyCallContext* ctx = reinterpret_cast<fibre::LegacyCallContext*>(*handle);
+    if (!ctx) {
+        ctx = legacy_func->start_call();
+        *handle = reinterpret_cast<LibFibreCallContext*>(ctx);
+    }
+    ctx->user_callback_ = reinterpret_cast<void(*)()>(callback);
+    ctx->user_ctx_ = cb_ctx;
 
     fibre::Callback<std::optional<fibre::CallBuffers>, fibre::CallBufferRelease> cb{
         [](void* ctx_, fibre::CallBufferRelease result) -> std::optional<fibre::CallBuffers> {
-            auto ctx = reinterpret_cast<Ctx*>(ctx_);
+            auto ctx = reinterpret_cast<fibre::LegacyCallContext*>(ctx_);
+            auto callback = reinterpret_cast<libfibre_call_cb_t>(ctx->user_callback_);
             const unsigned char* tx_buf;
             size_t tx_len;
             unsigned char* rx_buf;
             size_t rx_len;
-            auto status = ctx->callback(ctx->ctx, to_c(result.status), result.tx_end, result.rx_end, &tx_buf, &tx_len, &rx_buf, &rx_len);
+            auto status = callback(ctx->user_ctx_, to_c(result.status), result.tx_end, result.rx_end, &tx_buf, &tx_len, &rx_buf, &rx_len);
             if (status == kFibreBusy) {
-                delete ctx;
                 return std::nullopt;
             } else {
                 return fibre::CallBuffers{from_c(status), {tx_buf, tx_len}, {rx_buf, rx_len}};
@@ -537,18 +532,73 @@ LibFibreStatus libfibre_call(LibFibreFunction* func, LibFibreCallContext** handl
     }, ctx};
 
 
-    auto response = from_c(func)->call(from_c(handle), {from_c(status), {tx_buf, tx_len}, {rx_buf, rx_len}}, cb);
+    auto response = legacy_func->call(from_c(handle), {from_c(status), {tx_buf, tx_len}, {rx_buf, rx_len}}, cb);
 
     if (!response.has_value()) {
         return kFibreBusy;
     } else {
-        delete ctx;
         *tx_end = response->tx_end;
         *rx_end = response->rx_end;
         return to_c(response->status);
     }
 }
 
+LibFibreStatus libfibre_start_batch(LibFibreBatchItem* items, size_t n_items,
+        libfibre_batch_cb_t callback, void* cb_ctx) {
+    if ((n_items && !items) || !callback) {
+        FIBRE_LOG(E) << "invalid argument";
+        return kFibreInvalidArgument;
+    }
+    if (!n_items) {
+        return kFibreOk;
+    }
+
+    // The items are copied into a batch from the pool of the object client,
+    // so a batch doesn't use the heap.
+    auto first_prop = reinterpret_cast<fibre::LegacyObject*>(items[0].prop);
+    if (!first_prop) {
+        return kFibreInvalidArgument;
+    }
+    fibre::LegacyBatch* batch = first_prop->client->start_batch();
+    batch->user_items_ = items;
+    batch->user_callback_ = reinterpret_cast<void(*)()>(callback);
+    batch->user_ctx_ = cb_ctx;
+
+    for (size_t i = 0; i < n_items; ++i) {
+        if ((items[i].tx_len && !items[i].tx_buf) || (items[i].rx_len && !items[i].rx_buf)) {
+            FIBRE_LOG(E) << "invalid argument";
+            first_prop->client->batch_pool_.release(batch);
+            return kFibreInvalidArgument;
+        }
+        batch->items_.push_back({
+            reinterpret_cast<fibre::LegacyObject*>(items[i].prop),
+            {items[i].tx_buf, items[i].tx_len},
+            {items[i].rx_buf, items[i].rx_len},
+            items[i].rx_buf
+        });
+    }
+
+    fibre::Callback<void, fibre::LegacyBatch*, fibre::Status> cb{
+        [](void*, fibre::LegacyBatch* batch, fibre::Status status) {
+            auto items = reinterpret_cast<LibFibreBatchItem*>(batch->user_items_);
+            for (size_t i = 0; i < batch->items_.size(); ++i) {
+                items[i].rx_end = batch->items_[i].rx_end;
+            }
+            auto callback = reinterpret_cast<libfibre_batch_cb_t>(batch->user_callback_);
+            callback(batch->user_ctx_, to_c(status));
+    }, nullptr};
+
+    std::optional<fibre::Status> status = batch->run(cb);
+    if (!status.has_value()) {
+        return kFibreBusy;
+    }
+    for (size_t i = 0; i < n_items; ++i) {
+        items[i].rx_end = batch->items_[i].rx_end;
+    }
+    first_prop->client->batch_pool_.release(batch);
+    return to_c(*status);
+}
+
 void libfibre_start_tx(LibFibreTxStream* tx_stream,
         const uint8_t* tx_buf, size_t tx_len, on_tx_completed_cb_t on_completed,
         void* ctx) {
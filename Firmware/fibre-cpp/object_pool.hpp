@@ -0,0 +1,57 @@
+#ifndef __FIBRE_OBJECT_POOL_HPP
+#define __FIBRE_OBJECT_POOL_HPP
+
+#include <stddef.h>
+#include <vector>
+
+namespace fibre {
+
+/**
+ * @brief Recycles heap allocated objects of type T.
+ *
+ * Objects that are returned with release() are kept on a free list and handed
+ * out again by acquire(). The heap is therefore only used while the number of
+ * objects in use exceeds its previous maximum. Recycled objects are not
+ * reconstructed, so the caller must reset their state. This way an object can
+ * keep the capacity of its buffers.
+ *
+ * Not thread-safe.
+ */
+template<typename T>
+class ObjectPool {
+public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    ~ObjectPool() {
+        for (T* obj: free_) {
+            delete obj;
+        }
+    }
+
+    T* acquire() {
+        if (free_.empty()) {
+            n_allocated_++;
+            return new T();
+        }
+        T* obj = free_.back();
+        free_.pop_back();
+        return obj;
+    }
+
+    void release(T* obj) {
+        free_.push_back(obj);
+    }
+
+    size_t n_allocated() const { return n_allocated_; } // number of objects that were ever allocated
+    size_t n_free() const { return free_.size(); }
+
+private:
+    std::vector<T*> free_;
+    size_t n_allocated_ = 0;
+};
+
+}
+
+#endif // __FIBRE_OBJECT_POOL_HPP
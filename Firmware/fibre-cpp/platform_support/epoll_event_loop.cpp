@@ -5,8 +5,11 @@
 #include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <math.h>
 
 using namespace fibre;
 
@@ -39,9 +42,21 @@ bool EpollEventLoop::start(Callback<void> on_started) {
         ok = false;
     }
 
-    // Run for as long as there are callbacks pending posted or there's at least
-    // one file descriptor other than post_fd_ registerd.
-    while (pending_callbacks_.size() || (context_map_.size() > 1)) {
+    timers_.advance(get_current_tick());
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    bool timer_fd_ok = (timer_fd_ >= 0)
+            && register_event(timer_fd_, EPOLLIN, MEMBER_CB(this, run_timers));
+
+    if (!timer_fd_ok) {
+        FIBRE_LOG(E) << "failed to create a timer";
+        ok = false;
+    }
+
+    // Run for as long as there are callbacks pending posted, timers pending or
+    // there's at least one file descriptor other than post_fd_ and timer_fd_
+    // registerd.
+    while (pending_callbacks_.size() || !timers_.empty() || (context_map_.size() > 2)) {
         iterations_++;
 
         do {
@@ -74,6 +89,18 @@ bool EpollEventLoop::start(Callback<void> on_started) {
 
     FIBRE_LOG(D) << "epoll loop exited";
 
+    if ((timer_fd_ >= 0) && !deregister_event(timer_fd_)) {
+        FIBRE_LOG(E) << "deregister_event() failed";
+        ok = false;
+    }
+
+    if ((timer_fd_ >= 0) && close(timer_fd_) != 0) {
+        FIBRE_LOG(E) << "close() failed: " << sys_err();
+        ok = false;
+    }
+    timer_fd_ = -1;
+    armed_tick_ = UINT64_MAX;
+
     if ((post_fd_ >= 0) && !deregister_event(post_fd_)) {
         FIBRE_LOG(E) << "deregister_event() failed";
         ok = false;
@@ -175,13 +202,96 @@ bool EpollEventLoop::deregister_event(int event_fd) {
 }
 
 struct EventLoopTimer* EpollEventLoop::call_later(float delay, Callback<void> callback) {
-    FIBRE_LOG(E) << "not implemented"; // TODO: implement
-    return nullptr;
+    if (timer_fd_ < 0) {
+        FIBRE_LOG(E) << "not running";
+        return nullptr;
+    }
+
+    EventLoopTimer* timer = new EventLoopTimer();
+    // The current time is rounded up because a tick only starts to count
+    // once it has fully passed. Otherwise the timer could fire up to one tick
+    // early.
+    timer->expiry = get_current_tick(true) + (delay > 0.0f ? (uint64_t)ceilf(delay * 1000.0f) : 0);
+    timer->callback = callback;
+    timers_.insert(timer);
+
+    if (!update_timer_fd()) {
+        timers_.remove(timer);
+        delete timer;
+        return nullptr;
+    }
+
+    return timer;
 }
 
 bool EpollEventLoop::cancel_timer(EventLoopTimer* timer) {
-    FIBRE_LOG(E) << "not implemented"; // TODO: implement
-    return false;
+    if (!timer) {
+        FIBRE_LOG(E) << "invalid argument";
+        return false;
+    }
+
+    // timer_fd_ stays armed. If the cancelled timer was the earliest one the
+    // event loop just wakes up once without anything to do.
+    timers_.remove(timer);
+    delete timer;
+    return true;
+}
+
+/**
+ * @brief Returns the current time in ms (ticks of timers_), rounded down or,
+ * if round_up is true, up.
+ */
+uint64_t EpollEventLoop::get_current_tick(bool round_up) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t tick = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+    if (round_up && (now.tv_nsec % 1000000)) {
+        tick++;
+    }
+    return tick;
+}
+
+/**
+ * @brief Arms timer_fd_ for the earliest pending timer unless it is already
+ * armed for an earlier point in time.
+ */
+bool EpollEventLoop::update_timer_fd() {
+    uint64_t next_tick = timers_.next_tick();
+    if (next_tick >= armed_tick_) {
+        return true;
+    }
+
+    struct itimerspec spec = {
+        .it_interval = {0, 0},
+        .it_value = {(time_t)(next_tick / 1000), (long)(next_tick % 1000) * 1000000}
+    };
+
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        FIBRE_LOG(E) << "timerfd_settime() failed: " << sys_err();
+        return false;
+    }
+
+    armed_tick_ = next_tick;
+    return true;
+}
+
+void EpollEventLoop::run_timers(uint32_t) {
+    uint64_t val;
+    if (read(timer_fd_, &val, sizeof(val)) != sizeof(val)) {
+        FIBRE_LOG(D) << "timer fd not ready"; // can happen if the timer was re-armed in the meantime
+    }
+
+    armed_tick_ = UINT64_MAX;
+    timers_.advance(get_current_tick());
+
+    while (EventLoopTimer* timer = timers_.pop_expired()) {
+        timer->callback.invoke();
+        delete timer;
+    }
+
+    if (!update_timer_fd()) {
+        FIBRE_LOG(E) << "failed to re-arm timer";
+    }
 }
 
 void EpollEventLoop::run_callbacks(uint32_t) {
@@ -9,6 +9,7 @@
 //#include <algorithm>
 
 #include <fibre/event_loop.hpp>
+#include "timer_wheel.hpp"
 
 namespace fibre {
 
@@ -20,6 +21,10 @@ namespace fibre {
  * loop, that means register_event() and deregister_event() can be called from
  * within an event callback (which executes on the event loop thread), provided
  * those calls are properly synchronized with calls from other threads.
+ *
+ * Timers have a resolution of 1ms and are kept in a TimerWheel. A single
+ * timerfd is armed for the earliest pending timer, so starting and cancelling
+ * timers normally doesn't need a syscall.
  */
 class EpollEventLoop : public EventLoop {
 public:
@@ -46,9 +51,13 @@ private:
     };
 
     void run_callbacks(uint32_t);
+    void run_timers(uint32_t);
+    uint64_t get_current_tick(bool round_up = false);
+    bool update_timer_fd();
 
     int epoll_fd_ = -1;
     int post_fd_ = -1;
+    int timer_fd_ = -1;
     unsigned int iterations_ = 0;
 
     std::unordered_map<int, EventContext*> context_map_; // required to deregister callbacks
@@ -62,6 +71,9 @@ private:
 
     // Mutex to protect pending_callbacks_
     std::mutex pending_callbacks_mutex_;
+
+    TimerWheel timers_;
+    uint64_t armed_tick_ = UINT64_MAX; // tick for which timer_fd_ is armed
 };
 
 }
@@ -21,10 +21,6 @@ using namespace fibre;
 DEFINE_LOG_TOPIC(USB);
 USE_LOG_TOPIC(USB);
 
-// This probably has no noteworthy effect since we automatically restart
-// timed out operations anyway.
-constexpr unsigned int kBulkTimeoutMs = 10000;
-
 // Only relevant for platforms don't support hotplug detection and thus
 // need polling.
 constexpr unsigned int kPollingIntervalMs = 1000;
@@ -179,6 +175,7 @@ bool LibusbDiscoverer::deinit(int stage) {
         for (auto& dev: known_devices_) {
             libusb_unref_device(dev.second.dev);
         }
+        free_left_devices();
     }
 
     // FIXME: the libusb_hotplug_deregister_callback call will still trigger a
@@ -351,7 +348,11 @@ int LibusbDiscoverer::on_hotplug(struct libusb_device *dev,
                 libusb_close(it->second.handle);
             }
 
+            // The endpoints and channels are freed once all cancelled
+            // transfers were reported to the application.
+            left_devices_.push_back(it->second);
             known_devices_.erase(it);
+            on_endpoint_idle();
         }
 
         libusb_unref_device(dev);
@@ -500,25 +501,36 @@ void LibusbDiscoverer::consider_device(struct libusb_device *device, MyChannelDi
 
                 size_t mtu = SIZE_MAX;
 
+                // Each endpoint keeps several transfers in flight: the IN
+                // endpoint always has reads posted and writes to the OUT
+                // endpoint are queued back-to-back.
                 LibusbBulkInEndpoint* ep_in = new LibusbBulkInEndpoint();
-                if (libusb_ep_in && ep_in->init(this, my_dev.handle, libusb_ep_in->bEndpointAddress)) {
+                ReadAheadSource* rx_channel = nullptr;
+                if (libusb_ep_in && ep_in->init(this, my_dev.handle, libusb_ep_in->bEndpointAddress, FIBRE_USB_TRANSFER_COUNT)) {
                     my_dev.ep_in.push_back(ep_in);
                     mtu = std::min(mtu, (size_t)libusb_ep_in->wMaxPacketSize);
+                    rx_channel = new ReadAheadSource();
+                    my_dev.rx_channels.push_back(rx_channel);
+                    rx_channel->start(ep_in, FIBRE_USB_TRANSFER_COUNT, FIBRE_USB_TRANSFER_SIZE);
                 } else {
                     delete ep_in;
                     ep_in = nullptr;
                 }
 
                 LibusbBulkOutEndpoint* ep_out = new LibusbBulkOutEndpoint();
-                if (libusb_ep_out && ep_out->init(this, my_dev.handle, libusb_ep_out->bEndpointAddress)) {
+                WriteQueueSink* tx_channel = nullptr;
+                if (libusb_ep_out && ep_out->init(this, my_dev.handle, libusb_ep_out->bEndpointAddress, FIBRE_USB_TRANSFER_COUNT)) {
                     my_dev.ep_out.push_back(ep_out);
                     mtu = std::min(mtu, (size_t)libusb_ep_out->wMaxPacketSize);
+                    tx_channel = new WriteQueueSink();
+                    my_dev.tx_channels.push_back(tx_channel);
+                    tx_channel->start(ep_out, FIBRE_USB_TRANSFER_COUNT, FIBRE_USB_TRANSFER_SIZE);
                 } else {
                     delete ep_out;
                     ep_out = nullptr;
                 }
 
-                subscription->domain->add_channels({kFibreOk, ep_in, ep_out, mtu});
+                subscription->domain->add_channels({kFibreOk, rx_channel, tx_channel, mtu});
             }
         }
 
@@ -527,109 +539,166 @@ void LibusbDiscoverer::consider_device(struct libusb_device *device, MyChannelDi
     }
 }
 
+/**
+ * @brief Schedules the endpoints and channels of devices that left to be
+ * freed.
+ *
+ * This is deferred to the event loop because the endpoint that reports being
+ * idle is still on the call stack.
+ */
+void LibusbDiscoverer::on_endpoint_idle() {
+    if (!left_devices_.size()) {
+        return;
+    }
+    if (!event_loop_ || !event_loop_->post(MEMBER_CB(this, free_left_devices))) {
+        FIBRE_LOG(W) << "could not schedule freeing of USB endpoints";
+    }
+}
+
+void LibusbDiscoverer::free_left_devices() {
+    for (auto it = left_devices_.begin(); it != left_devices_.end(); ) {
+        bool idle = std::all_of(it->ep_in.begin(), it->ep_in.end(), [](LibusbBulkInEndpoint* ep) { return ep->is_idle(); })
+                 && std::all_of(it->ep_out.begin(), it->ep_out.end(), [](LibusbBulkOutEndpoint* ep) { return ep->is_idle(); });
+        if (!idle) {
+            ++it;
+            continue;
+        }
+        for (auto& ep: it->ep_in) { delete ep; }
+        for (auto& ep: it->ep_out) { delete ep; }
+        for (auto& channel: it->rx_channels) { delete channel; }
+        for (auto& channel: it->tx_channels) { delete channel; }
+        it = left_devices_.erase(it);
+    }
+}
 
 /* LibusbBulkEndpoint --------------------------------------------------------*/
 
 template<typename TRes>
-bool LibusbBulkEndpoint<TRes>::init(LibusbDiscoverer* parent, libusb_device_handle* handle, uint8_t endpoint_id) {
+bool LibusbBulkEndpoint<TRes>::init(LibusbDiscoverer* parent, libusb_device_handle* handle, uint8_t endpoint_id, size_t n_transfers) {
     parent_ = parent;
     handle_ = handle;
-    transfer_ = libusb_alloc_transfer(0);
     endpoint_id_ = endpoint_id;
+    transfers_.resize(std::max(n_transfers, (size_t)1));
+    for (auto& transfer: transfers_) {
+        transfer.ep = this;
+        transfer.transfer = libusb_alloc_transfer(0);
+        if (!transfer.transfer) {
+            FIBRE_LOG(E) << "libusb_alloc_transfer() failed";
+            return deinit(), false;
+        }
+    }
+    head_ = 0;
+    n_active_ = 0;
     return true;
 }
 
 template<typename TRes>
 bool LibusbBulkEndpoint<TRes>::deinit() {
-    if (completer_) {
-        FIBRE_LOG(E) << "Transfer on EP " << as_hex(endpoint_id_) << " still in progress. This is gonna be messy.";
+    deinitialized_ = true;
+
+    // Transfers that are still in progress are cancelled. They are freed once
+    // they were reported to the application.
+    for (size_t i = 0; i < transfers_.size(); ++i) {
+        Transfer& transfer = transfers_[(head_ + i) % transfers_.size()];
+        if (i >= n_active_) {
+            libusb_free_transfer(transfer.transfer);
+            transfer.transfer = nullptr;
+        } else if (!transfer.finished) {
+            libusb_cancel_transfer(transfer.transfer);
+        }
     }
-
-    libusb_free_transfer(transfer_);
-    transfer_ = nullptr;
     return true;
 }
 
 template<typename TRes>
 void LibusbBulkEndpoint<TRes>::start_transfer(bufptr_t buffer, TransferHandle* handle, Callback<void, TRes> completer) {
-    if (handle) {
-        *handle = reinterpret_cast<TransferHandle>(this);
-    }
-
-    if (completer_) {
-        FIBRE_LOG(E) << "transfer already in progress";
-        completer.invoke({kStreamError, nullptr});
+    if (n_active_ >= transfers_.size()) {
+        FIBRE_LOG(E) << "too many transfers in progress";
+        completer.invoke({kStreamError, buffer.begin()});
         return;
     }
 
-    if (!handle_) {
+    if (!handle_ || deinitialized_) {
         FIBRE_LOG(E) << "device not open";
-        completer.invoke({kStreamError, nullptr});
+        completer.invoke({kStreamError, buffer.begin()});
         return;
     }
 
+    Transfer* transfer = &transfers_[(head_ + n_active_) % transfers_.size()];
+    n_active_++;
+
+    if (handle) {
+        *handle = reinterpret_cast<TransferHandle>(transfer);
+    }
+
     auto direct_callback = [](struct libusb_transfer* transfer){
-        ((LibusbBulkEndpoint<TRes>*)transfer->user_data)->on_transfer_finished();
+        ((Transfer*)transfer->user_data)->on_finished();
     };
 
     // This callback is used if we start our own libusb thread
     // separate from the application's event loop thread
     auto indirect_callback = [](struct libusb_transfer* transfer){
-        auto ep = (LibusbBulkEndpoint<TRes>*)transfer->user_data;
-        ep->parent_->event_loop_->post(MEMBER_CB(ep, on_transfer_finished));
+        auto t = (Transfer*)transfer->user_data;
+        t->ep->parent_->event_loop_->post(MEMBER_CB(t, on_finished));
     };
 
+    // No timeout: a transfer that is restarted after a timeout would end up
+    // behind its successors. If the application wishes to have a timeout on
+    // the transfer it can just call cancel_transfer() after a while.
     //FIBRE_LOG(D) << "transfer of size " << buffer.size();
-    libusb_fill_bulk_transfer(transfer_, handle_, endpoint_id_,
+    libusb_fill_bulk_transfer(transfer->transfer, handle_, endpoint_id_,
         buffer.begin(), buffer.size(),
         parent_->using_sparate_libusb_thread_ ? indirect_callback : direct_callback,
-        this, kBulkTimeoutMs);
-    
-    completer_ = completer;
-    submit_transfer();
+        transfer, 0);
+
+    transfer->completer = completer;
+    transfer->finished = false;
+    submit_transfer(transfer);
 }
 
 template<typename TRes>
 void LibusbBulkEndpoint<TRes>::cancel_transfer(TransferHandle transfer_handle) {
-    if (!completer_) {
+    Transfer* transfer = reinterpret_cast<Transfer*>(transfer_handle);
+    if (!transfer || !transfer->completer || transfer->finished) {
         FIBRE_LOG(E) << "transfer not in progress";
         return;
     }
 
-    libusb_cancel_transfer(transfer_);
+    libusb_cancel_transfer(transfer->transfer);
 }
 
 template<typename TRes>
-void LibusbBulkEndpoint<TRes>::submit_transfer() {
-    int result = libusb_submit_transfer(transfer_);
+void LibusbBulkEndpoint<TRes>::submit_transfer(Transfer* transfer) {
+    int result = libusb_submit_transfer(transfer->transfer);
     if (LIBUSB_SUCCESS == result) {
         // ok
         FIBRE_LOG(T) << "started USB transfer on EP " << as_hex(endpoint_id_);
-    } else if (LIBUSB_ERROR_NO_DEVICE == result) {
-        FIBRE_LOG(W) << "couldn't start USB transfer on EP " << as_hex(endpoint_id_) << ": " << libusb_error_name(result);
-        completer_.invoke_and_clear({kStreamClosed, nullptr});
-    } else {
-        FIBRE_LOG(W) << "couldn't start USB transfer on EP " << as_hex(endpoint_id_) << ": " << libusb_error_name(result);
-        completer_.invoke_and_clear({kStreamError, nullptr});
+        return;
     }
+
+    FIBRE_LOG(W) << "couldn't start USB transfer on EP " << as_hex(endpoint_id_) << ": " << libusb_error_name(result);
+    transfer->finished = true;
+    transfer->result = {LIBUSB_ERROR_NO_DEVICE == result ? kStreamClosed : kStreamError, transfer->transfer->buffer};
+    complete_transfers();
 }
 
 template<typename TRes>
-void LibusbBulkEndpoint<TRes>::on_transfer_finished() {
-    // We ignore timeouts here and just retry. If the application wishes to have
-    // a timeout on the transfer it can just call cancel_transfer() after a while.
-    if (transfer_->status == LIBUSB_TRANSFER_TIMED_OUT) {
-        submit_transfer();
+void LibusbBulkEndpoint<TRes>::on_transfer_finished(Transfer* transfer) {
+    if (deinitialized_) {
+        transfer->finished = true;
+        transfer->result = {kStreamClosed, transfer->transfer->buffer};
+        complete_transfers();
         return;
     }
-    
+
     libusb_device* dev = libusb_get_device(handle_);
+    struct libusb_transfer* t = transfer->transfer;
 
     StreamStatus status;
 
-    if (transfer_->status == LIBUSB_TRANSFER_COMPLETED) {
+    if (t->status == LIBUSB_TRANSFER_COMPLETED) {
         status = kStreamOk;
-    } else if (transfer_->status == LIBUSB_TRANSFER_CANCELLED) {
+    } else if (t->status == LIBUSB_TRANSFER_CANCELLED) {
         status = kStreamCancelled;
     } else {
         // The error that we get on device removal tends to be inaccurate.
@@ -664,14 +733,15 @@ void LibusbBulkEndpoint<TRes>::on_transfer_finished() {
     }
 
     (status == kStreamError ? FIBRE_LOG(W) : FIBRE_LOG(T))
-        << "USB transfer on EP " << as_hex(endpoint_id_) << " finished with " << libusb_error_name(transfer_->status);
+        << "USB transfer on EP " << as_hex(endpoint_id_) << " finished with " << libusb_error_name(t->status);
 
     if (status == kStreamClosed) {
         handle_ = nullptr; // Ensure that no new transfer is started
     }
 
-    uint8_t* end = std::max(transfer_->buffer + transfer_->actual_length, transfer_->buffer);
-    completer_.invoke_and_clear({status, end});
+    transfer->finished = true;
+    transfer->result = {status, std::max(t->buffer + t->actual_length, t->buffer)};
+    complete_transfers();
     
     // If libusb does hotplug detection itself then we don't need to handle
     // device removal here. Libusb will call the corresponding hotplug callback.
@@ -682,3 +752,26 @@ void LibusbBulkEndpoint<TRes>::on_transfer_finished() {
         parent_->on_hotplug(dev, LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT);
     }
 }
+
+// Reports the finished transfers at the head of the ring buffer. A transfer
+// that finishes before its predecessor (e.g. because it was cancelled) is held
+// back until the predecessor finished.
+template<typename TRes>
+void LibusbBulkEndpoint<TRes>::complete_transfers() {
+    while (n_active_ && transfers_[head_].finished) {
+        Transfer& transfer = transfers_[head_];
+        head_ = (head_ + 1) % transfers_.size();
+        n_active_--;
+        transfer.finished = false;
+        if (deinitialized_) {
+            libusb_free_transfer(transfer.transfer);
+            transfer.transfer = nullptr;
+        }
+        // The completer may start a new transfer, which can reuse this slot
+        transfer.completer.invoke_and_clear(transfer.result);
+    }
+
+    if (deinitialized_ && !n_active_) {
+        parent_->on_endpoint_idle();
+    }
+}
@@ -4,12 +4,24 @@
 #include <fibre/event_loop.hpp>
 #include <fibre/async_stream.hpp>
 #include <fibre/channel_discoverer.hpp>
+#include "../stream_queue.hpp"
 
 #include <libusb.h>
 #include <thread>
 #include <vector>
 #include <unordered_map>
 
+// Number of transfers that are kept in flight on each USB bulk endpoint
+#ifndef FIBRE_USB_TRANSFER_COUNT
+#define FIBRE_USB_TRANSFER_COUNT 4
+#endif
+
+// Buffer size of each USB bulk transfer. This is the maximum size of a packet
+// on the channel.
+#ifndef FIBRE_USB_TRANSFER_SIZE
+#define FIBRE_USB_TRANSFER_SIZE 128
+#endif
+
 namespace fibre {
 
 class LibusbBulkInEndpoint;
@@ -50,6 +62,8 @@ private:
         struct libusb_device_handle* handle;
         std::vector<LibusbBulkInEndpoint*> ep_in;
         std::vector<LibusbBulkOutEndpoint*> ep_out;
+        std::vector<ReadAheadSource*> rx_channels;
+        std::vector<WriteQueueSink*> tx_channels;
     };
 
     bool deinit(int stage);
@@ -61,6 +75,8 @@ private:
     int on_hotplug(struct libusb_device *dev, libusb_hotplug_event event);
     void poll_devices_now();
     void consider_device(struct libusb_device *device, MyChannelDiscoveryContext* subscription);
+    void on_endpoint_idle();
+    void free_left_devices();
 
     EventLoop* event_loop_ = nullptr;
     bool using_sparate_libusb_thread_; // true on Windows. Initialized in init()
@@ -71,28 +87,51 @@ private:
     EventLoopTimer* device_polling_timer_;
     EventLoopTimer* event_loop_timer_ = nullptr;
     std::unordered_map<uint16_t, Device> known_devices_; // key: bus_number << 8 | dev_number
+    std::vector<Device> left_devices_; // devices that left but may still have transfers in progress
     std::vector<MyChannelDiscoveryContext*> subscriptions_;
 };
 
+/**
+ * @brief Bulk endpoint that can have several transfers in flight at the same
+ * time.
+ *
+ * Up to `n_transfers` transfers (as passed to init()) can be started before
+ * the first one finished. They are submitted to libusb right away, so the host
+ * controller can move on to the next transfer without waiting for the
+ * application. Transfers complete in the order in which they were started.
+ */
 template<typename TRes>
 class LibusbBulkEndpoint {
 public:
-    bool init(LibusbDiscoverer* parent, struct libusb_device_handle* handle, uint8_t endpoint_id);
+    bool init(LibusbDiscoverer* parent, struct libusb_device_handle* handle, uint8_t endpoint_id, size_t n_transfers);
     bool deinit();
+    bool is_idle() const { return n_active_ == 0; }
 
 protected:
     void start_transfer(bufptr_t buffer, TransferHandle* handle, Callback<void, TRes> completer);
     void cancel_transfer(TransferHandle transfer_handle);
 
 private:
-    void submit_transfer();
-    void on_transfer_finished();
+    struct Transfer {
+        LibusbBulkEndpoint* ep;
+        struct libusb_transfer* transfer;
+        Callback<void, TRes> completer;
+        bool finished;
+        TRes result;
+        void on_finished() { ep->on_transfer_finished(this); }
+    };
+
+    void submit_transfer(Transfer* transfer);
+    void on_transfer_finished(Transfer* transfer);
+    void complete_transfers();
 
     LibusbDiscoverer* parent_ = nullptr;
     struct libusb_device_handle* handle_ = nullptr;
     uint8_t endpoint_id_ = 0;
-    struct libusb_transfer* transfer_ = nullptr;
-    Callback<void, TRes> completer_ = nullptr;
+    std::vector<Transfer> transfers_; // ring buffer
+    size_t head_ = 0; // oldest transfer in progress
+    size_t n_active_ = 0; // number of transfers in progress (including finished ones that are waiting for their predecessor)
+    bool deinitialized_ = false;
 };
 
 class LibusbBulkInEndpoint final : public LibusbBulkEndpoint<ReadResult>, public AsyncStreamSource {
@@ -0,0 +1,204 @@
+#ifndef __FIBRE_TIMER_WHEEL_HPP
+#define __FIBRE_TIMER_WHEEL_HPP
+
+#include <fibre/callback.hpp>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace fibre {
+
+struct EventLoopTimer {
+    EventLoopTimer* prev = nullptr;
+    EventLoopTimer* next = nullptr;
+    uint64_t expiry = 0; // tick at which the timer expires
+    uint8_t level = 0;
+    uint8_t slot = 0;
+    Callback<void> callback;
+};
+
+/**
+ * @brief Hierarchical timer wheel with a resolution of one tick.
+ *
+ * Timers are kept in intrusive linked lists, one per slot, so insert() and
+ * remove() take constant time and don't allocate. Level 0 has one slot per
+ * tick, each higher level has slots that are 64 times wider. The timers of a
+ * slot are moved to the lower levels once the current tick reaches the start
+ * of the slot. Timers beyond the range of the top level (2^24 ticks) wait in
+ * its farthest slot and are re-inserted from there.
+ *
+ * A bitmap of non-empty slots per level makes it cheap to find the next tick
+ * at which something happens, so idle periods are skipped without iterating
+ * over every tick.
+ */
+class TimerWheel {
+public:
+    static constexpr size_t kLevels = 4;
+    static constexpr size_t kSlotBits = 6;
+    static constexpr size_t kSlots = 1 << kSlotBits;
+
+    /**
+     * @brief Adds a timer that expires at timer->expiry (or at the current
+     * tick if that is already in the past).
+     */
+    void insert(EventLoopTimer* timer) {
+        uint64_t expiry = timer->expiry > current_ ? timer->expiry : current_;
+        uint64_t delta = expiry - current_;
+
+        size_t level = 0;
+        while (level < kLevels - 1 && delta >> (kSlotBits * (level + 1))) {
+            level++;
+        }
+
+        uint64_t index = expiry >> (kSlotBits * level);
+        if (delta >> (kSlotBits * kLevels)) {
+            index = (current_ >> (kSlotBits * level)) + kSlots - 1;
+        }
+
+        timer->level = (uint8_t)level;
+        timer->slot = (uint8_t)(index & (kSlots - 1));
+        link(&slots_[level][timer->slot], timer);
+        occupied_[level] |= (uint64_t)1 << timer->slot;
+        n_pending_++;
+    }
+
+    /**
+     * @brief Removes a timer that was previously inserted and was not yet
+     * returned by pop_expired().
+     */
+    void remove(EventLoopTimer* timer) {
+        if (timer->level == kLevels) {
+            unlink(&expired_, timer);
+            return;
+        }
+        EventLoopTimer** head = &slots_[timer->level][timer->slot];
+        unlink(head, timer);
+        if (!*head) {
+            occupied_[timer->level] &= ~((uint64_t)1 << timer->slot);
+        }
+        n_pending_--;
+    }
+
+    /**
+     * @brief Advances the wheel up to and including the specified tick.
+     *
+     * Timers that expire in this interval can then be fetched with
+     * pop_expired().
+     */
+    void advance(uint64_t now) {
+        for (;;) {
+            uint64_t tick = next_tick();
+            if (tick > now || !n_pending_) {
+                break;
+            }
+            current_ = tick;
+
+            // Move the timers of all slots that start at this tick one level down
+            for (size_t level = kLevels - 1; level > 0; --level) {
+                if (tick & (((uint64_t)1 << (kSlotBits * level)) - 1)) {
+                    continue;
+                }
+                size_t slot = (tick >> (kSlotBits * level)) & (kSlots - 1);
+                EventLoopTimer* timer = take_slot(level, slot);
+                while (timer) {
+                    EventLoopTimer* next = timer->next;
+                    insert(timer);
+                    timer = next;
+                }
+            }
+
+            EventLoopTimer* timer = take_slot(0, tick & (kSlots - 1));
+            while (timer) {
+                EventLoopTimer* next = timer->next;
+                timer->level = kLevels;
+                link(&expired_, timer);
+                timer = next;
+            }
+
+            current_ = tick + 1;
+        }
+
+        if (current_ <= now) {
+            current_ = now + 1;
+        }
+    }
+
+    /**
+     * @brief Returns the next expired timer or nullptr.
+     */
+    EventLoopTimer* pop_expired() {
+        EventLoopTimer* timer = expired_;
+        if (timer) {
+            unlink(&expired_, timer);
+        }
+        return timer;
+    }
+
+    /**
+     * @brief Returns the earliest tick at which advance() has something to do
+     * or UINT64_MAX if no timers are pending.
+     */
+    uint64_t next_tick() const {
+        uint64_t result = UINT64_MAX;
+        for (size_t level = 0; level < kLevels; ++level) {
+            if (!occupied_[level]) {
+                continue;
+            }
+            size_t shift = kSlotBits * level;
+            uint64_t block = current_ >> shift;
+            // The slot of the current block was already handled unless the
+            // current tick is exactly at its start.
+            if (current_ & (((uint64_t)1 << shift) - 1)) {
+                block++;
+            }
+            size_t rotation = block & (kSlots - 1);
+            uint64_t rotated = (occupied_[level] >> rotation) | (rotation ? occupied_[level] << (kSlots - rotation) : 0);
+            uint64_t tick = (block + __builtin_ctzll(rotated)) << shift;
+            result = tick < result ? tick : result;
+        }
+        return result;
+    }
+
+    bool empty() const { return !n_pending_ && !expired_; }
+
+private:
+    static void link(EventLoopTimer** head, EventLoopTimer* timer) {
+        timer->prev = nullptr;
+        timer->next = *head;
+        if (*head) {
+            (*head)->prev = timer;
+        }
+        *head = timer;
+    }
+
+    static void unlink(EventLoopTimer** head, EventLoopTimer* timer) {
+        if (timer->prev) {
+            timer->prev->next = timer->next;
+        } else {
+            *head = timer->next;
+        }
+        if (timer->next) {
+            timer->next->prev = timer->prev;
+        }
+        timer->prev = timer->next = nullptr;
+    }
+
+    EventLoopTimer* take_slot(size_t level, size_t slot) {
+        EventLoopTimer* list = slots_[level][slot];
+        slots_[level][slot] = nullptr;
+        occupied_[level] &= ~((uint64_t)1 << slot);
+        for (EventLoopTimer* timer = list; timer; timer = timer->next) {
+            n_pending_--;
+        }
+        return list;
+    }
+
+    EventLoopTimer* slots_[kLevels][kSlots] = {};
+    uint64_t occupied_[kLevels] = {};
+    EventLoopTimer* expired_ = nullptr; // timers with level == kLevels
+    uint64_t current_ = 0; // next tick to be processed
+    size_t n_pending_ = 0; // number of timers in slots_
+};
+
+}
+
+#endif // __FIBRE_TIMER_WHEEL_HPP
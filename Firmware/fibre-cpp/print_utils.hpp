@@ -102,7 +102,7 @@ public:
 template<typename T>
 std::ostream& operator<<(std::ostream& stream, const HexPrinter<T>& printer) {
     // TODO: specialize for char
-    return stream << printer.to_string();
+    return stream << printer.str;
 }
 
 template<typename T>
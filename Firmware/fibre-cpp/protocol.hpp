@@ -5,6 +5,8 @@ see protocol.md for the protocol specification
 #ifndef __PROTOCOL_HPP
 #define __PROTOCOL_HPP
 
+#include <algorithm>
+#include <array>
 #include <functional>
 #include <limits>
 #include <cmath>
@@ -110,6 +112,27 @@ template<> struct Codec<endpoint_ref_t> {
             && SimpleSerializer<uint16_t, false>::write(value.json_crc, &(buffer->begin()), buffer->end());
     }
 };
+template<typename T, size_t N> struct Codec<std::array<T, N>> {
+    static std::optional<std::array<T, N>> decode(cbufptr_t* buffer) {
+        std::array<T, N> value;
+        for (size_t i = 0; i < N; ++i) {
+            std::optional<T> elem = Codec<T>::decode(buffer);
+            if (!elem.has_value()) {
+                return std::nullopt;
+            }
+            value[i] = *elem;
+        }
+        return value;
+    }
+    static bool encode(const std::array<T, N>& value, bufptr_t* buffer) {
+        for (size_t i = 0; i < N; ++i) {
+            if (!Codec<T>::encode(value[i], buffer)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
 }
 
 
@@ -306,5 +329,56 @@ struct Property<const T> {
     T(*getter_)(void*);
 };
 
+// Size in bytes of one chunk that is returned by a read operation on a Buffer.
+// This must fit into the smallest transport MTU (USB: 63 bytes minus the
+// 2 byte sequence number) and must match BUFFER_CHUNK_SIZE in
+// interface_generator.py.
+#define FIBRE_BUFFER_CHUNK_SIZE 60
+
+/**
+ * @brief Read-only view of an array which is transferred in chunks.
+ *
+ * A buffer maps to a single endpoint. Each request to this endpoint carries an
+ * offset (uint32) and the response contains the next kChunkLength elements
+ * starting at that offset. This makes reading large arrays much faster than
+ * fetching one element per request. Elements beyond the end of the buffer are
+ * returned as zero.
+ */
+template<typename T>
+struct Buffer {
+    static constexpr size_t kChunkLength = FIBRE_BUFFER_CHUNK_SIZE / sizeof(T);
+    using Chunk = std::array<T, kChunkLength>;
+
+    Buffer(void* ctx, T(*getter)(void*, uint32_t), uint32_t length)
+        : ctx_(ctx), getter_(getter), length_(length) {}
+    template<size_t N>
+    Buffer(const T (*array)[N])
+        : ctx_(const_cast<T*>(*array)), getter_([](void* ctx, uint32_t idx){ return ((const T*)ctx)[idx]; }), length_(N) {}
+    template<size_t N>
+    Buffer(const std::array<T, N>* array)
+        : ctx_(const_cast<T*>(array->data())), getter_([](void* ctx, uint32_t idx){ return ((const T*)ctx)[idx]; }), length_(N) {}
+    Buffer& operator*() { return *this; }
+    Buffer* operator->() { return this; }
+
+    Chunk read(uint32_t offset) const {
+        Chunk chunk{};
+        size_t n = offset < length_ ? std::min((size_t)(length_ - offset), kChunkLength) : 0;
+        for (size_t i = 0; i < n; ++i) {
+            chunk[i] = (*getter_)(ctx_, offset + i);
+        }
+        return chunk;
+    }
+
+    void* ctx_;
+    T(*getter_)(void*, uint32_t);
+    uint32_t length_;
+};
+
+namespace fibre {
+// Defined in the autogenerated endpoints.hpp. Returns a read accessor for the
+// float property referenced by endpoint_ref (false if it's not a float property).
+bool get_float_property(endpoint_ref_t endpoint_ref, Property<const float>* property);
+}
+
 
 #endif
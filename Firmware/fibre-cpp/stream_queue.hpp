@@ -0,0 +1,249 @@
+#ifndef __FIBRE_STREAM_QUEUE_HPP
+#define __FIBRE_STREAM_QUEUE_HPP
+
+#include <fibre/async_stream.hpp>
+#include <fibre/cpp_utils.hpp>
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+namespace fibre {
+
+/**
+ * @brief Keeps several read operations posted on an underlying source so that
+ * it never sits idle between two reads of the application.
+ *
+ * The underlying source must accept up to `n_transfers` concurrent
+ * start_read() calls and complete them in the order in which they were
+ * started (see LibusbBulkInEndpoint). Each of these reads goes into a buffer
+ * of this class. The application reads one completed buffer at a time, so
+ * every start_read() call returns the data of a single underlying read. If the
+ * application buffer is too small, the rest is returned by the next call.
+ *
+ * Cancelling a read of the application doesn't cancel the underlying reads, so
+ * no data is lost. The first read that fails on the underlying source (e.g.
+ * because the device was unplugged) is reported to the application once all
+ * data before it was read, and all subsequent reads fail with the same status.
+ *
+ * Only one read of the application can be in progress at a time.
+ */
+class ReadAheadSource : public AsyncStreamSource {
+public:
+    /**
+     * @brief Allocates the buffers and starts reading from the source.
+     * @param source: Must stay valid until all reads on it completed.
+     */
+    void start(AsyncStreamSource* source, size_t n_transfers, size_t transfer_size) {
+        source_ = source;
+        slots_.resize(std::max(n_transfers, (size_t)1));
+        for (auto& slot: slots_) {
+            slot.buf.resize(transfer_size);
+        }
+        head_ = 0;
+        n_done_ = 0;
+        n_posted_ = 0;
+        status_ = kStreamOk;
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            post();
+        }
+    }
+
+    void start_read(bufptr_t buffer, TransferHandle* handle, Callback<void, ReadResult> completer) final {
+        if (handle) {
+            *handle = reinterpret_cast<TransferHandle>(this);
+        }
+        if (completer_) {
+            completer.invoke({kStreamError, buffer.begin()});
+            return;
+        }
+        app_buf_ = buffer;
+        completer_ = completer;
+        deliver();
+    }
+
+    void cancel_read(TransferHandle) final {
+        completer_.invoke_and_clear({kStreamCancelled, app_buf_.begin()});
+    }
+
+    size_t n_posted() const { return n_posted_ - n_done_; } // number of reads in flight on the source
+    size_t n_buffered() const { return n_done_; } // number of completed reads not yet consumed by the application
+
+private:
+    struct Slot {
+        std::vector<uint8_t> buf;
+        TransferHandle handle = 0;
+        StreamStatus status = kStreamOk;
+        uint8_t* pos = nullptr; // next byte for the application
+        uint8_t* end = nullptr; // end of the received data
+    };
+
+    // Slots [head_, head_ + n_done_) hold completed reads and slots
+    // [head_ + n_done_, head_ + n_posted_) are in flight (indices modulo the
+    // number of slots).
+
+    void post() {
+        Slot& slot = slots_[(head_ + n_posted_) % slots_.size()];
+        n_posted_++;
+        source_->start_read({slot.buf.data(), slot.buf.size()}, &slot.handle, MEMBER_CB(this, on_read_finished));
+    }
+
+    void on_read_finished(ReadResult result) {
+        Slot& slot = slots_[(head_ + n_done_) % slots_.size()];
+        n_done_++;
+        slot.handle = 0;
+        slot.status = result.status;
+        slot.pos = slot.buf.data();
+        slot.end = result.status == kStreamOk ? result.end : slot.buf.data();
+        deliver();
+    }
+
+    void deliver() {
+        if (!completer_) {
+            return;
+        }
+        if (status_ != kStreamOk || !n_done_) {
+            if (status_ != kStreamOk) {
+                completer_.invoke_and_clear({status_, app_buf_.begin()});
+            }
+            return;
+        }
+
+        Slot& slot = slots_[head_];
+        if (slot.status != kStreamOk) {
+            status_ = slot.status;
+            completer_.invoke_and_clear({status_, app_buf_.begin()});
+            return;
+        }
+
+        size_t n_copy = std::min((size_t)(slot.end - slot.pos), app_buf_.size());
+        memcpy(app_buf_.begin(), slot.pos, n_copy);
+        slot.pos += n_copy;
+
+        // The completer is cleared before the slot is posted again because
+        // the source may complete the read right away.
+        Callback<void, ReadResult> completer = completer_;
+        completer_ = nullptr;
+        if (slot.pos == slot.end) {
+            head_ = (head_ + 1) % slots_.size();
+            n_done_--;
+            n_posted_--;
+            post();
+        }
+        completer.invoke({kStreamOk, app_buf_.begin() + n_copy});
+    }
+
+    AsyncStreamSource* source_ = nullptr;
+    std::vector<Slot> slots_;
+    size_t head_ = 0;
+    size_t n_done_ = 0;
+    size_t n_posted_ = 0;
+    StreamStatus status_ = kStreamOk; // status of the first failed read
+    bufptr_t app_buf_;
+    Callback<void, ReadResult> completer_;
+};
+
+/**
+ * @brief Lets the application queue writes back-to-back on an underlying sink.
+ *
+ * The underlying sink must accept up to `n_transfers` concurrent start_write()
+ * calls and complete them in the order in which they were started (see
+ * LibusbBulkOutEndpoint). start_write() copies the data (up to
+ * `transfer_size` bytes) into a free buffer, starts the write on the
+ * underlying sink and completes right away. Only if all buffers are in use,
+ * it completes once the oldest write on the underlying sink finished.
+ *
+ * Since writes complete before they reach the wire, a write that fails on the
+ * underlying sink is reported by the next start_write() call, and all
+ * subsequent writes fail with the same status.
+ *
+ * Only one write of the application can be in progress at a time.
+ */
+class WriteQueueSink : public AsyncStreamSink {
+public:
+    /**
+     * @brief Allocates the buffers.
+     * @param sink: Must stay valid until all writes on it completed.
+     */
+    void start(AsyncStreamSink* sink, size_t n_transfers, size_t transfer_size) {
+        sink_ = sink;
+        slots_.resize(std::max(n_transfers, (size_t)1));
+        for (auto& slot: slots_) {
+            slot.buf.resize(transfer_size);
+        }
+        head_ = 0;
+        n_busy_ = 0;
+        status_ = kStreamOk;
+    }
+
+    void start_write(cbufptr_t buffer, TransferHandle* handle, Callback<void, WriteResult> completer) final {
+        if (handle) {
+            *handle = reinterpret_cast<TransferHandle>(this);
+        }
+        if (completer_) {
+            completer.invoke({kStreamError, buffer.begin()});
+        } else if (status_ != kStreamOk) {
+            completer.invoke({status_, buffer.begin()});
+        } else if (n_busy_ == slots_.size()) {
+            app_buf_ = buffer;
+            completer_ = completer;
+        } else {
+            submit(buffer, completer);
+        }
+    }
+
+    void cancel_write(TransferHandle) final {
+        completer_.invoke_and_clear({kStreamCancelled, app_buf_.begin()});
+    }
+
+    size_t n_busy() const { return n_busy_; } // number of writes in flight on the sink
+
+private:
+    struct Slot {
+        std::vector<uint8_t> buf;
+        TransferHandle handle = 0;
+    };
+
+    // Slots [head_, head_ + n_busy_) are in flight (indices modulo the number
+    // of slots).
+
+    void submit(cbufptr_t buffer, Callback<void, WriteResult> completer) {
+        Slot& slot = slots_[(head_ + n_busy_) % slots_.size()];
+        size_t n_copy = std::min(buffer.size(), slot.buf.size());
+        memcpy(slot.buf.data(), buffer.begin(), n_copy);
+        n_busy_++;
+        sink_->start_write({slot.buf.data(), n_copy}, &slot.handle, MEMBER_CB(this, on_write_finished));
+        completer.invoke({kStreamOk, buffer.begin() + n_copy});
+    }
+
+    void on_write_finished(WriteResult result) {
+        slots_[head_].handle = 0;
+        head_ = (head_ + 1) % slots_.size();
+        n_busy_--;
+
+        if (result.status != kStreamOk && status_ == kStreamOk) {
+            status_ = result.status;
+        }
+
+        if (!completer_) {
+            // nothing to do
+        } else if (status_ != kStreamOk) {
+            completer_.invoke_and_clear({status_, app_buf_.begin()});
+        } else {
+            Callback<void, WriteResult> completer = completer_;
+            completer_ = nullptr;
+            submit(app_buf_, completer);
+        }
+    }
+
+    AsyncStreamSink* sink_ = nullptr;
+    std::vector<Slot> slots_;
+    size_t head_ = 0;
+    size_t n_busy_ = 0;
+    StreamStatus status_ = kStreamOk; // status of the first failed write
+    cbufptr_t app_buf_;
+    Callback<void, WriteResult> completer_;
+};
+
+}
+
+#endif // __FIBRE_STREAM_QUEUE_HPP
@@ -1,5 +1,43 @@
 from cantools.database import *
 from odrive.enums import *
+import argparse
+
+# Layout of the packed telemetry message (0x01E). This must match
+# <axis>.config.can.packed_telemetry on the ODrive. The default matches the
+# firmware defaults.
+default_packed_telemetry = 'POS_ESTIMATE:24:0.0001,VEL_ESTIMATE:24:0.0001,IQ_MEASURED:16:0.01'
+
+telemetry_units = {
+    TELEMETRY_SIGNAL_POS_ESTIMATE: 'rev',
+    TELEMETRY_SIGNAL_VEL_ESTIMATE: 'rev/s',
+    TELEMETRY_SIGNAL_POS_SETPOINT: 'rev',
+    TELEMETRY_SIGNAL_VEL_SETPOINT: 'rev/s',
+    TELEMETRY_SIGNAL_TORQUE_SETPOINT: 'Nm',
+    TELEMETRY_SIGNAL_IQ_SETPOINT: 'A',
+    TELEMETRY_SIGNAL_IQ_MEASURED: 'A',
+    TELEMETRY_SIGNAL_VBUS_VOLTAGE: 'V',
+    TELEMETRY_SIGNAL_IBUS: 'A',
+    TELEMETRY_SIGNAL_MOTOR_TEMPERATURE: 'degC',
+    TELEMETRY_SIGNAL_FET_TEMPERATURE: 'degC',
+}
+
+parser = argparse.ArgumentParser(description='Generates odrive-cansimple.dbc')
+parser.add_argument('--packed-telemetry', default=default_packed_telemetry,
+                    help='comma separated list of SIGNAL:bits:scale for the packed telemetry message (default: {})'.format(default_packed_telemetry))
+args = parser.parse_args()
+
+def packed_telemetry_signals(layout, receivers):
+    signals = []
+    start = 0
+    for entry in layout.split(','):
+        name, bits, scale = entry.split(':')
+        bits, scale = int(bits), float(scale)
+        if start + bits > 64:
+            break # the firmware leaves out slots that don't fit
+        signal = globals()['TELEMETRY_SIGNAL_' + name.upper()]
+        signals.append(can.Signal(name.title(), start, bits, is_signed=True, scale=scale, receivers=receivers, unit=telemetry_units[signal]))
+        start += bits
+    return signals, (start + 7) // 8
 
 msgList = []
 nodes = [can.Node('Master')]
@@ -177,6 +215,12 @@ for axisID in range(0, 8):
         0x01D, "Get_Controller_Error", 8, [controllerError], senders=[newNode.name]
     )
 
+    # 0x01E - Packed Telemetry
+    packedSignals, packedLength = packed_telemetry_signals(args.packed_telemetry, ['Master'])
+    packedTelemetryMsg = can.Message(
+        0x01E, "Get_Packed_Telemetry", packedLength, packedSignals, senders=[newNode.name]
+    )
+
     axisMsgs = [
         heartbeatMsg,
         motorErrorMsg,
@@ -205,6 +249,7 @@ for axisID in range(0, 8):
         setVelGainsMsg,
         getADCVoltageMsg,
         controllerErrorMsg,
+        packedTelemetryMsg,
     ]
 
     masterMsgs = [
@@ -6,6 +6,7 @@ import jinja2
 import jsonschema
 import re
 import argparse
+import binascii
 import sys
 from collections import OrderedDict
 
@@ -65,6 +66,7 @@ definitions:
         properties:
           type: {"$ref": "#/definitions/intf_or_val_type"}
           c_name: {"type": string}
+          c_persist_if: {"type": string}
           unit: {"type": string}
           doc: {"type": string}
         additionalProperties: false
@@ -242,7 +244,11 @@ def regularize_attribute(parent, name, elem, c_is_class):
         elem['c_getter'] = elem.get('c_getter', elem['c_name'])
         elem['c_setter'] = elem.get('c_setter', elem['c_name'] + ' = ')
 
-    if isinstance(elem['type'], str) and elem['type'].startswith('readonly '):
+    if isinstance(elem['type'], str) and elem['type'].startswith('readonly ') and elem['type'].endswith('[]'):
+        elem['typeargs']['fibre.Buffer.type'] = elem['type'][len('readonly '):-len('[]')]
+        elem['type'] = InterfaceRefElement(parent.fullname, None, 'fibre.Buffer', elem['typeargs'])
+        elem.pop('c_setter', None)
+    elif isinstance(elem['type'], str) and elem['type'].startswith('readonly '):
         elem['typeargs']['fibre.Property.mode'] = 'readonly'
         elem['typeargs']['fibre.Property.type'] = elem['type'][len('readonly '):]
         elem['type'] = InterfaceRefElement(parent.fullname, None, 'fibre.Property', elem['typeargs'])
@@ -282,6 +288,8 @@ class InterfaceRefElement():
         typeargs = self._typeargs
         if 'fibre.Property.type' in typeargs:
             typeargs['fibre.Property.type'] = resolve_valuetype(self._scope, typeargs['fibre.Property.type'])
+        if 'fibre.Buffer.type' in typeargs:
+            typeargs['fibre.Buffer.type'] = resolve_valuetype(self._scope, typeargs['fibre.Buffer.type'])
 
         scope = self._scope.split('.')
         for probe_scope in [join_name(*scope[:(len(scope)-i)]) for i in range(len(scope)+1)]:
@@ -371,6 +379,41 @@ class PropertyInterfaceElement(InterfaceElement):
 
         interfaces[fullname] = self # TODO: not good to write to a global here
 
+class BufferInterfaceElement(InterfaceElement):
+    def __init__(self, name, fullname, value_type):
+        self.name = name
+        self.fullname = fullname
+        self.purename = 'fibre.Buffer'
+        self.c_name = 'Buffer<' + value_type['c_name'] + '>'
+        self.value_type = value_type
+        self.chunk_length = BUFFER_CHUNK_SIZE // codec_sizes[map_to_fibre01_type(value_type)]
+        self.builtin = True
+        self.attributes = OrderedDict()
+        self.functions = OrderedDict()
+        chunk_type = {
+            'builtin': True,
+            'name': value_type['name'] + '[' + str(self.chunk_length) + ']',
+            'fullname': value_type['fullname'] + '[' + str(self.chunk_length) + ']',
+            'c_name': self.c_name + '::Chunk',
+        }
+        self.functions['read'] = {
+            'name': 'read',
+            'fullname': join_name(fullname, 'read'),
+            'in': OrderedDict([('obj', {'name': 'obj', 'type': {'c_name': self.c_name}}), ('offset', {'name': 'offset', 'type': value_types['uint32']})]),
+            'out': OrderedDict([('data', {'name': 'data', 'type': chunk_type})]),
+        }
+
+        interfaces[fullname] = self # TODO: not good to write to a global here
+
+def make_buffer_type(typeargs):
+    value_type = resolve_valuetype('', typeargs['fibre.Buffer.type'])
+    name = 'Buffer<' + value_type['fullname'] + '>'
+    fullname = join_name('fibre', name)
+    if fullname in interfaces:
+        return interfaces[fullname]
+    else:
+        return BufferInterfaceElement(name, fullname, value_type)
+
 def make_property_type(typeargs):
     value_type = resolve_valuetype('', typeargs['fibre.Property.type'])
     mode = typeargs.get('fibre.Property.mode', 'readwrite')
@@ -382,7 +425,17 @@ def make_property_type(typeargs):
         return PropertyInterfaceElement(name, fullname, mode, value_type)
 
 generics = {
-    'fibre.Property': make_property_type # TODO: improve generic support
+    'fibre.Property': make_property_type, # TODO: improve generic support
+    'fibre.Buffer': make_buffer_type
+}
+
+# Number of bytes returned by one read operation on a fibre.Buffer. Must match
+# FIBRE_BUFFER_CHUNK_SIZE in fibre-cpp/protocol.hpp.
+BUFFER_CHUNK_SIZE = 60
+
+codec_sizes = {
+    'bool': 1, 'int8': 1, 'uint8': 1, 'int16': 2, 'uint16': 2,
+    'int32': 4, 'uint32': 4, 'int64': 8, 'uint64': 8, 'float': 4
 }
 
 def regularize_valuetype(path, name, elem):
@@ -475,6 +528,23 @@ def generate_endpoint_for_property(prop, attr_bindto, idx):
     }
     return endpoint, endpoint_definition
 
+def generate_endpoint_for_buffer(prop, attr_bindto, idx):
+    buffer_intf = interfaces[prop['type'].fullname]
+
+    endpoint = {
+        'id': idx,
+        'function': buffer_intf.functions['read'],
+        'in_bindings': OrderedDict([('obj', attr_bindto)]),
+        'out_bindings': OrderedDict()
+    }
+    endpoint_definition = {
+        'name': prop['name'],
+        'id': idx,
+        'type': map_to_fibre01_type(buffer_intf.value_type) + '[' + str(buffer_intf.chunk_length) + ']',
+        'access': 'r',
+    }
+    return endpoint, endpoint_definition
+
 def generate_endpoint_table(intf, bindto, idx):
     """
     Generates a Fibre v0.1 endpoint table for a given interface.
@@ -495,6 +565,12 @@ def generate_endpoint_table(intf, bindto, idx):
             endpoints.append(endpoint)
             endpoint_definitions.append(endpoint_definition)
             cnt += 1
+        elif prop['type'].fullname.startswith('fibre.Buffer<'):
+            # Buffers also resolve to one single endpoint
+            endpoint, endpoint_definition = generate_endpoint_for_buffer(prop, attr_bindto, idx + cnt)
+            endpoints.append(endpoint)
+            endpoint_definitions.append(endpoint_definition)
+            cnt += 1
         else:
             inner_endpoints, inner_endpoint_definitions, inner_cnt = generate_endpoint_table(prop['type'], attr_bindto, idx + cnt)
             endpoints += inner_endpoints
@@ -714,6 +790,37 @@ def tokenize(text, interface, interface_transform, value_type_transform, attribu
 
     return re.sub(r'`([A-Za-z0-9\.:_]+)`', token_transform, text)
 
+def get_config_fields(intf, c_prefix='', path_prefix=''):
+    """
+    Returns the data members of a config interface that make up its persistent
+    state, including the members of nested interfaces.
+
+    Each field is identified by a 16-bit tag that is derived from its path
+    (e.g. "anticogging.pre_calibrated"), so fields can be added, removed and
+    reordered without invalidating the stored configuration.
+    Attributes with a custom getter are skipped because they don't map to a
+    member variable.
+    An attribute with a `c_persist_if` expression (in terms of `obj`, the
+    top-level config object) is only stored while the expression is true.
+    """
+    fields = []
+    for name, attr in intf.get_all_attributes().items():
+        path = path_prefix + name
+        c_expr = c_prefix + attr['c_name']
+        if attr['type'].fullname.startswith('fibre.Property<') or attr['type'].fullname.startswith('fibre.Buffer<'):
+            if attr.get('c_getter', attr['c_name']) == attr['c_name']:
+                fields.append({'tag': binascii.crc_hqx(path.encode('ascii'), 0), 'path': path, 'c_expr': c_expr, 'c_persist_if': attr.get('c_persist_if', None)})
+        elif isinstance(attr['type'], InterfaceElement) and not attr['type'].get_all_functions():
+            fields += get_config_fields(attr['type'], c_expr + '.', path + '.')
+
+    if not path_prefix:
+        tags = {}
+        for field in fields:
+            if field['tag'] in tags:
+                raise Exception('the config fields {} and {} of {} have the same tag. Rename one of them.'.format(tags[field['tag']], field['path'], intf.fullname))
+            tags[field['tag']] = field['path']
+    return fields
+
 def html_escape(text):
     import html
     return html.escape(str(text))
@@ -730,6 +837,7 @@ env.filters['tokenize'] = tokenize
 env.filters['html_escape'] = html_escape
 env.filters['diagonalize'] = lambda lst: [lst[:i + 1] for i in range(len(lst))]
 env.filters['debug'] = lambda x: print(x)
+env.filters['config_fields'] = get_config_fields
 
 template = env.from_string(template_file.read())
 
@@ -97,8 +97,10 @@ def restore_config(device, filename, logger):
     if errors:
         logger.warn("Some of the configuration could not be restored.")
     
+    # Reboot so that settings which are only applied at startup take effect
     try:
         device.save_configuration()
+        device.reboot()
     except fibre.libfibre.ObjectLostError:
-        pass # Saving configuration makes the device reboot
+        pass # the device disconnects when it reboots
     logger.info("Configuration restored.")
@@ -47,6 +47,31 @@ AXIS_STATE_HOMING                        = 11
 AXIS_STATE_ENCODER_HALL_POLARITY_CALIBRATION = 12
 AXIS_STATE_ENCODER_HALL_PHASE_CALIBRATION = 13
 
+# ODrive.Axis.TelemetrySignal
+TELEMETRY_SIGNAL_NONE                    = 0
+TELEMETRY_SIGNAL_POS_ESTIMATE            = 1
+TELEMETRY_SIGNAL_VEL_ESTIMATE            = 2
+TELEMETRY_SIGNAL_POS_SETPOINT            = 3
+TELEMETRY_SIGNAL_VEL_SETPOINT            = 4
+TELEMETRY_SIGNAL_TORQUE_SETPOINT         = 5
+TELEMETRY_SIGNAL_IQ_SETPOINT             = 6
+TELEMETRY_SIGNAL_IQ_MEASURED             = 7
+TELEMETRY_SIGNAL_VBUS_VOLTAGE            = 8
+TELEMETRY_SIGNAL_IBUS                    = 9
+TELEMETRY_SIGNAL_MOTOR_TEMPERATURE       = 10
+TELEMETRY_SIGNAL_FET_TEMPERATURE         = 11
+
+# ODrive.Oscilloscope.CaptureState
+CAPTURE_STATE_IDLE                       = 0
+CAPTURE_STATE_ARMED                      = 1
+CAPTURE_STATE_TRIGGERED                  = 2
+CAPTURE_STATE_DONE                       = 3
+
+# ODrive.Oscilloscope.TriggerEdge
+TRIGGER_EDGE_RISING                      = 0
+TRIGGER_EDGE_FALLING                     = 1
+TRIGGER_EDGE_BOTH                        = 2
+
 # ODrive.Encoder.Mode
 ENCODER_MODE_INCREMENTAL                 = 0
 ENCODER_MODE_HALL                        = 1
@@ -73,6 +98,12 @@ INPUT_MODE_TRAP_TRAJ                     = 5
 INPUT_MODE_TORQUE_RAMP                   = 6
 INPUT_MODE_MIRROR                        = 7
 INPUT_MODE_TUNING                        = 8
+INPUT_MODE_SCURVE_TRAJ                   = 9
+INPUT_MODE_PVT                           = 10
+
+# ODrive.Controller.AnticoggingMode
+ANTICOGGING_MODE_TABLE                   = 0
+ANTICOGGING_MODE_HARMONICS               = 1
 
 # ODrive.Motor.MotorType
 MOTOR_TYPE_HIGH_CURRENT                  = 0
@@ -205,6 +236,28 @@ class AxisState(enum.Enum):
     HOMING                                   = 11
     ENCODER_HALL_POLARITY_CALIBRATION        = 12
     ENCODER_HALL_PHASE_CALIBRATION           = 13
+class TelemetrySignal(enum.Enum):
+    NONE                                     = 0
+    POS_ESTIMATE                             = 1
+    VEL_ESTIMATE                             = 2
+    POS_SETPOINT                             = 3
+    VEL_SETPOINT                             = 4
+    TORQUE_SETPOINT                          = 5
+    IQ_SETPOINT                              = 6
+    IQ_MEASURED                              = 7
+    VBUS_VOLTAGE                             = 8
+    IBUS                                     = 9
+    MOTOR_TEMPERATURE                        = 10
+    FET_TEMPERATURE                          = 11
+class CaptureState(enum.Enum):
+    IDLE                                     = 0
+    ARMED                                    = 1
+    TRIGGERED                                = 2
+    DONE                                     = 3
+class TriggerEdge(enum.Enum):
+    RISING                                   = 0
+    FALLING                                  = 1
+    BOTH                                     = 2
 class EncoderMode(enum.Enum):
     INCREMENTAL                              = 0
     HALL                                     = 1
@@ -229,6 +282,11 @@ class InputMode(enum.Enum):
     TORQUE_RAMP                              = 6
     MIRROR                                   = 7
     TUNING                                   = 8
+    SCURVE_TRAJ                              = 9
+    PVT                                      = 10
+class AnticoggingMode(enum.Enum):
+    TABLE                                    = 0
+    HARMONICS                                = 1
 class MotorType(enum.Enum):
     HIGH_CURRENT                             = 0
     GIMBAL                                   = 2
@@ -1,4 +1,4 @@
 
 from .utils import Event, Logger, TimeoutError
 from .shell import launch_shell
-from .libfibre import Domain, ObjectLostError
+from .libfibre import Domain, ObjectLostError, read_properties, write_properties
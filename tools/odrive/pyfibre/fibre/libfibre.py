@@ -10,6 +10,7 @@ import concurrent
 import threading
 import time
 import platform
+import re
 from .utils import Logger, Event
 import sys
 
@@ -100,6 +101,7 @@ OnFunctionRemovedSignature = CFUNCTYPE(None, c_void_p, c_void_p)
 OnCallCompletedSignature = CFUNCTYPE(c_int, c_void_p, c_int, c_void_p, c_void_p, POINTER(c_void_p), POINTER(c_size_t), POINTER(c_void_p), POINTER(c_size_t))
 OnTxCompletedSignature = CFUNCTYPE(None, c_void_p, c_void_p, c_int, c_void_p)
 OnRxCompletedSignature = CFUNCTYPE(None, c_void_p, c_void_p, c_int, c_void_p)
+OnBatchCompletedSignature = CFUNCTYPE(None, c_void_p, c_int)
 
 kFibreOk = 0
 kFibreBusy = 1
@@ -129,6 +131,16 @@ class LibFibreEventLoop(Structure):
         ("cancel_timer", CancelTimerSignature),
     ]
 
+class LibFibreBatchItem(Structure):
+    _fields_ = [
+        ("prop", c_void_p),
+        ("tx_buf", c_void_p),
+        ("tx_len", c_size_t),
+        ("rx_buf", c_void_p),
+        ("rx_len", c_size_t),
+        ("rx_end", c_void_p),
+    ]
+
 libfibre_get_version = lib.libfibre_get_version
 libfibre_get_version.argtypes = []
 libfibre_get_version.restype = POINTER(LibFibreVersion)
@@ -173,6 +185,13 @@ libfibre_call = lib.libfibre_call
 libfibre_call.argtypes = [c_void_p, POINTER(c_void_p), c_int, c_void_p, c_size_t, c_void_p, c_size_t, POINTER(c_void_p), POINTER(c_void_p), OnCallCompletedSignature, c_void_p]
 libfibre_call.restype = c_int
 
+try:
+    libfibre_start_batch = lib.libfibre_start_batch
+    libfibre_start_batch.argtypes = [POINTER(LibFibreBatchItem), c_size_t, OnBatchCompletedSignature, c_void_p]
+    libfibre_start_batch.restype = c_int
+except AttributeError:
+    libfibre_start_batch = None # libfibre older than 0.1.5
+
 libfibre_start_tx = lib.libfibre_start_tx
 libfibre_start_tx.argtypes = [c_void_p, c_char_p, c_size_t, OnTxCompletedSignature, c_void_p]
 libfibre_start_tx.restype = None
@@ -267,15 +286,23 @@ codecs = {
     'object_ref': ObjectPtrCodec()
 }
 
+def get_codec(codec_name):
+    # Array codecs such as "float[15]" are used for chunks of buffers
+    match = re.match(r'^(\w+)\[(\d+)\]$', codec_name)
+    if match and isinstance(codecs.get(match.group(1), None), StructCodec):
+        elem_codec = codecs[match.group(1)]
+        return StructCodec("<" + match.group(2) + elem_codec._struct_format[1:], list)
+    if not codec_name in codecs:
+        raise Exception("unsupported codec {}".format(codec_name))
+    return codecs[codec_name]
+
 def decode_arg_list(arg_names, codec_names):
     for i in count(0):
         if arg_names[i] is None or codec_names[i] is None:
             break
         arg_name = arg_names[i].decode('utf-8')
         codec_name = codec_names[i].decode('utf-8')
-        if not codec_name in codecs:
-            raise Exception("unsupported codec {}".format(codec_name))
-        yield arg_name, codec_name, codecs[codec_name]
+        yield arg_name, codec_name, get_codec(codec_name)
 
 def insert_with_new_id(dictionary, val):
     key = next(x for x in count(1) if x not in set(dictionary.keys()))
@@ -644,6 +671,88 @@ class RemoteAttribute(object):
         else:
             raise Exception("this attribute cannot be written to")
 
+_read_only = object() # marks the properties that _access_properties() only reads
+
+async def _access_properties(props, values):
+    """
+    Reads the properties for which the value is _read_only and exchanges the
+    others with libfibre_start_batch() and returns the received values.
+    """
+    libfibre = props[0]._libfibre
+
+    if libfibre_start_batch is None:
+        # Older libfibre binaries: one call per property
+        results = []
+        for prop, value in zip(props, values):
+            results.append(await (prop.read() if value is _read_only else prop.exchange(value)))
+        return results
+
+    codecs = [type(prop).read._outputs[0][2] for prop in props]
+    tx_bufs = [None if value is _read_only else create_string_buffer(codec.serialize(libfibre, value), codec.get_length())
+               for codec, value in zip(codecs, values)]
+    rx_bufs = [create_string_buffer(codec.get_length()) for codec in codecs]
+
+    items = (LibFibreBatchItem * len(props))()
+    for i, prop in enumerate(props):
+        if not prop._obj_handle:
+            raise ObjectLostError()
+        items[i].prop = prop._obj_handle
+        if not tx_bufs[i] is None:
+            items[i].tx_buf = addressof(tx_bufs[i])
+            items[i].tx_len = len(tx_bufs[i])
+        items[i].rx_buf = addressof(rx_bufs[i])
+        items[i].rx_len = len(rx_bufs[i])
+
+    future = libfibre.loop.create_future()
+    batch_id = insert_with_new_id(libfibre._batches, future)
+    status = libfibre_start_batch(items, len(props), libfibre.c_on_batch_completed, batch_id)
+    if status == kFibreBusy:
+        status = await future
+    else:
+        libfibre._batches.pop(batch_id)
+
+    if status != kFibreOk:
+        raise _get_exception(status)
+
+    results = []
+    for i, codec in enumerate(codecs):
+        if items[i].rx_end != items[i].rx_buf + items[i].rx_len:
+            raise Exception("value of property {} missing in the response".format(i))
+        results.append(codec.deserialize(libfibre, rx_bufs[i].raw))
+    return results
+
+def read_properties(props):
+    """
+    Reads several properties of the same device with as few requests as
+    possible. The properties are the property objects, for instance
+    `odrv0.axis0._pos_estimate_property`.
+
+    Like RemoteFunction.__call__(), this returns an asyncio.Future when called
+    on the Fibre thread and otherwise blocks and returns the list of values.
+    """
+    props = list(props)
+    if len(props) == 0:
+        return []
+    if threading.current_thread() != libfibre_thread:
+        return run_coroutine_threadsafe(props[0]._libfibre.loop, lambda: read_properties(props))
+    return asyncio.ensure_future(_access_properties(props, [_read_only] * len(props)), loop=props[0]._libfibre.loop)
+
+def write_properties(props_and_values):
+    """
+    Writes several properties of the same device with as few requests as
+    possible. `props_and_values` is a list of (property object, value) tuples.
+
+    Returns the old values of the properties, in the same way as
+    read_properties() returns the values.
+    """
+    props = [prop for prop, _ in props_and_values]
+    values = [value for _, value in props_and_values]
+    if len(props) == 0:
+        return []
+    if threading.current_thread() != libfibre_thread:
+        return run_coroutine_threadsafe(props[0]._libfibre.loop, lambda: write_properties(props_and_values))
+    return asyncio.ensure_future(_access_properties(props, values), loop=props[0]._libfibre.loop)
+
 class EmptyInterface():
     def __str__(self):
         return "[lost object]"
@@ -755,6 +864,7 @@ class LibFibre():
         self.c_on_function_added = OnFunctionAddedSignature(self._on_function_added)
         self.c_on_function_removed = OnFunctionRemovedSignature(self._on_function_removed)
         self.c_on_call_completed = OnCallCompletedSignature(self._on_call_completed)
+        self.c_on_batch_completed = OnBatchCompletedSignature(self._on_batch_completed)
         
         self.timer_map = {}
         self.eventfd_map = {}
@@ -762,6 +872,7 @@ class LibFibre():
         self.discovery_processes = {} # key: ID, value: python dict
         self._objects = {} # key: libfibre handle, value: python class
         self._calls = {} # key: libfibre handle, value: Call object
+        self._batches = {} # key: batch ID, value: future
 
         event_loop = LibFibreEventLoop()
         event_loop.post = self.c_post
@@ -901,6 +1012,10 @@ class LibFibre():
 
         return kFibreBusy
 
+    def _on_batch_completed(self, ctx, status):
+        future = self._batches.pop(ctx)
+        future.set_result(status)
+
 class Discovery():
     """
     All public members of this class are thread-safe.
@@ -66,6 +66,7 @@ def launch_shell(args, logger):
         'dump_errors': dump_errors,
         'benchmark': benchmark,
         'oscilloscope_dump': oscilloscope_dump,
+        'read_flight_recorder': read_flight_recorder,
         'dump_interrupts': dump_interrupts,
         'dump_threads': dump_threads,
         'dump_dma': dump_dma,
@@ -126,10 +126,61 @@ def dump_errors(odrv, clear=False, printfunc = print):
     if clear:
         odrv.clear_errors()
 
-def oscilloscope_dump(odrv, num_vals, filename='oscilloscope.csv'):
+def read_buffer(buffer, length):
+    """
+    Reads the first `length` values of a buffer on the device (for instance
+    `odrv0.oscilloscope.samples`) and returns them as numpy array.
+    Every request returns a chunk of several values.
+    """
+    import numpy as np
+    vals = []
+    while len(vals) < length:
+        chunk = buffer.read(len(vals))
+        vals.extend(chunk[:length - len(vals)])
+    return np.array(vals)
+
+def read_oscilloscope(odrv):
+    """
+    Returns the last oscilloscope capture as numpy array of the shape
+    (num_channels, depth).
+    """
+    # The layout of the capture is fixed on arm(), so config.num_channels may
+    # not match it anymore.
+    num_channels = odrv.oscilloscope.num_channels
+    depth = odrv.oscilloscope.depth
+    return read_buffer(odrv.oscilloscope.samples, num_channels * depth).reshape((num_channels, depth))
+
+def read_cogging_map(axis):
+    """
+    Returns the anticogging map of the specified axis as numpy array.
+    """
+    return read_buffer(axis.controller.config.anticogging.cogging_map, 3600)
+
+def read_flight_recorder(axis):
+    """
+    Returns the signals that the flight recorder of the specified axis recorded
+    before it froze, as dict of numpy arrays (oldest sample first).
+    """
+    import numpy as np
+    channels = ['Id_setpoint', 'Iq_setpoint', 'Id_measured', 'Iq_measured',
+                'vbus_voltage', 'phase', 'vel_estimate', 'pos_setpoint']
+    depth = axis.flight_recorder.depth
+    n_samples = axis.flight_recorder.n_samples
+    samples = read_buffer(axis.flight_recorder.samples, len(channels) * depth).reshape((len(channels), depth))
+    result = {name: samples[i, :n_samples] for i, name in enumerate(channels)}
+    result['timestamp'] = read_buffer(axis.flight_recorder.timestamps, n_samples)
+    return result
+
+def oscilloscope_dump(odrv, num_vals=None, filename='oscilloscope.csv'):
+    """
+    Writes the last oscilloscope capture to a CSV file with one column per channel.
+    """
+    data = read_oscilloscope(odrv)
+    if not num_vals is None:
+        data = data[:, :num_vals]
     with open(filename, 'w') as f:
-        for x in range(num_vals):
-            f.write(str(odrv.oscilloscope.get_val(x)))
+        for x in range(data.shape[1]):
+            f.write(','.join(str(val) for val in data[:, x]))
             f.write('\n')
 
 data_rate = 200
@@ -316,13 +367,13 @@ def print_drv_regs(name, motor):
     print("Control Reg 2: " + str(ctrl_reg_2) + " (" + format(ctrl_reg_2, '#09b') + ")")
 
 def show_oscilloscope(odrv):
-    size = 18000
-    values = []
-    for i in range(size):
-        values.append(odrv.oscilloscope.get_val(i))
+    data = read_oscilloscope(odrv)
 
     import matplotlib.pyplot as plt
-    plt.plot(values)
+    for ch in range(data.shape[0]):
+        plt.plot(data[ch], label='channel {}'.format(ch))
+    plt.axvline(odrv.oscilloscope.trigger_index, color='gray', linestyle='--')
+    plt.legend()
     plt.show()
 
 def rate_test(device):
@@ -588,7 +639,14 @@ def dump_dma(odrv):
                      ("(" + ch_name + ")").ljust(30),
                      "*" if (status & 0x80000000) else " "))
 
-def dump_timing(odrv, n_samples=100, path='/tmp/timings.png'):
+def get_histogram_bucket_starts():
+    """
+    Returns the smallest length (in clocks) of each bucket of a task timer
+    histogram. See LatencyHistogram in the firmware.
+    """
+    return [(4 + (i & 3)) << (i >> 2) for i in range(64)]
+
+def dump_timing(odrv, n_samples=100, path='/tmp/timings.png', histogram_path='/tmp/timing_histograms.png'):
     import matplotlib.pyplot as plt
     import re
     import numpy as np
@@ -604,6 +662,12 @@ def dump_timing(odrv, n_samples=100, path='/tmp/timings.png'):
                 if not attr.startswith('_'):
                     timings.append((k + '.' + attr, getattr(getattr(odrv, k).task_times, attr), [], [])) # (name, obj, start_times, lengths)
 
+    # The histograms record every run of the tasks while the samples are taken.
+    # Enabling a histogram clears it.
+    for name, obj, start_times, lengths in timings:
+        obj.histogram_enabled = False
+        obj.histogram_enabled = True
+
     # Take a couple of samples
     print("sampling...")
     for i in range(n_samples):
@@ -631,3 +695,28 @@ def dump_timing(odrv, n_samples=100, path='/tmp/timings.png'):
         tick_label = [name for name, obj, start_times, lengths in timings], # labels
     )
     plt.savefig(path, bbox_inches='tight')
+
+    # The control loop runs at 8kHz on a 168MHz clock
+    budget = 168000000 / 8000
+    print("{:40} {:>8} {:>8} {:>8} {:>8}".format("clocks", "p50", "p99", "p99.9", "max"))
+    histograms = []
+    for name, obj, start_times, lengths in timings:
+        obj.histogram_enabled = False
+        histograms.append(read_buffer(obj.histogram, 64))
+        percentiles = [obj.p50, obj.p99, obj.p999]
+        print("{:40} {:>8} {:>8} {:>8} {:>8}  ({:.1f}% of the loop period at p99.9)".format(
+            name, *percentiles, obj.max_length, 100 * percentiles[2] / budget))
+
+    if histogram_path:
+        bucket_starts = get_histogram_bucket_starts()
+        plt.figure()
+        plt.grid(True)
+        for (name, obj, start_times, lengths), histogram in zip(timings, histograms):
+            if np.sum(histogram):
+                plt.step(bucket_starts, histogram / np.sum(histogram), where='post', label=name)
+        plt.axvline(budget, color='gray', linestyle='--')
+        plt.xscale('log')
+        plt.xlabel('length [clocks]')
+        plt.ylabel('fraction of samples')
+        plt.legend()
+        plt.savefig(histogram_path, bbox_inches='tight')